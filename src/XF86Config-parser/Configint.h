@@ -75,6 +75,23 @@ typedef struct
 }
 LexRec, *LexPtr;
 
+/*
+ * The scanner state, and the scanner globals shared with the section
+ * parsers, are per thread, so that several threads may each parse a
+ * config file at the same time.
+ */
+
+#if defined(__GNUC__) || defined(__SUNPRO_C) || defined(__clang__)
+#define XCONFIG_THREAD_LOCAL __thread
+#else
+#define XCONFIG_THREAD_LOCAL
+#endif
+
+extern XCONFIG_THREAD_LOCAL LexRec val;
+extern XCONFIG_THREAD_LOCAL int configLineNo;
+extern XCONFIG_THREAD_LOCAL char *configSection;
+extern XCONFIG_THREAD_LOCAL char *configPath;
+
 
 #include "configProcs.h"
 #include <stdlib.h>
@@ -107,6 +124,18 @@ LexRec, *LexPtr;
 }
 
 
+#define HANDLE_LIST_BUILDER(builder,func,type)                          \
+{                                                                       \
+    type p = func();                                                    \
+    if (p == NULL) {                                                    \
+        CLEANUP (&ptr);                                                 \
+        return (NULL);                                                  \
+    } else {                                                            \
+        xconfigListBuilderAppend(&(builder), (GenericListPtr) p);       \
+    }                                                                   \
+}
+
+
 #define Error(a,b)                            \
     do {                                      \
         xconfigErrorMsg(ParseErrorMsg, a, b); \
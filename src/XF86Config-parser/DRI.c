@@ -30,8 +30,6 @@
 #include "xf86tokens.h"
 #include "Configint.h"
 
-extern LexRec val;
-
 static XConfigSymTabRec DRITab[] =
 {
     {ENDSECTION, "endsection"},
@@ -61,8 +61,6 @@
 
 #include <ctype.h>
 
-extern LexRec val;
-
 static
 XConfigSymTabRec DeviceTab[] =
 {
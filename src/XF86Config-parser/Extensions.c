@@ -35,8 +35,6 @@
 #include "xf86tokens.h"
 #include "Configint.h"
 
-extern LexRec val;
-
 static XConfigSymTabRec ExtensionsTab[] =
 {
     {ENDSECTION, "endsection"},
@@ -61,8 +61,6 @@
 #include "xf86tokens.h"
 #include "Configint.h"
 
-extern LexRec val;
-
 static XConfigSymTabRec FilesTab[] =
 {
     {ENDSECTION, "endsection"},
@@ -60,8 +60,6 @@
 #include "Configint.h"
 #include "ctype.h"
 
-extern LexRec val;
-
 static XConfigSymTabRec KeyboardTab[] =
 {
     {ENDSECTION, "endsection"},
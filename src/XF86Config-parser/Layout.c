@@ -60,8 +60,6 @@
 #include "Configint.h"
 #include <string.h>
 
-extern LexRec val;
-
 static XConfigSymTabRec LayoutTab[] =
 {
     {ENDSECTION, "endsection"},
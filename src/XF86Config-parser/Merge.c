@@ -32,6 +32,138 @@
 
 
 
+/*
+ * XConfigNameIndexRec - an open-addressed hash table mapping names (as
+ * compared by xconfigNameCompare()) to the list items that carry them,
+ * so that merging is linear in the size of the configs, rather than
+ * searching the destination lists for every source item.  As with the
+ * xconfigFind*() functions, the first item with a given name wins.
+ */
+
+typedef struct {
+    unsigned int hash;
+    char * const *name; /* the item's name field, which may be replaced
+                         * by an equal name while indexed */
+    void *item;         /* NULL if the entry is unused */
+} XConfigNameIndexEntry;
+
+typedef struct {
+    XConfigNameIndexEntry *entries;
+    unsigned int mask;
+    unsigned int count;
+} XConfigNameIndexRec, *XConfigNameIndexPtr;
+
+#define NAME_INDEX_MIN_SIZE 16
+
+static int xconfigNameIndexEqual(const char *name0, const char *name1)
+{
+    return xconfigNameCompare(name0 ? name0 : "", name1 ? name1 : "") == 0;
+}
+
+static void *xconfigNameIndexFind(XConfigNameIndexPtr index, const char *name)
+{
+    unsigned int hash = xconfigNameHash(name);
+    unsigned int i;
+
+    if (!index->entries) {
+        return NULL;
+    }
+
+    for (i = hash & index->mask;
+         index->entries[i].item;
+         i = (i + 1) & index->mask) {
+        if (index->entries[i].hash == hash &&
+            xconfigNameIndexEqual(*index->entries[i].name, name)) {
+            return index->entries[i].item;
+        }
+    }
+
+    return NULL;
+}
+
+static void xconfigNameIndexInsert(XConfigNameIndexPtr index,
+                                   unsigned int hash, char * const *name,
+                                   void *item)
+{
+    unsigned int i;
+
+    for (i = hash & index->mask;
+         index->entries[i].item;
+         i = (i + 1) & index->mask);
+
+    index->entries[i].hash = hash;
+    index->entries[i].name = name;
+    index->entries[i].item = item;
+    index->count++;
+}
+
+/*
+ * xconfigNameIndexAdd() - Adds item under the name in its name field
+ * "pName", unless an item with that name is already in the index.  The
+ * name may later be replaced with one that compares equal.  Returns 0 if
+ * memory could not be allocated.
+ */
+static int xconfigNameIndexAdd(XConfigNameIndexPtr index, char * const *pName,
+                               void *item)
+{
+    if (xconfigNameIndexFind(index, *pName)) {
+        return 1;
+    }
+
+    /* Keep the load factor at or below 1/2 */
+
+    if (!index->entries || (index->count + 1) * 2 > index->mask + 1) {
+        XConfigNameIndexEntry *old = index->entries;
+        unsigned int oldSize = old ? index->mask + 1 : 0;
+        unsigned int size = old ? oldSize * 2 : NAME_INDEX_MIN_SIZE;
+        unsigned int i;
+
+        index->entries = calloc(size, sizeof(XConfigNameIndexEntry));
+        if (!index->entries) {
+            index->entries = old;
+            return 0;
+        }
+        index->mask = size - 1;
+        index->count = 0;
+
+        for (i = 0; i < oldSize; i++) {
+            if (old[i].item) {
+                xconfigNameIndexInsert(index, old[i].hash, old[i].name,
+                                       old[i].item);
+            }
+        }
+        free(old);
+    }
+
+    xconfigNameIndexInsert(index, xconfigNameHash(*pName), pName, item);
+
+    return 1;
+}
+
+static void xconfigNameIndexFree(XConfigNameIndexPtr index)
+{
+    free(index->entries);
+    index->entries = NULL;
+    index->mask = 0;
+    index->count = 0;
+}
+
+
+
+/*
+ * XConfigMergeIndicesRec - Indices of the destination config's sections,
+ * built once at the start of the merge and kept up to date as sections
+ * are added.
+ */
+
+typedef struct {
+    XConfigNameIndexRec monitors;
+    XConfigNameIndexRec devices;
+    XConfigNameIndexRec screens;
+} XConfigMergeIndicesRec, *XConfigMergeIndicesPtr;
+
+
+
 /*
  * xconfigAddRemovedOptionComment() - Makes a note in the comment
  * string "existing_comments" that a particular option has been
@@ -124,56 +256,87 @@ static int xconfigOptionValuesDiffer(XConfigOptionPtr option0,
 
 
 /*
- * xconfigMergeOption() - Merge option "name" from option source
- * list "srcHead" to option destination list "dstHead".
+ * xconfigMergeOptionList() - Merge the options of source option list
+ * "srcList" into option destination list "dstHead".
  *
  * Merging here means:
  *
- * If the option is not in the source config, do nothing to the
- * destination.  Otherwise, either add or update the option in
- * the dest.  If the option is modified, and a comment is given,
- * then the old option will be commented out instead of being
- * simply removed/replaced.
+ * Options that are not in the source list are left alone in the
+ * destination.  Otherwise, either add or update the option in the
+ * dest.  If the option is modified, and a comment is given, then the
+ * old option will be commented out instead of being simply
+ * removed/replaced.
+ *
+ * Returns 1 if the merge was successful and 0 if not.
  */
-static void xconfigMergeOption(XConfigOptionPtr *dstHead,
-                               XConfigOptionPtr *srcHead,
-                               const char *name, char **comments)
+static int xconfigMergeOptionList(XConfigOptionPtr *dstHead,
+                                  XConfigOptionPtr srcList, char **comments)
 {
-    XConfigOptionPtr srcOption = xconfigFindOption(*srcHead, name);
-    XConfigOptionPtr dstOption = xconfigFindOption(*dstHead, name);
+    XConfigNameIndexRec srcIndex = { 0 }, dstIndex = { 0 };
+    GenericListBuilderRec dstList;
+    XConfigOptionPtr option, srcOption, dstOption;
+    char *name;
+    int ret = 0;
+
+    for (option = srcList; option; option = option->next) {
+        if (!xconfigNameIndexAdd(&srcIndex, &option->name, option)) {
+            goto done;
+        }
+    }
+    for (option = *dstHead; option; option = option->next) {
+        if (!xconfigNameIndexAdd(&dstIndex, &option->name, option)) {
+            goto done;
+        }
+    }
 
-    char *srcValue = NULL;
+    xconfigListBuilderInit(&dstList, (GenericListPtr *)dstHead);
 
-    if (!srcOption) {
-        /* Option does not exist in src, do nothing to dst. */
-        return;
-    }
+    for (option = srcList; option; option = option->next) {
 
-    srcValue = xconfigOptionValue(srcOption);
+        name = xconfigOptionName(option);
 
-    if (srcOption && !dstOption) {
+        /* Duplicate names in the source all take the first's value */
+        srcOption = xconfigNameIndexFind(&srcIndex, name);
+        dstOption = xconfigNameIndexFind(&dstIndex, name);
 
-        /* option exists in src but not in dst: add to dst */
-        xconfigAddNewOption(dstHead, name, srcValue);
+        if (!dstOption) {
 
-    } else if (srcOption && dstOption) {
+            /* option exists in src but not in dst: add to dst */
 
-        /*
-         * option exists in src and in dst; if the option values are
-         * different, replace the dst's option value with src's option
-         * value; note that xconfigAddNewOption() will remove the old
-         * option first, if necessary
-         */
+            dstOption = xconfigNewOption(name, xconfigOptionValue(srcOption));
+            if (!dstOption ||
+                !xconfigNameIndexAdd(&dstIndex, &dstOption->name, dstOption)) {
+                xconfigFreeOptionList(&dstOption);
+                goto done;
+            }
+            xconfigListBuilderAppend(&dstList, (GenericListPtr)dstOption);
+
+        } else if (xconfigOptionValuesDiffer(srcOption, dstOption)) {
+
+            /*
+             * option exists in src and in dst, with different values:
+             * replace the dst's option value with src's option value,
+             * leaving the option in place
+             */
 
-        if (xconfigOptionValuesDiffer(srcOption, dstOption)) {
             if (comments) {
                 xconfigAddRemovedOptionComment(comments, dstOption);
             }
-            xconfigAddNewOption(dstHead, name, srcValue);
+            free(dstOption->name);
+            free(dstOption->val);
+            dstOption->name = xconfigStrdup(name);
+            dstOption->val = xconfigStrdup(xconfigOptionValue(srcOption));
         }
     }
 
-} /* xconfigMergeOption() */
+    ret = 1;
+
+ done:
+    xconfigNameIndexFree(&srcIndex);
+    xconfigNameIndexFree(&dstIndex);
+    return ret;
+
+} /* xconfigMergeOptionList() */
 
 
 
@@ -190,7 +353,6 @@ static void xconfigMergeOption(XConfigOptionPtr *dstHead,
 static int xconfigMergeFlags(XConfigPtr dstConfig, XConfigPtr srcConfig)
 {
     if (srcConfig->flags) {
-        XConfigOptionPtr option;
         
         /* Flag section was not found, create a new one */
         if (!dstConfig->flags) {
@@ -199,13 +361,10 @@ static int xconfigMergeFlags(XConfigPtr dstConfig, XConfigPtr srcConfig)
             if (!dstConfig->flags) return 0;
         }
         
-        option = srcConfig->flags->options;
-        while (option) {
-            xconfigMergeOption(&(dstConfig->flags->options),
-                               &(srcConfig->flags->options),
-                               xconfigOptionName(option),
-                               &(dstConfig->flags->comment));
-            option = option->next;
+        if (!xconfigMergeOptionList(&(dstConfig->flags->options),
+                                    srcConfig->flags->options,
+                                    &(dstConfig->flags->comment))) {
+            return 0;
         }
     }
     
@@ -267,20 +426,25 @@ static void xconfigMergeMonitors(XConfigMonitorPtr dstMonitor,
  * updating the "appropriate" destination monitor sections.
  *
  */
-static int xconfigMergeAllMonitors(XConfigPtr dstConfig, XConfigPtr srcConfig)
+static int xconfigMergeAllMonitors(XConfigPtr dstConfig, XConfigPtr srcConfig,
+                                   XConfigMergeIndicesPtr indices)
 {
     XConfigMonitorPtr dstMonitor;
     XConfigMonitorPtr srcMonitor;
+    GenericListBuilderRec dstMonitors;
 
 
     /* Make sure all monitors in the src config are also in the dst config */
 
+    xconfigListBuilderInit(&dstMonitors,
+                           (GenericListPtr *)(&dstConfig->monitors));
+
     for (srcMonitor = srcConfig->monitors;
          srcMonitor;
          srcMonitor = srcMonitor->next) {
 
-        dstMonitor =
-            xconfigFindMonitor(srcMonitor->identifier, dstConfig->monitors);
+        dstMonitor = xconfigNameIndexFind(&indices->monitors,
+                                          srcMonitor->identifier);
 
         /* Monitor section was not found, create a new one and add it */
         if (!dstMonitor) {
@@ -290,8 +454,12 @@ static int xconfigMergeAllMonitors(XConfigPtr dstConfig, XConfigPtr srcConfig)
 
             dstMonitor->identifier = xconfigStrdup(srcMonitor->identifier);
 
-            xconfigAddListItem((GenericListPtr *)(&dstConfig->monitors),
-                               (GenericListPtr)dstMonitor);
+            xconfigListBuilderAppend(&dstMonitors, (GenericListPtr)dstMonitor);
+
+            if (!xconfigNameIndexAdd(&indices->monitors,
+                                     &dstMonitor->identifier, dstMonitor)) {
+                return 0;
+            }
         }
 
         /* Do the merge */
@@ -357,20 +525,25 @@ static void xconfigMergeDevices(XConfigDevicePtr dstDevice,
  * updating the "appropriate" destination device sections.
  *
  */
-static int xconfigMergeAllDevices(XConfigPtr dstConfig, XConfigPtr srcConfig)
+static int xconfigMergeAllDevices(XConfigPtr dstConfig, XConfigPtr srcConfig,
+                                  XConfigMergeIndicesPtr indices)
 {
     XConfigDevicePtr dstDevice;
     XConfigDevicePtr srcDevice;
+    GenericListBuilderRec dstDevices;
 
 
     /* Make sure all monitors in the src config are also in the dst config */
 
+    xconfigListBuilderInit(&dstDevices,
+                           (GenericListPtr *)(&dstConfig->devices));
+
     for (srcDevice = srcConfig->devices;
          srcDevice;
          srcDevice = srcDevice->next) {
 
-        dstDevice =
-            xconfigFindDevice(srcDevice->identifier, dstConfig->devices);
+        dstDevice = xconfigNameIndexFind(&indices->devices,
+                                         srcDevice->identifier);
         
         /* Device section was not found, create a new one and add it */
         if (!dstDevice) {
@@ -380,8 +553,12 @@ static int xconfigMergeAllDevices(XConfigPtr dstConfig, XConfigPtr srcConfig)
 
             dstDevice->identifier = xconfigStrdup(srcDevice->identifier);
 
-            xconfigAddListItem((GenericListPtr *)(&dstConfig->devices),
-                               (GenericListPtr)dstDevice);
+            xconfigListBuilderAppend(&dstDevices, (GenericListPtr)dstDevice);
+
+            if (!xconfigNameIndexAdd(&indices->devices,
+                                     &dstDevice->identifier, dstDevice)) {
+                return 0;
+            }
         }
 
         /* Do the merge */
@@ -467,11 +644,15 @@ static int xconfigMergeDisplays(XConfigScreenPtr dstScreen,
     XConfigDisplayPtr dstDisplay;
     XConfigDisplayPtr srcDisplay;
     XConfigModePtr srcMode, dstMode, lastDstMode;
+    GenericListBuilderRec dstDisplays;
 
     /* Free all the displays in the destination screen */
 
     xconfigFreeDisplayList(&dstScreen->displays);
 
+    xconfigListBuilderInit(&dstDisplays,
+                           (GenericListPtr *)(&dstScreen->displays));
+
     /* Copy all te displays */
     
     for (srcDisplay = srcScreen->displays;
@@ -505,11 +686,14 @@ static int xconfigMergeDisplays(XConfigScreenPtr dstScreen,
 
         lastDstMode = NULL;
         srcMode = srcDisplay->modes;
-        dstMode = NULL;
         while (srcMode) {
 
-            /* Copy the mode */
+            /*
+             * Copy the mode; xconfigAddMode() prepends, so start from an
+             * empty list to get just the new mode
+             */
             
+            dstMode = NULL;
             xconfigAddMode(&dstMode, srcMode->mode_name);
 
             /* Add mode at the end of the list */
@@ -524,8 +708,7 @@ static int xconfigMergeDisplays(XConfigScreenPtr dstScreen,
             srcMode = srcMode->next;
         }
 
-        xconfigAddListItem((GenericListPtr *)(&dstScreen->displays),
-                           (GenericListPtr)dstDisplay);
+        xconfigListBuilderAppend(&dstDisplays, (GenericListPtr)dstDisplay);
     }
 
     return 1;
@@ -543,16 +726,15 @@ static int xconfigMergeDisplays(XConfigScreenPtr dstScreen,
  *
  */
 static void xconfigMergeScreens(XConfigScreenPtr dstScreen,
-                                XConfigPtr dstConfig,
-                                XConfigScreenPtr srcScreen,
-                                XConfigPtr srcConfig)
+                                XConfigMergeIndicesPtr indices,
+                                XConfigScreenPtr srcScreen)
 {
     /* Use the right device */
     
     free(dstScreen->device_name);
     dstScreen->device_name = xconfigStrdup(srcScreen->device_name);
     dstScreen->device =
-        xconfigFindDevice(dstScreen->device_name, dstConfig->devices);
+        xconfigNameIndexFind(&indices->devices, dstScreen->device_name);
     
 
     /* Use the right monitor */
@@ -560,7 +742,7 @@ static void xconfigMergeScreens(XConfigScreenPtr dstScreen,
     free(dstScreen->monitor_name);
     dstScreen->monitor_name = xconfigStrdup(srcScreen->monitor_name);
     dstScreen->monitor =
-        xconfigFindMonitor(dstScreen->monitor_name, dstConfig->monitors);
+        xconfigNameIndexFind(&indices->monitors, dstScreen->monitor_name);
     
 
     /* Update the right default depth */
@@ -587,20 +769,25 @@ static void xconfigMergeScreens(XConfigScreenPtr dstScreen,
  * updating the "appropriate" destination screen sections.
  *
  */
-static int xconfigMergeAllScreens(XConfigPtr dstConfig, XConfigPtr srcConfig)
+static int xconfigMergeAllScreens(XConfigPtr dstConfig, XConfigPtr srcConfig,
+                                  XConfigMergeIndicesPtr indices)
 {
     XConfigScreenPtr srcScreen;
     XConfigScreenPtr dstScreen;
+    GenericListBuilderRec dstScreens;
 
 
     /* Make sure all src screens are in the dst config */
 
+    xconfigListBuilderInit(&dstScreens,
+                           (GenericListPtr *)(&dstConfig->screens));
+
     for (srcScreen = srcConfig->screens;
          srcScreen;
          srcScreen = srcScreen->next) {
 
-        dstScreen =
-            xconfigFindScreen(srcScreen->identifier, dstConfig->screens);
+        dstScreen = xconfigNameIndexFind(&indices->screens,
+                                         srcScreen->identifier);
 
         /* Screen section was not found, create a new one and add it */
         if (!dstScreen) {
@@ -610,12 +797,16 @@ static int xconfigMergeAllScreens(XConfigPtr dstConfig, XConfigPtr srcConfig)
 
             dstScreen->identifier = xconfigStrdup(srcScreen->identifier);
 
-            xconfigAddListItem((GenericListPtr *)(&dstConfig->screens),
-                               (GenericListPtr)dstScreen);
+            xconfigListBuilderAppend(&dstScreens, (GenericListPtr)dstScreen);
+
+            if (!xconfigNameIndexAdd(&indices->screens,
+                                     &dstScreen->identifier, dstScreen)) {
+                return 0;
+            }
         }
 
         /* Do the merge */
-        xconfigMergeScreens(dstScreen, dstConfig, srcScreen, srcConfig);
+        xconfigMergeScreens(dstScreen, indices, srcScreen);
     }
 
     return 1;
@@ -629,7 +820,8 @@ static int xconfigMergeAllScreens(XConfigPtr dstConfig, XConfigPtr srcConfig)
  * layout with that of the source's first layout.
  *
  */
-static int xconfigMergeLayout(XConfigPtr dstConfig, XConfigPtr srcConfig)
+static int xconfigMergeLayout(XConfigPtr dstConfig, XConfigPtr srcConfig,
+                              XConfigMergeIndicesPtr indices)
 {
     XConfigLayoutPtr srcLayout = srcConfig->layouts;
     XConfigLayoutPtr dstLayout = dstConfig->layouts;
@@ -669,15 +861,15 @@ static int xconfigMergeLayout(XConfigPtr dstConfig, XConfigPtr srcConfig)
         dstAdj->refscreen = xconfigStrdup(srcAdj->refscreen);
 
         dstAdj->screen =
-            xconfigFindScreen(dstAdj->screen_name, dstConfig->screens);
+            xconfigNameIndexFind(&indices->screens, dstAdj->screen_name);
         dstAdj->top =
-            xconfigFindScreen(dstAdj->top_name, dstConfig->screens);
+            xconfigNameIndexFind(&indices->screens, dstAdj->top_name);
         dstAdj->bottom =
-            xconfigFindScreen(dstAdj->bottom_name, dstConfig->screens);
+            xconfigNameIndexFind(&indices->screens, dstAdj->bottom_name);
         dstAdj->left =
-            xconfigFindScreen(dstAdj->left_name, dstConfig->screens);
+            xconfigNameIndexFind(&indices->screens, dstAdj->left_name);
         dstAdj->right =
-            xconfigFindScreen(dstAdj->right_name, dstConfig->screens);
+            xconfigNameIndexFind(&indices->screens, dstAdj->right_name);
 
         /* Add adjacency at the end of the list */
         
@@ -694,15 +886,10 @@ static int xconfigMergeLayout(XConfigPtr dstConfig, XConfigPtr srcConfig)
     /* Merge the options */
     
     if (srcLayout->options) {
-        XConfigOptionPtr srcOption;
-
-        srcOption = srcLayout->options;
-        while (srcOption) {
-            xconfigMergeOption(&(dstLayout->options),
-                               &(srcLayout->options),
-                               xconfigOptionName(srcOption),
-                               &(dstLayout->comment));
-            srcOption = srcOption->next;
+        if (!xconfigMergeOptionList(&(dstLayout->options),
+                                    srcLayout->options,
+                                    &(dstLayout->comment))) {
+            return 0;
         }
     }
 
@@ -721,7 +908,6 @@ static int xconfigMergeLayout(XConfigPtr dstConfig, XConfigPtr srcConfig)
 static int  xconfigMergeExtensions(XConfigPtr dstConfig, XConfigPtr srcConfig)
 {
    if (srcConfig->extensions) {
-        XConfigOptionPtr option;
 
         /* Extension section was not found, create a new one */
         if (!dstConfig->extensions) {
@@ -730,13 +916,10 @@ static int  xconfigMergeExtensions(XConfigPtr dstConfig, XConfigPtr srcConfig)
             if (!dstConfig->extensions) return 0;
         }
 
-        option = srcConfig->extensions->options;
-        while (option) {
-            xconfigMergeOption(&(dstConfig->extensions->options),
-                               &(srcConfig->extensions->options),
-                               xconfigOptionName(option),
-                               &(dstConfig->extensions->comment));
-            option = option->next;
+        if (!xconfigMergeOptionList(&(dstConfig->extensions->options),
+                                    srcConfig->extensions->options,
+                                    &(dstConfig->extensions->comment))) {
+            return 0;
         }
     }
 
@@ -744,6 +927,46 @@ static int  xconfigMergeExtensions(XConfigPtr dstConfig, XConfigPtr srcConfig)
 
 } /* xconfigMergeExtensions() */
 
+/*
+ * xconfigMergeBuildIndices() - Indexes the monitor, device and screen
+ * sections of "config" by identifier.
+ *
+ * Returns 1 if successful and 0 if not.
+ */
+static int xconfigMergeBuildIndices(XConfigPtr config,
+                                    XConfigMergeIndicesPtr indices)
+{
+    XConfigMonitorPtr monitor;
+    XConfigDevicePtr device;
+    XConfigScreenPtr screen;
+
+    for (monitor = config->monitors; monitor; monitor = monitor->next) {
+        if (!xconfigNameIndexAdd(&indices->monitors, &monitor->identifier,
+                                 monitor)) {
+            return 0;
+        }
+    }
+
+    for (device = config->devices; device; device = device->next) {
+        if (!xconfigNameIndexAdd(&indices->devices, &device->identifier,
+                                 device)) {
+            return 0;
+        }
+    }
+
+    for (screen = config->screens; screen; screen = screen->next) {
+        if (!xconfigNameIndexAdd(&indices->screens, &screen->identifier,
+                                 screen)) {
+            return 0;
+        }
+    }
+
+    return 1;
+
+} /* xconfigMergeBuildIndices() */
+
+
+
 /*
  * xconfigMergeConfigs() - Merges the source X configuration with the
  * destination X configuration.
@@ -757,51 +980,69 @@ static int  xconfigMergeExtensions(XConfigPtr dstConfig, XConfigPtr srcConfig)
  */
 int xconfigMergeConfigs(XConfigPtr dstConfig, XConfigPtr srcConfig)
 {
+    XConfigMergeIndicesRec indices;
+    int ret = 0;
+
     /* Make sure the X config is valid */
     // make_xconfig_usable(dstConfig);
 
 
+    /* Index the destination's sections by identifier */
+
+    memset(&indices, 0, sizeof(indices));
+
+    if (!xconfigMergeBuildIndices(dstConfig, &indices)) {
+        goto done;
+    }
+
+
     /* Merge the server flag (Xinerama) section */
 
     if (!xconfigMergeFlags(dstConfig, srcConfig)) {
-        return 0;
+        goto done;
     }
 
 
     /* Merge the monitor sections */
 
-    if (!xconfigMergeAllMonitors(dstConfig, srcConfig)) {
-        return 0;
+    if (!xconfigMergeAllMonitors(dstConfig, srcConfig, &indices)) {
+        goto done;
     }
 
 
     /* Merge the device sections */
 
-    if (!xconfigMergeAllDevices(dstConfig, srcConfig)) {
-        return 0;
+    if (!xconfigMergeAllDevices(dstConfig, srcConfig, &indices)) {
+        goto done;
     }
 
 
     /* Merge the screen sections */
 
-    if (!xconfigMergeAllScreens(dstConfig, srcConfig)) {
-        return 0;
+    if (!xconfigMergeAllScreens(dstConfig, srcConfig, &indices)) {
+        goto done;
     }
 
 
     /* Merge the first layout */
     
-    if (!xconfigMergeLayout(dstConfig, srcConfig)) {
-        return 0;
+    if (!xconfigMergeLayout(dstConfig, srcConfig, &indices)) {
+        goto done;
     }
 
     /* Merge the extensions */
     
     if (!xconfigMergeExtensions(dstConfig, srcConfig)) {
-        return 0;
+        goto done;
     }
 
+    ret = 1;
 
-    return 1;
+ done:
+    xconfigNameIndexFree(&indices.monitors);
+    xconfigNameIndexFree(&indices.devices);
+    xconfigNameIndexFree(&indices.screens);
+
+    return ret;
 
 } /* xconfigMergeConfigs() */
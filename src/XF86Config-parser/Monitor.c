@@ -59,8 +59,6 @@
 #include "xf86tokens.h"
 #include "Configint.h"
 
-extern LexRec val;
-
 static XConfigSymTabRec MonitorTab[] =
 {
     {ENDSECTION, "endsection"},
@@ -401,8 +399,11 @@ xconfigParseMonitorSection (void)
 {
     int has_ident = FALSE;
     int token;
+    GenericListBuilderRec modelines;
     PARSE_PROLOGUE (XConfigMonitorPtr, XConfigMonitorRec)
 
+    xconfigListBuilderInit(&modelines, (GenericListPtr *)(&ptr->modelines));
+
         while ((token = xconfigGetToken (MonitorTab)) != ENDSECTION)
     {
         switch (token)
@@ -429,12 +430,12 @@ xconfigParseMonitorSection (void)
             ptr->modelname = val.str;
             break;
         case MODE:
-            HANDLE_LIST (modelines, xconfigParseVerboseMode,
-                         XConfigModeLinePtr);
+            HANDLE_LIST_BUILDER (modelines, xconfigParseVerboseMode,
+                                 XConfigModeLinePtr);
             break;
         case MODELINE:
-            HANDLE_LIST (modelines, xconfigParseModeLine,
-                         XConfigModeLinePtr);
+            HANDLE_LIST_BUILDER (modelines, xconfigParseModeLine,
+                                 XConfigModeLinePtr);
             break;
         case DISPLAYSIZE:
             if (xconfigGetSubToken (&(ptr->comment)) != NUMBER)
@@ -590,8 +591,11 @@ xconfigParseModesSection (void)
 {
     int has_ident = FALSE;
     int token;
+    GenericListBuilderRec modelines;
     PARSE_PROLOGUE (XConfigModesPtr, XConfigModesRec)
 
+    xconfigListBuilderInit(&modelines, (GenericListPtr *)(&ptr->modelines));
+
     while ((token = xconfigGetToken (ModesTab)) != ENDSECTION)
     {
         switch (token)
@@ -608,12 +612,12 @@ xconfigParseModesSection (void)
             has_ident = TRUE;
             break;
         case MODE:
-            HANDLE_LIST (modelines, xconfigParseVerboseMode,
-                         XConfigModeLinePtr);
+            HANDLE_LIST_BUILDER (modelines, xconfigParseVerboseMode,
+                                 XConfigModeLinePtr);
             break;
         case MODELINE:
-            HANDLE_LIST (modelines, xconfigParseModeLine,
-                         XConfigModeLinePtr);
+            HANDLE_LIST_BUILDER (modelines, xconfigParseModeLine,
+                                 XConfigModeLinePtr);
             break;
         default:
             xconfigErrorMsg(ParseErrorMsg, INVALID_KEYWORD_MSG,
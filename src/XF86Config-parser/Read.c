@@ -57,8 +57,6 @@
 #include "xf86tokens.h"
 #include "Configint.h"
 
-extern LexRec val;
-
 static XConfigSymTabRec TopLevelTab[] =
 {
     {SECTION, "section"},
@@ -81,11 +79,13 @@ static XConfigSymTabRec TopLevelTab[] =
         xconfigFreeConfig(&ptr);                                        \
         return XCONFIG_RETURN_PARSE_ERROR;                              \
     } else {                                                            \
-        xconfigAddListItem((GenericListPtr *)(&ptr->field),             \
-                           (GenericListPtr) p);                         \
+        xconfigListBuilderAppend(&lists.field, (GenericListPtr) p);     \
     }                                                                   \
 }
 
+#define READ_INIT_LIST(field)                                           \
+    xconfigListBuilderInit(&lists.field, (GenericListPtr *)(&ptr->field))
+
 #define READ_ERROR(a,b)                       \
     do {                                      \
         xconfigErrorMsg(ParseErrorMsg, a, b); \
@@ -104,10 +104,24 @@ XConfigError xconfigReadConfigFile(XConfigPtr *configPtr)
 {
     int token;
     XConfigPtr ptr = NULL;
+    struct {
+        GenericListBuilderRec inputs, videoadaptors, devices, monitors, modes,
+            screens, inputclasses, layouts, vendors;
+    } lists;
 
     *configPtr = NULL;
 
     ptr = xconfigAlloc(sizeof(XConfigRec));
+
+    READ_INIT_LIST(inputs);
+    READ_INIT_LIST(videoadaptors);
+    READ_INIT_LIST(devices);
+    READ_INIT_LIST(monitors);
+    READ_INIT_LIST(modes);
+    READ_INIT_LIST(screens);
+    READ_INIT_LIST(inputclasses);
+    READ_INIT_LIST(layouts);
+    READ_INIT_LIST(vendors);
     
     while ((token = xconfigGetToken(TopLevelTab)) != EOF_TOKEN) {
         
@@ -325,6 +339,50 @@ void xconfigAddListItem (GenericListPtr *pHead, GenericListPtr new)
 }
 
 
+/*
+ * initializes builder for appending items to the linked list at *pHead,
+ * which may already contain items; the list is walked once, here.
+ */
+void xconfigListBuilderInit (GenericListBuilderPtr builder,
+                             GenericListPtr *pHead)
+{
+    GenericListPtr p = *pHead;
+
+    builder->pHead = pHead;
+    builder->tail = NULL;
+
+    while (p) {
+        builder->tail = p;
+        p = p->next;
+    }
+}
+
+
+/*
+ * adds an item to the end of the linked list being built, in constant
+ * time (unless the item is itself the head of a list, which is walked to
+ * find the new end).
+ */
+void xconfigListBuilderAppend (GenericListBuilderPtr builder,
+                               GenericListPtr new)
+{
+    if (!new) {
+        return;
+    }
+
+    if (builder->tail) {
+        builder->tail->next = new;
+    } else {
+        *builder->pHead = new;
+    }
+
+    builder->tail = new;
+    while (builder->tail->next) {
+        builder->tail = builder->tail->next;
+    }
+}
+
+
 /*
  * removes an item from the linked list (but does not delete it). Any record
  * whose first field is a GenericListRec can be cast to this type and used
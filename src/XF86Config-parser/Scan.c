@@ -59,6 +59,11 @@
 #include <string.h>
 #include <unistd.h>
 #include <stdarg.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 
 #if !defined(X_NOT_POSIX)
 #if defined(_POSIX_SOURCE)
@@ -86,20 +91,54 @@
 
 #define CONFIG_BUF_LEN     1024
 
+/*
+ * files smaller than this are read rather than mmap(2)ed: mapping
+ * them saves little, and a mapped file that is truncated while it is
+ * being scanned raises SIGBUS, where reading it only gives a short
+ * read.  X config files are far smaller than this.
+ */
+#define CONFIG_MMAP_MIN_SIZE (1024 * 1024)
+
 static int StringToToken (char *, XConfigSymTabRec *);
 
-static FILE *configFile = NULL;
-static const char **builtinConfig = NULL;
-static int builtinIndex = 0;
-static int configPos = 0;            /* current readers position */
-static char *configBuf, *configRBuf; /* buffer for lines */
-static int pushToken = LOCK_TOKEN;
-static int eol_seen = 0;             /* private state to handle comments */
-LexRec val;
+/*
+ * XConfigScannerRec --
+ *
+ *  All state of the config file scanner.  The file contents are read
+ *  in one piece (or, for very large files, mmap(2)ed), and tokens are
+ *  scanned directly from the file data; the only copy made is of the
+ *  current token, into rbuf.
+ *
+ *  The scanner, like the other globals shared with the section
+ *  parsers, is thread-local, so that separate threads may parse
+ *  config files at the same time.
+ */
+
+typedef struct {
+    char *data;        /* contents of the config file */
+    size_t size;       /* size of data in bytes */
+    int mapped;        /* data is mmap(2)ed rather than malloc(3)ed */
+    int opened;        /* a config file is open */
+    size_t offset;     /* offset in data of the next unread line */
+    const char *line;  /* current line; points into data */
+    size_t lineLen;    /* length of the current line, including newline */
+    size_t pos;        /* current reader position within the line */
+    char *rbuf;        /* buffer for the current token */
+    size_t rbufLen;
+    int pushToken;
+    int eolSeen;       /* private state to handle comments */
+} XConfigScannerRec;
+
+static XCONFIG_THREAD_LOCAL XConfigScannerRec scanner = {
+    .pushToken = LOCK_TOKEN,
+};
 
-int configLineNo = 0;         /* linenumber */
-char *configSection = NULL;   /* name of current section being parsed */
-char *configPath;             /* path to config file */
+XCONFIG_THREAD_LOCAL LexRec val;
+
+XCONFIG_THREAD_LOCAL int configLineNo = 0;       /* linenumber */
+XCONFIG_THREAD_LOCAL char *configSection = NULL; /* name of current section
+                                                  * being parsed */
+XCONFIG_THREAD_LOCAL char *configPath;           /* path to config file */
 
 
 
@@ -177,151 +216,101 @@ static unsigned int xconfigStrToUL (char *str)
 }
 
 
+/*
+ * scannerChar --
+ *
+ *  return the character at position pos of the current line; reading
+ *  at or past the end of the line yields '\0', which xconfigGetToken()
+ *  treats as the request to advance to the next line.
+ */
+
+static char scannerChar(size_t pos)
+{
+    return (pos < scanner.lineLen) ? scanner.line[pos] : '\0';
+}
+
+#define CURRENT_CHAR()  scannerChar(scanner.pos)
+#define NEXT_CHAR()     scannerChar(scanner.pos++)
+
+
 /*
  * xconfigGetNextLine --
  *
- *  read from the configFile FILE stream until we encounter a new
- *  line; this is effectively just a big wrapper for fgets(3).
+ *  advance the scanner to the next line of the config file; returns
+ *  FALSE at the end of the file.
  *
- *  xconfigGetToken() assumes that we will read up to the next
- *  newline; we need to grow configBuf and configRBuf as needed to
- *  support that.
+ *  The line is not copied: scanner.line points into the file data.
+ *  xconfigGetToken() copies at most one line's worth of characters
+ *  into the token buffer, so grow that buffer to fit the line.
  */
 
-static char *xconfigGetNextLine(void)
+static int xconfigGetNextLine(void)
 {
-    static int configBufLen = CONFIG_BUF_LEN;
-    char *tmpConfigBuf, *tmpConfigRBuf;
-    int c, i, pos = 0, eolFound = 0;
-    char *ret = NULL;
-    
-    /*
-     * reallocate the string if it was grown last time (i.e., is no
-     * longer CONFIG_BUF_LEN); we malloc the new strings first, so
-     * that if either of the mallocs fail, we can fall back on the
-     * existing buffer allocations
-     */
-    
-    if (configBufLen != CONFIG_BUF_LEN) {
-                 
-        tmpConfigBuf = malloc(CONFIG_BUF_LEN);
-        tmpConfigRBuf = malloc(CONFIG_BUF_LEN);
-        
-        if (!tmpConfigBuf || !tmpConfigRBuf) {
-            
-            /*
-             * at least one of the mallocs failed; keep the old buffers
-             * and free any partial allocations
-             */
-            
-            free(tmpConfigBuf);
-            free(tmpConfigRBuf);
-            
+    const char *start, *eol;
+    size_t len;
+
+    if (scanner.offset >= scanner.size) {
+        return FALSE;
+    }
+
+    start = scanner.data + scanner.offset;
+    eol = memchr(start, '\n', scanner.size - scanner.offset);
+    len = eol ? (size_t) (eol - start) + 1 : scanner.size - scanner.offset;
+
+    if (len + 2 > scanner.rbufLen) {
+        size_t rbufLen = len + 2 + CONFIG_BUF_LEN;
+        char *tmp = realloc(scanner.rbuf, rbufLen);
+
+        if (tmp) {
+            scanner.rbuf = tmp;
+            scanner.rbufLen = rbufLen;
         } else {
-            
+
             /*
-             * malloc succeeded; free the old buffers and use the new
-             * buffers
+             * the reallocation failed; scan as much of the line as
+             * fits, and treat the remainder as the next line
              */
-            
-            configBufLen = CONFIG_BUF_LEN;
-            
-            free(configBuf);
-            free(configRBuf);
-            
-            configBuf = tmpConfigBuf;
-            configRBuf = tmpConfigRBuf;
+
+            len = scanner.rbufLen - 2;
         }
     }
 
-    /* read in another block of chars */
-    
-    do {
-        ret = fgets(configBuf + pos, configBufLen - pos - 1, configFile);
-        
-        if (!ret) break;
-        
-        /* search for EOL in the new block of chars */
-        
-        for (i = pos; i < (configBufLen - 1); i++) {
-            c = configBuf[i];
-            
-            if (c == '\0') break;
-            
-            if ((c == '\n') || (c == '\r')) {
-                eolFound = 1;
-                break;
-            }
-        }
-        
-        /*
-         * if we didn't find EOL, then grow the string and
-         * read in more
-         */
-        
-        if (!eolFound) {
-            
-            tmpConfigBuf = realloc(configBuf, configBufLen + CONFIG_BUF_LEN);
-            tmpConfigRBuf = realloc(configRBuf, configBufLen + CONFIG_BUF_LEN);
-            
-            if (!tmpConfigBuf || !tmpConfigRBuf) {
-                
-                /*
-                 * at least one of the reallocations failed; use the
-                 * new allocation that succeeded, but we have to
-                 * fallback to the previous configBufLen size and use
-                 * the string we have, even though we don't have an
-                 * EOL
-                 */
-                
-                if (tmpConfigBuf) configBuf = tmpConfigBuf;
-                if (tmpConfigRBuf) configRBuf = tmpConfigRBuf;
-                
-                break;
-                
-            } else {
-                
-                /* reallocation succeeded */
-
-                configBuf = tmpConfigBuf;
-                configRBuf = tmpConfigRBuf;
-                pos = i;
-                configBufLen += CONFIG_BUF_LEN;
-            }
-        }
-        
-    } while (!eolFound);
-    
-    return ret;
+    scanner.line = start;
+    scanner.lineLen = len;
+    scanner.offset += len;
+    scanner.pos = 0;
+
+    return TRUE;
 }
 
 
 
 /* 
  * xconfigGetToken --
- *      Read next Token from the config file. Handle the global variable
- *      pushToken.
+ *      Read next Token from the config file. Handle the pushed back
+ *      token, if any.
  */
 
 int xconfigGetToken (XConfigSymTabRec * tab)
 {
     int c, i;
+    char *rbuf;
 
     /* 
      * First check whether pushToken has a different value than LOCK_TOKEN.
-     * In this case rBuf[] contains a valid STRING/TOKEN/NUMBER. But in the
+     * In this case rbuf[] contains a valid STRING/TOKEN/NUMBER. But in the
      * oth * case the next token must be read from the input.
      */
-    if (pushToken == EOF_TOKEN)
+    if (scanner.pushToken == EOF_TOKEN)
         return (EOF_TOKEN);
-    else if (pushToken == LOCK_TOKEN)
+    else if (scanner.pushToken == LOCK_TOKEN)
     {
         /*
-         * eol_seen is only set for the first token after a newline.
+         * eolSeen is only set for the first token after a newline.
          */
-        eol_seen = 0;
+        scanner.eolSeen = 0;
 
-        c = configBuf[configPos];
+        c = CURRENT_CHAR();
 
         /* 
          * Get start of next Token. EOF is handled,
@@ -331,31 +320,21 @@ int xconfigGetToken (XConfigSymTabRec * tab)
 again:
         if (!c)
         {
-            char *ret;
-            if (configFile)
-                ret = xconfigGetNextLine();
-            else {
-                if (builtinConfig[builtinIndex] == NULL)
-                    ret = NULL;
-                else {
-                    ret = strncpy(configBuf, builtinConfig[builtinIndex],
-                            CONFIG_BUF_LEN);
-                    builtinIndex++;
-                }
-            }
-            if (ret == NULL)
+            if (!xconfigGetNextLine())
             {
-                return (pushToken = EOF_TOKEN);
+                return (scanner.pushToken = EOF_TOKEN);
             }
             configLineNo++;
-            configPos = 0;
-            eol_seen = 1;
+            scanner.eolSeen = 1;
         }
 
+        /* the line may have grown the token buffer */
+        rbuf = scanner.rbuf;
+
         i = 0;
         for (;;) {
-            c = configBuf[configPos++];
-            configRBuf[i++] = c;
+            c = NEXT_CHAR();
+            rbuf[i++] = c;
             switch (c) {
                 case ' ':
                 case '\t':
@@ -374,23 +353,23 @@ again:
         {
             do
             {
-                configRBuf[i++] = (c = configBuf[configPos++]);
+                rbuf[i++] = (c = NEXT_CHAR());
             }
             while ((c != '\n') && (c != '\r') && (c != '\0'));
-            configRBuf[i] = '\0';
+            rbuf[i] = '\0';
             /* XXX no private copy.
              * Use xconfigAddComment when setting a comment.
              */
-            val.str = configRBuf;
+            val.str = rbuf;
             return (COMMENT);
         }
 
         /* GJA -- handle '-' and ','  * Be careful: "-hsync" is a keyword. */
-        else if ((c == ',') && !xconfigIsAlpha(configBuf[configPos]))
+        else if ((c == ',') && !xconfigIsAlpha(CURRENT_CHAR()))
         {
             return COMMA;
         }
-        else if ((c == '-') && !xconfigIsAlpha(configBuf[configPos]))
+        else if ((c == '-') && !xconfigIsAlpha(CURRENT_CHAR()))
         {
             return DASH;
         }
@@ -403,26 +382,26 @@ again:
             int base;
 
             if (c == '0')
-                if ((configBuf[configPos] == 'x') ||
-                    (configBuf[configPos] == 'X'))
+                if ((CURRENT_CHAR() == 'x') ||
+                    (CURRENT_CHAR() == 'X'))
                     base = 16;
                 else
                     base = 8;
             else
                 base = 10;
 
-            configRBuf[0] = c;
+            rbuf[0] = c;
             i = 1;
-            while (xconfigIsDigit(c = configBuf[configPos++]) ||
+            while (xconfigIsDigit(c = NEXT_CHAR()) ||
                    (c == '.') || (c == 'x') || (c == 'X') ||
                    ((base == 16) && (((c >= 'a') && (c <= 'f')) ||
                                      ((c >= 'A') && (c <= 'F')))))
-                configRBuf[i++] = c;
-            configPos--;        /* GJA -- one too far */
-            configRBuf[i] = '\0';
-            val.num = xconfigStrToUL (configRBuf);
-            val.realnum = atof (configRBuf);
-            val.str = configRBuf;
+                rbuf[i++] = c;
+            scanner.pos--;      /* GJA -- one too far */
+            rbuf[i] = '\0';
+            val.num = xconfigStrToUL (rbuf);
+            val.realnum = atof (rbuf);
+            val.str = rbuf;
             return (NUMBER);
         }
 
@@ -434,12 +413,12 @@ again:
             i = -1;
             do
             {
-                configRBuf[++i] = (c = configBuf[configPos++]);
+                rbuf[++i] = (c = NEXT_CHAR());
             }
             while ((c != '\"') && (c != '\n') && (c != '\r') && (c != '\0'));
-            configRBuf[i] = '\0';
-            val.str = malloc (strlen (configRBuf) + 1);
-            strcpy (val.str, configRBuf);    /* private copy ! */
+            rbuf[i] = '\0';
+            val.str = malloc (i + 1);
+            memcpy (val.str, rbuf, i + 1);    /* private copy ! */
             return (STRING);
         }
 
@@ -449,11 +428,11 @@ again:
          */
         else
         {
-            configRBuf[0] = c;
+            rbuf[0] = c;
             i = 0;
             do
             {
-                configRBuf[++i] = (c = configBuf[configPos++]);;
+                rbuf[++i] = (c = NEXT_CHAR());
             }
             while ((c != ' ')  &&
                    (c != '\t') &&
@@ -462,8 +441,8 @@ again:
                    (c != '\0') &&
                    (c != '#'));
             
-            --configPos;
-            configRBuf[i] = '\0';
+            --scanner.pos;
+            rbuf[i] = '\0';
             i = 0;
         }
 
@@ -475,8 +454,8 @@ again:
          * Here we deal with pushed tokens. Reinitialize pushToken again. If
          * the pushed token was NUMBER || STRING return them again ...
          */
-        int temp = pushToken;
-        pushToken = LOCK_TOKEN;
+        int temp = scanner.pushToken;
+        scanner.pushToken = LOCK_TOKEN;
 
         if (temp == COMMA || temp == DASH)
             return (temp);
@@ -488,14 +467,7 @@ again:
      * Joop, at last we have to lookup the token ...
      */
     if (tab)
-    {
-        i = 0;
-        while (tab[i].token != -1)
-            if (xconfigNameCompare (configRBuf, tab[i].name) == 0)
-                return (tab[i].token);
-            else
-                i++;
-    }
+        return StringToToken (scanner.rbuf, tab);
 
     return (ERROR_TOKEN);        /* Error catcher */
 }
@@ -534,12 +506,12 @@ int xconfigGetSubTokenWithTab (char **comment, XConfigSymTabRec *tab)
 
 void xconfigUnGetToken (int token)
 {
-    pushToken = token;
+    scanner.pushToken = token;
 }
 
 char *xconfigTokenString (void)
 {
-    return configRBuf;
+    return scanner.rbuf;
 }
 
 static int pathIsAbsolute(const char *path)
@@ -640,9 +612,9 @@ static char *DoSubstitution(const char *template,
 {
     char *result;
     int i, l;
-    static const char *env = NULL;
-    static char *hostname = NULL;
-    static char majorvers[3] = "";
+    const char *env = NULL;
+    char hostname[MAXHOSTNAMELEN + 1] = "";
+    char majorvers[16] = "";
 
     if (!template)
         return NULL;
@@ -688,18 +660,14 @@ static char *DoSubstitution(const char *template,
                 APPEND_STR(XConfigFile);
                 break;
             case 'H':
-                if (!hostname) {
-                    if ((hostname = malloc(MAXHOSTNAMELEN + 1))) {
-                        if (gethostname(hostname, MAXHOSTNAMELEN) == 0) {
-                            hostname[MAXHOSTNAMELEN] = '\0';
-                        } else {
-                            free(hostname);
-                            hostname = NULL;
-                        }
+                if (!hostname[0]) {
+                    if (gethostname(hostname, MAXHOSTNAMELEN) == 0) {
+                        hostname[MAXHOSTNAMELEN] = '\0';
+                    } else {
+                        hostname[0] = '\0';
                     }
                 }
-                if (hostname)
-                    APPEND_STR(hostname);
+                APPEND_STR(hostname);
                 break;
             case 'E':
                 if (!env)
@@ -826,17 +794,118 @@ static const char __user_configpath[] =
 
 
 
+/*
+ * scannerLoad --
+ *
+ *  make the contents of the file at path available to the scanner:
+ *  large regular files are mmap(2)ed; anything else (small files,
+ *  pipes, character devices, some virtual file systems) is read into
+ *  a malloc(3)ed buffer instead.  Returns FALSE if the file can't be
+ *  opened.
+ */
+
+static int scannerLoad(const char *path)
+{
+    struct stat st;
+    char *buf, *tmp;
+    size_t len, size;
+    ssize_t ret;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return FALSE;
+    }
+
+    scanner.data = NULL;
+    scanner.size = 0;
+    scanner.mapped = FALSE;
+
+    if (fstat(fd, &st) < 0) {
+        st.st_mode = 0;
+    }
+
+    if (S_ISREG(st.st_mode) && (st.st_size >= CONFIG_MMAP_MIN_SIZE)) {
+        buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (buf != MAP_FAILED) {
+            scanner.data = buf;
+            scanner.size = st.st_size;
+            scanner.mapped = TRUE;
+            close(fd);
+            return TRUE;
+        }
+    }
+
+    buf = NULL;
+    len = size = 0;
+
+    /* size the buffer for the whole file, plus one byte to see EOF */
+    if (S_ISREG(st.st_mode) && (st.st_size > 0)) {
+        buf = malloc(st.st_size + 1);
+        if (buf) {
+            size = st.st_size + 1;
+        }
+    }
+
+    for (;;) {
+        if (len == size) {
+            size += 16 * CONFIG_BUF_LEN;
+            tmp = realloc(buf, size);
+            if (!tmp) {
+                break;
+            }
+            buf = tmp;
+        }
+        ret = read(fd, buf + len, size - len);
+        if (ret <= 0) {
+            break;
+        }
+        len += ret;
+    }
+
+    /*
+     * a read error is treated as the end of the file, as fgets(3)
+     * would; this matches reading a directory, for example, as an
+     * empty config file
+     */
+
+    scanner.data = buf;
+    scanner.size = len;
+    close(fd);
+
+    return TRUE;
+}
+
+static void scannerUnload(void)
+{
+    if (scanner.mapped) {
+        munmap(scanner.data, scanner.size);
+    } else {
+        free(scanner.data);
+    }
+
+    scanner.data = NULL;
+    scanner.size = 0;
+    scanner.mapped = FALSE;
+}
+
+
+
 const char *xconfigOpenConfigFile(const char *cmdline, const char *projroot)
 {
     const char *searchpath;
-    char *pathcopy;
+    char *pathcopy, *saveptr;
     const char *template;
     int cmdlineUsed = 0;
 
-    configFile = NULL;
-    configPos = 0;        /* current readers position */
-    configLineNo = 0;    /* linenumber */
-    pushToken = LOCK_TOKEN;
+    scanner.opened = FALSE;
+    scanner.offset = 0;
+    scanner.line = NULL;
+    scanner.lineLen = 0;
+    scanner.pos = 0;        /* current readers position */
+    scanner.pushToken = LOCK_TOKEN;
+    scanner.eolSeen = 0;
+    configLineNo = 0;       /* linenumber */
 
     /*
      * select the search path: XFree86 uses a slightly different path
@@ -853,59 +922,63 @@ const char *xconfigOpenConfigFile(const char *cmdline, const char *projroot)
     
     pathcopy = strdup(searchpath);
     
-    template = strtok(pathcopy, ",");
+    template = strtok_r(pathcopy, ",", &saveptr);
 
     /* First, search for a config file. */
-    while (template && !configFile) {
+    while (template && !scanner.opened) {
         if ((configPath = DoSubstitution(template, cmdline, projroot,
                                          &cmdlineUsed, NULL, XCONFIGFILE))) {
-            if ((configFile = fopen(configPath, "r")) != 0) {
+            if ((scanner.opened = scannerLoad(configPath))) {
                 if (cmdline && !cmdlineUsed) {
-                    fclose(configFile);
-                    configFile = NULL;
+                    scannerUnload();
+                    scanner.opened = FALSE;
                 }
             }
         }
-        if (configPath && !configFile) {
+        if (configPath && !scanner.opened) {
             free(configPath);
             configPath = NULL;
         }
-        template = strtok(NULL, ",");
+        template = strtok_r(NULL, ",", &saveptr);
     }
 
     /* Then search for fallback */
-    if (!configFile) {
+    if (!scanner.opened) {
         strcpy(pathcopy, searchpath);
-        template = strtok(pathcopy, ",");
+        template = strtok_r(pathcopy, ",", &saveptr);
         
-        while (template && !configFile) {
+        while (template && !scanner.opened) {
             if ((configPath = DoSubstitution(template, cmdline, projroot,
                                              &cmdlineUsed, NULL,
                                              XFREE86CFGFILE))) {
-                if ((configFile = fopen(configPath, "r")) != 0) {
+                if ((scanner.opened = scannerLoad(configPath))) {
                     if (cmdline && !cmdlineUsed) {
-                        fclose(configFile);
-                        configFile = NULL;
+                        scannerUnload();
+                        scanner.opened = FALSE;
                     }
                 }
             }
-            if (configPath && !configFile) {
+            if (configPath && !scanner.opened) {
                 free(configPath);
                 configPath = NULL;
             }
-            template = strtok(NULL, ",");
+            template = strtok_r(NULL, ",", &saveptr);
         }
     }
     
     free(pathcopy);
 
-    if (!configFile) {
+    if (!scanner.opened) {
         return NULL;
     }
 
-    configBuf = malloc(CONFIG_BUF_LEN);
-    configRBuf = malloc(CONFIG_BUF_LEN);
-    configBuf[0] = '\0';
+    scanner.rbufLen = CONFIG_BUF_LEN;
+    scanner.rbuf = malloc(scanner.rbufLen);
+    if (!scanner.rbuf) {
+        xconfigCloseConfigFile();
+        return NULL;
+    }
+    scanner.rbuf[0] = '\0';
 
     return configPath;
 }
@@ -914,17 +987,15 @@ void xconfigCloseConfigFile (void)
 {
     free (configPath);
     configPath = NULL;
-    free (configRBuf);
-    configRBuf = NULL;
-    free (configBuf);
-    configBuf = NULL;
-
-    if (configFile) {
-        fclose (configFile);
-        configFile = NULL;
-    } else {
-        builtinConfig = NULL;
-        builtinIndex = 0;
+    free (scanner.rbuf);
+    scanner.rbuf = NULL;
+    scanner.rbufLen = 0;
+    scanner.line = NULL;
+    scanner.lineLen = 0;
+
+    if (scanner.opened) {
+        scannerUnload();
+        scanner.opened = FALSE;
     }
 }
 
@@ -963,7 +1034,7 @@ xconfigAddComment(char *cur, char *add)
         curlen = strlen(cur);
         if (curlen)
             hasnewline = cur[curlen - 1] == '\n';
-        eol_seen = 0;
+        scanner.eolSeen = 0;
     }
     else
         curlen = 0;
@@ -979,14 +1050,14 @@ xconfigAddComment(char *cur, char *add)
 
     len = strlen(add);
     endnewline = add[len - 1] == '\n';
-    len +=  1 + iscomment + (!hasnewline) + (!endnewline) + eol_seen;
+    len +=  1 + iscomment + (!hasnewline) + (!endnewline) + scanner.eolSeen;
 
     if ((str = realloc(cur, len + curlen)) == NULL)
         return (cur);
 
     cur = str;
 
-    if (eol_seen || (curlen && !hasnewline))
+    if (scanner.eolSeen || (curlen && !hasnewline))
         cur[curlen++] = '\n';
     if (!iscomment)
         cur[curlen++] = '#';
@@ -1003,10 +1074,306 @@ xconfigGetStringToken (XConfigSymTabRec * tab)
     return StringToToken (val.str, tab);
 }
 
+/*
+ * Keyword lookup --
+ *
+ *  Every symbol table gets a perfect hash index the first time it is
+ *  searched, so that looking up a token costs one pass over the token
+ *  to normalize and hash it, and one compare, rather than an
+ *  xconfigNameCompare() per table entry.
+ *
+ *  Names are normalized the way xconfigNameCompare() compares them:
+ *  '_', ' ' and '\t' are dropped and letters are folded to lowercase.
+ *  A seed for which no two names of the table share a slot is searched
+ *  for when the index is built.
+ *
+ *  Indices are kept in a small cache keyed by table address and are
+ *  never freed; the tables themselves are static.  Tables for which no
+ *  index could be built get an entry without slots, so that they are
+ *  searched linearly without trying again.  Cache entries are published
+ *  with an atomic compare-and-swap, so that threads scanning config
+ *  files at the same time may share them; like XCONFIG_THREAD_LOCAL,
+ *  this falls back to plain accesses where the compiler does not
+ *  support it.
+ */
+
+#define SYMTAB_CACHE_BITS     7
+#define SYMTAB_CACHE_SIZE     (1 << SYMTAB_CACHE_BITS)
+#define SYMTAB_MAX_BITS       10
+#define SYMTAB_SEED_ATTEMPTS  1024
+#define SYMTAB_MAX_NAME       63
+
+typedef struct {
+    int token;
+    int len;           /* length of name */
+    const char *name;  /* normalized name; NULL if the slot is empty */
+} XConfigSymTabSlotRec;
+
+typedef struct {
+    const XConfigSymTabRec *tab;
+    unsigned int seed;
+    int bits;
+    int maxLen;        /* length of the longest normalized name */
+    XConfigSymTabSlotRec *slots;
+    char *names;       /* storage for the normalized names */
+} XConfigSymTabIndexRec, *XConfigSymTabIndexPtr;
+
+static XConfigSymTabIndexPtr symTabCache[SYMTAB_CACHE_SIZE];
+
+#if defined(__GNUC__) || defined(__clang__)
+#define SYMTAB_LOAD(entry) __atomic_load_n(entry, __ATOMIC_ACQUIRE)
+#define SYMTAB_PUBLISH(entry, expected, index) \
+    __atomic_compare_exchange_n(entry, expected, index, FALSE, \
+                                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#else
+#define SYMTAB_LOAD(entry) (*(entry))
+#define SYMTAB_PUBLISH(entry, expected, index) \
+    (*(entry) == *(expected) ? (*(entry) = (index), TRUE) \
+                             : (*(expected) = *(entry), FALSE))
+#endif
+
+/*
+ * SymTabNormalize() --
+ *
+ *  write the normalized form of s, of at most max characters, to out,
+ *  and its hash to hash.  Returns the length of the normalized name, or
+ *  -1 if it is longer than max.
+ */
+
+static int SymTabNormalize(const char *s, char *out, int max, uint64_t *hash)
+{
+    uint64_t h = 14695981039346656037ULL;    /* FNV-1a */
+    int len = 0;
+    char c;
+
+    while (s && (c = *s++)) {
+        if (c == '_' || c == ' ' || c == '\t') {
+            continue;
+        }
+        if (len == max) {
+            return -1;
+        }
+        c = xconfigToLower(c);
+        out[len++] = c;
+        h = (h ^ (unsigned char) c) * 1099511628211ULL;
+    }
+
+    out[len] = '\0';
+    *hash = h;
+
+    return len;
+}
+
+static unsigned int SymTabSlot(uint64_t hash, unsigned int seed, int bits)
+{
+    return (unsigned int)
+        (((hash ^ seed) * 0x9E3779B97F4A7C15ULL) >> (64 - bits));
+}
+
+/*
+ * SymTabTrySeed() --
+ *
+ *  fill index->slots for the given seed and size; returns FALSE if two
+ *  names share a slot.
+ */
+
+static int SymTabTrySeed(XConfigSymTabIndexPtr index,
+                         const XConfigSymTabSlotRec *entries,
+                         const uint64_t *hashes, int n,
+                         unsigned int seed, int bits)
+{
+    unsigned int slot;
+    int i;
+
+    memset(index->slots, 0, sizeof(XConfigSymTabSlotRec) << bits);
+
+    for (i = 0; i < n; i++) {
+        if (!entries[i].name) {
+            continue;
+        }
+        slot = SymTabSlot(hashes[i], seed, bits);
+        if (index->slots[slot].name) {
+            return FALSE;
+        }
+        index->slots[slot] = entries[i];
+    }
+
+    index->seed = seed;
+    index->bits = bits;
+
+    return TRUE;
+}
+
+/*
+ * SymTabBuildIndex() --
+ *
+ *  build the perfect hash index for tab; returns NULL if none could be
+ *  found, in which case the table is searched linearly.
+ */
+
+static XConfigSymTabIndexPtr SymTabBuildIndex(const XConfigSymTabRec *tab)
+{
+    XConfigSymTabIndexPtr index;
+    XConfigSymTabSlotRec *entries, *slots;
+    uint64_t *hashes;
+    char *name;
+    int i, j, n, bits;
+    unsigned int seed;
+
+    for (n = 0; tab[n].token != -1; n++);
+
+    entries = calloc(n + 1, sizeof(XConfigSymTabSlotRec));
+    hashes = calloc(n + 1, sizeof(uint64_t));
+    index = calloc(1, sizeof(XConfigSymTabIndexRec));
+    if (!entries || !hashes || !index) {
+        goto fail;
+    }
+
+    index->tab = tab;
+    index->names = malloc((n + 1) * (SYMTAB_MAX_NAME + 1));
+    if (!index->names) {
+        goto fail;
+    }
+
+    /*
+     * a linear search returns the first of several entries with the
+     * same name; leave the others out of the index
+     */
+
+    name = index->names;
+
+    for (i = 0; i < n; i++) {
+        entries[i].len = SymTabNormalize(tab[i].name, name, SYMTAB_MAX_NAME,
+                                         &hashes[i]);
+        if (entries[i].len < 0) {
+            goto fail;
+        }
+        entries[i].token = tab[i].token;
+        entries[i].name = name;
+        for (j = 0; j < i; j++) {
+            if (entries[j].name && !strcmp(entries[j].name, name)) {
+                entries[i].name = NULL;
+                break;
+            }
+        }
+        if (entries[i].name) {
+            name += entries[i].len + 1;
+            if (entries[i].len > index->maxLen) {
+                index->maxLen = entries[i].len;
+            }
+        }
+    }
+
+    /*
+     * start at a load factor of at most 1/4, where a perfect seed is
+     * quickly found, and grow the index if none is
+     */
+
+    for (bits = 3; (1 << bits) < 4 * n; bits++);
+
+    for (; bits <= SYMTAB_MAX_BITS; bits++) {
+        slots = realloc(index->slots, sizeof(XConfigSymTabSlotRec) << bits);
+        if (!slots) {
+            goto fail;
+        }
+        index->slots = slots;
+
+        for (seed = 0; seed < SYMTAB_SEED_ATTEMPTS; seed++) {
+            if (SymTabTrySeed(index, entries, hashes, n, seed, bits)) {
+                free(entries);
+                free(hashes);
+                return index;
+            }
+        }
+    }
+
+ fail:
+    if (index) {
+        free(index->slots);
+        free(index->names);
+    }
+    free(index);
+    free(entries);
+    free(hashes);
+    return NULL;
+}
+
+/*
+ * SymTabGetIndex() --
+ *
+ *  find the cached index for tab, building and caching it if needed.
+ *  The index has no slots if tab must be searched linearly; NULL is
+ *  returned if the cache is full.
+ */
+
+static XConfigSymTabIndexPtr SymTabGetIndex(const XConfigSymTabRec *tab)
+{
+    XConfigSymTabIndexPtr index = NULL, cur;
+    unsigned int i, h;
+
+    h = SymTabSlot((uintptr_t) tab, 0, SYMTAB_CACHE_BITS);
+
+    for (i = 0; i < SYMTAB_CACHE_SIZE; i++) {
+        XConfigSymTabIndexPtr *entry =
+            &symTabCache[(h + i) % SYMTAB_CACHE_SIZE];
+
+        cur = SYMTAB_LOAD(entry);
+
+        if (!cur) {
+            if (!index) {
+                index = SymTabBuildIndex(tab);
+            }
+            if (!index) {
+                /* remember that tab has no index */
+                index = calloc(1, sizeof(XConfigSymTabIndexRec));
+                if (!index) {
+                    return NULL;
+                }
+                index->tab = tab;
+            }
+
+            /*
+             * another thread may fill this entry first; if that is
+             * with this table, use its index
+             */
+
+            if (SYMTAB_PUBLISH(entry, &cur, index)) {
+                return index;
+            }
+        }
+
+        if (cur->tab == tab) {
+            break;
+        }
+    }
+
+    if (index) {
+        free(index->slots);
+        free(index->names);
+        free(index);
+    }
+
+    return (i < SYMTAB_CACHE_SIZE) ? cur : NULL;
+}
+
 static int
 StringToToken (char *str, XConfigSymTabRec * tab)
 {
-    int i;
+    XConfigSymTabIndexPtr index = SymTabGetIndex(tab);
+    XConfigSymTabSlotRec *slot;
+    char name[SYMTAB_MAX_NAME + 1];
+    uint64_t hash;
+    int i, len;
+
+    if (index && index->slots) {
+        len = SymTabNormalize(str, name, index->maxLen, &hash);
+        if (len < 0)
+            return (ERROR_TOKEN);
+        slot = &index->slots[SymTabSlot(hash, index->seed, index->bits)];
+        if (slot->name && slot->len == len && !memcmp(slot->name, name, len))
+            return slot->token;
+        return (ERROR_TOKEN);
+    }
 
     for (i = 0; tab[i].token != -1; i++)
     {
@@ -1055,6 +1422,27 @@ xconfigNameCompare (const char *s1, const char *s2)
     return (c1 - c2);
 }
 
+/*
+ * Hash a name; names that xconfigNameCompare() considers equal hash to
+ * the same value.
+ */
+unsigned int
+xconfigNameHash (const char *s)
+{
+    unsigned int h = 2166136261U;    /* FNV-1a */
+
+    if (!s)
+        return (h);
+
+    for (; *s; s++)
+    {
+        if (*s == '_' || *s == ' ' || *s == '\t')
+            continue;
+        h = (h ^ (unsigned char) xconfigToLower(*s)) * 16777619U;
+    }
+    return (h);
+}
+
 /* 
  * Compare two modelines.  The modeline identifiers and comments are
  * ignored in the comparison.
@@ -59,8 +59,6 @@
 #include "xf86tokens.h"
 #include "Configint.h"
 
-extern LexRec val;
-
 static XConfigSymTabRec DisplayTab[] =
 {
     {ENDSUBSECTION, "endsubsection"},
@@ -164,6 +162,10 @@ xconfigParseDisplaySubSection (void)
         case MODES:
             {
                 XConfigModePtr mptr;
+                GenericListBuilderRec modes;
+
+                xconfigListBuilderInit(&modes,
+                                       (GenericListPtr *)(&ptr->modes));
 
                 while ((token =
                         xconfigGetSubTokenWithTab(&(ptr->comment),
@@ -172,8 +174,7 @@ xconfigParseDisplaySubSection (void)
                     mptr = calloc (1, sizeof (XConfigModeRec));
                     mptr->mode_name = val.str;
                     mptr->next = NULL;
-                    xconfigAddListItem((GenericListPtr *)(&ptr->modes),
-                                       (GenericListPtr) mptr);
+                    xconfigListBuilderAppend(&modes, (GenericListPtr) mptr);
                 }
                 xconfigUnGetToken (token);
             }
@@ -221,9 +222,12 @@ xconfigParseScreenSection (void)
     int has_ident = FALSE;
     int has_driver= FALSE;
     int token;
+    GenericListBuilderRec displays;
 
     PARSE_PROLOGUE (XConfigScreenPtr, XConfigScreenRec)
 
+    xconfigListBuilderInit(&displays, (GenericListPtr *)(&ptr->displays));
+
         while ((token = xconfigGetToken (ScreenTab)) != ENDSECTION)
     {
         switch (token)
@@ -303,8 +307,8 @@ xconfigParseScreenSection (void)
                 Error (QUOTE_MSG, "SubSection");
             {
                 free(val.str);
-                HANDLE_LIST (displays, xconfigParseDisplaySubSection,
-                             XConfigDisplayPtr);
+                HANDLE_LIST_BUILDER (displays, xconfigParseDisplaySubSection,
+                                     XConfigDisplayPtr);
             }
             break;
         case EOF_TOKEN:
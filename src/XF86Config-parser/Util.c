@@ -111,10 +111,6 @@ char *xconfigStrcat(const char *str, ...)
 
 #define NV_FMT_BUF_LEN 64
 
-extern int configLineNo;
-extern char *configSection;
-extern char *configPath;
-
 void xconfigErrorMsg(MsgType t, char *fmt, ...)
 {
     va_list ap;
@@ -59,8 +59,6 @@
 #include "xf86tokens.h"
 #include "Configint.h"
 
-extern LexRec val;
-
 static XConfigSymTabRec VendorSubTab[] =
 {
     {ENDSUBSECTION, "endsubsection"},
@@ -67,32 +67,12 @@
 #include <locale.h>
 
 
-int xconfigWriteConfigFile (const char *filename, XConfigPtr cptr)
-{
-    FILE *cf;
-    char *locale;
-    
-    if ((cf = fopen(filename, "w")) == NULL)
-    {
-        xconfigErrorMsg(WriteErrorMsg, "Unable to open the file \"%s\" for "
-                     "writing (%s).\n", filename, strerror(errno));
-        return FALSE;
-    }
-
-    /*
-     * read the current locale and then set the standard "C" locale,
-     * so that the X configuration writer does not use locale-specific
-     * formatting.  After writing the configuration file, we restore
-     * the original locale.
-     */
-
-    locale = setlocale(LC_ALL, NULL);
-    
-    if (locale) locale = strdup(locale);
+/*
+ * xconfigPrintConfig() - print the complete config file to cf.
+ */
 
-    setlocale(LC_ALL, "C");
-    
-    
+static void xconfigPrintConfig(FILE *cf, XConfigPtr cptr)
+{
     if (cptr->comment)
         fprintf (cf, "%s\n", cptr->comment);
 
@@ -131,8 +111,45 @@ int xconfigWriteConfigFile (const char *filename, XConfigPtr cptr)
     xconfigPrintDRISection (cf, cptr->dri);
 
     xconfigPrintExtensionsSection (cf, cptr->extensions);
+}
+
+
+
+/*
+ * xconfigRenderConfig() - render the given config in memory, as one
+ * NUL-terminated buffer which the caller must free(3).  If len is not
+ * NULL, it is set to the length of the text.  Returns NULL on failure.
+ */
+
+char *xconfigRenderConfig(XConfigPtr config, size_t *len)
+{
+    char *locale;
+    char *buf = NULL;
+    size_t buf_len = 0;
+    FILE *cf;
+    int ret;
+
+    if (!config) return NULL;
+
+    cf = open_memstream(&buf, &buf_len);
+    if (!cf) return NULL;
+
+    /*
+     * read the current locale and then set the standard "C" locale,
+     * so that the X configuration writer does not use locale-specific
+     * formatting.  After rendering the configuration, we restore the
+     * original locale.
+     */
+
+    locale = setlocale(LC_ALL, NULL);
+
+    if (locale) locale = strdup(locale);
+
+    setlocale(LC_ALL, "C");
 
-    fclose(cf);
+    xconfigPrintConfig(cf, config);
+
+    ret = (fclose(cf) == 0);
 
     /* restore the original locale */
 
@@ -141,5 +158,53 @@ int xconfigWriteConfigFile (const char *filename, XConfigPtr cptr)
         free(locale);
     }
 
-    return TRUE;
+    if (!ret) {
+        free(buf);
+        return NULL;
+    }
+
+    if (len) *len = buf_len;
+
+    return buf;
+}
+
+
+
+int xconfigWriteConfigFile (const char *filename, XConfigPtr cptr)
+{
+    char *buf;
+    size_t len;
+    FILE *cf;
+    int ret = TRUE;
+
+    buf = xconfigRenderConfig(cptr, &len);
+    if (!buf) {
+        xconfigErrorMsg(WriteErrorMsg, "Unable to render the X "
+                     "configuration for \"%s\".\n", filename);
+        return FALSE;
+    }
+
+    if ((cf = fopen(filename, "w")) == NULL)
+    {
+        xconfigErrorMsg(WriteErrorMsg, "Unable to open the file \"%s\" for "
+                     "writing (%s).\n", filename, strerror(errno));
+        free(buf);
+        return FALSE;
+    }
+
+    if (fwrite(buf, 1, len, cf) != len) {
+        xconfigErrorMsg(WriteErrorMsg, "Unable to write the file \"%s\" "
+                     "(%s).\n", filename, strerror(errno));
+        ret = FALSE;
+    }
+
+    if (fclose(cf) != 0 && ret) {
+        xconfigErrorMsg(WriteErrorMsg, "Unable to write the file \"%s\" "
+                     "(%s).\n", filename, strerror(errno));
+        ret = FALSE;
+    }
+
+    free(buf);
+
+    return ret;
 }
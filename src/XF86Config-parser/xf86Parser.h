@@ -139,6 +139,19 @@ void xconfigPrint(MsgType t, const char *msg);
 typedef struct { void *next; } GenericListRec, *GenericListPtr;
 
 
+/*
+ * GenericListBuilderRec - appends items to the end of a GenericListRec
+ * list in constant time, by keeping track of the last item; see
+ * xconfigListBuilderInit().  The list must not be modified by other
+ * means while it is being built.
+ */
+
+typedef struct {
+    GenericListPtr *pHead;
+    GenericListPtr tail;
+} GenericListBuilderRec, *GenericListBuilderPtr;
+
+
 
 /*
  * Options are stored in the XConfigOptionRec structure
@@ -601,6 +614,7 @@ typedef struct {
     char                  *filename;
 } XConfigRec, *XConfigPtr;
 
+
 typedef struct {
     int token;            /* id of the token */
     char *name;           /* pointer to the LOWERCASED name */
@@ -639,6 +653,8 @@ int xconfigSanitizeConfig(XConfigPtr p, const char *screenName,
 void xconfigCloseConfigFile(void);
 int xconfigWriteConfigFile(const char *, XConfigPtr);
 
+char *xconfigRenderConfig(XConfigPtr config, size_t *len);
+
 void xconfigFreeConfig(XConfigPtr *p);
 
 /*
@@ -697,6 +713,10 @@ void xconfigFreeModesLinkList(XConfigModesLinkPtr *ptr);
  */
 
 void xconfigAddListItem(GenericListPtr *pHead, GenericListPtr c_new);
+void xconfigListBuilderInit(GenericListBuilderPtr builder,
+                            GenericListPtr *pHead);
+void xconfigListBuilderAppend(GenericListBuilderPtr builder,
+                              GenericListPtr c_new);
 void xconfigRemoveListItem(GenericListPtr *pHead, GenericListPtr item);
 int xconfigItemNotSublist(GenericListPtr list_1, GenericListPtr list_2);
 char *xconfigAddComment(char *cur, char *add);
@@ -735,6 +755,7 @@ XConfigOptionPtr xconfigOptionListMerge(XConfigOptionPtr head,
 char *xconfigStrdup(const char *s);
 char *xconfigStrcat(const char *str, ...);
 int xconfigNameCompare(const char *s1, const char *s2);
+unsigned int xconfigNameHash(const char *s);
 int xconfigModelineCompare(XConfigModeLinePtr m1, XConfigModeLinePtr m2);
 char *xconfigULongToString(unsigned long i);
 XConfigOptionPtr xconfigParseOption(XConfigOptionPtr head);
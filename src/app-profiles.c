@@ -34,8 +34,11 @@
 #include <unistd.h>
 #include <errno.h>
 #include <dirent.h>
+#include <fcntl.h>
 #include <ctype.h>
 #include <time.h>
+#include <limits.h>
+#include <strings.h>
 #include "common-utils.h"
 #include "app-profiles.h"
 #include "msg.h"
@@ -58,52 +61,105 @@
 # define NV_JSON_OBJECT_FOREACH(object, key, value) json_object_foreach(object, key, value)
 #endif
 
+/*
+ * Output buffer used by slurp() and nv_app_profile_file_syntax_to_json();
+ * text is only ever appended, so the translation is a single pass over the
+ * input.
+ */
+typedef struct {
+    char *s;
+    size_t len;
+    size_t alloc;
+} JsonTextBuffer;
+
+static int json_text_buffer_append(JsonTextBuffer *buf, const char *s, size_t n)
+{
+    if (buf->len + n + 1 > buf->alloc) {
+        size_t new_alloc = buf->alloc * 2;
+        char *new_s;
+
+        if (new_alloc < buf->len + n + 1) {
+            new_alloc = buf->len + n + 1;
+        }
+        new_s = realloc(buf->s, new_alloc);
+        if (!new_s) {
+            return FALSE;
+        }
+        buf->s = new_s;
+        buf->alloc = new_alloc;
+    }
+
+    memcpy(buf->s + buf->len, s, n);
+    buf->len += n;
+    buf->s[buf->len] = '\0';
+
+    return TRUE;
+}
+
+/*
+ * Read the non-empty lines of fp, each preceded by a newline.
+ */
 static char *slurp(FILE *fp)
 {
+    JsonTextBuffer text;
     int eof = FALSE;
-    char *text = strdup("");
-    char *new_text;
 
-    while (text && !eof) {
+    text.len = 0;
+    text.alloc = 4096;
+    text.s = malloc(text.alloc);
+    if (!text.s) {
+        return NULL;
+    }
+    text.s[0] = '\0';
+
+    while (!eof) {
         char *line = fget_next_line(fp, &eof);
 
         if (line && *line != '\0' && *line != '\n') {
-            new_text = nvstrcat(text, "\n", line, NULL);
-            free(text);
-            text = new_text;
+            if (!json_text_buffer_append(&text, "\n", 1) ||
+                !json_text_buffer_append(&text, line, strlen(line))) {
+                free(line);
+                free(text.s);
+                return NULL;
+            }
         }
         free(line);
     }
 
-    return text;
-}
-
-static void splice_string(char **s, size_t b, size_t e, const char *replace)
-{
-    char *tail = strdup(*s + e);
-    *s = realloc(*s, b + strlen(replace) + strlen(tail) + 1);
-    if (!*s) {
-        return;
-    }
-    sprintf(*s + b, "%s%s", replace, tail);
-    free(tail);
+    return text.s;
 }
 
 #define HEX_DIGITS "0123456789abcdefABCDEF"
 
 char *nv_app_profile_file_syntax_to_json(const char *orig_s)
 {
-    char *s = strdup(orig_s);
-
+    JsonTextBuffer out;
     int quoted = FALSE;
-    char *tok;
-    size_t start, end, size;
+    const char *tok, *copied;
+    size_t size;
     unsigned long long val;
-    char *old_substr = NULL;
     char *endptr;
-    char *new_substr = NULL;
+    char num_str[24];
+
+    /*
+     * Comment removal only ever shrinks the text, and a rewritten numeric
+     * literal grows by at most a few characters, so the input length is a
+     * good initial estimate of the output length.
+     */
+    out.len = 0;
+    out.alloc = strlen(orig_s) + 1;
+    out.s = malloc(out.alloc);
+    if (!out.s) {
+        return NULL;
+    }
+    out.s[0] = '\0';
 
-    tok = s;
+    /*
+     * Text between 'copied' and 'tok' is passed through unchanged; it is
+     * flushed to the output buffer only when a comment or numeric literal
+     * needs to be rewritten, and once more at the end.
+     */
+    copied = tok = orig_s;
     while ((tok = strpbrk(tok, "\\\"#" HEX_DIGITS))) {
         switch (*tok) {
         case '\"':
@@ -121,14 +177,15 @@ char *nv_app_profile_file_syntax_to_json(const char *orig_s)
         case '#':
             // Comment
             if (!quoted) {
-                char *end_tok = nvstrchrnul(tok, '\n');
-                start = tok - s;
-                end = end_tok - s;
-                splice_string(&s, start, end, "");
-                if (!s) {
+                if (!json_text_buffer_append(&out, copied, tok - copied)) {
                     goto fail;
                 }
-                tok = s + start;
+                tok = strchr(tok, '\n');
+                if (!tok) {
+                    tok = copied = orig_s + strlen(orig_s);
+                } else {
+                    copied = tok;
+                }
             } else {
                 tok++;
             }
@@ -142,28 +199,20 @@ char *nv_app_profile_file_syntax_to_json(const char *orig_s)
             if ((tok[0] == '0') &&
                 (tok[1] == 'x' || tok[1] == 'X' || isdigit(tok[1])) &&
                 !quoted) {
-                old_substr = nvstrndup(tok, size);
-                if (!old_substr) {
-                    goto fail;
-                }
                 errno = 0;
-                val = strtoull(old_substr, &endptr, 0);
-                if (errno || (endptr - old_substr != strlen(old_substr))) {
+                val = strtoull(tok, &endptr, 0);
+                if (errno || (endptr != tok + size)) {
                     // Invalid conversion, skip this string
                     tok += size;
-                    free(old_substr); old_substr = NULL;
                 } else {
-                    new_substr = nvasprintf("%llu", val);
-                    if (!new_substr) {
+                    snprintf(num_str, sizeof(num_str), "%llu", val);
+                    if (!json_text_buffer_append(&out, copied, tok - copied) ||
+                        !json_text_buffer_append(&out, num_str,
+                                                 strlen(num_str))) {
                         goto fail;
-                    } else {
-                        start = tok - s;
-                        end = tok - s + size;
-                        splice_string(&s, start, end, new_substr);
-                        free(new_substr); new_substr = NULL;
-                        free(old_substr); old_substr = NULL;
-                        tok = s + start;
                     }
+                    tok += size;
+                    copied = tok;
                 }
             } else {
                 // Not hex or octal; let the JSON parser deal with it
@@ -176,14 +225,14 @@ char *nv_app_profile_file_syntax_to_json(const char *orig_s)
         }
     }
 
-    assert(!new_substr);
-    assert(!old_substr);
-    return s;
+    if (!json_text_buffer_append(&out, copied, strlen(copied))) {
+        goto fail;
+    }
+
+    return out.s;
 
 fail:
-    free(old_substr);
-    free(new_substr);
-    free(s);
+    free(out.s);
     return NULL;
 }
 
@@ -216,6 +265,126 @@ static char *nv_dirname(const char *path)
     }
 }
 
+/*
+ * Record the location of the rule with the given ID, growing the rule index as
+ * needed.
+ */
+static void app_profile_config_set_rule_location(AppProfileConfig *config,
+                                                 int id,
+                                                 int file_idx,
+                                                 int rule_idx)
+{
+    size_t i, new_size;
+
+    assert(id >= 0);
+
+    if ((size_t)id >= config->rule_locations_size) {
+        new_size = config->rule_locations_size ?
+                   config->rule_locations_size : 64;
+        while (new_size <= (size_t)id) {
+            new_size *= 2;
+        }
+        config->rule_locations =
+            nvrealloc(config->rule_locations,
+                      new_size * sizeof(AppProfileRuleLocation));
+        for (i = config->rule_locations_size; i < new_size; i++) {
+            config->rule_locations[i].file_idx = -1;
+            config->rule_locations[i].rule_idx = -1;
+        }
+        config->rule_locations_size = new_size;
+    }
+
+    config->rule_locations[id].file_idx = file_idx;
+    config->rule_locations[id].rule_idx = rule_idx;
+}
+
+static const AppProfileRuleLocation *
+app_profile_config_get_rule_location(AppProfileConfig *config, int id)
+{
+    if ((id < 0) ||
+        ((size_t)id >= config->rule_locations_size) ||
+        (config->rule_locations[id].file_idx < 0)) {
+        return NULL;
+    }
+
+    return &config->rule_locations[id];
+}
+
+/*
+ * Recompute the running count of rules preceding each file.
+ */
+static void app_profile_config_count_file_rules(AppProfileConfig *config)
+{
+    size_t i, num_files;
+    json_t *file;
+
+    num_files = json_array_size(config->parsed_files);
+    config->rules_before_file = nvrealloc(config->rules_before_file,
+                                          (num_files + 1) * sizeof(size_t));
+
+    config->rules_before_file[0] = 0;
+    for (i = 0; i < num_files; i++) {
+        file = json_array_get(config->parsed_files, i);
+        config->rules_before_file[i + 1] =
+            config->rules_before_file[i] +
+            json_array_size(json_object_get(file, "rules"));
+    }
+}
+
+static void app_profile_config_index_file_rules(AppProfileConfig *config,
+                                                size_t file_idx)
+{
+    size_t i, size;
+    json_t *file, *file_rules, *rule;
+
+    file = json_array_get(config->parsed_files, file_idx);
+    file_rules = json_object_get(file, "rules");
+
+    for (i = 0, size = json_array_size(file_rules); i < size; i++) {
+        rule = json_array_get(file_rules, i);
+        app_profile_config_set_rule_location(config,
+            json_integer_value(json_object_get(rule, "id")), file_idx, i);
+    }
+}
+
+/*
+ * Update the rule index for all rules in parsed_files[first_file_idx] and the
+ * files following it. This must be called whenever files are added to or
+ * removed from the parsed_files array.
+ */
+static void app_profile_config_reindex_files(AppProfileConfig *config,
+                                             size_t first_file_idx)
+{
+    size_t i, num_files;
+
+    num_files = json_array_size(config->parsed_files);
+    for (i = first_file_idx; i < num_files; i++) {
+        app_profile_config_index_file_rules(config, i);
+    }
+
+    app_profile_config_count_file_rules(config);
+}
+
+/*
+ * Update the rule index for the rules of a single file. This must be called
+ * whenever rules are added to, removed from, or moved within the file.
+ */
+static void app_profile_config_reindex_file(AppProfileConfig *config,
+                                            const json_t *file)
+{
+    size_t i, num_files;
+
+    num_files = json_array_size(config->parsed_files);
+    for (i = 0; i < num_files; i++) {
+        if (json_array_get(config->parsed_files, i) == file) {
+            app_profile_config_index_file_rules(config, i);
+            break;
+        }
+    }
+
+    app_profile_config_count_file_rules(config);
+}
+
 static json_t *app_profile_config_insert_file_object(AppProfileConfig *config, json_t *new_file)
 {
     json_t *json_filename, *json_new_filename;
@@ -224,7 +393,7 @@ static json_t *app_profile_config_insert_file_object(AppProfileConfig *config, j
     json_t *file;
     json_t *order, *file_order;
     size_t new_file_major, new_file_minor, file_order_major, file_order_minor;
-    size_t i;
+    size_t i, new_file_idx;
     size_t num_files;
 
     json_new_filename = json_object_get(new_file, "filename");
@@ -280,30 +449,47 @@ static json_t *app_profile_config_insert_file_object(AppProfileConfig *config, j
 
     // Mark the order of the file
     order = json_object_get(new_file, "order");
+    if (!order) {
+        order = json_object();
+        json_object_set_new(new_file, "order", order);
+    }
     json_object_set_new(order, "major", json_integer(new_file_major));
     json_object_set_new(order, "minor", json_integer(new_file_minor));
 
     // Add the new file
     json_array_insert(config->parsed_files, i, new_file);
+    new_file_idx = i;
 
     // Bump up minor for files after this one with the same major
     num_files = json_array_size(config->parsed_files);
 
-    for ( ; i < num_files; i++) {
+    for (i = new_file_idx + 1; i < num_files; i++) {
         file = json_array_get(config->parsed_files, i);
         file_order = json_object_get(file, "order");
-        file_order_major = json_integer_value(json_object_get(order, "major"));
-        file_order_minor = json_integer_value(json_object_get(order, "minor"));
+        file_order_major = json_integer_value(json_object_get(file_order, "major"));
+        file_order_minor = json_integer_value(json_object_get(file_order, "minor"));
         if (file_order_major > new_file_major) {
             break;
         }
         json_object_set_new(file_order, "minor", json_integer(file_order_minor+1));
     }
 
+    // Files after the new one have shifted; update the rule index
+    app_profile_config_reindex_files(config, new_file_idx);
+
     return new_file;
 }
 
 
+/*
+ * Flag a file whose rules or profiles have been edited, so that it is
+ * compared against the original configuration during validation.
+ */
+static void app_profile_config_mark_file_modified(json_t *file)
+{
+    json_object_set_new(file, "modified", json_true());
+}
+
 /*
  * Create a new empty file object and adds it to the configuration.
  */
@@ -316,6 +502,7 @@ static json_t *app_profile_config_new_file(AppProfileConfig *config,
     json_object_set_new(new_file, "rules", json_array());
     json_object_set_new(new_file, "profiles", json_object());
     json_object_set_new(new_file, "dirty", json_false());
+    json_object_set_new(new_file, "modified", json_false());
     json_object_set_new(new_file, "new", json_true());
     // order is set by app_profile_config_insert_file_object() below
 
@@ -324,13 +511,6 @@ static json_t *app_profile_config_new_file(AppProfileConfig *config,
     return new_file;
 }
 
-static char *rule_id_to_key_string(int id)
-{
-    char *key;
-    key = nvasprintf("%d", id);
-    return key;
-}
-
 /*
  * Constructs a profile name that is guaranteed to be unique to this
  * configuration. This is used to handle the case where there are multiple
@@ -382,6 +562,111 @@ char *nv_app_profile_config_get_unused_profile_name(AppProfileConfig *config)
     return unique_name;
 }
 
+/*
+ * Bump allocator for JSON trees which only live while a file is being
+ * translated into the configuration. json_arena_loads() parses text with all
+ * of jansson's allocations served from the arena, and the whole tree is then
+ * released at once by json_arena_free() instead of node by node.
+ *
+ * Trees loaded this way must not be modified or passed to json_decref(), and
+ * any value taken from them must be copied (e.g. with json_copy()) before it
+ * is stored in a tree that outlives the arena.
+ */
+#define JSON_ARENA_ALIGN          16
+#define JSON_ARENA_MIN_CHUNK_SIZE (16 * 1024)
+#define JSON_ARENA_MAX_CHUNK_SIZE (1024 * 1024)
+
+typedef struct JsonArenaChunkRec {
+    struct JsonArenaChunkRec *next;
+    size_t size;
+    size_t used;
+} JsonArenaChunk;
+
+typedef struct {
+    JsonArenaChunk *chunks;
+    size_t next_chunk_size;
+} JsonArena;
+
+// Header size rounded up so that chunk data is suitably aligned
+#define JSON_ARENA_CHUNK_HEADER_SIZE \
+    ((sizeof(JsonArenaChunk) + JSON_ARENA_ALIGN - 1) & ~(JSON_ARENA_ALIGN - 1))
+
+// The arena serving jansson allocations, if any
+static JsonArena *current_json_arena;
+
+static void *json_arena_malloc(size_t size)
+{
+    JsonArena *arena = current_json_arena;
+    JsonArenaChunk *chunk = arena->chunks;
+    void *ptr;
+
+    size = (size + JSON_ARENA_ALIGN - 1) & ~(JSON_ARENA_ALIGN - 1);
+
+    if (!chunk || chunk->size - chunk->used < size) {
+        size_t chunk_size = arena->next_chunk_size;
+
+        if (chunk_size < size) {
+            chunk_size = size;
+        }
+        chunk = malloc(JSON_ARENA_CHUNK_HEADER_SIZE + chunk_size);
+        if (!chunk) {
+            return NULL;
+        }
+        chunk->size = chunk_size;
+        chunk->used = 0;
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+
+        if (arena->next_chunk_size < JSON_ARENA_MAX_CHUNK_SIZE) {
+            arena->next_chunk_size *= 2;
+        }
+    }
+
+    ptr = (char *)chunk + JSON_ARENA_CHUNK_HEADER_SIZE + chunk->used;
+    chunk->used += size;
+
+    return ptr;
+}
+
+static void json_arena_free_noop(void *ptr)
+{
+    // Memory is reclaimed all at once by json_arena_free()
+}
+
+static json_t *json_arena_loads(JsonArena *arena, const char *text,
+                                json_error_t *error)
+{
+    json_t *root;
+
+    assert(!current_json_arena);
+
+    if (!arena->chunks) {
+        arena->next_chunk_size = JSON_ARENA_MIN_CHUNK_SIZE;
+    }
+
+    current_json_arena = arena;
+    json_set_alloc_funcs(json_arena_malloc, json_arena_free_noop);
+
+    root = json_loads(text, 0, error);
+
+    json_set_alloc_funcs(malloc, free);
+    current_json_arena = NULL;
+
+    return root;
+}
+
+static void json_arena_free(JsonArena *arena)
+{
+    JsonArenaChunk *chunk, *next;
+
+    for (chunk = arena->chunks; chunk; chunk = next) {
+        next = chunk->next;
+        free(chunk);
+    }
+
+    arena->chunks = NULL;
+}
+
 static json_t *json_settings_parse(json_t *old_settings, const char *filename)
 {
     int uses_setting_objects;
@@ -436,8 +721,8 @@ static json_t *json_settings_parse(json_t *old_settings, const char *filename)
             return NULL;
         }
         new_setting = json_object();
-        json_object_set(new_setting, "key", json_key);
-        json_object_set(new_setting, "value", json_value);
+        json_object_set_new(new_setting, "key", json_copy(json_key));
+        json_object_set_new(new_setting, "value", json_copy(json_value));
         json_array_append_new(new_settings, new_setting);
     }
 
@@ -445,17 +730,83 @@ static json_t *json_settings_parse(json_t *old_settings, const char *filename)
 }
 
 /*
- * Load app profile key documentation from file.
+ * Application profile key documentation. The key, type and description
+ * strings of every documented key are packed into one buffer, and are
+ * referred to by their offsets in it.
+ */
+typedef struct {
+    unsigned int key;
+    unsigned int type;
+    unsigned int description;
+} AppProfileKeyDoc;
+
+typedef struct {
+    const char *key;
+    size_t index;
+} AppProfileKeyDocIndex;
+
+struct AppProfileKeyDocsRec {
+    char *filename;
+    int loaded;
+    char *strings;
+    AppProfileKeyDoc *docs;         // in file order
+    AppProfileKeyDocIndex *sorted;  // sorted by key, ignoring case
+    size_t num_docs;
+};
+
+static int compare_key_doc_index(const void *a, const void *b)
+{
+    const AppProfileKeyDocIndex *index_a = a;
+    const AppProfileKeyDocIndex *index_b = b;
+    int ret = strcasecmp(index_a->key, index_b->key);
+
+    if (ret == 0) {
+        // Keep keys which only differ in case in file order
+        ret = (index_a->index > index_b->index) -
+              (index_a->index < index_b->index);
+    }
+    return ret;
+}
+
+static int key_doc_object_is_valid(const json_t *json_key_object)
+{
+    /*
+     * Any invalid and non-string type for any fields per key will
+     * cause the key's data to not be added.
+     */
+    return json_is_string(json_object_get(json_key_object, "key")) &&
+           json_is_string(json_object_get(json_key_object, "description")) &&
+           json_is_string(json_object_get(json_key_object, "type"));
+}
+
+static unsigned int key_doc_add_string(char *strings, size_t *len,
+                                       const json_t *json_key_object,
+                                       const char *field)
+{
+    const char *s = json_string_value(json_object_get(json_key_object, field));
+    size_t offset = *len;
+    size_t n = strlen(s) + 1;
+
+    memcpy(strings + offset, s, n);
+    *len += n;
+
+    return offset;
+}
+
+/*
+ * Read the key documentation file into key_docs.
  */
-json_t *nv_app_profile_key_documentation_load(const char *key_docs_file)
+static void app_profile_key_docs_load(AppProfileKeyDocs *key_docs)
 {
-    json_t *key_docs = NULL;
-    int ret, i;
+    const char *key_docs_file = key_docs->filename;
+    int ret;
+    size_t i, size, num_docs, len;
     struct stat stat_buf;
     FILE *fp = NULL;
 
     char *orig_text = NULL;
     char *json_text = NULL;
+    JsonArena arena = { NULL };
     json_t *orig_file = NULL;
     json_t *orig_json_keys = NULL;
     json_error_t error;
@@ -487,7 +838,7 @@ json_t *nv_app_profile_key_documentation_load(const char *key_docs_file)
     }
 
     // Parse the resulting JSON
-    orig_file = json_loads(json_text, 0, &error);
+    orig_file = json_arena_loads(&arena, json_text, &error);
 
     if (!orig_file) {
         nv_error_msg("App profile parse error in %s: %s on %s, line %d\n",
@@ -497,66 +848,174 @@ json_t *nv_app_profile_key_documentation_load(const char *key_docs_file)
 
     // Process the array of key objects within the top level object
     orig_json_keys = json_object_get(orig_file, "registry_keys");
+    size = json_array_size(orig_json_keys);
 
-    if (orig_json_keys) {
-        int size = json_array_size(orig_json_keys);
-
-        key_docs = json_array();
+    // Measure the valid keys, so that everything is allocated once
+    num_docs = 0;
+    len = 0;
+    for (i = 0; i < size; i++) {
+        json_t *json_key_object = json_array_get(orig_json_keys, i);
 
-        for (i = 0; i < size; i++) {
-            json_t *json_name, *json_description, *json_type;
-            json_t *json_key_object = json_array_get(orig_json_keys, i);
-
-            if (!json_is_object(json_key_object)) {
-                nv_error_msg("App profile parse error in %s: "
-                             "Object expected in 'registry_keys' array "
-                             "at position %d",
-                             key_docs_file, i);
-                continue;
-            }
+        if (!json_is_object(json_key_object)) {
+            nv_error_msg("App profile parse error in %s: "
+                         "Object expected in 'registry_keys' array "
+                         "at position %d",
+                         key_docs_file, (int)i);
+            continue;
+        }
 
-            json_name        = json_object_get(json_key_object, "key");
-            json_description = json_object_get(json_key_object, "description");
-            json_type        = json_object_get(json_key_object, "type");
+        if (key_doc_object_is_valid(json_key_object)) {
+            num_docs++;
+            len += strlen(json_string_value(json_object_get(json_key_object, "key"))) +
+                   strlen(json_string_value(json_object_get(json_key_object, "type"))) +
+                   strlen(json_string_value(json_object_get(json_key_object, "description"))) + 3;
+        }
+    }
 
-            /*
-             * Any invalid and non-string type for any fields per key will
-             * cause the key's data to not be added.
-             */
-            if (json_is_string(json_name) &&
-                json_is_string(json_description) &&
-                json_is_string(json_type)) {
+    if (num_docs == 0 || len > UINT_MAX) {
+        goto done;
+    }
 
-                json_t *new_json_key_object = json_object();
+    key_docs->strings = nvalloc(len);
+    key_docs->docs = nvalloc(num_docs * sizeof(AppProfileKeyDoc));
+    key_docs->sorted = nvalloc(num_docs * sizeof(AppProfileKeyDocIndex));
 
-                json_object_set(new_json_key_object, "key", json_name);
-                json_object_set(new_json_key_object, "description",
-                                json_description);
-                json_object_set(new_json_key_object, "type", json_type);
+    len = 0;
+    for (i = 0; i < size; i++) {
+        json_t *json_key_object = json_array_get(orig_json_keys, i);
+        AppProfileKeyDoc *doc = &key_docs->docs[key_docs->num_docs];
 
-                json_array_append_new(key_docs, new_json_key_object);
-            }
+        if (!json_is_object(json_key_object) ||
+            !key_doc_object_is_valid(json_key_object)) {
+            continue;
         }
-    }
 
+        doc->key = key_doc_add_string(key_docs->strings, &len,
+                                      json_key_object, "key");
+        doc->type = key_doc_add_string(key_docs->strings, &len,
+                                       json_key_object, "type");
+        doc->description = key_doc_add_string(key_docs->strings, &len,
+                                              json_key_object, "description");
 
-done:
-    if (json_array_size(key_docs) == 0) {
-        json_decref(key_docs);
-        key_docs = NULL;
+        key_docs->sorted[key_docs->num_docs].key = key_docs->strings + doc->key;
+        key_docs->sorted[key_docs->num_docs].index = key_docs->num_docs;
+        key_docs->num_docs++;
     }
 
+    qsort(key_docs->sorted, key_docs->num_docs,
+          sizeof(AppProfileKeyDocIndex), compare_key_doc_index);
+
+done:
     free(orig_text);
     free(json_text);
-    json_decref(orig_file);
+    json_arena_free(&arena);
 
     if (fp) {
         fclose(fp);
     }
 
+    key_docs->loaded = TRUE;
+}
+
+AppProfileKeyDocs *nv_app_profile_key_docs_new(const char *key_docs_file)
+{
+    AppProfileKeyDocs *key_docs = nvalloc(sizeof(AppProfileKeyDocs));
+
+    if (key_docs_file) {
+        key_docs->filename = nvstrdup(key_docs_file);
+    }
+
     return key_docs;
 }
 
+void nv_app_profile_key_docs_free(AppProfileKeyDocs *key_docs)
+{
+    if (!key_docs) {
+        return;
+    }
+
+    free(key_docs->filename);
+    free(key_docs->strings);
+    free(key_docs->docs);
+    free(key_docs->sorted);
+    free(key_docs);
+}
+
+int nv_app_profile_key_docs_is_loaded(const AppProfileKeyDocs *key_docs)
+{
+    return key_docs && key_docs->loaded;
+}
+
+size_t nv_app_profile_key_docs_count(AppProfileKeyDocs *key_docs)
+{
+    if (!key_docs) {
+        return 0;
+    }
+
+    if (!key_docs->loaded) {
+        app_profile_key_docs_load(key_docs);
+    }
+
+    return key_docs->num_docs;
+}
+
+const char *nv_app_profile_key_docs_get_key(AppProfileKeyDocs *key_docs,
+                                            size_t i)
+{
+    if (i >= nv_app_profile_key_docs_count(key_docs)) {
+        return NULL;
+    }
+    return key_docs->strings + key_docs->docs[i].key;
+}
+
+const char *nv_app_profile_key_docs_get_type(AppProfileKeyDocs *key_docs,
+                                             size_t i)
+{
+    if (i >= nv_app_profile_key_docs_count(key_docs)) {
+        return NULL;
+    }
+    return key_docs->strings + key_docs->docs[i].type;
+}
+
+const char *nv_app_profile_key_docs_get_description(AppProfileKeyDocs *key_docs,
+                                                    size_t i)
+{
+    if (i >= nv_app_profile_key_docs_count(key_docs)) {
+        return NULL;
+    }
+    return key_docs->strings + key_docs->docs[i].description;
+}
+
+int nv_app_profile_key_docs_find(AppProfileKeyDocs *key_docs,
+                                 const char *key, int ignore_case)
+{
+    size_t lo = 0, hi = nv_app_profile_key_docs_count(key_docs);
+
+    if (!key) {
+        return -1;
+    }
+
+    // Find the first key which is not less than key, ignoring case
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (strcasecmp(key_docs->sorted[mid].key, key) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    for (; lo < key_docs->num_docs &&
+           !strcasecmp(key_docs->sorted[lo].key, key); lo++) {
+        if (ignore_case || !strcmp(key_docs->sorted[lo].key, key)) {
+            return key_docs->sorted[lo].index;
+        }
+    }
+
+    return -1;
+}
+
 /*
  * Load app profile settings from an already-open file. This operation is
  * atomic: either all of the settings from the file are added to the
@@ -571,6 +1030,7 @@ static void app_profile_config_load_file(AppProfileConfig *config,
     char *orig_text = NULL;
     size_t i, size;
     json_error_t error;
+    JsonArena arena = { NULL };
     json_t *orig_file = NULL;
     json_t *orig_json_profiles, *orig_json_rules;
     int next_free_rule_id = config->next_free_rule_id;
@@ -608,7 +1068,7 @@ static void app_profile_config_load_file(AppProfileConfig *config,
     new_json_rules = json_array();
 
     // Parse the resulting JSON
-    orig_file = json_loads(json_text, 0, &error);
+    orig_file = json_arena_loads(&arena, json_text, &error);
 
     if (!orig_file) {
         nv_error_msg("App profile parse error in %s: %s on %s, line %d\n",
@@ -709,12 +1169,12 @@ static void app_profile_config_load_file(AppProfileConfig *config,
                     json_decref(new_json_pattern);
                     goto done;
                 }
-                json_object_set(new_json_pattern, "feature", orig_json_feature);
-                json_object_set(new_json_pattern, "matches", orig_json_matches);
+                json_object_set_new(new_json_pattern, "feature", json_copy(orig_json_feature));
+                json_object_set_new(new_json_pattern, "matches", json_copy(orig_json_matches));
             } else if (json_is_string(orig_json_pattern)) {
                 // procname
                 json_object_set_new(new_json_pattern, "feature", json_string("procname"));
-                json_object_set(new_json_pattern, "matches", orig_json_pattern);
+                json_object_set_new(new_json_pattern, "matches", json_copy(orig_json_pattern));
             } else {
                 json_decref(new_json_rule);
                 json_decref(new_json_pattern);
@@ -792,6 +1252,7 @@ static void app_profile_config_load_file(AppProfileConfig *config,
     json_object_set(new_file, "profiles", new_json_profiles);
     json_object_set(new_file, "rules", new_json_rules);
     json_object_set_new(new_file, "dirty", dirty ? json_true() : json_false());
+    json_object_set_new(new_file, "modified", json_false());
     json_object_set_new(new_file, "new", json_false());
 
     // Don't use the atime in the stat_buf; instead measure it here
@@ -809,21 +1270,11 @@ static void app_profile_config_load_file(AppProfileConfig *config,
         }
     }
 
-    // Add the rules in this file to the global rules list
-    size = json_array_size(new_json_rules);
-    for (i = 0; i < size; i++) {
-        char *key;
-        json_t *new_rule;
-
-        new_rule = json_array_get(new_json_rules, i);
-        key = rule_id_to_key_string(json_integer_value(json_object_get(new_rule, "id")));
-        json_object_set_new(config->rule_locations, key, json_string(filename));
-        free(key);
-    }
+    // The rules in this file were added to the rule index above
     config->next_free_rule_id = next_free_rule_id;
 
 done:
-    json_decref(orig_file);
+    json_arena_free(&arena);
     json_decref(new_file);
     json_decref(new_json_rules);
     json_decref(new_json_profiles);
@@ -851,10 +1302,11 @@ static void app_profile_config_load_files_from_directory(AppProfileConfig *confi
         char *d_name = namelist[i]->d_name;
         char *full_path;
 
-        // Skip "." and ".."
-        if ((d_name[0] == '.') &&
-            ((d_name[1] == '\0') ||
-             ((d_name[1] == '.') && (d_name[2] == '\0')))) {
+        // Skip "." and "..", as well as hidden files: these include the
+        // ".backup" directory and temporary files left behind by an
+        // interrupted save (see app_profile_config_write_temp_file())
+        if (d_name[0] == '.') {
+            free(namelist[i]);
             continue;
         }
 
@@ -879,6 +1331,636 @@ static void app_profile_config_load_files_from_directory(AppProfileConfig *confi
     free(namelist);
 }
 
+/*
+ * Streaming validation of application profile files.
+ *
+ * The validator checks the same structure as app_profile_config_load_file(),
+ * but works from the events of json_parse_events() so that no JSON tree is
+ * built. Each open object or array has a frame on a stack saying what it is,
+ * and each frame records what the next value inside it is expected to be.
+ *
+ * Like json_loads(), which the loader uses, a member that appears more than
+ * once in an object only counts with its last value. So the problems found
+ * in the value of a member, as well as the profiles, rules and settings
+ * counted in it, are kept with the member (in a "slot" of the object's
+ * frame) and only passed up once the object ends; they are dropped if the
+ * member appears again.
+ */
+
+typedef enum {
+    APP_PROFILE_VALIDATE_SKIP,          // not checked
+    APP_PROFILE_VALIDATE_TOP,           // the top-level object
+    APP_PROFILE_VALIDATE_PROFILES,      // the "profiles" array
+    APP_PROFILE_VALIDATE_PROFILE,       // a member of "profiles"
+    APP_PROFILE_VALIDATE_RULES,         // the "rules" array
+    APP_PROFILE_VALIDATE_RULE,          // a member of "rules"
+    APP_PROFILE_VALIDATE_PATTERN,       // a pattern object
+    APP_PROFILE_VALIDATE_RULE_PROFILE,  // an inline profile object
+    APP_PROFILE_VALIDATE_SETTINGS,      // a settings array
+    APP_PROFILE_VALIDATE_SETTING,       // a setting object
+} AppProfileValidateKind;
+
+typedef enum {
+    APP_PROFILE_EXPECT_ANY,
+    APP_PROFILE_EXPECT_PROFILES,
+    APP_PROFILE_EXPECT_PROFILE,
+    APP_PROFILE_EXPECT_PROFILE_NAME,
+    APP_PROFILE_EXPECT_SETTINGS,
+    APP_PROFILE_EXPECT_RULES,
+    APP_PROFILE_EXPECT_RULE,
+    APP_PROFILE_EXPECT_PATTERN,
+    APP_PROFILE_EXPECT_PATTERN_STRING,
+    APP_PROFILE_EXPECT_RULE_PROFILE,
+    APP_PROFILE_EXPECT_RULE_PROFILE_NAME,
+    APP_PROFILE_EXPECT_SETTING,
+    APP_PROFILE_EXPECT_SETTING_KEY,
+    APP_PROFILE_EXPECT_SETTING_VALUE,
+    APP_PROFILE_EXPECT_SETTING_MEMBER,
+} AppProfileValidateExpect;
+
+// Members of objects which must be present
+#define APP_PROFILE_SEEN_NAME     0x1
+#define APP_PROFILE_SEEN_SETTINGS 0x2
+#define APP_PROFILE_SEEN_PATTERN  0x4
+#define APP_PROFILE_SEEN_PROFILE  0x8
+#define APP_PROFILE_SEEN_FEATURE  0x10
+#define APP_PROFILE_SEEN_MATCHES  0x20
+
+// Indices of the members of a setting object
+enum {
+    SETTING_MEMBER_KEY,
+    SETTING_MEMBER_K,
+    SETTING_MEMBER_VALUE,
+    SETTING_MEMBER_V,
+    NUM_SETTING_MEMBERS
+};
+
+// State of a setting object member
+enum {
+    SETTING_MEMBER_ABSENT,
+    SETTING_MEMBER_VALID,
+    SETTING_MEMBER_INVALID,
+};
+
+// Number of members checked in each kind of object (other than settings)
+#define APP_PROFILE_NUM_SLOTS 2
+
+typedef struct {
+    AppProfileValidateKind kind;
+    AppProfileValidateExpect expect;
+    unsigned int seen;
+    size_t count;               // number of array elements so far
+    int uses_setting_objects;   // for settings arrays
+    int member;                 // setting object member being parsed
+    char member_state[NUM_SETTING_MEMBERS];
+    int slot;                   // checked member being parsed, or -1
+    char *slot_error[APP_PROFILE_NUM_SLOTS];
+    AppProfileFileSummary slot_summary[APP_PROFILE_NUM_SLOTS];
+} AppProfileValidateFrame;
+
+typedef struct {
+    AppProfileValidateFrame *frames;
+    size_t num_frames;
+    size_t frames_alloc;
+    AppProfileFileSummary *summary;
+    char *error;
+} AppProfileValidateState;
+
+/*
+ * Add a problem (if error is non-NULL) and counts (if summary is non-NULL) to
+ * the slot of the innermost member being parsed; outside of any member, they
+ * are final. Only the first problem is kept.
+ */
+static void app_profile_validate_record(AppProfileValidateState *state,
+                                        char *error,
+                                        const AppProfileFileSummary *summary)
+{
+    AppProfileValidateFrame *frame;
+    AppProfileFileSummary *dest = state->summary;
+    char **dest_error = &state->error;
+    size_t i;
+
+    for (i = state->num_frames; i > 0; i--) {
+        frame = &state->frames[i - 1];
+        if (frame->slot >= 0) {
+            dest = &frame->slot_summary[frame->slot];
+            dest_error = &frame->slot_error[frame->slot];
+            break;
+        }
+    }
+
+    if (error && !*dest_error) {
+        *dest_error = error;
+    } else {
+        free(error);
+    }
+
+    if (summary && dest) {
+        dest->num_profiles += summary->num_profiles;
+        dest->num_rules += summary->num_rules;
+        dest->num_settings += summary->num_settings;
+    }
+}
+
+static void app_profile_validate_fail(AppProfileValidateState *state,
+                                      const char *msg)
+{
+    app_profile_validate_record(state, nvstrdup(msg), NULL);
+}
+
+static void app_profile_validate_count(AppProfileValidateState *state,
+                                       size_t num_profiles,
+                                       size_t num_rules,
+                                       size_t num_settings)
+{
+    AppProfileFileSummary summary;
+
+    summary.num_profiles = num_profiles;
+    summary.num_rules = num_rules;
+    summary.num_settings = num_settings;
+    app_profile_validate_record(state, NULL, &summary);
+}
+
+static void app_profile_validate_push(AppProfileValidateState *state,
+                                      AppProfileValidateKind kind)
+{
+    AppProfileValidateFrame *frame;
+
+    if (state->num_frames == state->frames_alloc) {
+        state->frames_alloc = state->frames_alloc ? state->frames_alloc * 2 : 16;
+        state->frames = nvrealloc(state->frames,
+                                  state->frames_alloc * sizeof(*frame));
+    }
+
+    frame = &state->frames[state->num_frames++];
+    memset(frame, 0, sizeof(*frame));
+    frame->kind = kind;
+    frame->slot = -1;
+}
+
+static void app_profile_validate_clear_slots(AppProfileValidateFrame *frame)
+{
+    int i;
+
+    for (i = 0; i < APP_PROFILE_NUM_SLOTS; i++) {
+        free(frame->slot_error[i]);
+        frame->slot_error[i] = NULL;
+    }
+}
+
+static int is_setting_value_event(json_event_type type)
+{
+    return type == JSON_EVENT_STRING || type == JSON_EVENT_INTEGER ||
+           type == JSON_EVENT_REAL || type == JSON_EVENT_TRUE ||
+           type == JSON_EVENT_FALSE;
+}
+
+/*
+ * Work out what the next element of the array described by frame should be.
+ * The first element of a settings array decides its layout, as in
+ * json_settings_parse().
+ */
+static AppProfileValidateExpect
+app_profile_validate_array_expect(AppProfileValidateFrame *frame,
+                                  json_event_type type)
+{
+    switch (frame->kind) {
+    case APP_PROFILE_VALIDATE_PROFILES:
+        return APP_PROFILE_EXPECT_PROFILE;
+    case APP_PROFILE_VALIDATE_RULES:
+        return APP_PROFILE_EXPECT_RULE;
+    case APP_PROFILE_VALIDATE_SETTINGS:
+        if (frame->count == 0) {
+            frame->uses_setting_objects = (type == JSON_EVENT_OBJECT_START);
+        }
+        if (frame->uses_setting_objects) {
+            return APP_PROFILE_EXPECT_SETTING;
+        }
+        return (frame->count % 2) ? APP_PROFILE_EXPECT_SETTING_VALUE :
+                                    APP_PROFILE_EXPECT_SETTING_KEY;
+    default:
+        return APP_PROFILE_EXPECT_ANY;
+    }
+}
+
+/*
+ * Record the key of an object member, and what its value should be.
+ */
+static void app_profile_validate_key(AppProfileValidateFrame *frame,
+                                     const char *key)
+{
+    AppProfileValidateExpect expect = APP_PROFILE_EXPECT_ANY;
+    unsigned int seen = 0;
+    int slot = -1;
+
+    switch (frame->kind) {
+    case APP_PROFILE_VALIDATE_TOP:
+        if (!strcmp(key, "profiles")) {
+            expect = APP_PROFILE_EXPECT_PROFILES;
+            slot = 0;
+        } else if (!strcmp(key, "rules")) {
+            expect = APP_PROFILE_EXPECT_RULES;
+            slot = 1;
+        }
+        break;
+    case APP_PROFILE_VALIDATE_PROFILE:
+        if (!strcmp(key, "name")) {
+            expect = APP_PROFILE_EXPECT_PROFILE_NAME;
+            seen = APP_PROFILE_SEEN_NAME;
+            slot = 0;
+        } else if (!strcmp(key, "settings")) {
+            expect = APP_PROFILE_EXPECT_SETTINGS;
+            seen = APP_PROFILE_SEEN_SETTINGS;
+            slot = 1;
+        }
+        break;
+    case APP_PROFILE_VALIDATE_RULE:
+        if (!strcmp(key, "pattern")) {
+            expect = APP_PROFILE_EXPECT_PATTERN;
+            seen = APP_PROFILE_SEEN_PATTERN;
+            slot = 0;
+        } else if (!strcmp(key, "profile")) {
+            expect = APP_PROFILE_EXPECT_RULE_PROFILE;
+            seen = APP_PROFILE_SEEN_PROFILE;
+            slot = 1;
+        }
+        break;
+    case APP_PROFILE_VALIDATE_PATTERN:
+        if (!strcmp(key, "feature")) {
+            expect = APP_PROFILE_EXPECT_PATTERN_STRING;
+            seen = APP_PROFILE_SEEN_FEATURE;
+            slot = 0;
+        } else if (!strcmp(key, "matches")) {
+            expect = APP_PROFILE_EXPECT_PATTERN_STRING;
+            seen = APP_PROFILE_SEEN_MATCHES;
+            slot = 1;
+        }
+        break;
+    case APP_PROFILE_VALIDATE_RULE_PROFILE:
+        if (!strcmp(key, "name")) {
+            expect = APP_PROFILE_EXPECT_RULE_PROFILE_NAME;
+            slot = 0;
+        } else if (!strcmp(key, "settings")) {
+            expect = APP_PROFILE_EXPECT_SETTINGS;
+            seen = APP_PROFILE_SEEN_SETTINGS;
+            slot = 1;
+        }
+        break;
+    case APP_PROFILE_VALIDATE_SETTING:
+        if (!strcmp(key, "key")) {
+            frame->member = SETTING_MEMBER_KEY;
+        } else if (!strcmp(key, "k")) {
+            frame->member = SETTING_MEMBER_K;
+        } else if (!strcmp(key, "value")) {
+            frame->member = SETTING_MEMBER_VALUE;
+        } else if (!strcmp(key, "v")) {
+            frame->member = SETTING_MEMBER_V;
+        } else {
+            break;
+        }
+        expect = APP_PROFILE_EXPECT_SETTING_MEMBER;
+        break;
+    default:
+        break;
+    }
+
+    frame->expect = expect;
+    frame->seen |= seen;
+    frame->slot = slot;
+
+    // A repeated member replaces the earlier value
+    if (slot >= 0) {
+        free(frame->slot_error[slot]);
+        frame->slot_error[slot] = NULL;
+        memset(&frame->slot_summary[slot], 0,
+               sizeof(frame->slot_summary[slot]));
+    }
+}
+
+/*
+ * Check a value (a scalar, or the start of an object or array) against what
+ * the enclosing frame expects, and push a frame for objects and arrays.
+ */
+static int app_profile_validate_value(AppProfileValidateState *state,
+                                      json_event_type type)
+{
+    AppProfileValidateFrame *frame;
+    AppProfileValidateExpect expect;
+    int is_object = (type == JSON_EVENT_OBJECT_START);
+    int is_array = (type == JSON_EVENT_ARRAY_START);
+    int is_string = (type == JSON_EVENT_STRING);
+
+    if (state->num_frames == 0) {
+        if (!is_object) {
+            state->error = nvstrdup("top-level config not an object!");
+            return -1;
+        }
+        app_profile_validate_push(state, APP_PROFILE_VALIDATE_TOP);
+        return 0;
+    }
+
+    frame = &state->frames[state->num_frames - 1];
+    if (frame->kind == APP_PROFILE_VALIDATE_PROFILES ||
+        frame->kind == APP_PROFILE_VALIDATE_RULES ||
+        frame->kind == APP_PROFILE_VALIDATE_SETTINGS) {
+        expect = app_profile_validate_array_expect(frame, type);
+        frame->count++;
+    } else {
+        // Object members; nothing inside a skipped value is expected
+        expect = frame->expect;
+    }
+
+    switch (expect) {
+    case APP_PROFILE_EXPECT_ANY:
+        break;
+    case APP_PROFILE_EXPECT_PROFILES:
+        if (!is_array) {
+            app_profile_validate_fail(state, "profiles value is not an array");
+            break;
+        }
+        app_profile_validate_push(state, APP_PROFILE_VALIDATE_PROFILES);
+        return 0;
+    case APP_PROFILE_EXPECT_RULES:
+        if (!is_array) {
+            app_profile_validate_fail(state, "rules value is not an array");
+            break;
+        }
+        app_profile_validate_push(state, APP_PROFILE_VALIDATE_RULES);
+        return 0;
+    case APP_PROFILE_EXPECT_PROFILE:
+        if (!is_object) {
+            app_profile_validate_fail(state, "profile is not an object");
+            break;
+        }
+        app_profile_validate_push(state, APP_PROFILE_VALIDATE_PROFILE);
+        return 0;
+    case APP_PROFILE_EXPECT_RULE:
+        if (!is_object) {
+            app_profile_validate_fail(state, "rule is not an object");
+            break;
+        }
+        app_profile_validate_push(state, APP_PROFILE_VALIDATE_RULE);
+        return 0;
+    case APP_PROFILE_EXPECT_PROFILE_NAME:
+    case APP_PROFILE_EXPECT_RULE_PROFILE_NAME:
+        if (!is_string) {
+            app_profile_validate_fail(state, "profile name is not a string");
+            break;
+        }
+        break;
+    case APP_PROFILE_EXPECT_SETTINGS:
+        if (!is_array) {
+            app_profile_validate_fail(state, "settings value is not an array");
+            break;
+        }
+        app_profile_validate_push(state, APP_PROFILE_VALIDATE_SETTINGS);
+        return 0;
+    case APP_PROFILE_EXPECT_PATTERN:
+        if (is_object) {
+            app_profile_validate_push(state, APP_PROFILE_VALIDATE_PATTERN);
+            return 0;
+        }
+        if (!is_string) {
+            app_profile_validate_fail(state, "rule pattern is not an object or a string");
+            break;
+        }
+        break;
+    case APP_PROFILE_EXPECT_PATTERN_STRING:
+        if (!is_string) {
+            app_profile_validate_fail(state, "rule pattern feature or match is not a string");
+            break;
+        }
+        break;
+    case APP_PROFILE_EXPECT_RULE_PROFILE:
+        if (is_object) {
+            app_profile_validate_push(state, APP_PROFILE_VALIDATE_RULE_PROFILE);
+            return 0;
+        }
+        if (is_array) {
+            // An array is the settings of an unnamed inline profile
+            app_profile_validate_count(state, 1, 0, 0);
+            app_profile_validate_push(state, APP_PROFILE_VALIDATE_SETTINGS);
+            return 0;
+        }
+        if (!is_string) {
+            app_profile_validate_fail(state, "rule profile is not an object, array or string");
+            break;
+        }
+        break;
+    case APP_PROFILE_EXPECT_SETTING:
+        if (!is_object) {
+            app_profile_validate_fail(state, "Invalid key detected in settings array");
+            break;
+        }
+        app_profile_validate_push(state, APP_PROFILE_VALIDATE_SETTING);
+        return 0;
+    case APP_PROFILE_EXPECT_SETTING_KEY:
+        if (!is_string) {
+            app_profile_validate_fail(state, "Invalid key detected in settings array");
+            break;
+        }
+        break;
+    case APP_PROFILE_EXPECT_SETTING_VALUE:
+        if (!is_setting_value_event(type)) {
+            app_profile_validate_fail(state, "Invalid value detected in settings array");
+            break;
+        }
+        app_profile_validate_count(state, 0, 0, 1);
+        break;
+    case APP_PROFILE_EXPECT_SETTING_MEMBER:
+        // Checked when the setting object ends, as "key" and "value" take
+        // precedence over "k" and "v"
+        if (frame->member == SETTING_MEMBER_KEY ||
+            frame->member == SETTING_MEMBER_K) {
+            frame->member_state[frame->member] =
+                is_string ? SETTING_MEMBER_VALID : SETTING_MEMBER_INVALID;
+        } else {
+            frame->member_state[frame->member] =
+                is_setting_value_event(type) ? SETTING_MEMBER_VALID :
+                                               SETTING_MEMBER_INVALID;
+        }
+        break;
+    }
+
+    if (is_object || is_array) {
+        app_profile_validate_push(state, APP_PROFILE_VALIDATE_SKIP);
+    }
+
+    return 0;
+}
+
+/*
+ * Check that an object or array that has just ended had everything it needs.
+ */
+static int app_profile_validate_end(AppProfileValidateState *state)
+{
+    AppProfileValidateFrame *frame = &state->frames[--state->num_frames];
+    int key, value;
+    int i;
+
+    // The last value of each member is final now
+    for (i = 0; i < APP_PROFILE_NUM_SLOTS; i++) {
+        app_profile_validate_record(state, frame->slot_error[i],
+                                    &frame->slot_summary[i]);
+        frame->slot_error[i] = NULL;
+    }
+
+    switch (frame->kind) {
+    case APP_PROFILE_VALIDATE_PROFILE:
+        if (!(frame->seen & APP_PROFILE_SEEN_NAME)) {
+            app_profile_validate_fail(state, "profile has no name");
+            break;
+        }
+        if (!(frame->seen & APP_PROFILE_SEEN_SETTINGS)) {
+            app_profile_validate_fail(state, "profile has no settings");
+            break;
+        }
+        app_profile_validate_count(state, 1, 0, 0);
+        break;
+    case APP_PROFILE_VALIDATE_RULE:
+        if (!(frame->seen & APP_PROFILE_SEEN_PATTERN)) {
+            app_profile_validate_fail(state, "rule has no pattern");
+            break;
+        }
+        if (!(frame->seen & APP_PROFILE_SEEN_PROFILE)) {
+            app_profile_validate_fail(state, "rule has no profile");
+            break;
+        }
+        app_profile_validate_count(state, 0, 1, 0);
+        break;
+    case APP_PROFILE_VALIDATE_PATTERN:
+        if (!(frame->seen & APP_PROFILE_SEEN_FEATURE) ||
+            !(frame->seen & APP_PROFILE_SEEN_MATCHES)) {
+            app_profile_validate_fail(state, "rule pattern needs a feature and a match");
+        }
+        break;
+    case APP_PROFILE_VALIDATE_RULE_PROFILE:
+        if (!(frame->seen & APP_PROFILE_SEEN_SETTINGS)) {
+            app_profile_validate_fail(state, "profile has no settings");
+            break;
+        }
+        app_profile_validate_count(state, 1, 0, 0);
+        break;
+    case APP_PROFILE_VALIDATE_SETTINGS:
+        if (!frame->uses_setting_objects && (frame->count % 2)) {
+            app_profile_validate_fail(state, "Key/value array of odd length");
+        }
+        break;
+    case APP_PROFILE_VALIDATE_SETTING:
+        key = frame->member_state[SETTING_MEMBER_KEY];
+        if (key == SETTING_MEMBER_ABSENT) {
+            key = frame->member_state[SETTING_MEMBER_K];
+        }
+        value = frame->member_state[SETTING_MEMBER_VALUE];
+        if (value == SETTING_MEMBER_ABSENT) {
+            value = frame->member_state[SETTING_MEMBER_V];
+        }
+        if (key != SETTING_MEMBER_VALID) {
+            app_profile_validate_fail(state, "Invalid key detected in settings array");
+            break;
+        }
+        if (value != SETTING_MEMBER_VALID) {
+            app_profile_validate_fail(state, "Invalid value detected in settings array");
+            break;
+        }
+        app_profile_validate_count(state, 0, 0, 1);
+        break;
+    default:
+        break;
+    }
+
+    return 0;
+}
+
+static int app_profile_validate_event(const json_event_t *event, void *data)
+{
+    AppProfileValidateState *state = data;
+
+    switch (event->type) {
+    case JSON_EVENT_KEY:
+        app_profile_validate_key(&state->frames[state->num_frames - 1],
+                                 event->string);
+        return 0;
+    case JSON_EVENT_OBJECT_END:
+    case JSON_EVENT_ARRAY_END:
+        return app_profile_validate_end(state);
+    default:
+        return app_profile_validate_value(state, event->type);
+    }
+}
+
+int nv_app_profile_file_validate(const char *filename,
+                                 AppProfileFileSummary *summary,
+                                 char **error_str)
+{
+    FILE *fp;
+    struct stat stat_buf;
+    char *orig_text = NULL;
+    char *json_text = NULL;
+    char *error = NULL;
+    json_error_t json_error;
+    AppProfileValidateState state;
+    size_t i;
+
+    memset(&state, 0, sizeof(state));
+    if (summary) {
+        memset(summary, 0, sizeof(*summary));
+        state.summary = summary;
+    }
+
+    if (open_and_stat(filename, "r", &fp, &stat_buf) < 0) {
+        error = nvasprintf("Could not open %s: %s", filename, strerror(errno));
+        goto done;
+    }
+
+    orig_text = slurp(fp);
+    fclose(fp);
+
+    if (!orig_text) {
+        error = nvasprintf("Could not read from file %s", filename);
+        goto done;
+    }
+
+    json_text = nv_app_profile_file_syntax_to_json(orig_text);
+    if (!json_text) {
+        error = nvasprintf("App profile parse error in %s: text is not valid "
+                           "app profile configuration syntax", filename);
+        goto done;
+    }
+
+    // JSON_DECODE_ANY, so that a non-object is reported by the validator
+    if (json_parse_events(json_text, JSON_DECODE_ANY,
+                          app_profile_validate_event, &state,
+                          &json_error)) {
+        error = nvasprintf("App profile parse error in %s: %s on %s, line %d",
+                           filename,
+                           state.error ? state.error : json_error.text,
+                           json_error.source, json_error.line);
+    } else if (state.error) {
+        // Problems are only final once the enclosing object has ended, so
+        // there is no useful position to report
+        error = nvasprintf("App profile parse error in %s: %s",
+                           filename, state.error);
+    }
+
+done:
+    for (i = 0; i < state.num_frames; i++) {
+        app_profile_validate_clear_slots(&state.frames[i]);
+    }
+    free(state.frames);
+    free(state.error);
+    free(json_text);
+    free(orig_text);
+
+    if (error_str) {
+        *error_str = error;
+    } else {
+        free(error);
+    }
+
+    return error == NULL;
+}
+
 static json_t *app_profile_config_load_global_options(const char *global_config_file)
 {
     json_error_t error;
@@ -944,7 +2026,10 @@ AppProfileConfig *nv_app_profile_config_load(const char *global_config_file,
 
     config->parsed_files = json_array();
     config->profile_locations = json_object();
-    config->rule_locations = json_object();
+    config->rule_locations = NULL;
+    config->rule_locations_size = 0;
+    config->rules_before_file = NULL;
+    app_profile_config_count_file_rules(config);
 
     if (global_config_file) {
         config->global_config_file = nvstrdup(global_config_file);
@@ -1061,6 +2146,9 @@ static int app_profile_config_backup_file(AppProfileConfig *config,
     int ret;
     char *backup_name = nv_app_profile_config_get_backup_filename(config, filename);
     char *backup_dirname = nv_dirname(backup_name);
+    struct stat stat_buf;
+    int is_symlink = (lstat(filename, &stat_buf) == 0) &&
+                     S_ISLNK(stat_buf.st_mode);
 
     ret = nv_mkdirp(backup_dirname, error_str);
     if (ret < 0) {
@@ -1069,7 +2157,22 @@ static int app_profile_config_backup_file(AppProfileConfig *config,
         goto done;
     }
 
-    ret = rename(filename, backup_name);
+    // Hard link the backup where possible, so the original file stays in
+    // place until it is atomically replaced by the updated file
+    if ((unlink(backup_name) < 0) && (errno != ENOENT)) {
+        LOG_ERROR(error_str, "Could not remove the old backup file \"%s\" (%s)",
+                  backup_name, strerror(errno));
+        ret = -1;
+        goto done;
+    }
+
+    // Link the file a symlink points to, rather than the symlink itself;
+    // renaming a symlink out of the way would break it
+    ret = linkat(AT_FDCWD, filename, AT_FDCWD, backup_name,
+                 AT_SYMLINK_FOLLOW);
+    if ((ret < 0) && (errno != ENOENT) && !is_symlink) {
+        ret = rename(filename, backup_name);
+    }
     if (ret < 0) {
         if (errno == ENOENT) {
             // Clear the error; the file does not exist
@@ -1089,6 +2192,66 @@ done:
 }
 
 
+/*
+ * Write the given text to a new temporary file in the same directory as
+ * filename, which the caller can then rename over filename. The temporary
+ * file is hidden, so that the directory loader never reads it as a profile
+ * file. Returns the name of the temporary file, or NULL on failure.
+ */
+static char *app_profile_config_write_temp_file(const char *filename,
+                                                const char *text,
+                                                mode_t mode,
+                                                char **error_str)
+{
+    char *dirname = nv_dirname(filename);
+    char *basename = nv_basename(filename);
+    char *tmp_filename = nvasprintf("%s/.%s.XXXXXX", dirname, basename);
+    FILE *fp = NULL;
+    int fd;
+
+    free(dirname);
+    free(basename);
+
+    fd = mkstemp(tmp_filename);
+    if (fd < 0) {
+        LOG_ERROR(error_str, "Could not create a temporary file for \"%s\" (%s)",
+                  filename, strerror(errno));
+        goto fail;
+    }
+
+    fp = fdopen(fd, "w");
+    if (!fp) {
+        close(fd);
+        LOG_ERROR(error_str, "Could not write to the file \"%s\" (%s)",
+                  tmp_filename, strerror(errno));
+        goto fail_unlink;
+    }
+
+    if ((fchmod(fd, mode) < 0) ||
+        (fprintf(fp, "%s\n", text) < 0) ||
+        (fflush(fp) != 0) ||
+        (fsync(fd) < 0)) {
+        LOG_ERROR(error_str, "Could not write to the file \"%s\" (%s)",
+                  tmp_filename, strerror(errno));
+        fclose(fp);
+        goto fail_unlink;
+    }
+
+    if (fclose(fp) != 0) {
+        LOG_ERROR(error_str, "Could not write to the file \"%s\" (%s)",
+                  tmp_filename, strerror(errno));
+        goto fail_unlink;
+    }
+
+    return tmp_filename;
+
+fail_unlink:
+    unlink(tmp_filename);
+fail:
+    free(tmp_filename);
+    return NULL;
+}
+
 static int app_profile_config_save_updates_to_file(AppProfileConfig *config,
                                                    const char *filename,
                                                    const char *update_text,
@@ -1098,7 +2261,10 @@ static int app_profile_config_save_updates_to_file(AppProfileConfig *config,
     int file_is_new = FALSE;
     struct stat stat_buf;
     char *dirname = NULL;
-    FILE *fp;
+    char *tmp_filename = NULL;
+    char *real_filename = NULL;
+    const char *target_filename = filename;
+    mode_t mode, old_umask;
     int ret;
 
     ret = stat(filename, &stat_buf);
@@ -1136,6 +2302,10 @@ static int app_profile_config_save_updates_to_file(AppProfileConfig *config,
                     }
                 }
                 ret = unlink(dirname);
+                if ((ret < 0) && backup && (errno == ENOENT)) {
+                    // The backup could not be linked and was renamed instead
+                    ret = 0;
+                }
                 if (ret < 0) {
                     LOG_ERROR(error_str,
                               "Could not remove the file \"%s\" (%s)",
@@ -1165,24 +2335,65 @@ static int app_profile_config_save_updates_to_file(AppProfileConfig *config,
         goto done;
     }
 
+    // If the file is a symlink, update the file it points to rather than
+    // replacing the symlink with a regular file
+    if (!file_is_new) {
+        struct stat lstat_buf;
+
+        if ((lstat(filename, &lstat_buf) == 0) &&
+            S_ISLNK(lstat_buf.st_mode)) {
+            real_filename = realpath(filename, NULL);
+            if (!real_filename) {
+                ret = -1;
+                LOG_ERROR(error_str,
+                          "Could not resolve the symbolic link \"%s\" (%s)",
+                          filename, strerror(errno));
+                goto done;
+            }
+            target_filename = real_filename;
+        }
+    }
+
+    // Preserve the permissions of an existing file; otherwise, honor the
+    // umask as fopen(3) would
+    if (file_is_new) {
+        old_umask = umask(0);
+        umask(old_umask);
+        mode = 0666 & ~old_umask;
+    } else {
+        mode = stat_buf.st_mode & 07777;
+    }
+
+    // Write the complete update to a temporary file first, so that a failed
+    // write never leaves a truncated configuration file behind
+    tmp_filename = app_profile_config_write_temp_file(target_filename,
+                                                      update_text,
+                                                      mode, error_str);
+    if (!tmp_filename) {
+        ret = -1;
+        goto done;
+    }
+
     if (!file_is_new && backup) {
         ret = app_profile_config_backup_file(config, filename,
                                              error_str);
         if (ret < 0) {
+            unlink(tmp_filename);
             goto done;
         }
     }
-    ret = open_and_stat(filename, "w", &fp, &stat_buf);
+
+    nv_info_msg("", "Writing to configuration file \"%s\"\n", filename);
+    ret = rename(tmp_filename, target_filename);
     if (ret < 0) {
         LOG_ERROR(error_str, "Could not write to the file \"%s\" (%s)",
-                  filename, strerror(errno));
-        goto done;
+                  target_filename, strerror(errno));
+        unlink(tmp_filename);
     }
-    nv_info_msg("", "Writing to configuration file \"%s\"\n", filename);
-    fprintf(fp, "%s\n", update_text);
-    fclose(fp);
 
 done:
+    free(tmp_filename);
+    free(real_filename);
     free(dirname);
     return ret;
 }
@@ -1235,8 +2446,14 @@ AppProfileConfig *nv_app_profile_config_dup(AppProfileConfig *config)
     new_config = malloc(sizeof(AppProfileConfig));
     new_config->parsed_files = json_deep_copy(config->parsed_files);
     new_config->profile_locations = json_deep_copy(config->profile_locations);
-    new_config->rule_locations = json_deep_copy(config->rule_locations);
+    new_config->rule_locations_size = config->rule_locations_size;
+    new_config->rule_locations =
+        nvalloc(sizeof(AppProfileRuleLocation) * config->rule_locations_size);
+    memcpy(new_config->rule_locations, config->rule_locations,
+           sizeof(AppProfileRuleLocation) * config->rule_locations_size);
     new_config->next_free_rule_id = config->next_free_rule_id;
+    new_config->rules_before_file = NULL;
+    app_profile_config_count_file_rules(new_config);
 
     new_config->global_config_file =
         config->global_config_file ? strdup(config->global_config_file) : NULL;
@@ -1278,7 +2495,8 @@ void nv_app_profile_config_free(AppProfileConfig *config)
     json_decref(config->global_options);
     json_decref(config->parsed_files);
     json_decref(config->profile_locations);
-    json_decref(config->rule_locations);
+    free(config->rule_locations);
+    free(config->rules_before_file);
 
     for (i = 0; i < config->search_path_count; i++) {
         free(config->search_path[i]);
@@ -1320,6 +2538,7 @@ static void app_profile_config_delete_file(AppProfileConfig *config, const char
         json_filename = json_object_get(json_file, "filename");
         if (!strcmp(json_string_value(json_filename), filename)) {
             json_array_remove(config->parsed_files, i);
+            app_profile_config_reindex_files(config, i);
             return;
         }
     }
@@ -1415,16 +2634,21 @@ fail:
     return output;
 }
 
-static void add_files_from_config(AppProfileConfig *config, json_t *all_files, json_t *changed_files)
+/*
+ * Dirty files always need to be written out; modified files only need to be
+ * written out if their contents differ from the original configuration.
+ */
+static void add_files_from_config(AppProfileConfig *config, json_t *modified_files, json_t *changed_files)
 {
     json_t *file, *filename;
     size_t i, size;
     for (i = 0, size = json_array_size(config->parsed_files); i < size; i++) {
         file = json_array_get(config->parsed_files, i);
         filename = json_object_get(file, "filename");
-        json_object_set_new(all_files, json_string_value(filename), json_true());
         if (json_is_true(json_object_get(file, "dirty"))) {
             json_object_set_new(changed_files, json_string_value(filename), json_true());
+        } else if (json_is_true(json_object_get(file, "modified"))) {
+            json_object_set_new(modified_files, json_string_value(filename), json_true());
         }
     }
 }
@@ -1453,7 +2677,7 @@ static json_t *app_profile_config_validate_global_options(AppProfileConfig *new_
 json_t *nv_app_profile_config_validate(AppProfileConfig *new_config,
                                        AppProfileConfig *old_config)
 {
-    json_t *all_files, *changed_files;
+    json_t *modified_files, *changed_files;
     json_t *new_file, *new_rules, *old_rules;
     json_t *old_file, *new_profiles, *old_profiles;
     json_t *updates, *update;
@@ -1469,15 +2693,20 @@ json_t *nv_app_profile_config_validate(AppProfileConfig *new_config,
         json_array_append_new(updates, update);
     }
 
-    // Build a set of files to examine: this is the union of files specified
-    // by the old configuration and the new.
-    all_files = json_object();
+    // Build a set of files to examine: this is the union of files edited
+    // in the old configuration and the new. Files which were not edited
+    // in either configuration cannot have changed.
+    modified_files = json_object();
     changed_files = json_object();
-    add_files_from_config(new_config, all_files, changed_files);
-    add_files_from_config(old_config, all_files, changed_files);
+    add_files_from_config(new_config, modified_files, changed_files);
+    add_files_from_config(old_config, modified_files, changed_files);
 
     // For each file in the set, determine if it needs to be updated
-    NV_JSON_OBJECT_FOREACH(all_files, filename, unused) {
+    NV_JSON_OBJECT_FOREACH(modified_files, filename, unused) {
+        if (json_object_get(changed_files, filename)) {
+            continue;
+        }
+
         app_profile_config_get_per_file_config(new_config, filename, &new_file, &new_rules, &new_profiles);
         app_profile_config_get_per_file_config(old_config, filename, &old_file, &old_rules, &old_profiles);
 
@@ -1501,7 +2730,7 @@ json_t *nv_app_profile_config_validate(AppProfileConfig *new_config,
         free(update_text);
     }
 
-    json_decref(all_files);
+    json_decref(modified_files);
     json_decref(changed_files);
 
     return updates;
@@ -1557,6 +2786,7 @@ int nv_app_profile_config_update_profile(AppProfileConfig *config,
         file_profiles = json_object_get(file, "profiles");
         if (file) {
             json_object_del(file_profiles, profile_name);
+            app_profile_config_mark_file_modified(file);
         }
     }
 
@@ -1567,6 +2797,7 @@ int nv_app_profile_config_update_profile(AppProfileConfig *config,
 
     file_profiles = json_object_get(file, "profiles");
     json_object_set(file_profiles, profile_name, new_profile);
+    app_profile_config_mark_file_modified(file);
     json_object_set(config->profile_locations, profile_name, json_string(filename));
 
     if (old_file) {
@@ -1586,6 +2817,7 @@ void nv_app_profile_config_delete_profile(AppProfileConfig *config,
         file = app_profile_config_lookup_file(config, filename);
         if (file) {
             json_object_del(json_object_get(file, "profiles"), profile_name);
+            app_profile_config_mark_file_modified(file);
         }
     }
 
@@ -1600,7 +2832,6 @@ int nv_app_profile_config_create_rule(AppProfileConfig *config,
                                       const char *filename,
                                       json_t *new_rule)
 {
-    char *key;
     json_t *file, *file_rules;
     json_t *new_rule_copy;
     int new_id;
@@ -1619,28 +2850,12 @@ int nv_app_profile_config_create_rule(AppProfileConfig *config,
     new_id = config->next_free_rule_id++;
     json_object_set_new(new_rule_copy, "id", json_integer(new_id));
 
-    key = rule_id_to_key_string(new_id);
-    json_object_set(config->rule_locations, key, json_string(filename));
-    free(key);
+    app_profile_config_reindex_file(config, file);
+    app_profile_config_mark_file_modified(file);
 
     return new_id;
 }
 
-static int lookup_rule_index_in_array(json_t *rules, int id)
-{
-    json_t *rule, *rule_id;
-    size_t i, size;
-    for (i = 0, size = json_array_size(rules); i < size; i++) {
-        rule = json_array_get(rules, i);
-        rule_id = json_object_get(rule, "id");
-        if (json_integer_value(rule_id) == id) {
-            return i;
-        }
-    }
-
-    return -1;
-}
-
 int nv_app_profile_config_update_rule(AppProfileConfig *config,
                                       const char *filename,
                                       int id,
@@ -1649,18 +2864,19 @@ int nv_app_profile_config_update_rule(AppProfileConfig *config,
     json_t *old_file, *new_file;
     json_t *old_file_rules, *new_file_rules;
     json_t *new_rule_copy;
+    const AppProfileRuleLocation *loc;
     const char *old_filename;
-    char *key;
     int idx;
     int rule_moved;
 
-    key = rule_id_to_key_string(id);
-    old_filename = json_string_value(json_object_get(config->rule_locations, key));
-    assert(old_filename);
+    loc = app_profile_config_get_rule_location(config, id);
+    assert(loc);
 
-    old_file = app_profile_config_lookup_file(config, old_filename);
+    old_file = json_array_get(config->parsed_files, loc->file_idx);
     assert(old_file);
 
+    idx = loc->rule_idx;
+    old_filename = json_string_value(json_object_get(old_file, "filename"));
     old_file_rules = json_object_get(old_file, "rules");
 
     if (filename && (strcmp(filename, old_filename) != 0)) {
@@ -1673,28 +2889,23 @@ int nv_app_profile_config_update_rule(AppProfileConfig *config,
 
         new_file_rules = json_object_get(new_file, "rules");
 
-        idx = lookup_rule_index_in_array(old_file_rules, id);
-        if (idx != -1) {
-            json_array_remove(old_file_rules, idx);
-        }
+        json_array_remove(old_file_rules, idx);
         json_array_insert(new_file_rules, 0, new_rule);
         new_rule_copy = json_array_get(new_file_rules, 0);
         json_object_set_new(new_rule_copy, "id", json_integer(id));
 
-        json_object_set_new(config->rule_locations, key, json_string(filename));
+        app_profile_config_reindex_file(config, old_file);
+        app_profile_config_reindex_file(config, new_file);
+        app_profile_config_mark_file_modified(new_file);
     } else {
         // Otherwise, just edit the existing rule
         rule_moved = FALSE;
-        idx = lookup_rule_index_in_array(old_file_rules, id);
-        if (idx != -1) {
-            json_array_set(old_file_rules, idx, new_rule);
-            new_rule_copy = json_array_get(old_file_rules, idx);
-            json_object_set_new(new_rule_copy, "id", json_integer(id));
-        }
+        json_array_set(old_file_rules, idx, new_rule);
+        new_rule_copy = json_array_get(old_file_rules, idx);
+        json_object_set_new(new_rule_copy, "id", json_integer(id));
     }
 
-    free(key);
-
+    app_profile_config_mark_file_modified(old_file);
     app_profile_config_prune_empty_file(config, old_file);
 
     return rule_moved;
@@ -1704,50 +2915,27 @@ int nv_app_profile_config_update_rule(AppProfileConfig *config,
 void nv_app_profile_config_delete_rule(AppProfileConfig *config, int id)
 {
     json_t *file, *file_rules;
-    const char *filename;
-    char *key;
+    const AppProfileRuleLocation *loc;
     int idx;
 
-    key = rule_id_to_key_string(id);
-
-    filename = json_string_value(json_object_get(config->rule_locations, key));
-    assert(filename);
+    loc = app_profile_config_get_rule_location(config, id);
+    assert(loc);
 
-    file = app_profile_config_lookup_file(config, filename);
+    file = json_array_get(config->parsed_files, loc->file_idx);
     assert(file);
 
+    idx = loc->rule_idx;
     file_rules = json_object_get(file, "rules");
+    json_array_remove(file_rules, idx);
 
-    idx = lookup_rule_index_in_array(file_rules, id);
-    if (idx != -1) {
-        json_array_remove(file_rules, idx);
-    }
-
-    json_object_del(config->rule_locations, key);
-    free(key);
+    app_profile_config_set_rule_location(config, id, -1, -1);
+    app_profile_config_reindex_file(config, file);
+    app_profile_config_mark_file_modified(file);
 }
 
 size_t nv_app_profile_config_count_rules(AppProfileConfig *config)
 {
-    return json_object_size(config->rule_locations);
-}
-
-static size_t app_profile_config_count_rules_before(AppProfileConfig *config, const char *filename)
-{
-    size_t i, size;
-    size_t num_rules = 0;
-    json_t *cur_file, *cur_filename;
-
-    for (i = 0, size = json_array_size(config->parsed_files); i < size; i++) {
-        cur_file = json_array_get(config->parsed_files, i);
-        cur_filename = json_object_get(cur_file, "filename");
-        if (!strcmp(filename, json_string_value(cur_filename))) {
-            break;
-        }
-        num_rules += json_array_size(json_object_get(cur_file, "rules"));
-    }
-
-    return num_rules;
+    return config->rules_before_file[json_array_size(config->parsed_files)];
 }
 
 static void app_profile_config_insert_rule(AppProfileConfig *config,
@@ -1756,26 +2944,26 @@ static void app_profile_config_insert_rule(AppProfileConfig *config,
                                            const char *old_filename)
 {
     size_t i, j, size;
-    size_t num_rules = 0;
-    char *key;
+    size_t num_rules, num_file_rules;
     const char *filename;
-    json_t *file, *file_rules;
+    json_t *file_rules;
     json_t *target[2];
     size_t rules_before_target[2];
 
     for (i = 0, j = 0, size = json_array_size(config->parsed_files); i < size; i++) {
-        file = json_array_get(config->parsed_files, i);
-        file_rules = json_object_get(file, "rules");
+        num_rules = config->rules_before_file[i];
+        num_file_rules = config->rules_before_file[i + 1] - num_rules;
         if ((num_rules <= new_pri) &&
-            (num_rules + json_array_size(file_rules) >= new_pri)) {
+            (num_rules + num_file_rules >= new_pri)) {
             // Potential target file for this rule
             rules_before_target[j] = num_rules;
-            target[j++] = file;
+            target[j++] = json_array_get(config->parsed_files, i);
             if (j >= 2) {
                 break;
             }
+        } else if (num_rules > new_pri) {
+            break;
         }
-        num_rules += json_array_size(file_rules);
     }
 
     assert((j > 0) && (j <= 2));
@@ -1791,36 +2979,21 @@ static void app_profile_config_insert_rule(AppProfileConfig *config,
 
     file_rules = json_object_get(target[i], "rules");
     json_array_insert_new(file_rules, new_pri - rules_before_target[i], rule);
-    // Update the hashtable to point to the new file
-    key = rule_id_to_key_string(json_integer_value(json_object_get(rule, "id")));
-    filename = json_string_value(json_object_get(target[i], "filename"));
-    json_object_set_new(config->rule_locations, key, json_string(filename));
-    free(key);
+
+    // Update the rule index to point to the new location
+    app_profile_config_reindex_file(config, target[i]);
+    app_profile_config_mark_file_modified(target[i]);
 }
 
 size_t nv_app_profile_config_get_rule_priority(AppProfileConfig *config,
                                                int id)
 {
-    json_t *file, *file_rules;
-    const char *filename;
-    int idx;
-    char *key;
-
-    key = rule_id_to_key_string(id);
-
-    filename = json_string_value(json_object_get(config->rule_locations, key));
-    assert(filename);
+    const AppProfileRuleLocation *loc;
 
-    file = app_profile_config_lookup_file(config, filename);
-    assert(file);
-
-    file_rules = json_object_get(file, "rules");
+    loc = app_profile_config_get_rule_location(config, id);
+    assert(loc);
 
-    idx = lookup_rule_index_in_array(file_rules, id);
-
-    free(key);
-
-    return app_profile_config_count_rules_before(config, filename) + idx;
+    return config->rules_before_file[loc->file_idx] + loc->rule_idx;
 }
 
 static void app_profile_config_set_abs_rule_priority_internal(AppProfileConfig *config,
@@ -1831,9 +3004,9 @@ static void app_profile_config_set_abs_rule_priority_internal(AppProfileConfig *
 {
     json_t *rule, *rule_copy;
     json_t *file, *file_rules;
+    const AppProfileRuleLocation *loc;
     const char *filename;
     int idx;
-    char *key;
 
     if (new_pri == current_pri) {
         return;
@@ -1841,27 +3014,26 @@ static void app_profile_config_set_abs_rule_priority_internal(AppProfileConfig *
         new_pri = lowest_pri - 1;
     }
 
-    key = rule_id_to_key_string(id);
+    loc = app_profile_config_get_rule_location(config, id);
+    assert(loc);
 
-    filename = json_string_value(json_object_get(config->rule_locations, key));
-    assert(filename);
-
-    file = app_profile_config_lookup_file(config, filename);
+    file = json_array_get(config->parsed_files, loc->file_idx);
     assert(file);
 
+    idx = loc->rule_idx;
     file_rules = json_object_get(file, "rules");
-    idx = lookup_rule_index_in_array(file_rules, id);
-    assert(idx >= 0);
     rule = json_array_get(file_rules, idx);
+    assert(rule);
 
     rule_copy = json_deep_copy(rule);
     json_array_remove(file_rules, idx);
+    app_profile_config_reindex_file(config, file);
+    app_profile_config_mark_file_modified(file);
 
+    filename = json_string_value(json_object_get(file, "filename"));
     app_profile_config_insert_rule(config, rule_copy, new_pri, filename);
 
     app_profile_config_prune_empty_file(config, file);
-
-    free(key);
 }
 
 void nv_app_profile_config_set_abs_rule_priority(AppProfileConfig *config,
@@ -1907,31 +3079,19 @@ const json_t *nv_app_profile_config_get_profile(AppProfileConfig *config,
 const json_t *nv_app_profile_config_get_rule(AppProfileConfig *config,
                                              int id)
 {
-    char *key = rule_id_to_key_string(id);
-    json_t *file, *rule, *filename;
-    json_t *file_rules;
-    int idx;
+    const AppProfileRuleLocation *loc;
+    json_t *file, *file_rules;
 
-    filename = json_object_get(config->rule_locations, key);
+    loc = app_profile_config_get_rule_location(config, id);
 
-    if (!filename) {
-        free(key);
+    if (!loc) {
         return NULL;
     }
 
-    file = app_profile_config_lookup_file(config, json_string_value(filename));
+    file = json_array_get(config->parsed_files, loc->file_idx);
     file_rules = json_object_get(file, "rules");
 
-    idx = lookup_rule_index_in_array(file_rules, id);
-    if (idx != -1) {
-        rule = json_array_get(file_rules, idx);
-    } else {
-        assert(0);
-        rule = NULL;
-    }
-
-    free(key);
-    return rule;
+    return json_array_get(file_rules, loc->rule_idx);
 }
 
 struct AppProfileConfigProfileIterRec {
@@ -2099,14 +3259,18 @@ const char *nv_app_profile_config_rule_iter_filename(AppProfileConfigRuleIter *i
 const char *nv_app_profile_config_get_rule_filename(AppProfileConfig *config,
                                                     int id)
 {
-    const char *filename;
-    char *key;
+    const AppProfileRuleLocation *loc;
+    json_t *file;
+
+    loc = app_profile_config_get_rule_location(config, id);
 
-    key = rule_id_to_key_string(id);
-    filename = json_string_value(json_object_get(config->rule_locations, key));
-    free(key);
+    if (!loc) {
+        return NULL;
+    }
 
-    return filename;
+    file = json_array_get(config->parsed_files, loc->file_idx);
+
+    return json_string_value(json_object_get(file, "filename"));
 }
 
 const char *nv_app_profile_config_get_profile_filename(AppProfileConfig *config,
@@ -2248,6 +3412,173 @@ int nv_app_profile_config_check_backing_files(AppProfileConfig *config)
     return changed;
 }
 
+/*
+ * Returns TRUE if filename is either the given search path entry itself, or a
+ * file directly inside of it.
+ */
+static int app_profile_config_file_in_entry(const char *filename,
+                                            const char *entry)
+{
+    char *dirname;
+    int ret;
+
+    if (!strcmp(filename, entry)) {
+        return TRUE;
+    }
+
+    dirname = nv_dirname(filename);
+    ret = !strcmp(dirname, entry);
+    free(dirname);
+
+    return ret;
+}
+
+/*
+ * Remove a parsed file, along with all of its rules and profiles, from the
+ * configuration.
+ */
+static void app_profile_config_unload_file(AppProfileConfig *config,
+                                           const char *filename)
+{
+    json_t *file, *file_rules, *file_profiles, *rule, *profile;
+    const char *profile_name, *profile_filename;
+    size_t i, size;
+
+    file = app_profile_config_lookup_file(config, filename);
+    if (!file) {
+        return;
+    }
+
+    file_rules = json_object_get(file, "rules");
+    for (i = 0, size = json_array_size(file_rules); i < size; i++) {
+        rule = json_array_get(file_rules, i);
+        app_profile_config_set_rule_location(config,
+            json_integer_value(json_object_get(rule, "id")), -1, -1);
+    }
+
+    file_profiles = json_object_get(file, "profiles");
+    NV_JSON_OBJECT_FOREACH(file_profiles, profile_name, profile) {
+        profile_filename =
+            json_string_value(json_object_get(config->profile_locations,
+                                              profile_name));
+        if (profile_filename && !strcmp(profile_filename, filename)) {
+            json_object_del(config->profile_locations, profile_name);
+        }
+    }
+
+    app_profile_config_delete_file(config, filename);
+}
+
+static int app_profile_config_reload_file(AppProfileConfig *config,
+                                          const char *filename)
+{
+    struct stat stat_buf;
+    FILE *fp;
+    int had_file;
+    int ret;
+
+    had_file = (app_profile_config_lookup_file(config, filename) != NULL);
+
+    app_profile_config_unload_file(config, filename);
+
+    if (nv_app_profile_config_check_valid_source_file(config, filename, NULL)) {
+        ret = open_and_stat(filename, "r", &fp, &stat_buf);
+        if (ret >= 0) {
+            app_profile_config_load_file(config, filename, &stat_buf, fp);
+            fclose(fp);
+        }
+    }
+
+    return had_file ||
+           (app_profile_config_lookup_file(config, filename) != NULL);
+}
+
+int nv_app_profile_config_reload_path(AppProfileConfig *config,
+                                      const char *path)
+{
+    json_t *filenames, *file, *unused;
+    const char *filename;
+    struct dirent **namelist;
+    struct stat stat_buf;
+    size_t i, size;
+    int j, n, changed = FALSE;
+
+    if (!file_in_search_path(config, path)) {
+        return app_profile_config_reload_file(config, path);
+    }
+
+    // Collect the files previously loaded from this search path entry, as
+    // well as the files which are there now
+    filenames = json_object();
+
+    for (i = 0, size = json_array_size(config->parsed_files); i < size; i++) {
+        file = json_array_get(config->parsed_files, i);
+        filename = json_string_value(json_object_get(file, "filename"));
+        if (app_profile_config_file_in_entry(filename, path)) {
+            json_object_set_new(filenames, filename, json_true());
+        }
+    }
+
+    if ((stat(path, &stat_buf) == 0) && S_ISDIR(stat_buf.st_mode)) {
+        n = scandir(path, &namelist, NULL, alphasort);
+        for (j = 0; j < n; j++) {
+            const char *d_name = namelist[j]->d_name;
+
+            // Skip hidden files, as when loading the directory (see
+            // app_profile_config_load_files_from_directory())
+            if (d_name[0] != '.') {
+                char *full_path = nvstrcat(path, "/", d_name, NULL);
+                json_object_set_new(filenames, full_path, json_true());
+                free(full_path);
+            }
+            free(namelist[j]);
+        }
+        if (n >= 0) {
+            free(namelist);
+        }
+    } else {
+        json_object_set_new(filenames, path, json_true());
+    }
+
+    // Unload everything first, so that a file which replaced a directory (or
+    // vice versa) does not conflict with the files it replaced
+    NV_JSON_OBJECT_FOREACH(filenames, filename, unused) {
+        if (app_profile_config_lookup_file(config, filename)) {
+            app_profile_config_unload_file(config, filename);
+            changed = TRUE;
+        }
+    }
+
+    NV_JSON_OBJECT_FOREACH(filenames, filename, unused) {
+        if (app_profile_config_reload_file(config, filename)) {
+            changed = TRUE;
+        }
+    }
+
+    json_decref(filenames);
+
+    return changed;
+}
+
+int nv_app_profile_config_check_modified_path(AppProfileConfig *config,
+                                              const char *path)
+{
+    json_t *file;
+    const char *filename;
+    size_t i, size;
+
+    for (i = 0, size = json_array_size(config->parsed_files); i < size; i++) {
+        file = json_array_get(config->parsed_files, i);
+        filename = json_string_value(json_object_get(file, "filename"));
+        if (json_is_true(json_object_get(file, "modified")) &&
+            app_profile_config_file_in_entry(filename, path)) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
 /*
  * Filenames in the search path ending in "*.d" are directories by convention,
  * and should not be listed as valid default filenames.
@@ -2316,6 +3647,7 @@ int nv_app_profile_config_profile_name_change_fixup(AppProfileConfig *config,
             rule_profile_str = json_string_value(rule_profile);
             if (!strcmp(rule_profile_str, orig_name)) {
                 json_object_set_new(rule, "profile", json_string(new_name));
+                app_profile_config_mark_file_modified(file);
                 fixed_up = TRUE;
             }
         }
@@ -2323,3 +3655,249 @@ int nv_app_profile_config_profile_name_change_fixup(AppProfileConfig *config,
 
     return fixed_up;
 }
+
+#define SEARCH_PATH_NUM_FILES 4
+
+char **nv_app_profile_config_get_default_search_path(size_t *num_files)
+{
+    size_t i = 0;
+    char **filenames = malloc(SEARCH_PATH_NUM_FILES * sizeof(char *));
+    const char *homeStr = getenv("HOME");
+
+    if (homeStr) {
+        filenames[i++] = nvstrcat(homeStr, "/.nv/nvidia-application-profiles-rc", NULL);
+        filenames[i++] = nvstrcat(homeStr, "/.nv/nvidia-application-profiles-rc.d", NULL);
+    }
+    filenames[i++] = strdup("/etc/nvidia/nvidia-application-profiles-rc");
+    filenames[i++] = strdup("/etc/nvidia/nvidia-application-profiles-rc.d");
+
+    *num_files = i;
+    assert(i <= SEARCH_PATH_NUM_FILES);
+
+    return filenames;
+}
+
+void nv_app_profile_config_free_search_path(char **search_path,
+                                            size_t search_path_size)
+{
+    while (search_path_size--) {
+        free(search_path[search_path_size]);
+    }
+    free(search_path);
+}
+
+char *nv_app_profile_config_get_default_global_config_file(void)
+{
+    const char *homeStr = getenv("HOME");
+    if (homeStr) {
+        return nvstrcat(homeStr, "/.nv/nvidia-application-profile-globals-rc", NULL);
+    } else {
+        nv_error_msg("The environment variable HOME is not set. Any "
+                     "modifications to global application profile settings "
+                     "will not be saved.");
+        return NULL;
+    }
+}
+
+struct AppProfileMatcherRec {
+    AppProfileConfig *config;
+
+    // Rule objects in priority order
+    json_t *rules;
+
+    // Hashtables mapping the "matches" string of procname and dso rules to
+    // an ascending array of the priorities of the rules using that string
+    json_t *procname_rules;
+    json_t *dso_rules;
+
+    // Ascending array of the priorities of rules which always apply
+    size_t *true_rules;
+    size_t num_true_rules;
+};
+
+static void app_profile_matcher_index_rule(json_t *index,
+                                           const char *matches,
+                                           size_t pri)
+{
+    json_t *pris = json_object_get(index, matches);
+
+    if (!pris) {
+        pris = json_array();
+        json_object_set_new(index, matches, pris);
+    }
+
+    json_array_append_new(pris, json_integer(pri));
+}
+
+AppProfileMatcher *nv_app_profile_matcher_new(AppProfileConfig *config)
+{
+    AppProfileMatcher *matcher;
+    AppProfileConfigRuleIter *iter;
+    json_t *rule, *pattern;
+    const char *feature, *matches;
+    size_t pri;
+
+    matcher = nvalloc(sizeof(AppProfileMatcher));
+    matcher->config = config;
+    matcher->rules = json_array();
+    matcher->procname_rules = json_object();
+    matcher->dso_rules = json_object();
+    matcher->true_rules = nvalloc((nv_app_profile_config_count_rules(config) + 1) *
+                                  sizeof(size_t));
+
+    for (iter = nv_app_profile_config_rule_iter(config), pri = 0;
+         iter;
+         iter = nv_app_profile_config_rule_iter_next(iter), pri++) {
+        rule = nv_app_profile_config_rule_iter_val(iter);
+        json_array_append(matcher->rules, rule);
+
+        pattern = json_object_get(rule, "pattern");
+        feature = json_string_value(json_object_get(pattern, "feature"));
+        matches = json_string_value(json_object_get(pattern, "matches"));
+
+        if (!feature) {
+            continue;
+        }
+
+        // Features unknown to this version never match, as in the driver
+        if (!strcmp(feature, "true")) {
+            matcher->true_rules[matcher->num_true_rules++] = pri;
+        } else if (matches && !strcmp(feature, "procname")) {
+            app_profile_matcher_index_rule(matcher->procname_rules,
+                                           matches, pri);
+        } else if (matches && !strcmp(feature, "dso")) {
+            app_profile_matcher_index_rule(matcher->dso_rules,
+                                           matches, pri);
+        }
+    }
+
+    return matcher;
+}
+
+void nv_app_profile_matcher_free(AppProfileMatcher *matcher)
+{
+    if (!matcher) {
+        return;
+    }
+
+    json_decref(matcher->rules);
+    json_decref(matcher->procname_rules);
+    json_decref(matcher->dso_rules);
+    free(matcher->true_rules);
+    free(matcher);
+}
+
+static int compare_rule_priorities(const void *a, const void *b)
+{
+    size_t pri_a = *(const size_t *)a;
+    size_t pri_b = *(const size_t *)b;
+
+    return (pri_a > pri_b) - (pri_a < pri_b);
+}
+
+static size_t app_profile_matcher_add_matching_rules(size_t **matching,
+                                                     size_t num_matching,
+                                                     json_t *index,
+                                                     const char *path)
+{
+    json_t *pris;
+    const char *last_slash;
+    size_t i, size;
+
+    if (!path) {
+        return num_matching;
+    }
+
+    // Rules match against the path with leading directory components removed
+    last_slash = strrchr(path, '/');
+    pris = json_object_get(index, last_slash ? last_slash + 1 : path);
+    size = json_array_size(pris);
+
+    if (!size) {
+        return num_matching;
+    }
+
+    *matching = nvrealloc(*matching, (num_matching + size) * sizeof(size_t));
+    for (i = 0; i < size; i++) {
+        (*matching)[num_matching++] =
+            json_integer_value(json_array_get(pris, i));
+    }
+
+    return num_matching;
+}
+
+json_t *nv_app_profile_matcher_resolve(AppProfileMatcher *matcher,
+                                       const char *procname,
+                                       const char **dsos,
+                                       size_t num_dsos)
+{
+    json_t *resolved, *seen_keys;
+    json_t *rule, *settings, *setting, *new_setting, *key;
+    const json_t *profile;
+    const char *profile_name;
+    size_t *matching;
+    size_t num_matching;
+    size_t i, j, size;
+
+    num_matching = matcher->num_true_rules;
+    matching = nvalloc((num_matching + 1) * sizeof(size_t));
+    memcpy(matching, matcher->true_rules, num_matching * sizeof(size_t));
+
+    num_matching = app_profile_matcher_add_matching_rules(&matching,
+                                                          num_matching,
+                                                          matcher->procname_rules,
+                                                          procname);
+    for (i = 0; i < num_dsos; i++) {
+        num_matching = app_profile_matcher_add_matching_rules(&matching,
+                                                              num_matching,
+                                                              matcher->dso_rules,
+                                                              dsos[i]);
+    }
+
+    qsort(matching, num_matching, sizeof(size_t), compare_rule_priorities);
+
+    resolved = json_array();
+    seen_keys = json_object();
+
+    // Settings from higher-priority rules take precedence over conflicting
+    // settings from lower-priority rules
+    for (i = 0; i < num_matching; i++) {
+        if (i > 0 && matching[i] == matching[i-1]) {
+            // The same library may be listed more than once
+            continue;
+        }
+
+        rule = json_array_get(matcher->rules, matching[i]);
+        profile_name = json_string_value(json_object_get(rule, "profile"));
+        if (!profile_name) {
+            continue;
+        }
+        profile = nv_app_profile_config_get_profile(matcher->config,
+                                                    profile_name);
+        settings = json_object_get(profile, "settings");
+
+        for (j = 0, size = json_array_size(settings); j < size; j++) {
+            setting = json_array_get(settings, j);
+            key = json_object_get(setting, "key");
+            if (!json_is_string(key) ||
+                json_object_get(seen_keys, json_string_value(key))) {
+                continue;
+            }
+            json_object_set(seen_keys, json_string_value(key), json_true());
+
+            new_setting = json_object();
+            json_object_set(new_setting, "key", key);
+            json_object_set(new_setting, "value",
+                            json_object_get(setting, "value"));
+            json_object_set_new(new_setting, "profile",
+                                json_string(profile_name));
+            json_object_set(new_setting, "rule", json_object_get(rule, "id"));
+            json_array_append_new(resolved, new_setting);
+        }
+    }
+
+    json_decref(seen_keys);
+    free(matching);
+
+    return resolved;
+}
@@ -49,6 +49,9 @@
  *     dirty: a flag indicating this file should be overwritten even if
  *     validation does not detect any changes (used to handle invalid
  *     configuration, e.g. duplicate profile names).
+ *     modified: a flag indicating the rules or profiles of this file have been
+ *     edited since the configuration was loaded; only modified or dirty files
+ *     are compared against the original configuration during validation.
  *     new: indicates whether the file object is new to the configuration or
  *     loaded from disk
  *     atime: time of last access as determined by time(2) during the
@@ -74,6 +77,15 @@
  * JSON object.
  */
 
+/*
+ * Location of a rule in the configuration: the index of its file in the
+ * parsed_files array, and the index of the rule in that file's rules array.
+ */
+typedef struct AppProfileRuleLocationRec {
+    int file_idx;
+    int rule_idx;
+} AppProfileRuleLocation;
+
 /*
  * The AppProfileConfig struct contains the current profile configuration
  * as determined by nvidia-settings. This configuration contains a list
@@ -94,15 +106,28 @@ typedef struct AppProfileConfigRec {
     json_t *parsed_files;
 
     /*
-     * We maintain secondary hashtables of profile and rule locations stored as
-     * JSON objects for quicker lookup of individual profiles and rules. This is
-     * also used to ensure that globally there are no two profiles with the same
-     * name (regardless of their file of origin).
+     * We maintain a secondary hashtable of profile locations stored as a JSON
+     * object for quicker lookup of individual profiles. This is also used to
+     * ensure that globally there are no two profiles with the same name
+     * (regardless of their file of origin).
      */
     json_t *profile_locations;
-    json_t *rule_locations;
+
+    /*
+     * Rule IDs are allocated sequentially, so rule locations are indexed
+     * directly by ID. Entries for unused IDs have a file_idx of -1.
+     */
+    AppProfileRuleLocation *rule_locations;
+    size_t rule_locations_size;
     size_t next_free_rule_id;
 
+    /*
+     * Running count of rules per file: rules_before_file[i] is the number of
+     * rules in all files preceding parsed_files[i]. This array has one more
+     * entry than parsed_files, so the last entry is the total number of rules.
+     */
+    size_t *rules_before_file;
+
     /*
      * Copy of the global configuration filename
      */
@@ -120,7 +145,8 @@ typedef struct AppProfileConfigRec {
  * Save configuration specified by the JSON array updates to disk. See
  * nv_app_profile_config_validate() below for the format of this array.
  * backup indicates whether this should also make backups of the original files
- * before saving.
+ * before saving. Each file is written to a temporary file first, which then
+ * atomically replaces the original.
  * Returns 0 if successful, or a negative integer if an error was encountered.
  * If error_str is non-NULL, *error_str is set to NULL on success, or a
  * dynamically-allocated string if an error occurred.
@@ -137,9 +163,70 @@ AppProfileConfig *nv_app_profile_config_load(const char *global_config_file,
                                              size_t search_path_count);
 
 /*
- * Load the registry keys documentation from the installed file.
+ * Documentation of the registry keys which can be used in profile settings.
+ * nv_app_profile_key_docs_new() only records the path of the installed
+ * documentation file; the file is read the first time any of the other
+ * functions below need its contents.
+ */
+typedef struct AppProfileKeyDocsRec AppProfileKeyDocs;
+
+AppProfileKeyDocs *nv_app_profile_key_docs_new(const char *key_docs_file);
+void nv_app_profile_key_docs_free(AppProfileKeyDocs *key_docs);
+
+/*
+ * Returns TRUE if the documentation file has already been read.
+ */
+int nv_app_profile_key_docs_is_loaded(const AppProfileKeyDocs *key_docs);
+
+/*
+ * Returns the number of documented keys; 0 if the file could not be read.
+ */
+size_t nv_app_profile_key_docs_count(AppProfileKeyDocs *key_docs);
+
+/*
+ * Accessors for the i-th documented key, in the order of the documentation
+ * file. These return NULL if i is out of range.
+ */
+const char *nv_app_profile_key_docs_get_key(AppProfileKeyDocs *key_docs,
+                                            size_t i);
+const char *nv_app_profile_key_docs_get_type(AppProfileKeyDocs *key_docs,
+                                             size_t i);
+const char *nv_app_profile_key_docs_get_description(AppProfileKeyDocs *key_docs,
+                                                    size_t i);
+
+/*
+ * Returns the index of the documented key named key, optionally ignoring
+ * case, or -1 if there is none. If several keys match, the first in the
+ * documentation file is returned.
+ */
+int nv_app_profile_key_docs_find(AppProfileKeyDocs *key_docs,
+                                 const char *key, int ignore_case);
+
+/*
+ * Counts of what an application profile file defines, as reported by
+ * nv_app_profile_file_validate().
+ */
+typedef struct AppProfileFileSummaryRec {
+    size_t num_profiles;
+    size_t num_rules;
+    size_t num_settings;
+} AppProfileFileSummary;
+
+/*
+ * Check that the file at filename is a valid application profile
+ * configuration file, without loading it into a configuration. The file is
+ * checked as it is parsed, so no JSON tree is built. Where a member appears
+ * more than once in an object, only the last occurrence is checked, as only
+ * the last one is used when the file is loaded.
+ *
+ * Returns TRUE if the file is valid. If summary is non-NULL, it is filled in
+ * with the number of profiles, rules and settings found. If error_str is
+ * non-NULL, *error_str is set to NULL on success, or a dynamically-allocated
+ * description of the first problem found.
  */
-json_t *nv_app_profile_key_documentation_load(const char *key_docs_file);
+int nv_app_profile_file_validate(const char *filename,
+                                 AppProfileFileSummary *summary,
+                                 char **error_str);
 
 /*
  * Duplicate the configuration; the copy can then be edited and compared against
@@ -161,7 +248,9 @@ void nv_app_profile_config_free(AppProfileConfig *config);
 /*
  * Validate the configuration specified by new_config against the pristine copy
  * specified by old_config, and generate a list of changes needed in order to
- * achieve the new configuration.
+ * achieve the new configuration. Only files which are marked dirty or
+ * modified in either configuration are considered; new_config is expected to
+ * be derived from old_config via nv_app_profile_config_dup().
  *
  * This returns a JSON array which must be freed via json_decref(), containing
  * a list of update objects. Each update object contains the following
@@ -280,6 +369,25 @@ void nv_app_profile_config_change_rule_priority(AppProfileConfig *config,
  */
 int nv_app_profile_config_check_backing_files(AppProfileConfig *config);
 
+/*
+ * Re-read the given path from disk, replacing the rules and profiles that were
+ * previously loaded from it. path may be an entry in the search path, or a
+ * file inside a search path directory; if path is a search path entry, every
+ * file in it is re-read, and files which no longer exist are removed from the
+ * configuration. Rules which are reloaded are assigned new IDs.
+ *
+ * This function returns TRUE if the configuration was changed as a result.
+ */
+int nv_app_profile_config_reload_path(AppProfileConfig *config,
+                                      const char *path);
+
+/*
+ * Returns TRUE if the file given by path, or any file inside the search path
+ * directory given by path, has been edited since it was loaded from disk.
+ */
+int nv_app_profile_config_check_modified_path(AppProfileConfig *config,
+                                              const char *path);
+
 /*
  * Utility function to strip comments and translate hex/octal values to decimal
  * so the JSON parser can understand.
@@ -320,4 +428,44 @@ int nv_app_profile_config_profile_name_change_fixup(AppProfileConfig *config,
                                                     const char *orig_name,
                                                     const char *new_name);
 
+/*
+ * Helpers for constructing the default configuration search path and global
+ * configuration filename used by the NVIDIA driver. The returned values should
+ * be freed by the caller; the search path via
+ * nv_app_profile_config_free_search_path().
+ */
+char **nv_app_profile_config_get_default_search_path(size_t *num_files);
+void nv_app_profile_config_free_search_path(char **search_path,
+                                            size_t search_path_size);
+char *nv_app_profile_config_get_default_global_config_file(void);
+
+/*
+ * An AppProfileMatcher is a compiled form of the rules in a configuration,
+ * which allows the rules applying to a process to be found without walking
+ * the whole rule list. The matcher keeps a pointer to the configuration, and
+ * must be recreated after any rules in it are created, deleted, edited, or
+ * reordered; edits to profiles do not require recreating the matcher.
+ */
+typedef struct AppProfileMatcherRec AppProfileMatcher;
+
+AppProfileMatcher *nv_app_profile_matcher_new(AppProfileConfig *config);
+void nv_app_profile_matcher_free(AppProfileMatcher *matcher);
+
+/*
+ * Determine the settings the driver would apply to a process with the given
+ * process name and list of loaded libraries; leading directory components are
+ * ignored in both. Returns a JSON array of setting objects, each of which
+ * contains the following members:
+ *     key, value: the setting, as in a profile's settings array
+ *     profile: the name of the profile the setting was taken from
+ *     rule: the ID of the matching rule which applied that profile
+ * If several matching rules specify the same key, the setting from the rule
+ * with the highest priority is used. The returned array should be freed via
+ * json_decref().
+ */
+json_t *nv_app_profile_matcher_resolve(AppProfileMatcher *matcher,
+                                       const char *procname,
+                                       const char **dsos,
+                                       size_t num_dsos);
+
 #endif // __APP_PROFILES_H__
@@ -307,6 +307,8 @@ Options *parse_command_line(int argc, char *argv[],
         case 'w': op->write_config = boolval; break;
         case 'i': op->use_gtk2 = NV_TRUE; break;
         case 'I': op->gtk_lib_path = strval; break;
+        case RESOLVE_APP_PROFILE_OPTION: op->resolve_app_profile = strval; break;
+        case VALIDATE_APP_PROFILE_OPTION: op->validate_app_profile = strval; break;
         default:
             nv_error_msg("Invalid commandline, please run `%s --help` "
                          "for usage information.\n", argv[0]);
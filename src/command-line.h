@@ -30,6 +30,8 @@ struct _CtrlSystemList;
 #define DEFAULT_RC_FILE "~/.nvidia-settings-rc"
 #define CONFIG_FILE_OPTION 1
 #define DISPLAY_OPTION 2
+#define RESOLVE_APP_PROFILE_OPTION 3
+#define VALIDATE_APP_PROFILE_OPTION 4
 
 /*
  * Options structure -- stores the parameters specified on the
@@ -122,6 +124,18 @@ typedef struct {
                           * ignored.
                           */
 
+    char *resolve_app_profile; /*
+                                * If set, print the application profile
+                                * settings that would be applied to the
+                                * given process, and exit.
+                                */
+
+    char *validate_app_profile; /*
+                                 * If set, check the application profile
+                                 * file, or the files in the directory, at
+                                 * this path, and exit.
+                                 */
+
 } Options;
 
 
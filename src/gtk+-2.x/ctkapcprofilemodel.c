@@ -488,6 +488,64 @@ void ctk_apc_profile_model_attach(CtkApcProfileModel *prof_model, AppProfileConf
     }
 }
 
+/*
+ * Bring the model up to date with profiles which were added to, removed from
+ * or changed in the attached config behind the model's back (e.g. when a file
+ * is reloaded from disk).
+ */
+void ctk_apc_profile_model_refresh(CtkApcProfileModel *prof_model)
+{
+    AppProfileConfig *config = prof_model->config;
+    AppProfileConfigProfileIter *prof_iter;
+    GHashTable *model_profiles;
+    GtkTreePath *path;
+    GtkTreeIter iter;
+    const char *profile_name;
+    char *dup_profile_name;
+    gint i;
+
+    model_profiles = g_hash_table_new(g_str_hash, g_str_equal);
+
+    // Remove rows for profiles which no longer exist; the remaining profiles
+    // may have new settings, so emit a "row-changed" signal for them
+    for (i = prof_model->profiles->len - 1; i >= 0; i--) {
+        dup_profile_name = g_array_index(prof_model->profiles, char*, i);
+        path = gtk_tree_path_new_from_indices(i, -1);
+        if (!nv_app_profile_config_get_profile(config, dup_profile_name)) {
+            g_array_remove_index(prof_model->profiles, i);
+            gtk_tree_model_row_deleted(GTK_TREE_MODEL(prof_model), path);
+            free(dup_profile_name);
+        } else {
+            g_hash_table_insert(model_profiles, dup_profile_name, dup_profile_name);
+            apc_profile_model_get_iter(GTK_TREE_MODEL(prof_model), &iter, path);
+            gtk_tree_model_row_changed(GTK_TREE_MODEL(prof_model), path, &iter);
+        }
+        gtk_tree_path_free(path);
+    }
+
+    // Append rows for new profiles
+    for (prof_iter = nv_app_profile_config_profile_iter(config);
+         prof_iter;
+         prof_iter = nv_app_profile_config_profile_iter_next(prof_iter)) {
+        profile_name = nv_app_profile_config_profile_iter_name(prof_iter);
+        if (g_hash_table_lookup(model_profiles, profile_name)) {
+            continue;
+        }
+
+        dup_profile_name = strdup(profile_name);
+        i = prof_model->profiles->len;
+        g_array_append_val(prof_model->profiles, dup_profile_name);
+
+        // emit a "row-inserted" signal
+        path = gtk_tree_path_new_from_indices(i, -1);
+        apc_profile_model_get_iter(GTK_TREE_MODEL(prof_model), &iter, path);
+        gtk_tree_model_row_inserted(GTK_TREE_MODEL(prof_model), path, &iter);
+        gtk_tree_path_free(path);
+    }
+
+    g_hash_table_destroy(model_profiles);
+}
+
 CtkApcProfileModel *ctk_apc_profile_model_new(AppProfileConfig *config)
 {
     CtkApcProfileModel *prof_model;
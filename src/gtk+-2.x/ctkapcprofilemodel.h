@@ -94,6 +94,7 @@ void ctk_apc_profile_model_delete_profile(CtkApcProfileModel *prof_model,
                                           const char *profile_name);
 
 void ctk_apc_profile_model_attach(CtkApcProfileModel *prof_model, AppProfileConfig *config);
+void ctk_apc_profile_model_refresh(CtkApcProfileModel *prof_model);
 
 // Thin wrapper around nv_app_profile_config_get_profile() to promote
 // modularity (all requests for config data should go through the models).
@@ -535,6 +535,62 @@ void ctk_apc_rule_model_attach(CtkApcRuleModel *rule_model, AppProfileConfig *co
     }
 }
 
+/*
+ * Bring the model up to date with rules which were added to or removed from the
+ * attached config behind the model's back (e.g. when a file is reloaded from
+ * disk), emitting signals only for the affected rows.
+ */
+void ctk_apc_rule_model_refresh(CtkApcRuleModel *rule_model)
+{
+    AppProfileConfig *config = rule_model->config;
+    AppProfileConfigRuleIter *rule_iter;
+    GtkTreePath *path;
+    GtkTreeIter iter;
+    json_t *rule;
+    gint i;
+    gint id;
+
+    // Remove rows for rules which no longer exist
+    for (i = rule_model->rules->len - 1; i >= 0; i--) {
+        id = g_array_index(rule_model->rules, gint, i);
+        if (!nv_app_profile_config_get_rule(config, id)) {
+            g_array_remove_index(rule_model->rules, i);
+
+            // Emit a "row-deleted" signal
+            path = gtk_tree_path_new_from_indices(i, -1);
+            gtk_tree_model_row_deleted(GTK_TREE_MODEL(rule_model), path);
+            gtk_tree_path_free(path);
+        }
+    }
+
+    // The remaining rules keep their relative order, so new rules can be
+    // merged into the model in a single pass over the config
+    for (rule_iter = nv_app_profile_config_rule_iter(config), i = 0;
+         rule_iter;
+         rule_iter = nv_app_profile_config_rule_iter_next(rule_iter), i++) {
+        rule = nv_app_profile_config_rule_iter_val(rule_iter);
+        id = (int)json_integer_value(json_object_get(rule, "id"));
+
+        if ((i < rule_model->rules->len) &&
+            (g_array_index(rule_model->rules, gint, i) == id)) {
+            continue;
+        }
+
+        g_array_insert_val(rule_model->rules, i, id);
+
+        // Emit a "row-inserted" signal
+        path = gtk_tree_path_new_from_indices(i, -1);
+        apc_rule_model_get_iter(GTK_TREE_MODEL(rule_model), &iter, path);
+        gtk_tree_model_row_inserted(GTK_TREE_MODEL(rule_model), path, &iter);
+        gtk_tree_path_free(path);
+    }
+
+    if (rule_model->rules->len != nv_app_profile_config_count_rules(config)) {
+        // The rules were reordered as well; start over
+        ctk_apc_rule_model_attach(rule_model, config);
+    }
+}
+
 CtkApcRuleModel *ctk_apc_rule_model_new(AppProfileConfig *config)
 {
     CtkApcRuleModel *rule_model;
@@ -91,6 +91,7 @@ void ctk_apc_rule_model_change_rule_priority(CtkApcRuleModel *rule_model,
                                             int id, int delta);
 
 void ctk_apc_rule_model_attach(CtkApcRuleModel *rule_model, AppProfileConfig *config);
+void ctk_apc_rule_model_refresh(CtkApcRuleModel *rule_model);
 
 G_END_DECLS
 
@@ -23,6 +23,10 @@
 #include <assert.h>
 #include <unistd.h>
 #include <string.h>
+#include <sys/stat.h>
+#if defined(__linux__)
+#include <sys/inotify.h>
+#endif
 #include <gtk/gtk.h>
 #include <gdk/gdk.h>
 #include <gdk/gdkkeysyms.h>
@@ -252,6 +256,23 @@ static void app_profile_finalize(GObject *object)
     ctk_help_data_list_free_full(ctk_app_profile->profiles_help_data);
     ctk_help_data_list_free_full(ctk_app_profile->profiles_columns_help_data);
     ctk_help_data_list_free_full(ctk_app_profile->save_reload_help_data);
+
+    nv_app_profile_key_docs_free(ctk_app_profile->key_docs);
+
+    // Stop watching the search path
+    if (ctk_app_profile->watch_source) {
+        g_source_remove(ctk_app_profile->watch_source);
+    }
+    if (ctk_app_profile->reload_timer) {
+        g_source_remove(ctk_app_profile->reload_timer);
+    }
+    if (ctk_app_profile->inotify_fd >= 0) {
+        close(ctk_app_profile->inotify_fd);
+    }
+    if (ctk_app_profile->watched_dirs) {
+        g_hash_table_destroy(ctk_app_profile->watched_dirs);
+    }
+    json_decref(ctk_app_profile->pending_reloads);
 }
 
 static void tool_button_set_label_and_stock_icon(GtkToolButton *button, const gchar *label_text, const gchar *icon_id)
@@ -336,8 +357,8 @@ static GtkWidget *populate_registry_key_combo_callback(gpointer init_data)
 {
     CtkAppProfile *ctk_app_profile;
     CtkDropDownMenu *menu = NULL;
-    json_t *key_docs;
-    int i;
+    AppProfileKeyDocs *key_docs;
+    size_t i, num_keys;
     EditProfileDialog *dialog = (EditProfileDialog *) init_data;
 
     if (!dialog || dialog->registry_key_combo) {
@@ -346,8 +367,9 @@ static GtkWidget *populate_registry_key_combo_callback(gpointer init_data)
 
     ctk_app_profile = CTK_APP_PROFILE(dialog->parent);
     key_docs = ctk_app_profile->key_docs;
+    num_keys = nv_app_profile_key_docs_count(key_docs);
 
-    if (json_array_size(key_docs) <= 0) {
+    if (num_keys == 0) {
         dialog->registry_key_combo = NULL;
         return NULL;
     }
@@ -358,11 +380,9 @@ static GtkWidget *populate_registry_key_combo_callback(gpointer init_data)
 
     ctk_drop_down_menu_append_item(menu, "Custom", -1);
     ctk_drop_down_menu_set_current_value(menu, -1);
-    for (i = 0; i < json_array_size(key_docs); i++) {
-        json_t *json_key_object = json_array_get(key_docs, i);
-        json_t *json_name = json_object_get(json_key_object, "key");
+    for (i = 0; i < num_keys; i++) {
         ctk_drop_down_menu_append_item(menu,
-                                       json_string_value(json_name),
+                                       nv_app_profile_key_docs_get_key(key_docs, i),
                                        i);
     }
 
@@ -1659,18 +1679,13 @@ static json_t *get_default_json_from_type(int type)
     }
 }
 
-static const char *get_expected_type_string_from_key(json_t *key_docs,
+static const char *get_expected_type_string_from_key(AppProfileKeyDocs *key_docs,
                                                      const char *key)
 {
-    int i;
-    for (i = 0; i < json_array_size(key_docs); i++) {
-        json_t *json_obj = json_array_get(key_docs, i);
-        json_t *json_key = json_object_get(json_obj, "key");
-        const char * name = json_string_value(json_key);
-        if (!strcmp(name, key)) {
-            json_key = json_object_get(json_obj, "type");
-            return json_string_value(json_key);
-        }
+    int i = nv_app_profile_key_docs_find(key_docs, key, FALSE);
+
+    if (i >= 0) {
+        return nv_app_profile_key_docs_get_type(key_docs, i);
     }
     return "unspecified";
 }
@@ -1699,7 +1714,7 @@ static void setting_expected_type_renderer_func(GtkTreeViewColumn *tree_column,
                                                 GtkTreeIter       *iter,
                                                 gpointer           data)
 {
-    json_t *key_docs = (json_t *) data;
+    AppProfileKeyDocs *key_docs = (AppProfileKeyDocs *) data;
     const char *expected_type = NULL;
     json_t *setting;
     gtk_tree_model_get(model, iter,
@@ -2201,7 +2216,7 @@ static void edit_profile_dialog_settings_new_row(GtkTreeView *tree_view,
                                                  GtkTreeModel *tree_model,
                                                  GtkTreePath **path,
                                                  GtkTreeViewColumn **column,
-                                                 json_t *key_docs,
+                                                 AppProfileKeyDocs *key_docs,
                                                  int key_index)
 {
     GtkTreeIter iter;
@@ -2210,11 +2225,11 @@ static void edit_profile_dialog_settings_new_row(GtkTreeView *tree_view,
     int expected_type;
     int column_to_edit;
 
-    if (json_array_size(key_docs) > 0 && key_index >= 0) {
-        json_t *key_obj = json_array_get(key_docs, key_index);
-        s = json_string_value(json_object_get(key_obj, "key"));
+    if (key_index >= 0 &&
+        (size_t)key_index < nv_app_profile_key_docs_count(key_docs)) {
+        s = nv_app_profile_key_docs_get_key(key_docs, key_index);
 
-        expected_type = get_type_from_string(get_expected_type_string_from_key(key_docs, s));
+        expected_type = get_type_from_string(nv_app_profile_key_docs_get_type(key_docs, key_index));
         column_to_edit = lookup_column_number_by_name(tree_view, "Value");
     } else {
         s = "";
@@ -2362,22 +2377,18 @@ static gboolean widget_get_visible(GtkWidget *widget)
 }
 
 static const gchar *get_canonical_setting_key(const gchar *key,
-                                              json_t *key_docs)
+                                              AppProfileKeyDocs *key_docs)
 {
-    size_t i;
-    for (i = 0; i < json_array_size(key_docs); i++) {
-        json_t *key_obj = json_array_get(key_docs, i);
-        json_t *key_name = json_object_get(key_obj, "key");
-        if (json_is_string(key_name) &&
-            !strcasecmp(key, json_string_value(key_name))) {
-            return json_string_value(key_name);
-        }
+    int i = nv_app_profile_key_docs_find(key_docs, key, TRUE);
+
+    if (i >= 0) {
+        return nv_app_profile_key_docs_get_key(key_docs, i);
     }
     return NULL;
 }
 
 static gboolean check_unrecognized_setting_keys(const json_t *settings,
-                                                json_t *key_docs)
+                                                AppProfileKeyDocs *key_docs)
 {
     const json_t *setting;
     const char *key;
@@ -3144,6 +3155,122 @@ static void rules_tree_view_row_activated_callback(GtkTreeView *tree_view,
     edit_rule_callbacks_common(ctk_app_profile, path);
 }
 
+/*
+ * State for the modal dialog used to preview the settings that the current
+ * rules would apply to a given process.
+ */
+typedef struct _PreviewSettingsDialog {
+    AppProfileMatcher *matcher;
+    GtkEntry *procname_entry;
+    GtkEntry *dsos_entry;
+    GtkLabel *settings_label;
+} PreviewSettingsDialog;
+
+static void preview_settings_update(GtkWidget *widget, gpointer user_data)
+{
+    PreviewSettingsDialog *dialog = (PreviewSettingsDialog *)user_data;
+    const char *procname;
+    const char **dsos;
+    gchar **dso_tokens;
+    size_t i, num_dsos;
+    json_t *resolved;
+    char *settings_string;
+
+    procname = gtk_entry_get_text(dialog->procname_entry);
+    dso_tokens = g_strsplit_set(gtk_entry_get_text(dialog->dsos_entry),
+                                " ,", -1);
+
+    dsos = nvalloc((g_strv_length(dso_tokens) + 1) * sizeof(char *));
+    for (i = 0, num_dsos = 0; dso_tokens[i]; i++) {
+        if (dso_tokens[i][0] != '\0') {
+            dsos[num_dsos++] = dso_tokens[i];
+        }
+    }
+
+    resolved = nv_app_profile_matcher_resolve(dialog->matcher,
+                                              procname[0] ? procname : NULL,
+                                              dsos, num_dsos);
+
+    if (json_array_size(resolved)) {
+        settings_string = serialize_settings(resolved, TRUE);
+    } else {
+        settings_string = markup_string("(no settings)", TRUE,
+                                        "span", "color", "#555555", NULL);
+    }
+
+    gtk_label_set_markup(dialog->settings_label, settings_string);
+
+    free(settings_string);
+    json_decref(resolved);
+    free(dsos);
+    g_strfreev(dso_tokens);
+}
+
+static void preview_settings_callback(GtkWidget *widget, gpointer user_data)
+{
+    CtkAppProfile *ctk_app_profile = (CtkAppProfile *)user_data;
+    PreviewSettingsDialog dialog;
+    GtkWidget *preview_dialog;
+    GtkWidget *content_area;
+    GtkWidget *table;
+    GtkWidget *label;
+    GtkWidget *entry;
+
+    dialog.matcher = nv_app_profile_matcher_new(ctk_app_profile->cur_config);
+
+    preview_dialog = gtk_dialog_new_with_buttons(
+        "Preview Settings",
+        GTK_WINDOW(gtk_widget_get_toplevel(GTK_WIDGET(ctk_app_profile))),
+        GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
+        GTK_STOCK_CLOSE,
+        GTK_RESPONSE_CLOSE,
+        NULL);
+
+    content_area = ctk_dialog_get_content_area(GTK_DIALOG(preview_dialog));
+
+    table = gtk_table_new(3, 2, FALSE);
+    gtk_container_set_border_width(GTK_CONTAINER(table), 8);
+    gtk_table_set_row_spacings(GTK_TABLE(table), 4);
+    gtk_table_set_col_spacings(GTK_TABLE(table), 8);
+
+    label = gtk_label_new("Process name:");
+    gtk_misc_set_alignment(GTK_MISC(label), 0, 0.5);
+    gtk_table_attach_defaults(GTK_TABLE(table), label, 0, 1, 0, 1);
+
+    entry = gtk_entry_new();
+    dialog.procname_entry = GTK_ENTRY(entry);
+    gtk_table_attach_defaults(GTK_TABLE(table), entry, 1, 2, 0, 1);
+
+    label = gtk_label_new("Loaded libraries:");
+    gtk_misc_set_alignment(GTK_MISC(label), 0, 0.5);
+    gtk_table_attach_defaults(GTK_TABLE(table), label, 0, 1, 1, 2);
+
+    entry = gtk_entry_new();
+    dialog.dsos_entry = GTK_ENTRY(entry);
+    gtk_table_attach_defaults(GTK_TABLE(table), entry, 1, 2, 1, 2);
+
+    label = gtk_label_new(NULL);
+    gtk_misc_set_alignment(GTK_MISC(label), 0, 0);
+    gtk_label_set_line_wrap(GTK_LABEL(label), TRUE);
+    dialog.settings_label = GTK_LABEL(label);
+    gtk_table_attach_defaults(GTK_TABLE(table), label, 0, 2, 2, 3);
+
+    gtk_box_pack_start(GTK_BOX(content_area), table, TRUE, TRUE, 0);
+
+    g_signal_connect(G_OBJECT(dialog.procname_entry), "changed",
+                     G_CALLBACK(preview_settings_update), (gpointer)&dialog);
+    g_signal_connect(G_OBJECT(dialog.dsos_entry), "changed",
+                     G_CALLBACK(preview_settings_update), (gpointer)&dialog);
+
+    preview_settings_update(NULL, &dialog);
+
+    gtk_widget_show_all(content_area);
+    gtk_dialog_run(GTK_DIALOG(preview_dialog));
+    gtk_widget_destroy(preview_dialog);
+
+    nv_app_profile_matcher_free(dialog.matcher);
+}
+
 static GtkWidget* create_rules_page(CtkAppProfile *ctk_app_profile)
 {
     GtkWidget *vbox;
@@ -3209,6 +3336,18 @@ static GtkWidget* create_rules_page(CtkAppProfile *ctk_app_profile)
             .user_data = ctk_app_profile,
             .flags = TOOLBAR_ITEM_GHOST_IF_NOTHING_SELECTED
         },
+        {
+            .text = "Preview Settings",
+            .help_text = "The Preview Settings button allows you to see which settings the current rules "
+                         "would apply to a process, given its name and the libraries it has loaded.",
+            .extended_help_text = "Settings are shown as they would be applied by the driver, with "
+                                  "conflicting settings taken from the highest-priority matching rule. "
+                                  "Unsaved changes to the configuration are included in the preview.",
+            .icon_id = GTK_STOCK_FIND,
+            .callback = (GCallback)preview_settings_callback,
+            .user_data = ctk_app_profile,
+            .flags = 0,
+        },
     };
 
     const TreeViewColumnTemplate rules_tree_view_columns[] = {
@@ -3650,19 +3789,6 @@ static GtkWidget* create_profiles_page(CtkAppProfile *ctk_app_profile)
     return vbox;
 }
 
-static char *get_default_global_config_file(void)
-{
-    const char *homeStr = getenv("HOME");
-    if (homeStr) {
-        return nvstrcat(homeStr, "/.nv/nvidia-application-profile-globals-rc", NULL);
-    } else {
-        nv_error_msg("The environment variable HOME is not set. Any "
-                     "modifications to global application profile settings "
-                     "will not be saved.");
-        return NULL;
-    }
-}
-
 static char *get_default_keys_file(const char *driver_version)
 {
     char *file = NULL;
@@ -3703,35 +3829,6 @@ static char *get_default_keys_file(const char *driver_version)
     }
 }
 
-#define SEARCH_PATH_NUM_FILES 4
-
-static char **get_default_search_path(size_t *num_files)
-{
-    size_t i = 0;
-    char **filenames = malloc(SEARCH_PATH_NUM_FILES * sizeof(char *));
-    const char *homeStr = getenv("HOME");
-
-    if (homeStr) {
-        filenames[i++] = nvstrcat(homeStr, "/.nv/nvidia-application-profiles-rc", NULL);
-        filenames[i++] = nvstrcat(homeStr, "/.nv/nvidia-application-profiles-rc.d", NULL);
-    }
-    filenames[i++] = strdup("/etc/nvidia/nvidia-application-profiles-rc");
-    filenames[i++] = strdup("/etc/nvidia/nvidia-application-profiles-rc.d");
-
-    *num_files = i;
-    assert(i <= SEARCH_PATH_NUM_FILES);
-
-    return filenames;
-}
-
-static void free_search_path(char **search_path, size_t search_path_size)
-{
-    while (search_path_size--) {
-        free(search_path[search_path_size]);
-    }
-    free(search_path);
-}
-
 static void app_profile_load_global_settings(CtkAppProfile *ctk_app_profile,
                                              AppProfileConfig *config)
 {
@@ -3754,13 +3851,13 @@ static void app_profile_reload(CtkAppProfile *ctk_app_profile)
     nv_app_profile_config_free(ctk_app_profile->cur_config);
     nv_app_profile_config_free(ctk_app_profile->gold_config);
 
-    search_path = get_default_search_path(&search_path_size);
-    global_config_file = get_default_global_config_file();
+    search_path = nv_app_profile_config_get_default_search_path(&search_path_size);
+    global_config_file = nv_app_profile_config_get_default_global_config_file();
     ctk_app_profile->gold_config = nv_app_profile_config_load(global_config_file,
                                                               search_path,
                                                               search_path_size);
     ctk_app_profile->cur_config = nv_app_profile_config_dup(ctk_app_profile->gold_config);
-    free_search_path(search_path, search_path_size);
+    nv_app_profile_config_free_search_path(search_path, search_path_size);
     free(global_config_file);
 
     ctk_apc_profile_model_attach(ctk_app_profile->apc_profile_model, ctk_app_profile->cur_config);
@@ -3811,6 +3908,368 @@ static void reload_callback(GtkWidget *widget, gpointer user_data)
     g_string_free(nonfatal_errors, TRUE);
 }
 
+/*
+ * Files in the search path may be rewritten by other tools (e.g. configuration
+ * management) while the page is open. On Linux, watch the search path with
+ * inotify and reload just the files that change.
+ */
+
+#if defined(__linux__)
+
+#define APP_PROFILE_RELOAD_DELAY 250 /* milliseconds */
+
+#define APP_PROFILE_WATCH_MASK (IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | \
+                                IN_MOVED_FROM | IN_MOVED_TO)
+
+static gboolean app_profile_dialogs_visible(CtkAppProfile *ctk_app_profile)
+{
+    return ctk_widget_get_visible(ctk_app_profile->edit_rule_dialog->top_window) ||
+           ctk_widget_get_visible(ctk_app_profile->edit_profile_dialog->top_window) ||
+           ctk_widget_get_visible(ctk_app_profile->save_app_profile_changes_dialog->top_window);
+}
+
+static gboolean app_profile_is_search_path_entry(AppProfileConfig *config,
+                                                 const char *path)
+{
+    size_t i;
+
+    for (i = 0; i < config->search_path_count; i++) {
+        if (!strcmp(path, config->search_path[i])) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static void app_profile_watch_dir(CtkAppProfile *ctk_app_profile,
+                                  const char *dirname)
+{
+    int wd;
+
+    wd = inotify_add_watch(ctk_app_profile->inotify_fd, dirname,
+                           APP_PROFILE_WATCH_MASK);
+    if (wd >= 0) {
+        g_hash_table_replace(ctk_app_profile->watched_dirs,
+                             GINT_TO_POINTER(wd), g_strdup(dirname));
+    }
+}
+
+static void app_profile_watch_search_path_dir(CtkAppProfile *ctk_app_profile,
+                                              const char *path)
+{
+    struct stat stat_buf;
+
+    if ((stat(path, &stat_buf) == 0) && S_ISDIR(stat_buf.st_mode)) {
+        app_profile_watch_dir(ctk_app_profile, path);
+    }
+}
+
+/*
+ * Watch the directory containing a search path entry. If it does not exist
+ * yet, watch its nearest existing ancestor instead, so that creating the
+ * missing directories is noticed (see app_profile_read_events()).
+ */
+static void app_profile_watch_search_path_parent(CtkAppProfile *ctk_app_profile,
+                                                 const char *path)
+{
+    struct stat stat_buf;
+    gchar *dirname = g_path_get_dirname(path);
+    gchar *parent;
+
+    while ((stat(dirname, &stat_buf) < 0) || !S_ISDIR(stat_buf.st_mode)) {
+        parent = g_path_get_dirname(dirname);
+        if (!strcmp(parent, dirname)) {
+            g_free(parent);
+            break;
+        }
+        g_free(dirname);
+        dirname = parent;
+    }
+
+    app_profile_watch_dir(ctk_app_profile, dirname);
+    g_free(dirname);
+}
+
+static void app_profile_watch_search_path_entries(CtkAppProfile *ctk_app_profile)
+{
+    AppProfileConfig *config = ctk_app_profile->gold_config;
+    size_t i;
+
+    for (i = 0; i < config->search_path_count; i++) {
+        app_profile_watch_search_path_parent(ctk_app_profile,
+                                             config->search_path[i]);
+        app_profile_watch_search_path_dir(ctk_app_profile,
+                                          config->search_path[i]);
+    }
+}
+
+/*
+ * Returns TRUE if path is a proper ancestor directory of a search path
+ * entry's directory, i.e. one of the directories that must be created before
+ * that entry can be.
+ */
+static gboolean app_profile_is_search_path_ancestor(AppProfileConfig *config,
+                                                    const char *path)
+{
+    size_t len = strlen(path);
+    size_t i;
+
+    for (i = 0; i < config->search_path_count; i++) {
+        const char *entry = config->search_path[i];
+
+        if (!strncmp(entry, path, len) && (entry[len] == '/') &&
+            strchr(entry + len + 1, '/')) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static gboolean app_profile_process_reloads(gpointer user_data)
+{
+    CtkAppProfile *ctk_app_profile = CTK_APP_PROFILE(user_data);
+    AppProfileConfig *gold_config = ctk_app_profile->gold_config;
+    AppProfileConfig *cur_config = ctk_app_profile->cur_config;
+    json_t *pending = ctk_app_profile->pending_reloads;
+    const char *path;
+    void *iter;
+    size_t next_free_rule_id;
+    gboolean changed = FALSE;
+    gboolean skipped = FALSE;
+
+    // Rule IDs and profiles may disappear from under an open dialog box, so
+    // wait until the user is done with it
+    if (app_profile_dialogs_visible(ctk_app_profile)) {
+        return TRUE;
+    }
+
+    for (iter = json_object_iter(pending);
+         iter;
+         iter = json_object_iter_next(pending, iter)) {
+        path = json_object_iter_key(iter);
+
+        if (nv_app_profile_config_check_modified_path(cur_config, path)) {
+            // Don't clobber unsaved changes; the user is warned about the
+            // conflict by nv_app_profile_config_check_backing_files() when
+            // saving or reloading
+            skipped = TRUE;
+            continue;
+        }
+
+        // Reloaded rules get new IDs; keep them in sync between the two
+        // configurations so they can still be compared
+        next_free_rule_id = MAX(gold_config->next_free_rule_id,
+                                cur_config->next_free_rule_id);
+        gold_config->next_free_rule_id = next_free_rule_id;
+        cur_config->next_free_rule_id = next_free_rule_id;
+
+        nv_app_profile_config_reload_path(gold_config, path);
+        if (nv_app_profile_config_reload_path(cur_config, path)) {
+            changed = TRUE;
+        }
+
+        // A search path directory may have been (re)created
+        if (app_profile_is_search_path_entry(cur_config, path)) {
+            app_profile_watch_search_path_dir(ctk_app_profile, path);
+        }
+    }
+
+    json_object_clear(pending);
+    ctk_app_profile->reload_timer = 0;
+
+    if (changed) {
+        ctk_apc_profile_model_refresh(ctk_app_profile->apc_profile_model);
+        ctk_apc_rule_model_refresh(ctk_app_profile->apc_rule_model);
+    }
+
+    if (skipped) {
+        ctk_config_statusbar_message(ctk_app_profile->ctk_config,
+                                     "Application profile configuration files "
+                                     "with unsaved changes were modified on "
+                                     "disk, and have not been reloaded.");
+    } else if (changed) {
+        ctk_config_statusbar_message(ctk_app_profile->ctk_config,
+                                     "Application profile configuration files "
+                                     "modified on disk have been reloaded.");
+    }
+
+    return FALSE;
+}
+
+/*
+ * Reads the pending inotify events, and adds changes to search path entries to
+ * the set of paths to reload. Paths found in the ignored_paths object (if
+ * any) are dropped instead. Hidden files, such as the temporary files and
+ * backups written while saving, are always dropped.
+ */
+static void app_profile_read_events(CtkAppProfile *ctk_app_profile,
+                                    json_t *ignored_paths)
+{
+    AppProfileConfig *config = ctk_app_profile->gold_config;
+    long buf[4096 / sizeof(long)];
+    const struct inotify_event *event;
+    const char *dirname;
+    char *path, *ptr;
+    ssize_t len;
+    gboolean rewatch = FALSE;
+    size_t i;
+
+    while ((len = read(ctk_app_profile->inotify_fd, buf, sizeof(buf))) > 0) {
+        for (ptr = (char *)buf;
+             ptr < (char *)buf + len;
+             ptr += sizeof(struct inotify_event) + event->len) {
+            event = (const struct inotify_event *)ptr;
+
+            if (event->mask & IN_IGNORED) {
+                // The watched directory was removed
+                g_hash_table_remove(ctk_app_profile->watched_dirs,
+                                    GINT_TO_POINTER(event->wd));
+                continue;
+            }
+
+            dirname = g_hash_table_lookup(ctk_app_profile->watched_dirs,
+                                          GINT_TO_POINTER(event->wd));
+            if (!dirname || !event->len || (event->name[0] == '.')) {
+                continue;
+            }
+
+            path = nvstrcat(dirname, "/", event->name, NULL);
+
+            // A missing directory leading to a search path entry was created;
+            // watch it, and pick up any entries created along with it
+            if ((event->mask & IN_ISDIR) &&
+                (event->mask & (IN_CREATE | IN_MOVED_TO)) &&
+                app_profile_is_search_path_ancestor(config, path)) {
+                rewatch = TRUE;
+                for (i = 0; i < config->search_path_count; i++) {
+                    size_t path_len = strlen(path);
+
+                    if (!strncmp(config->search_path[i], path, path_len) &&
+                        (config->search_path[i][path_len] == '/')) {
+                        json_object_set_new(ctk_app_profile->pending_reloads,
+                                            config->search_path[i],
+                                            json_true());
+                    }
+                }
+            }
+
+            // The parent directories of search path entries are watched as
+            // well; ignore anything in them that is not in the search path
+            if ((!ignored_paths || !json_object_get(ignored_paths, path)) &&
+                (app_profile_is_search_path_entry(config, dirname) ||
+                 app_profile_is_search_path_entry(config, path))) {
+                json_object_set_new(ctk_app_profile->pending_reloads,
+                                    path, json_true());
+            }
+            free(path);
+        }
+    }
+
+    if (rewatch) {
+        app_profile_watch_search_path_entries(ctk_app_profile);
+    }
+}
+
+static gboolean app_profile_watch_event(GIOChannel *source,
+                                        GIOCondition condition,
+                                        gpointer user_data)
+{
+    CtkAppProfile *ctk_app_profile = CTK_APP_PROFILE(user_data);
+
+    app_profile_read_events(ctk_app_profile, NULL);
+
+    // Tools often write several files at once; batch them up
+    if (json_object_size(ctk_app_profile->pending_reloads) &&
+        !ctk_app_profile->reload_timer) {
+        ctk_app_profile->reload_timer =
+            g_timeout_add(APP_PROFILE_RELOAD_DELAY,
+                          app_profile_process_reloads,
+                          (gpointer)ctk_app_profile);
+    }
+
+    return TRUE;
+}
+
+/*
+ * Watch each directory in the search path, as well as the directories
+ * containing the search path entries, so that entries which are created,
+ * removed or replaced are picked up too.
+ */
+static void app_profile_watch_search_path(CtkAppProfile *ctk_app_profile)
+{
+    GIOChannel *channel;
+
+    ctk_app_profile->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (ctk_app_profile->inotify_fd < 0) {
+        return;
+    }
+
+    ctk_app_profile->watched_dirs =
+        g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+
+    app_profile_watch_search_path_entries(ctk_app_profile);
+
+    channel = g_io_channel_unix_new(ctk_app_profile->inotify_fd);
+    ctk_app_profile->watch_source =
+        g_io_add_watch(channel, G_IO_IN, app_profile_watch_event,
+                       (gpointer)ctk_app_profile);
+    g_io_channel_unref(channel);
+}
+
+/*
+ * Drops the inotify events caused by saving the given updates from this page,
+ * so that the saved files are not reloaded as if modified by another program.
+ * inotify queues events as the files are written, so they are all pending by
+ * the time the save returns. Only the events for the files written (and the
+ * directories the save may have created for them) are dropped; changes made
+ * to other files meanwhile are still reloaded.
+ */
+static void app_profile_ignore_own_changes(CtkAppProfile *ctk_app_profile,
+                                           json_t *updates)
+{
+    json_t *ignored_paths;
+    const char *filename;
+    gchar *dirname;
+    size_t i, size;
+
+    if (ctk_app_profile->inotify_fd < 0) {
+        return;
+    }
+
+    ignored_paths = json_object();
+    for (i = 0, size = json_array_size(updates); i < size; i++) {
+        filename = json_string_value(json_object_get(json_array_get(updates, i),
+                                                     "filename"));
+        if (!filename) {
+            continue;
+        }
+        json_object_set_new(ignored_paths, filename, json_true());
+
+        dirname = g_path_get_dirname(filename);
+        json_object_set_new(ignored_paths, dirname, json_true());
+        g_free(dirname);
+    }
+
+    app_profile_read_events(ctk_app_profile, ignored_paths);
+    json_decref(ignored_paths);
+
+    // Saving may have created search path directories
+    app_profile_watch_search_path_entries(ctk_app_profile);
+
+    // Other files may have changed meanwhile
+    if (json_object_size(ctk_app_profile->pending_reloads) &&
+        !ctk_app_profile->reload_timer) {
+        ctk_app_profile->reload_timer =
+            g_timeout_add(APP_PROFILE_RELOAD_DELAY,
+                          app_profile_process_reloads,
+                          (gpointer)ctk_app_profile);
+    }
+}
+
+#endif
+
 static void save_changes_callback(GtkWidget *widget, gpointer user_data);
 
 static ToolbarItemTemplate *get_save_reload_toolbar_items(CtkAppProfile *ctk_app_profile, size_t *num_save_reload_toolbar_items)
@@ -3893,6 +4352,9 @@ static void save_app_profile_changes_dialog_save_changes(GtkWidget *widget, gpoi
         ret = nv_app_profile_config_save_updates(ctk_app_profile->cur_config,
                                                  dialog->updates,
                                                  do_backup, &write_errors);
+#if defined(__linux__)
+        app_profile_ignore_own_changes(ctk_app_profile, dialog->updates);
+#endif
         if (ret < 0) {
             if (!write_errors) {
                 write_errors = strdup("Unknown error.");
@@ -4275,12 +4737,64 @@ static const char __profiles_page_extended_help[] =
     "button is clicked.";
 
 
+static void help_add_key_docs(GtkTextBuffer *b, GtkTextIter *i,
+                              AppProfileKeyDocs *key_docs)
+{
+    size_t j, num_keys = nv_app_profile_key_docs_count(key_docs);
+
+    if (num_keys > 0) {
+        ctk_help_para(b, i, "This NVIDIA® Linux Graphics Driver supports the following application profile setting "
+                            "keys. For more information on a given key, please consult the README.");
+
+        for (j = 0; j < num_keys; j++) {
+            ctk_help_term(b, i, "%s", nv_app_profile_key_docs_get_key(key_docs, j));
+            ctk_help_para(b, i, "%s", nv_app_profile_key_docs_get_description(key_docs, j));
+        }
+    } else {
+        ctk_help_para(b, i, "There was an error reading the application profile setting "
+                            "keys resource file. For information on available keys, please "
+                            "consult the README.");
+    }
+}
+
+static gboolean help_fill_key_docs(gpointer user_data)
+{
+    GtkTextBuffer *b = GTK_TEXT_BUFFER(user_data);
+    GtkTextMark *mark = gtk_text_buffer_get_mark(b, "key-docs");
+    GtkTextIter i;
+
+    if (mark) {
+        gtk_text_buffer_get_iter_at_mark(b, &i, mark);
+        gtk_text_buffer_delete_mark(b, mark);
+        help_add_key_docs(b, &i, g_object_get_data(G_OBJECT(b), "key-docs"));
+        ctk_help_finish(b);
+    }
+
+    g_object_unref(b);
+    return FALSE;
+}
+
+/*
+ * The list of supported keys needs the key documentation file, so it is only
+ * added to the help text when the help page is first shown; showing the page
+ * places the cursor, which emits "mark-set". The text is inserted from an idle
+ * callback, as the help window still holds iterators into the buffer while
+ * the signal is emitted.
+ */
+static void help_buffer_mark_set(GtkTextBuffer *b, GtkTextIter *location,
+                                 GtkTextMark *mark, gpointer user_data)
+{
+    g_signal_handlers_disconnect_by_func(b, G_CALLBACK(help_buffer_mark_set),
+                                         user_data);
+    g_idle_add(help_fill_key_docs, g_object_ref(b));
+}
+
 GtkTextBuffer *ctk_app_profile_create_help(CtkAppProfile *ctk_app_profile, GtkTextTagTable *table)
 {
     size_t j;
     GtkTextIter i;
     GtkTextBuffer *b;
-    json_t * key_docs = ctk_app_profile->key_docs;
+    AppProfileKeyDocs *key_docs = ctk_app_profile->key_docs;
 
     b = gtk_text_buffer_new(table);
     gtk_text_buffer_get_iter_at_offset(b, &i, 0);
@@ -4372,21 +4886,13 @@ GtkTextBuffer *ctk_app_profile_create_help(CtkAppProfile *ctk_app_profile, GtkTe
 
     ctk_help_heading(b, &i, "Supported Setting Keys");
 
-    if (json_array_size(key_docs) > 0) {
-        ctk_help_para(b, &i, "This NVIDIA® Linux Graphics Driver supports the following application profile setting "
-                             "keys. For more information on a given key, please consult the README.");
-
-        for (j = 0; j < json_array_size(key_docs); j++) {
-            json_t *key_obj = json_array_get(key_docs, j);
-            json_t *key_name = json_object_get(key_obj, "key");
-            json_t *key_desc = json_object_get(key_obj, "description");
-            ctk_help_term(b, &i, "%s", json_string_value(key_name));
-            ctk_help_para(b, &i, "%s", json_string_value(key_desc));
-        }
+    if (nv_app_profile_key_docs_is_loaded(key_docs)) {
+        help_add_key_docs(b, &i, key_docs);
     } else {
-        ctk_help_para(b, &i, "There was an error reading the application profile setting "
-                             "keys resource file. For information on available keys, please "
-                             "consult the README.");
+        gtk_text_buffer_create_mark(b, "key-docs", &i, TRUE);
+        g_object_set_data(G_OBJECT(b), "key-docs", key_docs);
+        g_signal_connect(G_OBJECT(b), "mark-set",
+                         G_CALLBACK(help_buffer_mark_set), NULL);
     }
 
     ctk_help_finish(b);
@@ -4439,22 +4945,22 @@ GtkWidget* ctk_app_profile_new(CtrlTarget *ctrl_target,
 
     gtk_box_set_spacing(GTK_BOX(ctk_app_profile), 10);
 
-    /* Load registry keys resource file */
+    /* Locate the registry keys resource file; it is read on first use */
     driver_version = get_nvidia_driver_version(ctrl_target);
     keys_file = get_default_keys_file(driver_version);
     free(driver_version);
-    ctk_app_profile->key_docs = nv_app_profile_key_documentation_load(keys_file);
+    ctk_app_profile->key_docs = nv_app_profile_key_docs_new(keys_file);
     free(keys_file);
 
     /* Load app profile settings */
     // TODO only load this if the page is exposed
-    search_path = get_default_search_path(&search_path_size);
-    global_config_file = get_default_global_config_file();
+    search_path = nv_app_profile_config_get_default_search_path(&search_path_size);
+    global_config_file = nv_app_profile_config_get_default_global_config_file();
     ctk_app_profile->gold_config = nv_app_profile_config_load(global_config_file,
                                                               search_path,
                                                               search_path_size);
     ctk_app_profile->cur_config = nv_app_profile_config_dup(ctk_app_profile->gold_config);
-    free_search_path(search_path, search_path_size);
+    nv_app_profile_config_free_search_path(search_path, search_path_size);
     free(global_config_file);
 
     ctk_app_profile->apc_profile_model = ctk_apc_profile_model_new(ctk_app_profile->cur_config);
@@ -4535,5 +5041,15 @@ GtkWidget* ctk_app_profile_new(CtrlTarget *ctrl_target,
     ctk_app_profile->edit_profile_dialog = edit_profile_dialog_new(ctk_app_profile);
     ctk_app_profile->save_app_profile_changes_dialog = save_app_profile_changes_dialog_new(ctk_app_profile);
 
+    /* Watch the search path for changes made by other programs */
+    ctk_app_profile->inotify_fd = -1;
+    ctk_app_profile->watched_dirs = NULL;
+    ctk_app_profile->pending_reloads = json_object();
+    ctk_app_profile->reload_timer = 0;
+    ctk_app_profile->watch_source = 0;
+#if defined(__linux__)
+    app_profile_watch_search_path(ctk_app_profile);
+#endif
+
     return GTK_WIDGET(ctk_app_profile);
 }
@@ -156,7 +156,7 @@ struct _CtkAppProfile
     CtkConfig *ctk_config;
 
     AppProfileConfig *gold_config, *cur_config;
-    json_t *key_docs;
+    AppProfileKeyDocs *key_docs;
 
     // Interfaces layered on top of the config object for use with GtkTreeView
     CtkApcProfileModel *apc_profile_model;
@@ -184,6 +184,13 @@ struct _CtkAppProfile
 
     GList *save_reload_help_data;
 
+    // Watches on the search path, used to reload files changed on disk
+    int inotify_fd;
+    guint watch_source;
+    GHashTable *watched_dirs; // watch descriptor -> directory name
+    json_t *pending_reloads;  // set of paths waiting to be reloaded
+    guint reload_timer;
+
     // TODO: provide undo functionality
 };
 
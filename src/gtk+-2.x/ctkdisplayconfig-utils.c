@@ -19,11 +19,10 @@
 
 #include <stdlib.h> /* malloc */
 #include <string.h> /* strlen,  strdup */
-#include <unistd.h> /* lseek, close */
+#include <unistd.h> /* access, unlink */
 #include <errno.h>
 
 #include <fcntl.h>
-#include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <pwd.h>
@@ -44,6 +43,8 @@ static void xconfig_update_buffer(GtkWidget *widget, gpointer user_data);
 static gchar *display_pick_config_name(nvDisplayPtr display,
                                        int force_target_id_name);
 static Bool screen_check_metamodes(nvScreenPtr screen);
+static void set_query(CtrlAttributeQuery *query, CtrlTarget *ctrl_target,
+                      CtrlAttributeType attr_type, int attr);
 
 
 
@@ -216,6 +217,366 @@ void apply_screen_info_token(char *token, char *value, void *data)
 /*****************************************************************************/
 
 
+/** modepool_alloc() *************************************************
+ *
+ * Allocates zeroed memory from the modepool's arena.  The memory lives
+ * until modepool_clear() is called on the pool.
+ *
+ **/
+#define MODEPOOL_CHUNK_SIZE  16384
+#define MODEPOOL_ALIGN(x) \
+    (((x) + sizeof(double) - 1) & ~(sizeof(double) - 1))
+
+static void *modepool_alloc(nvModePoolPtr pool, size_t size)
+{
+    nvModePoolChunkPtr chunk = pool->chunks;
+    const size_t header = MODEPOOL_ALIGN(sizeof(nvModePoolChunk));
+    char *ptr;
+
+    size = MODEPOOL_ALIGN(size);
+
+    if (!chunk || (chunk->size - chunk->used) < size) {
+        size_t chunk_size = MODEPOOL_CHUNK_SIZE;
+
+        if (chunk_size < header + size) {
+            chunk_size = header + size;
+        }
+
+        chunk = calloc(1, chunk_size);
+        if (!chunk) return NULL;
+
+        chunk->used = header;
+        chunk->size = chunk_size;
+        chunk->next = pool->chunks;
+        pool->chunks = chunk;
+    }
+
+    ptr = (char *)chunk + chunk->used;
+    chunk->used += size;
+
+    return ptr;
+
+} /* modepool_alloc() */
+
+
+
+/** modepool_read_name() *********************************************
+ *
+ * Same as parse_read_name(), but copies the name into the modepool's
+ * arena.
+ *
+ **/
+static const char *modepool_read_name(nvModePoolPtr pool, const char *str,
+                                      char **name, char term)
+{
+    const char *tmp;
+
+    str = parse_skip_whitespace(str);
+    tmp = str;
+    while (*str &&
+           ((term == 0) ?
+            !(*str == ' ' || *str == '\t' || *str == '\n' || *str == '\r') :
+            (*str != term))) {
+        str++;
+    }
+
+    *name = modepool_alloc(pool, str - tmp + 1);
+    if (!*name) return NULL;
+    memcpy(*name, tmp, str - tmp);
+
+    if (*str) {
+        str++;
+    }
+    return parse_skip_whitespace(str);
+
+} /* modepool_read_name() */
+
+
+
+/** modeline_hash_str() **********************************************
+ *
+ * Folds a string into an FNV-1a hash, optionally ignoring ASCII case.
+ *
+ **/
+static unsigned int modeline_hash_str(unsigned int hash, const char *str,
+                                      Bool ignore_case)
+{
+    if (!str) return hash;
+
+    for (; *str; str++) {
+        unsigned char c = (unsigned char)*str;
+        if (ignore_case) {
+            c = (unsigned char)g_ascii_tolower(c);
+        }
+        hash = (hash ^ c) * 16777619u;
+    }
+
+    return hash;
+
+} /* modeline_hash_str() */
+
+
+
+/** modeline_timings_hash() ******************************************
+ *
+ * Hashes everything modelines_match() compares, so that matching
+ * modelines always hash the same.
+ *
+ **/
+static unsigned int modeline_timings_hash(const nvModeLine *m)
+{
+    const int values[] = {
+        m->data.hdisplay, m->data.hsyncstart, m->data.hsyncend,
+        m->data.htotal, m->data.vdisplay, m->data.vsyncstart,
+        m->data.vsyncend, m->data.vtotal, m->data.vscan,
+        m->data.flags, m->data.hskew,
+    };
+    unsigned int hash = 2166136261u;
+    int i;
+
+    for (i = 0; i < ARRAY_LEN(values); i++) {
+        hash = (hash ^ (unsigned int)values[i]) * 16777619u;
+    }
+    hash = modeline_hash_str(hash, m->data.clock, TRUE);
+    hash = modeline_hash_str(hash, m->data.identifier, TRUE);
+
+    return hash;
+
+} /* modeline_timings_hash() */
+
+
+
+/** modepool_grow() **************************************************
+ *
+ * Doubles the number of hash buckets of the modepool and rehashes the
+ * modelines into them.
+ *
+ **/
+static Bool modepool_grow(nvModePoolPtr pool)
+{
+    unsigned int num_buckets = pool->num_buckets ? pool->num_buckets * 2 : 64;
+    nvModeLinePtr *timing_buckets;
+    nvModeLinePtr *name_buckets;
+    unsigned int i;
+
+    timing_buckets = calloc(num_buckets, sizeof(nvModeLinePtr));
+    name_buckets = calloc(num_buckets, sizeof(nvModeLinePtr));
+    if (!timing_buckets || !name_buckets) {
+        free(timing_buckets);
+        free(name_buckets);
+        return FALSE;
+    }
+
+    for (i = 0; i < pool->num_buckets; i++) {
+        nvModeLinePtr m, next;
+
+        for (m = pool->timing_buckets[i]; m; m = next) {
+            unsigned int idx = m->hash & (num_buckets - 1);
+            next = m->hash_next;
+            m->hash_next = timing_buckets[idx];
+            timing_buckets[idx] = m;
+        }
+        for (m = pool->name_buckets[i]; m; m = next) {
+            unsigned int idx = m->name_hash & (num_buckets - 1);
+            next = m->name_next;
+            m->name_next = name_buckets[idx];
+            name_buckets[idx] = m;
+        }
+    }
+
+    free(pool->timing_buckets);
+    free(pool->name_buckets);
+    pool->timing_buckets = timing_buckets;
+    pool->name_buckets = name_buckets;
+    pool->num_buckets = num_buckets;
+
+    return TRUE;
+
+} /* modepool_grow() */
+
+
+
+/** modepool_add_modeline() ******************************************
+ *
+ * Adds a modeline allocated from the modepool to the pool's indices.
+ * Modelines must be added in the order they appear in the display's
+ * modeline list.
+ *
+ **/
+static Bool modepool_add_modeline(nvModePoolPtr pool, nvModeLinePtr m)
+{
+    unsigned int idx;
+
+    if ((unsigned int)pool->num_modelines >= pool->num_buckets &&
+        !modepool_grow(pool)) {
+        return FALSE;
+    }
+
+    m->pool = pool;
+    m->seq = pool->next_seq++;
+    m->hash = modeline_timings_hash(m);
+    m->name_hash = modeline_hash_str(2166136261u, m->data.identifier, FALSE);
+
+    idx = m->hash & (pool->num_buckets - 1);
+    m->hash_next = pool->timing_buckets[idx];
+    pool->timing_buckets[idx] = m;
+
+    idx = m->name_hash & (pool->num_buckets - 1);
+    m->name_next = pool->name_buckets[idx];
+    pool->name_buckets[idx] = m;
+
+    pool->num_modelines++;
+    pool->sorted_valid = FALSE;
+
+    return TRUE;
+
+} /* modepool_add_modeline() */
+
+
+
+/** modepool_remove_modeline() ***************************************
+ *
+ * Removes a modeline from the modepool's indices.  Its memory remains
+ * in the arena until the pool is cleared.
+ *
+ **/
+static void modepool_remove_modeline(nvModePoolPtr pool, nvModeLinePtr m)
+{
+    nvModeLinePtr *link;
+
+    if (!pool->num_buckets) return;
+
+    link = &pool->timing_buckets[m->hash & (pool->num_buckets - 1)];
+    while (*link && *link != m) {
+        link = &(*link)->hash_next;
+    }
+    if (*link) {
+        *link = m->hash_next;
+    }
+
+    link = &pool->name_buckets[m->name_hash & (pool->num_buckets - 1)];
+    while (*link && *link != m) {
+        link = &(*link)->name_next;
+    }
+    if (*link) {
+        *link = m->name_next;
+    }
+
+    pool->num_modelines--;
+    pool->sorted_valid = FALSE;
+
+} /* modepool_remove_modeline() */
+
+
+
+/** modepool_clear() *************************************************
+ *
+ * Releases the modepool's arena and indices.  All modelines allocated
+ * from the pool become invalid.
+ *
+ **/
+static void modepool_clear(nvModePoolPtr pool)
+{
+    nvModePoolChunkPtr chunk, next;
+
+    for (chunk = pool->chunks; chunk; chunk = next) {
+        next = chunk->next;
+        free(chunk);
+    }
+
+    free(pool->timing_buckets);
+    free(pool->name_buckets);
+    free(pool->sorted);
+
+    memset(pool, 0, sizeof(nvModePool));
+
+} /* modepool_clear() */
+
+
+
+/** modepool_set_order() *********************************************
+ *
+ * Renumbers the modepool's modelines to follow the order of the given
+ * modeline list.
+ *
+ **/
+static void modepool_set_order(nvModePoolPtr pool, nvModeLinePtr modelines)
+{
+    nvModeLinePtr m;
+
+    pool->next_seq = 0;
+    for (m = modelines; m; m = m->next) {
+        m->seq = pool->next_seq++;
+    }
+    pool->sorted_valid = FALSE;
+
+} /* modepool_set_order() */
+
+
+
+/** modepool_compare_sorted() ****************************************
+ *
+ * qsort() callback ordering modelines by width, height, refresh rate
+ * and then by their position in the modeline list.
+ *
+ **/
+static int modepool_compare_sorted(const void *a, const void *b)
+{
+    const nvModeLine *m1 = *(const nvModeLine * const *)a;
+    const nvModeLine *m2 = *(const nvModeLine * const *)b;
+
+    if (m1->data.hdisplay != m2->data.hdisplay) {
+        return (m1->data.hdisplay < m2->data.hdisplay) ? -1 : 1;
+    }
+    if (m1->data.vdisplay != m2->data.vdisplay) {
+        return (m1->data.vdisplay < m2->data.vdisplay) ? -1 : 1;
+    }
+    if (m1->refresh_rate != m2->refresh_rate) {
+        return (m1->refresh_rate < m2->refresh_rate) ? -1 : 1;
+    }
+    return m1->seq - m2->seq;
+
+} /* modepool_compare_sorted() */
+
+
+
+/** modepool_update_sorted() *****************************************
+ *
+ * (Re)builds the modepool's size index if modelines were added or
+ * removed since it was last built.
+ *
+ **/
+static Bool modepool_update_sorted(nvModePoolPtr pool)
+{
+    nvModeLinePtr *sorted;
+    unsigned int i;
+    int n = 0;
+
+    if (pool->sorted_valid) return TRUE;
+
+    sorted = realloc(pool->sorted,
+                     (pool->num_modelines + 1) * sizeof(nvModeLinePtr));
+    if (!sorted) return FALSE;
+    pool->sorted = sorted;
+
+    for (i = 0; i < pool->num_buckets; i++) {
+        nvModeLinePtr m;
+        for (m = pool->timing_buckets[i]; m; m = m->hash_next) {
+            sorted[n++] = m;
+        }
+    }
+
+    qsort(sorted, n, sizeof(nvModeLinePtr), modepool_compare_sorted);
+
+    pool->num_sorted = n;
+    pool->sorted_valid = TRUE;
+
+    return TRUE;
+
+} /* modepool_update_sorted() */
+
+
+
 /** modeline_parse() *************************************************
  *
  * Converts a modeline string to an modeline structure that the
@@ -225,6 +586,9 @@ void apply_screen_info_token(char *token, char *value, void *data)
  *
  *   "mode_name"  dot_clock  timings  flags
  *
+ * The modeline and its strings are allocated from the display's
+ * modepool.
+ *
  **/
 static nvModeLinePtr modeline_parse(nvDisplayPtr display,
                                     nvGpuPtr gpu,
@@ -240,7 +604,7 @@ static nvModeLinePtr modeline_parse(nvDisplayPtr display,
 
     if (!str) return NULL;
 
-    modeline = (nvModeLinePtr)calloc(1, sizeof(nvModeLine));
+    modeline = modepool_alloc(&display->modepool, sizeof(nvModeLine));
     if (!modeline) return NULL;
 
     /* Parse the modeline tokens */
@@ -258,11 +622,13 @@ static nvModeLinePtr modeline_parse(nvDisplayPtr display,
     str = parse_skip_whitespace(str);
     if (!str || *str != '"') goto fail;
     str++;
-    str = parse_read_name(str, &(modeline->data.identifier), '"');
+    str = modepool_read_name(&display->modepool, str,
+                             &(modeline->data.identifier), '"');
     if (!str) goto fail;
 
     /* Read dot clock */
-    str = parse_read_name(str, &(modeline->data.clock), 0);
+    str = modepool_read_name(&display->modepool, str,
+                             &(modeline->data.clock), 0);
     if (!str) goto fail;
 
     /* Read the mode timings */
@@ -397,9 +763,11 @@ static nvModeLinePtr modeline_parse(nvDisplayPtr display,
     return modeline;
 
 
-    /* Handle failures */
+    /* Handle failures; the modeline's memory is reclaimed along with the
+     * rest of the modepool.
+     */
  fail:
-    free(modeline);
+    free(modeline->xconfig_name);
 
     return NULL;
 
@@ -480,9 +848,14 @@ void mode_set_modeline(nvModePtr mode,
         /* NULL modeline given (display is being turned off), use a default
          * resolution to show the display.
          */
+        if (!mode->display->modelines) {
+            display_load_modelines(mode->display);
+        }
         if (mode->display->modelines) {
             // XXX assumes that the first modeline in the display's list is the
-            //     default (nvidia-auto-select).
+            //     default (nvidia-auto-select).  Until the rest of the
+            //     display's modepool is queried, this is its current
+            //     modeline.
             width = mode->display->modelines->data.hdisplay;
             height = mode->display->modelines->data.vdisplay;
         } else {
@@ -699,12 +1072,12 @@ nvModePtr mode_parse(nvDisplayPtr display, const char *mode_str)
 
 
     /* Find the display's modeline that matches the given mode name */
-    modeline = display->modelines;
-    while (modeline) {
-        if (!strcmp(mode_name, modeline->data.identifier)) {
-            break;
-        }
-        modeline = modeline->next;
+    modeline = display_find_modeline_by_name(display, mode_name);
+
+    /* Modes other than the current one need the rest of the modepool */
+    if (!modeline && display->modelines_pending && strcmp(mode_name, "NULL")) {
+        display_load_modelines(display);
+        modeline = display_find_modeline_by_name(display, mode_name);
     }
 
     /* If we can't find a matching modeline, set the NULL mode. */
@@ -895,70 +1268,83 @@ void get_underscan_settings_from_viewportout(const nvSize raster_size,
 
 
 
-/** mode_get_str() ***************************************************
+/** mode_str_begin_flag() ********************************************
+ *
+ * Appends the separator that goes before a mode flag: " {" before the
+ * first flag, ", " before the others.
+ *
+ **/
+static void mode_str_begin_flag(GString *mode_str, Bool *has_flags)
+{
+    g_string_append(mode_str, *has_flags ? ", " : " {");
+    *has_flags = TRUE;
+
+} /* mode_str_begin_flag() */
+
+
+
+/** mode_append_str() ************************************************
  *
- * Returns the mode string of the given mode in the following format:
+ * Appends the mode string of the given mode to 'mode_str' in the
+ * following format:
  *
  * "mode_name @WxH +X+Y"
  *
+ * Returns FALSE (and appends nothing) if the mode has no mode string.
+ *
  **/
-static gchar *mode_get_str(nvModePtr mode, int force_target_id_name)
+static Bool mode_append_str(GString *mode_str, nvModePtr mode,
+                            int force_target_id_name)
 {
-    gchar *mode_str;
-    gchar *tmp;
-    gchar *flags_str;
+    gchar *name;
+    Bool has_flags;
     nvDisplayPtr display;
     nvScreenPtr screen;
     nvGpuPtr gpu;
 
     /* Make sure the mode has everything it needs to be displayed */
     if (!mode || !mode->metamode || !mode->display) {
-        return NULL;
+        return FALSE;
     }
 
     display = mode->display;
 
     /* Don't include dummy modes */
     if (mode->dummy && !mode->modeline) {
-        return NULL;
+        return FALSE;
     }
 
     screen = display->screen;
     gpu = display->gpu;
     if (!screen || !gpu) {
-        return NULL;
+        return FALSE;
     }
 
     /* Pick a suitable display name qualifier */
-    mode_str = display_pick_config_name(display, force_target_id_name);
-    if (mode_str[0] != '\0') {
-        tmp = mode_str;
-        mode_str = g_strconcat(tmp, ": ", NULL);
-        g_free(tmp);
+    name = display_pick_config_name(display, force_target_id_name);
+    if (name[0] != '\0') {
+        g_string_append(mode_str, name);
+        g_string_append(mode_str, ": ");
     }
+    g_free(name);
 
 
     /* NULL mode */
     if (!mode->modeline) {
-        tmp = g_strconcat(mode_str, "NULL", NULL);
-        g_free(mode_str);
-        return tmp;
+        g_string_append(mode_str, "NULL");
+        return TRUE;
     }
 
 
     /* Mode name */
-    tmp = g_strconcat(mode_str, mode->modeline->data.identifier, NULL);
-    g_free(mode_str);
-    mode_str = tmp;
+    g_string_append(mode_str, mode->modeline->data.identifier);
 
 
     /* Panning domain */
     if ((mode->pan.width != mode->viewPortIn.width) ||
         (mode->pan.height != mode->viewPortIn.height)) {
-        tmp = g_strdup_printf("%s @%dx%d",
-                              mode_str, mode->pan.width, mode->pan.height);
-        g_free(mode_str);
-        mode_str = tmp;
+        g_string_append_printf(mode_str, " @%dx%d",
+                               mode->pan.width, mode->pan.height);
     }
 
 
@@ -980,17 +1366,14 @@ static gchar *mode_get_str(nvModePtr mode, int force_target_id_name)
      *     information.
      */
 
-    tmp = g_strdup_printf("%s +%d+%d",
-                          mode_str,
-                          /* Make mode position relative */
-                          mode->pan.x - mode->metamode->edim.x,
-                          mode->pan.y - mode->metamode->edim.y);
-    g_free(mode_str);
-    mode_str = tmp;
+    g_string_append_printf(mode_str, " +%d+%d",
+                           /* Make mode position relative */
+                           mode->pan.x - mode->metamode->edim.x,
+                           mode->pan.y - mode->metamode->edim.y);
 
 
     /* Mode Flags */
-    flags_str = NULL;
+    has_flags = FALSE;
 
     /* Passive Stereo Eye */
     if (screen->stereo_supported &&
@@ -1011,10 +1394,8 @@ static gchar *mode_get_str(nvModePtr mode, int force_target_id_name)
         }
 
         if (str) {
-            tmp = g_strdup_printf("%s, stereo=%s", (flags_str ? flags_str : ""),
-                                  str);
-            g_free(flags_str);
-            flags_str = tmp;
+            mode_str_begin_flag(mode_str, &has_flags);
+            g_string_append_printf(mode_str, "stereo=%s", str);
         }
     }
 
@@ -1037,10 +1418,8 @@ static gchar *mode_get_str(nvModePtr mode, int force_target_id_name)
         }
 
         if (str) {
-            tmp = g_strdup_printf("%s, rotation=%s",
-                                  (flags_str ? flags_str : ""), str);
-            g_free(flags_str);
-            flags_str = tmp;
+            mode_str_begin_flag(mode_str, &has_flags);
+            g_string_append_printf(mode_str, "rotation=%s", str);
         }
     }
 
@@ -1063,10 +1442,8 @@ static gchar *mode_get_str(nvModePtr mode, int force_target_id_name)
         }
 
         if (str) {
-            tmp = g_strdup_printf("%s, reflection=%s",
-                                  (flags_str ? flags_str : ""), str);
-            g_free(flags_str);
-            flags_str = tmp;
+            mode_str_begin_flag(mode_str, &has_flags);
+            g_string_append_printf(mode_str, "reflection=%s", str);
         }
     }
 
@@ -1090,12 +1467,10 @@ static gchar *mode_get_str(nvModePtr mode, int force_target_id_name)
         if (mode->viewPortIn.width && mode->viewPortIn.height &&
             ((mode->viewPortIn.width != width) ||
              (mode->viewPortIn.height != height))) {
-            tmp = g_strdup_printf("%s, viewportin=%dx%d",
-                                  (flags_str ? flags_str : ""),
-                                  mode->viewPortIn.width,
-                                  mode->viewPortIn.height);
-            g_free(flags_str);
-            flags_str = tmp;
+            mode_str_begin_flag(mode_str, &has_flags);
+            g_string_append_printf(mode_str, "viewportin=%dx%d",
+                                   mode->viewPortIn.width,
+                                   mode->viewPortIn.height);
         }
     }
 
@@ -1105,26 +1480,20 @@ static gchar *mode_get_str(nvModePtr mode, int force_target_id_name)
         (mode->viewPortOut.width && mode->viewPortOut.height &&
          ((mode->viewPortOut.width != mode->modeline->data.hdisplay) ||
           (mode->viewPortOut.height != mode->modeline->data.vdisplay)))) {
-        tmp = g_strdup_printf("%s, viewportout=%dx%d%+d%+d",
-                              (flags_str ? flags_str : ""),
-                              mode->viewPortOut.width, mode->viewPortOut.height,
-                              mode->viewPortOut.x, mode->viewPortOut.y);
-        g_free(flags_str);
-        flags_str = tmp;
+        mode_str_begin_flag(mode_str, &has_flags);
+        g_string_append_printf(mode_str, "viewportout=%dx%d%+d%+d",
+                               mode->viewPortOut.width,
+                               mode->viewPortOut.height,
+                               mode->viewPortOut.x, mode->viewPortOut.y);
     }
 
-    if (flags_str) {
-        tmp = g_strdup_printf("%s {%s}",
-                              mode_str,
-                              flags_str+2 // Skip the first comma and whitespace
-                              );
-        g_free(mode_str);
-        mode_str = tmp;
+    if (has_flags) {
+        g_string_append_c(mode_str, '}');
     }
 
-    return mode_str;
+    return TRUE;
 
-} /* mode_get_str() */
+} /* mode_append_str() */
 
 
 
@@ -1280,21 +1649,31 @@ int display_find_closest_mode_matching_modeline(nvDisplayPtr display,
 /** modeline_free() *************************************
  *
  * Helper function that frees an nvModeLinePtr and
- * associated memory.
+ * associated memory.  Modelines that live in a display's
+ * modepool are only removed from the pool's indices; their
+ * memory is released when the pool is cleared.
  *
  **/
 void modeline_free(nvModeLinePtr m)
 {
     if (m->xconfig_name) {
         free(m->xconfig_name);
-    }
-
-    if (m->data.identifier) {
-        free(m->data.identifier);
+        m->xconfig_name = NULL;
     }
 
     if (m->data.comment) {
         free(m->data.comment);
+        m->data.comment = NULL;
+    }
+
+    if (m->pool) {
+        modepool_remove_modeline(m->pool, m);
+        m->pool = NULL;
+        return;
+    }
+
+    if (m->data.identifier) {
+        free(m->data.identifier);
     }
 
     if (m->data.clock) {
@@ -1373,6 +1752,41 @@ Bool viewports_out_match(const GdkRectangle viewPortOut1,
 
 
 
+/** display_find_modeline() ******************************************
+ *
+ * Returns the first modeline in the display's modeline list that
+ * matches the given modeline (see modelines_match()), or NULL if there
+ * is none.
+ *
+ **/
+nvModeLinePtr display_find_modeline(nvDisplayPtr display,
+                                    nvModeLinePtr modeline)
+{
+    nvModePoolPtr pool = &display->modepool;
+    nvModeLinePtr m, found = NULL;
+    unsigned int hash;
+
+    if (!modeline || !pool->num_buckets) {
+        return NULL;
+    }
+
+    hash = modeline->pool ? modeline->hash : modeline_timings_hash(modeline);
+
+    for (m = pool->timing_buckets[hash & (pool->num_buckets - 1)];
+         m;
+         m = m->hash_next) {
+        if (m->hash == hash && modelines_match(m, modeline) &&
+            (!found || m->seq < found->seq)) {
+            found = m;
+        }
+    }
+
+    return found;
+
+} /* display_find_modeline() */
+
+
+
 /** display_has_modeline() *******************************************
  *
  * Helper function that returns TRUE or FALSE based on whether
@@ -1382,17 +1796,143 @@ Bool viewports_out_match(const GdkRectangle viewPortOut1,
 Bool display_has_modeline(nvDisplayPtr display,
                           nvModeLinePtr modeline)
 {
-    nvModeLinePtr m;
+    return (display_find_modeline(display, modeline) != NULL);
 
-    for (m = display->modelines; m; m = m->next) {
-         if (modelines_match(m, modeline)) {
-            return TRUE;
+} /* display_has_modeline() */
+
+
+
+/** display_find_modeline_by_name() **********************************
+ *
+ * Returns the first modeline in the display's modeline list whose
+ * identifier is 'name', or NULL if there is none.
+ *
+ **/
+nvModeLinePtr display_find_modeline_by_name(nvDisplayPtr display,
+                                            const char *name)
+{
+    nvModePoolPtr pool = &display->modepool;
+    nvModeLinePtr m, found = NULL;
+    unsigned int hash;
+
+    if (!name || !pool->num_buckets) {
+        return NULL;
+    }
+
+    hash = modeline_hash_str(2166136261u, name, FALSE);
+
+    for (m = pool->name_buckets[hash & (pool->num_buckets - 1)];
+         m;
+         m = m->name_next) {
+        if (m->name_hash == hash && !strcmp(m->data.identifier, name) &&
+            (!found || m->seq < found->seq)) {
+            found = m;
         }
     }
 
-    return FALSE;
+    return found;
+
+} /* display_find_modeline_by_name() */
 
-} /* display_has_modeline() */
+
+
+/** display_get_modelines_by_size() **********************************
+ *
+ * Returns the display's modelines of the given resolution, sorted by
+ * refresh rate and then by position in the modeline list, and sets
+ * 'count' to their number.  The returned array belongs to the display
+ * and is valid until its modelines change.
+ *
+ **/
+nvModeLinePtr *display_get_modelines_by_size(nvDisplayPtr display,
+                                             int width, int height,
+                                             int *count)
+{
+    nvModePoolPtr pool = &display->modepool;
+    int lo, hi, first;
+
+    *count = 0;
+
+    if (!modepool_update_sorted(pool) || !pool->num_sorted) {
+        return NULL;
+    }
+
+    /* Find the first modeline of at least the given size */
+    lo = 0;
+    hi = pool->num_sorted;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        const nvModeLine *m = pool->sorted[mid];
+
+        if ((m->data.hdisplay < width) ||
+            ((m->data.hdisplay == width) && (m->data.vdisplay < height))) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    first = lo;
+
+    while ((lo < pool->num_sorted) &&
+           (pool->sorted[lo]->data.hdisplay == width) &&
+           (pool->sorted[lo]->data.vdisplay == height)) {
+        lo++;
+    }
+
+    *count = lo - first;
+
+    return pool->sorted + first;
+
+} /* display_get_modelines_by_size() */
+
+
+
+/** display_find_closest_modeline() **********************************
+ *
+ * Returns the display's modeline that best matches the given one
+ * (typically, a modeline of another display): an identical modeline
+ * if the display has one, otherwise the modeline of the same
+ * resolution with the closest refresh rate.  Returns NULL if the
+ * display has no modeline of that resolution.
+ *
+ **/
+nvModeLinePtr display_find_closest_modeline(nvDisplayPtr display,
+                                            nvModeLinePtr modeline)
+{
+    nvModeLinePtr *modelines;
+    nvModeLinePtr best = NULL;
+    double best_dist = 0;
+    double dist;
+    int count;
+    int i;
+
+    if (!modeline) {
+        return NULL;
+    }
+
+    modelines = display_get_modelines_by_size(display,
+                                              modeline->data.hdisplay,
+                                              modeline->data.vdisplay,
+                                              &count);
+
+    for (i = 0; i < count; i++) {
+        if (modelines_match(modelines[i], modeline)) {
+            return modelines[i];
+        }
+
+        dist = modelines[i]->refresh_rate - modeline->refresh_rate;
+        if (dist < 0) {
+            dist = -dist;
+        }
+        if (!best || dist < best_dist) {
+            best = modelines[i];
+            best_dist = dist;
+        }
+    }
+
+    return best;
+
+} /* display_find_closest_modeline() */
 
 
 
@@ -1412,71 +1952,187 @@ static void display_remove_modelines(nvDisplayPtr display)
             modeline_free(modeline);
         }
         display->num_modelines = 0;
+        modepool_clear(&display->modepool);
     }
 
 } /* display_remove_modelines() */
 
 
 
-/** display_add_modelines_from_server() ******************************
+/** display_take_modelines() *****************************************
  *
- * Queries the display's current modepool (modelines list).
+ * Moves the display's modelines, along with the modepool they are
+ * allocated from, to the given pool and returns them.  The display is
+ * left without modelines.  Release the modelines with
+ * modepool_free_modelines().
  *
  **/
-Bool display_add_modelines_from_server(nvDisplayPtr display, nvGpuPtr gpu,
-                                       gchar **err_str)
+nvModeLinePtr display_take_modelines(nvDisplayPtr display,
+                                     nvModePoolPtr pool)
+{
+    nvModeLinePtr modelines = display->modelines;
+    nvModeLinePtr m;
+    unsigned int i;
+
+    *pool = display->modepool;
+    memset(&display->modepool, 0, sizeof(nvModePool));
+
+    for (i = 0; i < pool->num_buckets; i++) {
+        for (m = pool->timing_buckets[i]; m; m = m->hash_next) {
+            m->pool = pool;
+        }
+    }
+
+    display->modelines = NULL;
+    display->num_modelines = 0;
+
+    return modelines;
+
+} /* display_take_modelines() */
+
+
+
+/** modepool_free_modelines() ****************************************
+ *
+ * Frees the given list of modelines and the modepool they were
+ * allocated from (see display_take_modelines()).
+ *
+ **/
+void modepool_free_modelines(nvModeLinePtr modelines, nvModePoolPtr pool)
+{
+    nvModeLinePtr next;
+
+    while (modelines) {
+        next = modelines->next;
+        modeline_free(modelines);
+        modelines = next;
+    }
+    modepool_clear(pool);
+
+} /* modepool_free_modelines() */
+
+
+
+/** display_has_broken_doublescan_modelines() ************************
+ *
+ * Checks the version of the NV-CONTROL protocol -- versions <= 1.13 had
+ * a bug in how they reported double scan modelines (vsyncstart,
+ * vsyncend, and vtotal were doubled); determine if this X server has
+ * this bug, so that we can use broken_doublescan_modelines to
+ * correctly compute the refresh rate.
+ *
+ **/
+static int display_has_broken_doublescan_modelines(nvDisplayPtr display)
 {
-    nvModeLinePtr modeline;
-    char *modeline_strs = NULL;
-    char *str;
-    int len;
     ReturnStatus ret, ret1;
     int major = 0, minor = 0;
-    int broken_doublescan_modelines;
-    CtrlTarget *ctrl_target = display->ctrl_target;
 
-    /*
-     * check the version of the NV-CONTROL protocol -- versions <=
-     * 1.13 had a bug in how they reported double scan modelines
-     * (vsyncstart, vsyncend, and vtotal were doubled); determine
-     * if this X server has this bug, so that we can use
-     * broken_doublescan_modelines to correctly compute the
-     * refresh rate.
-     */
-    broken_doublescan_modelines = 1;
-
-    ret = NvCtrlGetAttribute(ctrl_target,
+    ret = NvCtrlGetAttribute(display->ctrl_target,
                              NV_CTRL_ATTR_NV_MAJOR_VERSION, &major);
-    ret1 = NvCtrlGetAttribute(ctrl_target,
+    ret1 = NvCtrlGetAttribute(display->ctrl_target,
                               NV_CTRL_ATTR_NV_MINOR_VERSION, &minor);
 
     if ((ret == NvCtrlSuccess) && (ret1 == NvCtrlSuccess) &&
         ((major > 1) || ((major == 1) && (minor > 13)))) {
-        broken_doublescan_modelines = 0;
+        return 0;
     }
 
+    return 1;
+
+} /* display_has_broken_doublescan_modelines() */
+
+
+
+/** display_add_current_modeline() ***********************************
+ *
+ * Replaces the display's modepool with the given (current) modeline
+ * string, as returned by NV_CTRL_STRING_CURRENT_MODELINE.
+ *
+ **/
+static Bool display_add_current_modeline(nvDisplayPtr display, nvGpuPtr gpu,
+                                         const char *modeline_str)
+{
+    nvModeLinePtr modeline;
 
-    /* Free any old mode lines */
     display_remove_modelines(display);
 
+    modeline = modeline_parse(display, gpu, modeline_str,
+                              display_has_broken_doublescan_modelines(display));
+    if (!modeline ||
+        !modepool_add_modeline(&display->modepool, modeline)) {
+        display_remove_modelines(display);
+        return FALSE;
+    }
 
-    /* Get the validated modelines for the display */
-    ret = NvCtrlGetBinaryAttribute(ctrl_target, 0,
-                                   NV_CTRL_BINARY_DATA_MODELINES,
-                                   (unsigned char **)&modeline_strs, &len);
-    if (ret != NvCtrlSuccess) {
-        *err_str = g_strdup_printf("Failed to query modelines of display "
-                                  "device %d '%s'.",
-                                   NvCtrlGetTargetId(ctrl_target),
-                                   display->logName);
-        nv_error_msg("%s", *err_str);
-        goto fail;
+    display->modelines = modeline;
+    display->num_modelines = 1;
+
+    return TRUE;
+
+} /* display_add_current_modeline() */
+
+
+
+/** display_add_modelines() *****************************************
+ *
+ * Fills the display's modepool with the modelines parsed from the
+ * given NV_CTRL_BINARY_DATA_MODELINES data, in that order.
+ *
+ * Modelines the display already has (its current modeline) take the
+ * place of their match in the data, so modes that reference them stay
+ * valid.  On failure, the display is left with the modelines it had.
+ *
+ **/
+static Bool display_add_modelines(nvDisplayPtr display, nvGpuPtr gpu,
+                                  const char *modeline_strs,
+                                  gchar **err_str)
+{
+    nvModePoolPtr pool = &display->modepool;
+    nvModeLinePtr modeline, next;
+    nvModeLinePtr *kept = NULL;
+    GenericListBuilderRec modelines;
+    const char *str;
+    size_t str_len;
+    int num_kept = 0;
+    int first_seq = pool->next_seq;
+    int broken_doublescan_modelines;
+    int i;
+    CtrlTarget *ctrl_target = display->ctrl_target;
+
+
+    broken_doublescan_modelines =
+        display_has_broken_doublescan_modelines(display);
+
+
+    /* Set the display's current modelines aside */
+    if (display->num_modelines) {
+        kept = calloc(display->num_modelines, sizeof(nvModeLinePtr));
+        if (!kept) {
+            *err_str = g_strdup_printf("Failed to allocate memory for the "
+                                       "modelines of display device %d "
+                                       "'%s'.",
+                                       NvCtrlGetTargetId(ctrl_target),
+                                       display->logName);
+            nv_error_msg("%s", *err_str);
+            return FALSE;
+        }
+        for (modeline = display->modelines;
+             modeline && (num_kept < display->num_modelines);
+             modeline = modeline->next) {
+            kept[num_kept++] = modeline;
+        }
     }
 
+    display->modelines = NULL;
+    display->num_modelines = 0;
+
 
     /* Parse each modeline */
+    xconfigListBuilderInit(&modelines,
+                           (GenericListPtr *)(&display->modelines));
+
     str = modeline_strs;
-    while (strlen(str)) {
+    while (str && (str_len = strlen(str))) {
 
         modeline = modeline_parse(display, gpu, str,
                                   broken_doublescan_modelines);
@@ -1491,37 +2147,230 @@ Bool display_add_modelines_from_server(nvDisplayPtr display, nvGpuPtr gpu,
             goto fail;
         }
 
+        /* Reuse the display's own copy of the modeline if it has one;
+         * a reused modeline is marked with a negative seq until the
+         * modepool is renumbered.
+         */
+        for (i = 0; i < num_kept; i++) {
+            if ((kept[i]->seq >= 0) && modelines_match(kept[i], modeline)) {
+                break;
+            }
+        }
+
+        if (i < num_kept) {
+            free(modeline->xconfig_name);
+            modeline = kept[i];
+            modeline->seq = -1;
+
+        } else if (!modepool_add_modeline(pool, modeline)) {
+            free(modeline->xconfig_name);
+            *err_str = g_strdup_printf("Failed to index the modelines of "
+                                       "display device %d '%s'.",
+                                       NvCtrlGetTargetId(ctrl_target),
+                                       display->logName);
+            nv_error_msg("%s", *err_str);
+            goto fail;
+        }
+
         /* Add the modeline at the end of the display's modeline list */
-        xconfigAddListItem((GenericListPtr *)(&display->modelines),
-                           (GenericListPtr)modeline);
+        modeline->next = NULL;
+        xconfigListBuilderAppend(&modelines, (GenericListPtr)modeline);
         display->num_modelines++;
 
         /* Get next modeline string */
-        str += strlen(str) +1;
+        str += str_len + 1;
     }
 
-    free(modeline_strs);
+    /* Keep the display's modelines that were not in the data */
+    for (i = 0; i < num_kept; i++) {
+        if (kept[i]->seq >= 0) {
+            kept[i]->next = NULL;
+            xconfigListBuilderAppend(&modelines, (GenericListPtr)kept[i]);
+            display->num_modelines++;
+        }
+    }
+
+    modepool_set_order(pool, display->modelines);
+
+    free(kept);
     return TRUE;
 
 
     /* Handle the failure case */
  fail:
-    display_remove_modelines(display);
-    free(modeline_strs);
+    for (modeline = display->modelines; modeline; modeline = next) {
+        next = modeline->next;
+        if (modeline->seq >= first_seq) {
+            modeline_free(modeline);
+        }
+    }
+
+    display->modelines = NULL;
+    display->num_modelines = 0;
+    xconfigListBuilderInit(&modelines,
+                           (GenericListPtr *)(&display->modelines));
+    for (i = 0; i < num_kept; i++) {
+        kept[i]->next = NULL;
+        xconfigListBuilderAppend(&modelines, (GenericListPtr)kept[i]);
+        display->num_modelines++;
+    }
+
+    modepool_set_order(pool, display->modelines);
+
+    free(kept);
     return FALSE;
 
+} /* display_add_modelines() */
+
+
+
+/** display_modelines_query_failed() ********************************
+ *
+ * Reports that the display's modelines could not be queried.  The
+ * display keeps the modelines it already has.
+ *
+ **/
+static void display_modelines_query_failed(nvDisplayPtr display,
+                                           gchar **err_str)
+{
+    *err_str = g_strdup_printf("Failed to query modelines of display "
+                              "device %d '%s'.",
+                               NvCtrlGetTargetId(display->ctrl_target),
+                               display->logName);
+    nv_error_msg("%s", *err_str);
+
+} /* display_modelines_query_failed() */
+
+
+
+/** display_add_modelines_from_server() ******************************
+ *
+ * Queries the display's current modepool (modelines list).
+ *
+ **/
+Bool display_add_modelines_from_server(nvDisplayPtr display, nvGpuPtr gpu,
+                                       gchar **err_str)
+{
+    char *modeline_strs = NULL;
+    int len;
+    ReturnStatus ret;
+    Bool success;
+    CtrlTarget *ctrl_target = display->ctrl_target;
+
+    display->modelines_pending = FALSE;
+
+    /* Get the validated modelines for the display */
+    ret = NvCtrlGetBinaryAttribute(ctrl_target, 0,
+                                   NV_CTRL_BINARY_DATA_MODELINES,
+                                   (unsigned char **)&modeline_strs, &len);
+    if (ret != NvCtrlSuccess) {
+        display_modelines_query_failed(display, err_str);
+        return FALSE;
+    }
+
+    success = display_add_modelines(display, gpu, modeline_strs, err_str);
+
+    free(modeline_strs);
+    return success;
+
 } /* display_add_modelines_from_server() */
 
 
 
-/** display_get_mode_str() *******************************************
+/** display_load_modelines() *****************************************
+ *
+ * Displays are loaded with only their current modeline; this queries
+ * the rest of the display's modepool the first time it is needed (the
+ * display is selected or enabled, or a mode references one of its
+ * other modelines).
+ *
+ * Returns FALSE if the modepool could not be queried.
+ *
+ **/
+Bool display_load_modelines(nvDisplayPtr display)
+{
+    gchar *err_str = NULL;
+
+    if (!display || !display->modelines_pending) {
+        return TRUE;
+    }
+
+    if (!display_add_modelines_from_server(display, display->gpu,
+                                           &err_str)) {
+        g_free(err_str);
+        return FALSE;
+    }
+
+    return TRUE;
+
+} /* display_load_modelines() */
+
+
+
+/** displays_load_modelines() ****************************************
+ *
+ * Loads the pending modepools of several displays at once, with a
+ * single batch of NV-CONTROL queries.
+ *
+ **/
+static void displays_load_modelines(nvDisplayPtr *displays, int num_displays)
+{
+    CtrlAttributeQuery *queries;
+    gchar *err_str = NULL;
+    int i;
+
+    if (num_displays <= 0) {
+        return;
+    }
+
+    queries = calloc(num_displays, sizeof(CtrlAttributeQuery));
+    if (!queries) {
+        /* Fall back to loading the modepools one at a time */
+        for (i = 0; i < num_displays; i++) {
+            display_load_modelines(displays[i]);
+        }
+        return;
+    }
+
+    for (i = 0; i < num_displays; i++) {
+        set_query(queries + i, displays[i]->ctrl_target,
+                  CTRL_ATTRIBUTE_TYPE_BINARY_DATA,
+                  NV_CTRL_BINARY_DATA_MODELINES);
+    }
+
+    NvCtrlQueryAttributes(queries, num_displays);
+
+    for (i = 0; i < num_displays; i++) {
+        nvDisplayPtr display = displays[i];
+
+        display->modelines_pending = FALSE;
+
+        if (queries[i].status != NvCtrlSuccess) {
+            display_modelines_query_failed(display, &err_str);
+        } else {
+            display_add_modelines(display, display->gpu,
+                                  (char *)queries[i].data, &err_str);
+        }
+        g_free(err_str);
+        err_str = NULL;
+    }
+
+    NvCtrlFreeAttributeQueries(queries, num_displays);
+    free(queries);
+
+} /* displays_load_modelines() */
+
+
+
+/** display_append_mode_str() ****************************************
  *
- * Returns the mode string of the display's 'mode_idx''s
- * mode.
+ * Appends the mode string of the display's 'mode_idx''s mode to
+ * 'mode_str'.  Returns FALSE (and appends nothing) if the display has
+ * no mode string for that mode.
  *
  **/
-static gchar *display_get_mode_str(nvDisplayPtr display, int mode_idx,
-                                   int force_target_id_name)
+static Bool display_append_mode_str(GString *mode_str, nvDisplayPtr display,
+                                    int mode_idx, int force_target_id_name)
 {
     nvModePtr mode = display->modes;
 
@@ -1531,12 +2380,12 @@ static gchar *display_get_mode_str(nvDisplayPtr display, int mode_idx,
     }
 
     if (mode) {
-        return mode_get_str(mode, force_target_id_name);
+        return mode_append_str(mode_str, mode, force_target_id_name);
     }
 
-    return NULL;
+    return FALSE;
 
-} /* display_get_mode_str() */
+} /* display_append_mode_str() */
 
 
 
@@ -1918,44 +2767,91 @@ static void screen_remove_displays(nvScreenPtr screen)
  *
  * "mode1_1, mode1_2, mode1_3 ... "
  *
+ * The string is built in a single buffer, sized up front for the
+ * screen's displays.
+ *
  **/
 gchar *screen_get_metamode_str(nvScreenPtr screen, int metamode_idx,
                                int force_target_id_name)
 {
     nvDisplayPtr display;
+    GString *metamode_str;
+    gsize len;
 
-    gchar *metamode_str = NULL;
-    gchar *mode_str;
-    gchar *tmp;
+    metamode_str =
+        g_string_sized_new((screen->num_displays + 1) * MODE_STR_SIZE_HINT);
 
     for (display = screen->displays;
          display;
          display = display->next_in_screen) {
 
-        mode_str = display_get_mode_str(display, metamode_idx,
-                                        force_target_id_name);
-        if (!mode_str) continue;
+        len = metamode_str->len;
+        if (len) {
+            g_string_append(metamode_str, ", ");
+        }
 
-        if (!metamode_str) {
-            metamode_str = mode_str;
-        } else {
-            tmp = g_strdup_printf("%s, %s", metamode_str, mode_str);
-            g_free(mode_str);
-            g_free(metamode_str);
-            metamode_str = tmp;
+        if (!display_append_mode_str(metamode_str, display, metamode_idx,
+                                     force_target_id_name)) {
+            g_string_truncate(metamode_str, len);
         }
     }
 
-    if (!metamode_str) {
-        metamode_str = strdup("NULL");
+    if (!metamode_str->len) {
+        g_string_assign(metamode_str, "NULL");
     }
 
-    return metamode_str;
+    return g_string_free(metamode_str, FALSE);
 
 } /* screen_get_metamode_str() */
 
 
 
+/** screen_get_modes_metamode_str() **********************************
+ *
+ * Returns a screen's metamode string, as screen_get_metamode_str()
+ * does, for the metamode whose mode on each of the screen's displays
+ * (in order) is given in 'modes'.  This lets callers going through
+ * all the metamodes keep track of the modes themselves, rather than
+ * have each display's list of modes walked from the start.
+ *
+ **/
+gchar *screen_get_modes_metamode_str(nvScreenPtr screen, nvModePtr *modes,
+                                     int force_target_id_name)
+{
+    nvDisplayPtr display;
+    GString *metamode_str;
+    gsize len;
+    int i;
+
+    metamode_str =
+        g_string_sized_new((screen->num_displays + 1) * MODE_STR_SIZE_HINT);
+
+    for (display = screen->displays, i = 0;
+         display;
+         display = display->next_in_screen, i++) {
+
+        if (!modes[i]) continue;
+
+        len = metamode_str->len;
+        if (len) {
+            g_string_append(metamode_str, ", ");
+        }
+
+        if (!mode_append_str(metamode_str, modes[i], force_target_id_name)) {
+            g_string_truncate(metamode_str, len);
+        }
+    }
+
+    if (!metamode_str->len) {
+        g_string_assign(metamode_str, "NULL");
+    }
+
+    return g_string_free(metamode_str, FALSE);
+
+} /* screen_get_modes_metamode_str() */
+
+
+
 /** cleanup_metamode() ***********************************************
  *
  * Frees any internal memory used by the metamode.
@@ -2206,6 +3102,7 @@ static Bool screen_check_metamodes(nvScreenPtr screen)
     nvMetaModePtr metamode;
     nvModePtr mode;
     nvModePtr last_mode = NULL;
+    GenericListBuilderRec modes;
 
 
     for (display = screen->displays;
@@ -2225,6 +3122,8 @@ static Bool screen_check_metamodes(nvScreenPtr screen)
         }
 
         /* Each display must have as many modes as its screen has metamodes */
+        xconfigListBuilderInit(&modes, (GenericListPtr *)(&display->modes));
+
         while (metamode) {
 
             /* Create a dummy mode */
@@ -2241,8 +3140,7 @@ static Bool screen_check_metamodes(nvScreenPtr screen)
             }
 
             /* Add the mode at the end of display's mode list */
-            xconfigAddListItem((GenericListPtr *)(&display->modes),
-                               (GenericListPtr)mode);
+            xconfigListBuilderAppend(&modes, (GenericListPtr)mode);
             display->num_modes++;
 
             metamode = metamode->next;
@@ -2295,32 +3193,147 @@ static void screen_assign_dummy_metamode_positions(nvScreenPtr screen)
 
 
 
+/** screen_load_referenced_modelines() *******************************
+ *
+ * Displays are loaded with only their current modeline.  Looks through
+ * the screen's metamode strings for modes that name any other modeline
+ * of such a display, and loads the modepools of all those displays with
+ * a single batch of queries (rather than one round trip per display
+ * from mode_parse()).
+ *
+ **/
+static void screen_load_referenced_modelines(nvScreenPtr screen,
+                                             const char *metamode_strs)
+{
+    nvDisplayPtr *displays;
+    int num_displays = 0;
+    int max_displays = 0;
+    nvGpuPtr gpu;
+    const char *str;
+
+    for (gpu = screen->layout->gpus; gpu; gpu = gpu->next_in_layout) {
+        max_displays += gpu->num_displays;
+    }
+    if (max_displays <= 0) {
+        return;
+    }
+
+    displays = calloc(max_displays, sizeof(nvDisplayPtr));
+    if (!displays) {
+        return;
+    }
+
+    for (str = metamode_strs; str && strlen(str); str += strlen(str) + 1) {
+        const char *modes = strstr(str, "::");
+        char *modes_copy;
+        char *mode_str_itr;
+
+        modes = modes ? (modes + 2) : str;
+        modes_copy = strdup(modes);
+        if (!modes_copy) {
+            break;
+        }
+
+        for (mode_str_itr = mode_strtok(modes_copy);
+             mode_str_itr;
+             mode_str_itr = mode_strtok(NULL)) {
+
+            nvDisplayPtr display;
+            unsigned int display_id;
+            const char *mode_str;
+            char *mode_name = NULL;
+            int i;
+
+            mode_str = parse_read_display_id(mode_str_itr, &display_id);
+            if (!mode_str) {
+                continue;
+            }
+
+            display = layout_get_display(screen->layout, display_id);
+            if (!display || !display->modelines_pending) {
+                continue;
+            }
+
+            /* Skip displays that are already in the batch */
+            for (i = 0; i < num_displays; i++) {
+                if (displays[i] == display) {
+                    break;
+                }
+            }
+            if (i < num_displays) {
+                continue;
+            }
+
+            mode_str = parse_read_name(mode_str, &mode_name, 0);
+            if (mode_str && mode_name && strcmp(mode_name, "NULL") &&
+                !display_find_modeline_by_name(display, mode_name) &&
+                num_displays < max_displays) {
+                displays[num_displays++] = display;
+            }
+            free(mode_name);
+        }
+
+        free(modes_copy);
+    }
+
+    displays_load_modelines(displays, num_displays);
+
+    free(displays);
+
+} /* screen_load_referenced_modelines() */
+
+
+
+/*
+ * Queries made for each X screen by layout_add_screens_from_server().
+ * The metamode and primary display attributes are queried even for
+ * screens that do not scan out, and only looked at when they apply.
+ */
+
+enum {
+    SCREEN_QUERY_STEREO = 0,
+    SCREEN_QUERY_OVERLAY,
+    SCREEN_QUERY_HWOVERLAY,
+    SCREEN_QUERY_UBB,
+    SCREEN_QUERY_NO_SCANOUT,
+    SCREEN_QUERY_MULTIGPU_DISPLAY_OWNER,
+    SCREEN_QUERY_GPUS_USED,
+    SCREEN_QUERY_SLI_VISUAL_INDICATOR,
+    SCREEN_QUERY_SLI_MODE,
+    SCREEN_QUERY_MULTIGPU_MODE,
+    SCREEN_QUERY_SCREEN_RECTANGLE,
+    SCREEN_QUERY_METAMODES,
+    SCREEN_QUERY_CURRENT_METAMODE,
+    SCREEN_QUERY_XINERAMA_INFO_ORDER,
+    SCREEN_QUERY_COUNT
+};
+
+
+
 /** screen_add_metamodes() *******************************************
  *
  * Adds all the appropriate modes on all display devices of this
- * screen by parsing all the metamode strings.
+ * screen by parsing all the metamode strings, using the results of
+ * the queries set by screen_set_queries().
  *
  **/
-static Bool screen_add_metamodes(nvScreenPtr screen, gchar **err_str)
+static Bool screen_add_metamodes(nvScreenPtr screen,
+                                 const CtrlAttributeQuery *queries,
+                                 gchar **err_str)
 {
     nvDisplayPtr display;
 
-    char *metamode_strs = NULL;  /* Screen's list metamode strings */
-    char *cur_metamode_str;      /* Current metamode */
+    const char *metamode_strs;   /* Screen's list metamode strings */
+    const char *cur_metamode_str;/* Current metamode */
 
-    char *str;                   /* Temp pointer for parsing */
-    int len;
-    ReturnStatus ret;
+    const char *str;             /* Temp pointer for parsing */
     int i;
 
 
 
     /* Get the list of metamodes for the screen */
-    ret = NvCtrlGetBinaryAttribute(screen->ctrl_target, 0,
-                                   NV_CTRL_BINARY_DATA_METAMODES_VERSION_2,
-                                   (unsigned char **)&metamode_strs,
-                                   &len);
-    if (ret != NvCtrlSuccess) {
+    metamode_strs = (const char *)queries[SCREEN_QUERY_METAMODES].data;
+    if (queries[SCREEN_QUERY_METAMODES].status != NvCtrlSuccess) {
         *err_str = g_strdup_printf("Failed to query list of metamodes on\n"
                                    "screen %d.", screen->scrnum);
         nv_error_msg("%s", *err_str);
@@ -2329,10 +3342,9 @@ static Bool screen_add_metamodes(nvScreenPtr screen, gchar **err_str)
 
 
     /* Get the current metamode for the screen */
-    ret = NvCtrlGetStringAttribute(screen->ctrl_target,
-                                   NV_CTRL_STRING_CURRENT_METAMODE_VERSION_2,
-                                   &cur_metamode_str);
-    if (ret != NvCtrlSuccess) {
+    cur_metamode_str = queries[SCREEN_QUERY_CURRENT_METAMODE].str;
+    if ((queries[SCREEN_QUERY_CURRENT_METAMODE].status != NvCtrlSuccess) ||
+        !cur_metamode_str) {
         *err_str = g_strdup_printf("Failed to query current metamode of\n"
                                    "screen %d.", screen->scrnum);
         nv_error_msg("%s", *err_str);
@@ -2344,6 +3356,10 @@ static Bool screen_add_metamodes(nvScreenPtr screen, gchar **err_str)
     screen_remove_metamodes(screen);
 
 
+    /* Load the modepools the metamodes need in one batch */
+    screen_load_referenced_modelines(screen, metamode_strs);
+
+
     /* Parse each mode in the metamode strings */
     for (str = metamode_strs;
          (str && strlen(str));
@@ -2369,8 +3385,6 @@ static Bool screen_add_metamodes(nvScreenPtr screen, gchar **err_str)
         /* Make sure each display device gets a mode */
         screen_check_metamodes(screen);
     }
-    free(metamode_strs);
-    metamode_strs = NULL;
 
     if (!screen->metamodes) {
         nv_warning_msg("Failed to add any metamode to screen %d.",
@@ -2409,7 +3423,6 @@ static Bool screen_add_metamodes(nvScreenPtr screen, gchar **err_str)
     /* Remove modes we may have added */
     screen_remove_metamodes(screen);
 
-    free(metamode_strs);
     return FALSE;
 
 } /* screen_add_metamodes() */
@@ -2517,6 +3530,85 @@ Bool screen_has_gpu(nvScreenPtr screen, nvGpuPtr gpu)
 
 
 
+/** grid_get_display_position() **************************************
+ *
+ * Returns the position of the display at the given row and column of
+ * the grid, relative to the top left corner of the grid.
+ *
+ **/
+
+void grid_get_display_position(const nvGrid *grid, int row, int column,
+                               int *x, int *y)
+{
+    *x = column * (grid->display_width - grid->h_overlap);
+    *y = row * (grid->display_height - grid->v_overlap);
+
+} /* grid_get_display_position() */
+
+
+
+/** grid_get_size() **************************************************
+ *
+ * Returns the total size covered by the displays of the grid.
+ *
+ **/
+
+void grid_get_size(const nvGrid *grid, int *width, int *height)
+{
+    *width = 0;
+    *height = 0;
+
+    if (grid->rows < 1 || grid->columns < 1) {
+        return;
+    }
+
+    grid_get_display_position(grid, grid->rows - 1, grid->columns - 1,
+                              width, height);
+    *width += grid->display_width;
+    *height += grid->display_height;
+
+} /* grid_get_size() */
+
+
+
+/** grid_get_metamode_str() ******************************************
+ *
+ * Returns a metamode string that drives each display of the grid
+ * with the given mode, as:
+ *
+ * "mode +0+0, mode +X+0, ... mode +X+Y"
+ *
+ * Displays are listed row by row, the way SLI Mosaic expects them.
+ *
+ **/
+
+gchar *grid_get_metamode_str(const nvGrid *grid, const char *mode_name)
+{
+    GString *str;
+    int row, column;
+    int x, y;
+
+    if (grid->rows < 1 || grid->columns < 1) {
+        return NULL;
+    }
+
+    str = g_string_sized_new(grid->rows * grid->columns *
+                             (strlen(mode_name) + 16));
+
+    for (row = 0; row < grid->rows; row++) {
+        for (column = 0; column < grid->columns; column++) {
+            grid_get_display_position(grid, row, column, &x, &y);
+            g_string_append_printf(str, "%s%s +%d+%d",
+                                   str->len ? ", " : "", mode_name, x, y);
+        }
+    }
+
+    return g_string_free(str, FALSE);
+
+} /* grid_get_metamode_str() */
+
+
+
 /*****************************************************************************/
 /** GPU FUNCTIONS ************************************************************/
 /*****************************************************************************/
@@ -2657,9 +3749,9 @@ static Bool gpu_query_gvo_mode_info(nvGpuPtr gpu, int mode_id, int table_idx)
 
 
 
-/** display_add_name_from_server() ***********************************
+/** display_add_name() **********************************************
  *
- *  Queries and adds the NV-CONTROL name to the display device.
+ *  Adds the queried NV-CONTROL name to the display device.
  *
  **/
 
@@ -2685,18 +3777,14 @@ static const struct DisplayNameInfoRec {
       offsetof(nvDisplay, randrName) },
 };
 
-static Bool display_add_name_from_server(nvDisplayPtr display,
-                                         const struct DisplayNameInfoRec *displayNameInfo,
-                                         gchar **err_str)
+static Bool display_add_name(nvDisplayPtr display,
+                             const struct DisplayNameInfoRec *displayNameInfo,
+                             CtrlAttributeQuery *query,
+                             gchar **err_str)
 {
-    ReturnStatus ret;
-    char *str;
-
-    ret = NvCtrlGetStringAttribute(display->ctrl_target,
-                                   displayNameInfo->attr,
-                                   &str);
-    if (ret == NvCtrlSuccess) {
-        *((char **)(((char *)display) + displayNameInfo->offset)) = str;
+    if (query->status == NvCtrlSuccess) {
+        *((char **)(((char *)display) + displayNameInfo->offset)) = query->str;
+        query->str = NULL;
 
     } else if (!displayNameInfo->canBeNull) {
         *err_str = g_strdup_printf("Failed to query name '%s' of display "
@@ -2712,17 +3800,71 @@ static Bool display_add_name_from_server(nvDisplayPtr display,
 
 
 
+/*
+ * Queries made for each display device by layout_add_gpus_from_server():
+ * the names of DisplayNamesTable, in the same order, followed by these.
+ */
+
+#define DISPLAY_QUERY_IS_SDI            (ARRAY_LEN(DisplayNamesTable))
+#define DISPLAY_QUERY_CURRENT_MODELINE  (DISPLAY_QUERY_IS_SDI + 1)
+#define DISPLAY_QUERY_COUNT             (DISPLAY_QUERY_CURRENT_MODELINE + 1)
+
+static void set_query(CtrlAttributeQuery *query, CtrlTarget *ctrl_target,
+                      CtrlAttributeType attr_type, int attr)
+{
+    query->ctrl_target = ctrl_target;
+    query->attr_type = attr_type;
+    query->display_mask = 0;
+    query->attr = attr;
+}
+
+static Bool display_target_is_connected(CtrlTarget *ctrl_target)
+{
+    return (NvCtrlGetTargetType(ctrl_target) == DISPLAY_TARGET) &&
+        ctrl_target->display.connected;
+}
+
+
+
+/** display_set_queries() ********************************************
+ *
+ *  Fills in the DISPLAY_QUERY_COUNT queries needed to load the display
+ *  device.
+ *
+ **/
+static void display_set_queries(CtrlTarget *ctrl_target,
+                                CtrlAttributeQuery *queries)
+{
+    int i;
+
+    for (i = 0; i < ARRAY_LEN(DisplayNamesTable); i++) {
+        set_query(queries + i, ctrl_target, CTRL_ATTRIBUTE_TYPE_STRING,
+                  DisplayNamesTable[i].attr);
+    }
+
+    set_query(queries + DISPLAY_QUERY_IS_SDI, ctrl_target,
+              CTRL_ATTRIBUTE_TYPE_INTEGER, NV_CTRL_IS_GVO_DISPLAY);
+    set_query(queries + DISPLAY_QUERY_CURRENT_MODELINE, ctrl_target,
+              CTRL_ATTRIBUTE_TYPE_STRING, NV_CTRL_STRING_CURRENT_MODELINE);
+
+} /* display_set_queries() */
+
+
+
 /** gpu_add_display_from_server() ************************************
  *
- *  Adds the display with the device id given to the GPU structure.
+ *  Adds the display with the device id given to the GPU structure,
+ *  using the results of the queries set by display_set_queries().
  *
  **/
 static nvDisplayPtr gpu_add_display_from_server(nvGpuPtr gpu,
                                                 CtrlTarget *ctrl_target,
+                                                CtrlAttributeQuery *queries,
                                                 gchar **err_str)
 {
     ReturnStatus ret;
     nvDisplayPtr display;
+    CtrlAttributeQuery *query;
     int i;
 
 
@@ -2735,18 +3877,16 @@ static nvDisplayPtr gpu_add_display_from_server(nvGpuPtr gpu,
 
     /* Query the display information */
     for (i = 0; i < ARRAY_LEN(DisplayNamesTable); i++) {
-        if (!display_add_name_from_server(display,
-                                          DisplayNamesTable + i, err_str)) {
+        if (!display_add_name(display, DisplayNamesTable + i, queries + i,
+                              err_str)) {
             goto fail;
         }
     }
 
 
     /* Query if this display is an SDI display */
-    ret = NvCtrlGetAttribute(ctrl_target,
-                             NV_CTRL_IS_GVO_DISPLAY,
-                             &(display->is_sdi));
-    if (ret != NvCtrlSuccess) {
+    display->is_sdi = queries[DISPLAY_QUERY_IS_SDI].val;
+    if (queries[DISPLAY_QUERY_IS_SDI].status != NvCtrlSuccess) {
         nv_warning_msg("Failed to query if display device\n"
                        "%d connected to GPU-%d '%s' is an\n"
                        "SDI device.",
@@ -2838,65 +3978,253 @@ static nvDisplayPtr gpu_add_display_from_server(nvGpuPtr gpu,
     }
 
 
-    /* Query the modelines for the display device */
-    if (!display_add_modelines_from_server(display, gpu, err_str)) {
-        nv_warning_msg("Failed to add modelines to display device %d "
-                       "'%s'\nconnected to GPU-%d '%s'.",
+    /* Add the current modeline to the display device.  The rest of the
+     * modepool is only queried when needed (see display_load_modelines()).
+     * Displays that are off have no current modeline.
+     */
+    query = queries + DISPLAY_QUERY_CURRENT_MODELINE;
+    if ((query->status == NvCtrlSuccess) && query->str && *(query->str) &&
+        !display_add_current_modeline(display, gpu, query->str)) {
+        nv_warning_msg("Failed to add the current modeline of display "
+                       "device %d '%s'\nconnected to GPU-%d '%s'.",
                        NvCtrlGetTargetId(ctrl_target), display->logName,
                        NvCtrlGetTargetId(gpu->ctrl_target), gpu->name);
-        goto fail;
+    }
+    display->modelines_pending = TRUE;
+
+    /* Add the display at the end of gpu's display list */
+    gpu_add_display(gpu, display);
+
+    return display;
+
+
+    /* Failure case */
+ fail:
+    display_free(display);
+    return NULL;
+
+} /* gpu_add_display_from_server() */
+
+
+
+/** gpu_add_displays_from_server() ***********************************
+ *
+ * Adds the display devices connected on the GPU to the GPU structure.
+ * The queries of each connected display are found, in order, in the
+ * given array.
+ *
+ **/
+static Bool gpu_add_displays_from_server(nvGpuPtr gpu,
+                                         CtrlAttributeQuery *queries,
+                                         gchar **err_str)
+{
+    CtrlTargetNode *node;
+
+    gpu_remove_displays(gpu);
+
+    for (node = gpu->ctrl_target->relations; node; node = node->next) {
+        CtrlTarget *ctrl_target = node->t;
+
+        if (!display_target_is_connected(ctrl_target)) {
+            continue;
+        }
+
+        if (!gpu_add_display_from_server(gpu, ctrl_target, queries,
+                                         err_str)) {
+            nv_warning_msg("Failed to add display device %d to GPU-%d "
+                           "'%s'.",
+                           NvCtrlGetTargetId(ctrl_target),
+                           NvCtrlGetTargetId(gpu->ctrl_target),
+                           gpu->name);
+            goto fail;
+        }
+
+        queries += DISPLAY_QUERY_COUNT;
+    }
+    return TRUE;
+
+ fail:
+    gpu_remove_displays(gpu);
+    return FALSE;
+
+} /* gpu_add_displays_from_server() */
+
+
+
+/** gpu_update_displays_from_server() ********************************
+ *
+ * Brings the GPU's display devices in line with the ones currently
+ * connected to it, after a probe.  Only the displays that were
+ * connected or disconnected are added or removed; the others, and any
+ * changes the user made to them, are left untouched.
+ *
+ * 'changed' is set if any display was added or removed, and
+ * 'allow_apply' if a display with an active mode was removed.
+ *
+ * Returns FALSE if the GPU cannot be updated in place and the layout
+ * has to be reloaded instead: when a newly connected display is not
+ * yet known to the layout's connection to the system, when the last
+ * display of an X screen was disconnected, or when a query fails.
+ *
+ **/
+Bool gpu_update_displays_from_server(nvGpuPtr gpu, Bool *changed,
+                                     Bool *allow_apply, gchar **err_str)
+{
+    CtrlTargetNode *node;
+    CtrlAttributeQuery *queries = NULL;
+    CtrlAttributeQuery *display_queries;
+    nvDisplayPtr display, next;
+    int *pData = NULL;
+    int len;
+    int num_added = 0;
+    int i;
+    ReturnStatus ret;
+
+    *changed = FALSE;
+    *allow_apply = FALSE;
+
+    ret = NvCtrlGetBinaryAttribute(gpu->ctrl_target, 0,
+                                   NV_CTRL_BINARY_DATA_DISPLAYS_CONNECTED_TO_GPU,
+                                   (unsigned char **)&pData, &len);
+    if ((ret != NvCtrlSuccess) || !pData) {
+        *err_str = g_strdup_printf("Failed to query the display devices "
+                                   "connected to GPU-%d '%s'.",
+                                   NvCtrlGetTargetId(gpu->ctrl_target),
+                                   gpu->name);
+        nv_error_msg("%s", *err_str);
+        free(pData);
+        return FALSE;
+    }
+
+
+    /* Refresh the connection state of the GPU's display targets */
+    for (node = gpu->ctrl_target->relations; node; node = node->next) {
+        if (NvCtrlGetTargetType(node->t) == DISPLAY_TARGET) {
+            node->t->display.connected = NV_FALSE;
+        }
+    }
+
+    for (i = 0; i < pData[0]; i++) {
+        CtrlTarget *ctrl_target = NULL;
+
+        for (node = gpu->ctrl_target->relations; node; node = node->next) {
+            if ((NvCtrlGetTargetType(node->t) == DISPLAY_TARGET) &&
+                (NvCtrlGetTargetId(node->t) == pData[i+1])) {
+                ctrl_target = node->t;
+                break;
+            }
+        }
+
+        if (!ctrl_target) {
+            /* A display device the layout's system does not know of */
+            free(pData);
+            return FALSE;
+        }
+
+        ctrl_target->display.connected = NV_TRUE;
+    }
+    free(pData);
+
+
+    /* Make sure no X screen is left without displays */
+    for (display = gpu->displays; display; display = display->next_on_gpu) {
+        nvDisplayPtr other;
+        Bool screen_keeps_display = FALSE;
+
+        if (!display->screen ||
+            display_target_is_connected(display->ctrl_target)) {
+            continue;
+        }
+
+        for (other = display->screen->displays;
+             other;
+             other = other->next_in_screen) {
+            if (display_target_is_connected(other->ctrl_target)) {
+                screen_keeps_display = TRUE;
+                break;
+            }
+        }
+        if (!screen_keeps_display) {
+            return FALSE;
+        }
     }
 
-    /* Add the display at the end of gpu's display list */
-    gpu_add_display(gpu, display);
 
-    return display;
+    /* Remove the disconnected displays */
+    for (display = gpu->displays; display; display = next) {
+        next = display->next_on_gpu;
 
+        if (display_target_is_connected(display->ctrl_target)) {
+            continue;
+        }
 
-    /* Failure case */
- fail:
-    display_free(display);
-    return NULL;
+        if (display->cur_mode && display->cur_mode->modeline) {
+            *allow_apply = TRUE;
+        }
 
-} /* gpu_add_display_from_server() */
+        gpu_remove_and_free_display(display);
+        *changed = TRUE;
+    }
 
 
+    /* Add the newly connected displays, querying them as one batch */
+    for (node = gpu->ctrl_target->relations; node; node = node->next) {
+        if (display_target_is_connected(node->t) &&
+            !layout_get_display(gpu->layout, NvCtrlGetTargetId(node->t))) {
+            num_added++;
+        }
+    }
 
-/** gpu_add_displays_from_server() ***********************************
- *
- * Adds the display devices connected on the GPU to the GPU structure
- *
- **/
-static Bool gpu_add_displays_from_server(nvGpuPtr gpu, gchar **err_str)
-{
-    CtrlTargetNode *node;
+    if (num_added == 0) {
+        return TRUE;
+    }
 
-    gpu_remove_displays(gpu);
+    queries = calloc(num_added * DISPLAY_QUERY_COUNT,
+                     sizeof(CtrlAttributeQuery));
+    if (!queries) {
+        return FALSE;
+    }
 
+    display_queries = queries;
     for (node = gpu->ctrl_target->relations; node; node = node->next) {
-        CtrlTarget *ctrl_target = node->t;
-
-        if (NvCtrlGetTargetType(ctrl_target) != DISPLAY_TARGET ||
-            !(ctrl_target->display.connected)) {
-            continue;
+        if (display_target_is_connected(node->t) &&
+            !layout_get_display(gpu->layout, NvCtrlGetTargetId(node->t))) {
+            display_set_queries(node->t, display_queries);
+            display_queries += DISPLAY_QUERY_COUNT;
         }
+    }
+
+    NvCtrlQueryAttributes(queries, num_added * DISPLAY_QUERY_COUNT);
 
-        if (!gpu_add_display_from_server(gpu, ctrl_target, err_str)) {
+    display_queries = queries;
+    for (i = 0; i < num_added; i++) {
+        CtrlTarget *ctrl_target =
+            (CtrlTarget *)display_queries[0].ctrl_target;
+
+        if (!gpu_add_display_from_server(gpu, ctrl_target, display_queries,
+                                         err_str)) {
             nv_warning_msg("Failed to add display device %d to GPU-%d "
                            "'%s'.",
                            NvCtrlGetTargetId(ctrl_target),
                            NvCtrlGetTargetId(gpu->ctrl_target),
                            gpu->name);
-            goto fail;
+            break;
         }
+        *changed = TRUE;
+        display_queries += DISPLAY_QUERY_COUNT;
     }
-    return TRUE;
 
- fail:
-    gpu_remove_displays(gpu);
-    return FALSE;
+    NvCtrlFreeAttributeQueries(queries, num_added * DISPLAY_QUERY_COUNT);
+    free(queries);
 
-} /* gpu_add_displays_from_server() */
+    if (i < num_added) {
+        return FALSE;
+    }
+
+    /* Give the new displays a mode so they show up on the layout page */
+    return gpu_add_screenless_modes_to_displays(gpu);
+
+} /* gpu_update_displays_from_server() */
 
 
 
@@ -3097,20 +4425,136 @@ static void layout_remove_gpus(nvLayoutPtr layout)
 
 
 
+/*
+ * Queries made for each GPU by layout_add_gpus_from_server().  The
+ * mosaic attributes are queried unconditionally, and only looked at
+ * when they apply.
+ */
+
+enum {
+    GPU_QUERY_PRODUCT_NAME = 0,
+    GPU_QUERY_UUID,
+    GPU_QUERY_PCI_DOMAIN,
+    GPU_QUERY_PCI_BUS,
+    GPU_QUERY_PCI_DEVICE,
+    GPU_QUERY_PCI_FUNCTION,
+    GPU_QUERY_MAX_SCREEN_WIDTH,
+    GPU_QUERY_MAX_SCREEN_HEIGHT,
+    GPU_QUERY_MAX_DISPLAYS,
+    GPU_QUERY_DEPTH_30_ALLOWED,
+    GPU_QUERY_MULTIGPU_MASTER_POSSIBLE,
+    GPU_QUERY_GPU_FLAGS,
+    GPU_QUERY_SLI_MOSAIC_MODE_AVAILABLE,
+    GPU_QUERY_SLI_MODE,
+    GPU_QUERY_BASE_MOSAIC,
+    GPU_QUERY_COUNT
+};
+
+
+
+/** gpu_set_queries() ************************************************
+ *
+ * Fills in the GPU_QUERY_COUNT queries needed to load the GPU.
+ *
+ **/
+static void gpu_set_queries(CtrlTarget *ctrl_target,
+                            CtrlAttributeQuery *queries)
+{
+    static const struct {
+        int index;
+        CtrlAttributeType attr_type;
+        int attr;
+    } GpuQueriesTable[] = {
+        { GPU_QUERY_PRODUCT_NAME,
+          CTRL_ATTRIBUTE_TYPE_STRING, NV_CTRL_STRING_PRODUCT_NAME },
+        { GPU_QUERY_UUID,
+          CTRL_ATTRIBUTE_TYPE_STRING, NV_CTRL_STRING_GPU_UUID },
+        { GPU_QUERY_PCI_DOMAIN,
+          CTRL_ATTRIBUTE_TYPE_INTEGER, NV_CTRL_PCI_DOMAIN },
+        { GPU_QUERY_PCI_BUS,
+          CTRL_ATTRIBUTE_TYPE_INTEGER, NV_CTRL_PCI_BUS },
+        { GPU_QUERY_PCI_DEVICE,
+          CTRL_ATTRIBUTE_TYPE_INTEGER, NV_CTRL_PCI_DEVICE },
+        { GPU_QUERY_PCI_FUNCTION,
+          CTRL_ATTRIBUTE_TYPE_INTEGER, NV_CTRL_PCI_FUNCTION },
+        { GPU_QUERY_MAX_SCREEN_WIDTH,
+          CTRL_ATTRIBUTE_TYPE_INTEGER, NV_CTRL_MAX_SCREEN_WIDTH },
+        { GPU_QUERY_MAX_SCREEN_HEIGHT,
+          CTRL_ATTRIBUTE_TYPE_INTEGER, NV_CTRL_MAX_SCREEN_HEIGHT },
+        { GPU_QUERY_MAX_DISPLAYS,
+          CTRL_ATTRIBUTE_TYPE_INTEGER, NV_CTRL_MAX_DISPLAYS },
+        { GPU_QUERY_DEPTH_30_ALLOWED,
+          CTRL_ATTRIBUTE_TYPE_INTEGER, NV_CTRL_DEPTH_30_ALLOWED },
+        { GPU_QUERY_MULTIGPU_MASTER_POSSIBLE,
+          CTRL_ATTRIBUTE_TYPE_INTEGER, NV_CTRL_MULTIGPU_MASTER_POSSIBLE },
+        { GPU_QUERY_GPU_FLAGS,
+          CTRL_ATTRIBUTE_TYPE_BINARY_DATA, NV_CTRL_BINARY_DATA_GPU_FLAGS },
+        { GPU_QUERY_SLI_MOSAIC_MODE_AVAILABLE,
+          CTRL_ATTRIBUTE_TYPE_INTEGER, NV_CTRL_SLI_MOSAIC_MODE_AVAILABLE },
+        { GPU_QUERY_SLI_MODE,
+          CTRL_ATTRIBUTE_TYPE_STRING, NV_CTRL_STRING_SLI_MODE },
+        { GPU_QUERY_BASE_MOSAIC,
+          CTRL_ATTRIBUTE_TYPE_INTEGER, NV_CTRL_BASE_MOSAIC },
+    };
+    int i;
+
+    for (i = 0; i < ARRAY_LEN(GpuQueriesTable); i++) {
+        set_query(queries + GpuQueriesTable[i].index, ctrl_target,
+                  GpuQueriesTable[i].attr_type, GpuQueriesTable[i].attr);
+    }
+
+} /* gpu_set_queries() */
+
+
+
+/** gpu_get_bus_id_str() *********************************************
+ *
+ * Returns the PCI bus ID string of the GPU, as get_bus_id_str() does,
+ * from the results of the queries set by gpu_set_queries().
+ *
+ **/
+static gchar *gpu_get_bus_id_str(const CtrlAttributeQuery *queries)
+{
+    gchar *bus_id;
+    int i;
+
+    for (i = GPU_QUERY_PCI_DOMAIN; i <= GPU_QUERY_PCI_FUNCTION; i++) {
+        if (queries[i].status != NvCtrlSuccess) {
+            return NULL;
+        }
+    }
+
+    bus_id = g_malloc(32);
+    if (!bus_id) {
+        return NULL;
+    }
+    xconfigFormatPciBusString(bus_id, 32,
+                              queries[GPU_QUERY_PCI_DOMAIN].val,
+                              queries[GPU_QUERY_PCI_BUS].val,
+                              queries[GPU_QUERY_PCI_DEVICE].val,
+                              queries[GPU_QUERY_PCI_FUNCTION].val);
+    return bus_id;
+
+} /* gpu_get_bus_id_str() */
+
+
+
 /** layout_add_gpu_from_server() *************************************
  *
- * Adds a GPU to the layout structure.
+ * Adds a GPU to the layout structure, using the results of the queries
+ * set by gpu_set_queries(), and those of the display devices connected
+ * to it.
  *
  **/
 static Bool layout_add_gpu_from_server(nvLayoutPtr layout,
                                        CtrlTarget *ctrl_target,
+                                       CtrlAttributeQuery *queries,
+                                       CtrlAttributeQuery *display_queries,
                                        gchar **err_str)
 {
     ReturnStatus ret;
     nvGpuPtr gpu = NULL;
     unsigned int *pData;
-    int len;
-    int val;
 
 
     /* Create the GPU structure */
@@ -3123,30 +4567,29 @@ static Bool layout_add_gpu_from_server(nvLayoutPtr layout,
 
 
     /* Query the GPU information */
-    ret = NvCtrlGetStringAttribute(ctrl_target, NV_CTRL_STRING_PRODUCT_NAME,
-                                   &gpu->name);
-    if (ret != NvCtrlSuccess) {
+    if (queries[GPU_QUERY_PRODUCT_NAME].status != NvCtrlSuccess) {
         *err_str = g_strdup_printf("Failed to query GPU name of GPU-%d.",
                                    NvCtrlGetTargetId(ctrl_target));
         nv_error_msg("%s", *err_str);
         goto fail;
     }
+    gpu->name = queries[GPU_QUERY_PRODUCT_NAME].str;
+    queries[GPU_QUERY_PRODUCT_NAME].str = NULL;
 
-    ret = NvCtrlGetStringAttribute(ctrl_target, NV_CTRL_STRING_GPU_UUID,
-                                   &gpu->uuid);
-    if (ret != NvCtrlSuccess) {
+    if (queries[GPU_QUERY_UUID].status != NvCtrlSuccess) {
         nv_warning_msg("Failed to query GPU UUID of GPU-%d '%s'.  GPU UUID "
                        "qualifiers will not be used.",
                        NvCtrlGetTargetId(ctrl_target),
                        gpu->name);
         gpu->uuid = NULL;
+    } else {
+        gpu->uuid = queries[GPU_QUERY_UUID].str;
+        queries[GPU_QUERY_UUID].str = NULL;
     }
 
-    gpu->pci_bus_id = get_bus_id_str(ctrl_target);
+    gpu->pci_bus_id = gpu_get_bus_id_str(queries);
 
-    ret = NvCtrlGetAttribute(ctrl_target, NV_CTRL_MAX_SCREEN_WIDTH,
-                             (int *)&(gpu->max_width));
-    if (ret != NvCtrlSuccess) {
+    if (queries[GPU_QUERY_MAX_SCREEN_WIDTH].status != NvCtrlSuccess) {
         *err_str = g_strdup_printf("Failed to query MAX SCREEN WIDTH on "
                                    "GPU-%d '%s'.",
                                    NvCtrlGetTargetId(ctrl_target),
@@ -3154,10 +4597,9 @@ static Bool layout_add_gpu_from_server(nvLayoutPtr layout,
         nv_error_msg("%s", *err_str);
         goto fail;
     }
+    gpu->max_width = queries[GPU_QUERY_MAX_SCREEN_WIDTH].val;
 
-    ret = NvCtrlGetAttribute(ctrl_target, NV_CTRL_MAX_SCREEN_HEIGHT,
-                             (int *)&(gpu->max_height));
-    if (ret != NvCtrlSuccess) {
+    if (queries[GPU_QUERY_MAX_SCREEN_HEIGHT].status != NvCtrlSuccess) {
         *err_str = g_strdup_printf("Failed to query MAX SCREEN HEIGHT on "
                                    "GPU-%d '%s'.",
                                    NvCtrlGetTargetId(ctrl_target),
@@ -3165,10 +4607,9 @@ static Bool layout_add_gpu_from_server(nvLayoutPtr layout,
         nv_error_msg("%s", *err_str);
         goto fail;
     }
+    gpu->max_height = queries[GPU_QUERY_MAX_SCREEN_HEIGHT].val;
 
-    ret = NvCtrlGetAttribute(ctrl_target, NV_CTRL_MAX_DISPLAYS,
-                             (int *)&(gpu->max_displays));
-    if (ret != NvCtrlSuccess) {
+    if (queries[GPU_QUERY_MAX_DISPLAYS].status != NvCtrlSuccess) {
         *err_str = g_strdup_printf("Failed to query MAX DISPLAYS on "
                                    "GPU-%d '%s'.",
                                    NvCtrlGetTargetId(ctrl_target),
@@ -3176,30 +4617,28 @@ static Bool layout_add_gpu_from_server(nvLayoutPtr layout,
         nv_error_msg("%s", *err_str);
         goto fail;
     }
+    gpu->max_displays = queries[GPU_QUERY_MAX_DISPLAYS].val;
 
-    ret = NvCtrlGetAttribute(ctrl_target, NV_CTRL_DEPTH_30_ALLOWED,
-                             &(gpu->allow_depth_30));
-
-    if (ret != NvCtrlSuccess) {
+    if (queries[GPU_QUERY_DEPTH_30_ALLOWED].status != NvCtrlSuccess) {
         gpu->allow_depth_30 = FALSE;
+    } else {
+        gpu->allow_depth_30 = queries[GPU_QUERY_DEPTH_30_ALLOWED].val;
     }
 
-    ret = NvCtrlGetAttribute(ctrl_target, NV_CTRL_MULTIGPU_MASTER_POSSIBLE,
-                             &(gpu->multigpu_master_possible));
-    if (ret != NvCtrlSuccess) {
+    if (queries[GPU_QUERY_MULTIGPU_MASTER_POSSIBLE].status != NvCtrlSuccess) {
         gpu->multigpu_master_possible = FALSE;
+    } else {
+        gpu->multigpu_master_possible =
+            queries[GPU_QUERY_MULTIGPU_MASTER_POSSIBLE].val;
     }
 
-    ret = NvCtrlGetBinaryAttribute(ctrl_target,
-                                   0,
-                                   NV_CTRL_BINARY_DATA_GPU_FLAGS,
-                                   (unsigned char **)&pData,
-                                   &len);
-    if (ret != NvCtrlSuccess) {
+    pData = (unsigned int *)queries[GPU_QUERY_GPU_FLAGS].data;
+    if ((queries[GPU_QUERY_GPU_FLAGS].status != NvCtrlSuccess) || !pData) {
         gpu->num_flags = 0;
         gpu->flags_memory = NULL;
         gpu->flags = NULL;
     } else {
+        queries[GPU_QUERY_GPU_FLAGS].data = NULL;
         gpu->flags_memory = pData;
         gpu->num_flags = pData[0];
         gpu->flags = &pData[1];
@@ -3211,24 +4650,19 @@ static Bool layout_add_gpu_from_server(nvLayoutPtr layout,
     gpu->mosaic_type = MOSAIC_TYPE_UNSUPPORTED;
     gpu->mosaic_enabled = FALSE;
 
-    ret = NvCtrlGetAttribute(ctrl_target,
-                             NV_CTRL_SLI_MOSAIC_MODE_AVAILABLE,
-                             &(val));
-
-    if ((ret == NvCtrlSuccess) &&
-        (val == NV_CTRL_SLI_MOSAIC_MODE_AVAILABLE_TRUE)) {
-        char *sli_str;
+    if ((queries[GPU_QUERY_SLI_MOSAIC_MODE_AVAILABLE].status ==
+         NvCtrlSuccess) &&
+        (queries[GPU_QUERY_SLI_MOSAIC_MODE_AVAILABLE].val ==
+         NV_CTRL_SLI_MOSAIC_MODE_AVAILABLE_TRUE)) {
+        const char *sli_str = queries[GPU_QUERY_SLI_MODE].str;
 
         gpu->mosaic_type = MOSAIC_TYPE_SLI_MOSAIC;
 
-        ret = NvCtrlGetStringAttribute(ctrl_target,
-                                       NV_CTRL_STRING_SLI_MODE,
-                                       &sli_str);
-        if ((ret == NvCtrlSuccess) && sli_str) {
+        if ((queries[GPU_QUERY_SLI_MODE].status == NvCtrlSuccess) &&
+            sli_str) {
             if (!strcasecmp(sli_str, "Mosaic")) {
                 gpu->mosaic_enabled = TRUE;
             }
-            free(sli_str);
         }
 
     } else {
@@ -3248,9 +4682,10 @@ static Bool layout_add_gpu_from_server(nvLayoutPtr layout,
             }
 
             if (gpu->mosaic_type != MOSAIC_TYPE_UNSUPPORTED) {
-                ret = NvCtrlGetAttribute(ctrl_target, NV_CTRL_BASE_MOSAIC,
-                                         &(val));
-                if ((ret == NvCtrlSuccess) &&
+                int val = queries[GPU_QUERY_BASE_MOSAIC].val;
+
+                if ((queries[GPU_QUERY_BASE_MOSAIC].status ==
+                     NvCtrlSuccess) &&
                     (val == NV_CTRL_BASE_MOSAIC_FULL ||
                      val == NV_CTRL_BASE_MOSAIC_LIMITED)) {
                     gpu->mosaic_enabled = TRUE;
@@ -3260,7 +4695,7 @@ static Bool layout_add_gpu_from_server(nvLayoutPtr layout,
     }
 
     /* Add the display devices to the GPU */
-    if (!gpu_add_displays_from_server(gpu, err_str)) {
+    if (!gpu_add_displays_from_server(gpu, display_queries, err_str)) {
         nv_warning_msg("Failed to add displays to GPU-%d '%s'.",
                        NvCtrlGetTargetId(ctrl_target),
                        gpu->name);
@@ -3286,27 +4721,105 @@ static Bool layout_add_gpu_from_server(nvLayoutPtr layout,
  *
  * Adds the GPUs found on the server to the layout structure.
  *
+ * The attributes of all the GPUs and of their connected display
+ * devices are queried as a single batch, so that loading the layout
+ * costs one round trip to the X server instead of one per attribute.
+ *
  **/
 static int layout_add_gpus_from_server(nvLayoutPtr layout, gchar **err_str)
 {
-    CtrlTargetNode *node;
+    CtrlTargetNode *node, *display_node;
+    CtrlAttributeQuery *queries = NULL;
+    CtrlAttributeQuery *gpu_queries, *display_queries;
+    int num_gpus = 0;
+    int num_displays = 0;
+    int num_queries;
 
     layout_remove_gpus(layout);
 
+
+    /* Size the batch of queries */
+    for (node = layout->system->targets[GPU_TARGET]; node; node = node->next) {
+        num_gpus++;
+
+        for (display_node = node->t->relations;
+             display_node;
+             display_node = display_node->next) {
+            if (display_target_is_connected(display_node->t)) {
+                num_displays++;
+            }
+        }
+    }
+
+    num_queries = num_gpus * GPU_QUERY_COUNT +
+        num_displays * DISPLAY_QUERY_COUNT;
+    if (num_queries == 0) {
+        return 0;
+    }
+
+    queries = calloc(num_queries, sizeof(CtrlAttributeQuery));
+    if (!queries) {
+        goto fail;
+    }
+
+
+    /* Queue the queries of each GPU, then those of each display device */
+    gpu_queries = queries;
+    display_queries = queries + num_gpus * GPU_QUERY_COUNT;
+
+    for (node = layout->system->targets[GPU_TARGET]; node; node = node->next) {
+        gpu_set_queries(node->t, gpu_queries);
+        gpu_queries += GPU_QUERY_COUNT;
+
+        for (display_node = node->t->relations;
+             display_node;
+             display_node = display_node->next) {
+            if (display_target_is_connected(display_node->t)) {
+                display_set_queries(display_node->t, display_queries);
+                display_queries += DISPLAY_QUERY_COUNT;
+            }
+        }
+    }
+
+    NvCtrlQueryAttributes(queries, num_queries);
+
+
+    /* Build the GPUs from the replies */
+    gpu_queries = queries;
+    display_queries = queries + num_gpus * GPU_QUERY_COUNT;
+
     for (node = layout->system->targets[GPU_TARGET]; node; node = node->next) {
         CtrlTarget *ctrl_target = node->t;
 
-        if (!layout_add_gpu_from_server(layout, ctrl_target, err_str)) {
+        if (!layout_add_gpu_from_server(layout, ctrl_target, gpu_queries,
+                                        display_queries, err_str)) {
             nv_warning_msg("Failed to add GPU-%d to layout.",
                            NvCtrlGetTargetId(ctrl_target));
             goto fail;
         }
+
+        gpu_queries += GPU_QUERY_COUNT;
+
+        for (display_node = ctrl_target->relations;
+             display_node;
+             display_node = display_node->next) {
+            if (display_target_is_connected(display_node->t)) {
+                display_queries += DISPLAY_QUERY_COUNT;
+            }
+        }
     }
 
+    NvCtrlFreeAttributeQueries(queries, num_queries);
+    free(queries);
+
     return layout->num_gpus;
 
 
  fail:
+    if (queries) {
+        NvCtrlFreeAttributeQueries(queries, num_queries);
+        free(queries);
+    }
     layout_remove_gpus(layout);
     return 0;
 
@@ -3337,12 +4850,10 @@ static void layout_remove_screens(nvLayoutPtr layout)
  *
  **/
 
-static Bool link_screen_to_gpus(nvLayoutPtr layout, nvScreenPtr screen)
+static Bool link_screen_to_gpus(nvLayoutPtr layout, nvScreenPtr screen,
+                                const CtrlAttributeQuery *queries)
 {
-    Bool status = FALSE;
-    ReturnStatus ret;
-    int *pData = NULL;
-    int len;
+    const int *pData;
     int i;
     int scrnum = NvCtrlGetTargetId(screen->ctrl_target);
 
@@ -3350,20 +4861,17 @@ static Bool link_screen_to_gpus(nvLayoutPtr layout, nvScreenPtr screen)
      * which is the case when SLI Mosaic is configured, link the screen to the
      * first (multi gpu master possible) GPU we find.
      */
-    ret = NvCtrlGetAttribute(screen->ctrl_target,
-                             NV_CTRL_MULTIGPU_DISPLAY_OWNER,
-                             &(screen->display_owner_gpu_id));
-    if (ret != NvCtrlSuccess) {
+    if (queries[SCREEN_QUERY_MULTIGPU_DISPLAY_OWNER].status == NvCtrlSuccess) {
+        screen->display_owner_gpu_id =
+            queries[SCREEN_QUERY_MULTIGPU_DISPLAY_OWNER].val;
+    } else {
         screen->display_owner_gpu_id = -1;
     }
 
-    ret = NvCtrlGetBinaryAttribute(screen->ctrl_target,
-                                   0,
-                                   NV_CTRL_BINARY_DATA_GPUS_USED_BY_XSCREEN,
-                                   (unsigned char **)(&pData),
-                                   &len);
-    if ((ret != NvCtrlSuccess) || !pData || (pData[0] < 1)) {
-        goto done;
+    pData = (const int *)queries[SCREEN_QUERY_GPUS_USED].data;
+    if ((queries[SCREEN_QUERY_GPUS_USED].status != NvCtrlSuccess) ||
+        !pData || (pData[0] < 1)) {
+        return FALSE;
     }
 
     /* Point to all the gpus */
@@ -3385,33 +4893,86 @@ static Bool link_screen_to_gpus(nvLayoutPtr layout, nvScreenPtr screen)
     /* Make sure a display owner was picked */
     if (screen->num_gpus <= 0) {
         nv_error_msg("Failed to link X screen %d to any GPU.", scrnum);
-        goto done;
+        return FALSE;
     }
 
-    status = TRUE;
+    return TRUE;
+}
+
 
- done:
-    free(pData);
 
-    return status;
-}
+/** screen_set_queries() *********************************************
+ *
+ * Fills in the SCREEN_QUERY_COUNT queries needed to load the X screen.
+ *
+ **/
+static void screen_set_queries(CtrlTarget *ctrl_target,
+                               CtrlAttributeQuery *queries)
+{
+    static const struct {
+        int index;
+        CtrlAttributeType attr_type;
+        int attr;
+    } ScreenQueriesTable[] = {
+        { SCREEN_QUERY_STEREO,
+          CTRL_ATTRIBUTE_TYPE_INTEGER, NV_CTRL_STEREO },
+        { SCREEN_QUERY_OVERLAY,
+          CTRL_ATTRIBUTE_TYPE_INTEGER, NV_CTRL_OVERLAY },
+        { SCREEN_QUERY_HWOVERLAY,
+          CTRL_ATTRIBUTE_TYPE_INTEGER, NV_CTRL_HWOVERLAY },
+        { SCREEN_QUERY_UBB,
+          CTRL_ATTRIBUTE_TYPE_INTEGER, NV_CTRL_UBB },
+        { SCREEN_QUERY_NO_SCANOUT,
+          CTRL_ATTRIBUTE_TYPE_INTEGER, NV_CTRL_NO_SCANOUT },
+        { SCREEN_QUERY_MULTIGPU_DISPLAY_OWNER,
+          CTRL_ATTRIBUTE_TYPE_INTEGER, NV_CTRL_MULTIGPU_DISPLAY_OWNER },
+        { SCREEN_QUERY_GPUS_USED,
+          CTRL_ATTRIBUTE_TYPE_BINARY_DATA,
+          NV_CTRL_BINARY_DATA_GPUS_USED_BY_XSCREEN },
+        { SCREEN_QUERY_SLI_VISUAL_INDICATOR,
+          CTRL_ATTRIBUTE_TYPE_INTEGER, NV_CTRL_SHOW_SLI_VISUAL_INDICATOR },
+        { SCREEN_QUERY_SLI_MODE,
+          CTRL_ATTRIBUTE_TYPE_STRING, NV_CTRL_STRING_SLI_MODE },
+        { SCREEN_QUERY_MULTIGPU_MODE,
+          CTRL_ATTRIBUTE_TYPE_STRING, NV_CTRL_STRING_MULTIGPU_MODE },
+        { SCREEN_QUERY_SCREEN_RECTANGLE,
+          CTRL_ATTRIBUTE_TYPE_STRING, NV_CTRL_STRING_SCREEN_RECTANGLE },
+        { SCREEN_QUERY_METAMODES,
+          CTRL_ATTRIBUTE_TYPE_BINARY_DATA,
+          NV_CTRL_BINARY_DATA_METAMODES_VERSION_2 },
+        { SCREEN_QUERY_CURRENT_METAMODE,
+          CTRL_ATTRIBUTE_TYPE_STRING,
+          NV_CTRL_STRING_CURRENT_METAMODE_VERSION_2 },
+        { SCREEN_QUERY_XINERAMA_INFO_ORDER,
+          CTRL_ATTRIBUTE_TYPE_STRING,
+          NV_CTRL_STRING_NVIDIA_XINERAMA_INFO_ORDER },
+    };
+    int i;
+
+    for (i = 0; i < ARRAY_LEN(ScreenQueriesTable); i++) {
+        set_query(queries + ScreenQueriesTable[i].index, ctrl_target,
+                  ScreenQueriesTable[i].attr_type, ScreenQueriesTable[i].attr);
+    }
+
+} /* screen_set_queries() */
 
 
 
 /** layout_add_screen_from_server() **********************************
  *
- * Adds an X screen to the layout structure.
+ * Adds an X screen to the layout structure, using the results of the
+ * queries set by screen_set_queries().
  *
  **/
 static Bool layout_add_screen_from_server(nvLayoutPtr layout,
                                           CtrlTarget *ctrl_target,
+                                          CtrlAttributeQuery *queries,
                                           gchar **err_str)
 {
     nvScreenPtr screen;
-    int val, tmp;
-    ReturnStatus ret;
-    gchar *primary_str = NULL;
-    gchar *screen_info = NULL;
+    int val;
+    const gchar *primary_str;
+    const gchar *screen_info;
     GdkRectangle screen_parsed_info;
 
 
@@ -3423,40 +4984,37 @@ static Bool layout_add_screen_from_server(nvLayoutPtr layout,
 
 
     /* Query the current stereo mode */
-    ret = NvCtrlGetAttribute(ctrl_target, NV_CTRL_STEREO, &val);
-    if (ret == NvCtrlSuccess) {
+    if (queries[SCREEN_QUERY_STEREO].status == NvCtrlSuccess) {
         screen->stereo_supported = TRUE;
-        screen->stereo = val;
+        screen->stereo = queries[SCREEN_QUERY_STEREO].val;
     } else {
         screen->stereo_supported = FALSE;
     }
 
     /* Query the current overlay state */
-    ret = NvCtrlGetAttribute(ctrl_target, NV_CTRL_OVERLAY, &val);
-    if (ret == NvCtrlSuccess) {
-        screen->overlay = val;
+    if (queries[SCREEN_QUERY_OVERLAY].status == NvCtrlSuccess) {
+        screen->overlay = queries[SCREEN_QUERY_OVERLAY].val;
     } else {
         screen->overlay = NV_CTRL_OVERLAY_OFF;
     }
 
-    ret = NvCtrlGetAttribute(ctrl_target, NV_CTRL_HWOVERLAY, &val);
-    if (ret == NvCtrlSuccess) {
-        screen->hw_overlay = val;
+    if (queries[SCREEN_QUERY_HWOVERLAY].status == NvCtrlSuccess) {
+        screen->hw_overlay = queries[SCREEN_QUERY_HWOVERLAY].val;
     } else {
         screen->hw_overlay = NV_CTRL_HWOVERLAY_FALSE;
     }
 
     /* Query the current UBB state */
-    ret = NvCtrlGetAttribute(ctrl_target, NV_CTRL_UBB, &val);
-    if (ret == NvCtrlSuccess) {
-        screen->ubb = val;
+    if (queries[SCREEN_QUERY_UBB].status == NvCtrlSuccess) {
+        screen->ubb = queries[SCREEN_QUERY_UBB].val;
     } else {
         screen->ubb = NV_CTRL_UBB_OFF;
     }
 
     /* See if the screen is set to not scanout */
-    ret = NvCtrlGetAttribute(ctrl_target, NV_CTRL_NO_SCANOUT, &val);
-    if (ret != NvCtrlSuccess) {
+    if (queries[SCREEN_QUERY_NO_SCANOUT].status == NvCtrlSuccess) {
+        val = queries[SCREEN_QUERY_NO_SCANOUT].val;
+    } else {
         /* Don't make it a fatal error if NV_CTRL_NO_SCANOUT can't be
          * queried, since some drivers may not support this attribute. */
 
@@ -3474,7 +5032,7 @@ static Bool layout_add_screen_from_server(nvLayoutPtr layout,
 
 
     /* Link screen to the GPUs driving it */
-    if (!link_screen_to_gpus(layout, screen)) {
+    if (!link_screen_to_gpus(layout, screen, queries)) {
         *err_str = g_strdup_printf("Failed to find GPU that drives screen %d.",
                                    NvCtrlGetTargetId(ctrl_target));
         nv_warning_msg("%s", *err_str);
@@ -3482,25 +5040,22 @@ static Bool layout_add_screen_from_server(nvLayoutPtr layout,
     }
 
     /* Query SLI status */
-    ret = NvCtrlGetAttribute(ctrl_target,
-                             NV_CTRL_SHOW_SLI_VISUAL_INDICATOR,
-                             &tmp);
-
-    screen->sli = (ret == NvCtrlSuccess);
+    screen->sli =
+        (queries[SCREEN_QUERY_SLI_VISUAL_INDICATOR].status == NvCtrlSuccess);
 
     /* Query SLI mode */
-    ret = NvCtrlGetStringAttribute(ctrl_target,
-                                   NV_CTRL_STRING_SLI_MODE,
-                                   &screen->sli_mode);
-    if (ret != NvCtrlSuccess) {
+    if (queries[SCREEN_QUERY_SLI_MODE].status == NvCtrlSuccess) {
+        screen->sli_mode = queries[SCREEN_QUERY_SLI_MODE].str;
+        queries[SCREEN_QUERY_SLI_MODE].str = NULL;
+    } else {
         screen->sli_mode = NULL;
     }
 
     /* Query MULTIGPU mode */
-    ret = NvCtrlGetStringAttribute(ctrl_target,
-                                   NV_CTRL_STRING_MULTIGPU_MODE,
-                                   &screen->multigpu_mode);
-    if (ret != NvCtrlSuccess) {
+    if (queries[SCREEN_QUERY_MULTIGPU_MODE].status == NvCtrlSuccess) {
+        screen->multigpu_mode = queries[SCREEN_QUERY_MULTIGPU_MODE].str;
+        queries[SCREEN_QUERY_MULTIGPU_MODE].str = NULL;
+    } else {
         screen->multigpu_mode = NULL;
     }
 
@@ -3511,10 +5066,9 @@ static Bool layout_add_screen_from_server(nvLayoutPtr layout,
     screen->depth = NvCtrlGetScreenPlanes(ctrl_target);
 
     /* Initialize the virtual X screen size */
-    ret = NvCtrlGetStringAttribute(ctrl_target,
-                                   NV_CTRL_STRING_SCREEN_RECTANGLE,
-                                   &screen_info);
-    if (ret != NvCtrlSuccess) {
+    if (queries[SCREEN_QUERY_SCREEN_RECTANGLE].status == NvCtrlSuccess) {
+        screen_info = queries[SCREEN_QUERY_SCREEN_RECTANGLE].str;
+    } else {
         screen_info = NULL;
     }
 
@@ -3533,7 +5087,6 @@ static Bool layout_add_screen_from_server(nvLayoutPtr layout,
             screen->dim.width = screen_parsed_info.width;
             screen->dim.height = screen_parsed_info.height;
         }
-        free(screen_info);
     }
 
     /* Add the screen to the layout */
@@ -3544,7 +5097,7 @@ static Bool layout_add_screen_from_server(nvLayoutPtr layout,
 
     /* Parse the screen's metamodes (ties displays on the gpu to the screen) */
     if (!screen->no_scanout) {
-        if (!screen_add_metamodes(screen, err_str)) {
+        if (!screen_add_metamodes(screen, queries, err_str)) {
             nv_warning_msg("Failed to add metamodes to screen %d.",
                            NvCtrlGetTargetId(ctrl_target));
             goto fail;
@@ -3552,11 +5105,10 @@ static Bool layout_add_screen_from_server(nvLayoutPtr layout,
 
         /* Query & parse the screen's primary display */
         screen->primaryDisplay = NULL;
-        ret = NvCtrlGetStringAttribute(ctrl_target,
-                                       NV_CTRL_STRING_NVIDIA_XINERAMA_INFO_ORDER,
-                                       &primary_str);
+        primary_str = queries[SCREEN_QUERY_XINERAMA_INFO_ORDER].str;
 
-        if (ret == NvCtrlSuccess && primary_str) {
+        if ((queries[SCREEN_QUERY_XINERAMA_INFO_ORDER].status ==
+             NvCtrlSuccess) && primary_str) {
             char *str;
 
             /* The TwinView Xinerama Info Order string may be a comma-separated
@@ -3569,7 +5121,6 @@ static Bool layout_add_screen_from_server(nvLayoutPtr layout,
             } else {
                 str = nvstrndup(primary_str, str-primary_str);
             }
-            free(primary_str);
 
             screen->primaryDisplay = screen_find_named_display(screen, str);
             nvfree(str);
@@ -3597,26 +5148,67 @@ static Bool layout_add_screen_from_server(nvLayoutPtr layout,
  *
  * Adds the screens found on the server to the layout structure.
  *
+ * The attributes of all the X screens, their metamodes included, are
+ * queried as a single batch, as layout_add_gpus_from_server() does for
+ * the GPUs.
+ *
  **/
 static int layout_add_screens_from_server(nvLayoutPtr layout, gchar **err_str)
 {
     CtrlTargetNode *node;
+    CtrlAttributeQuery *queries;
+    CtrlAttributeQuery *screen_queries;
+    int num_queries = 0;
 
     layout_remove_screens(layout);
 
+
+    /* Queue the queries of each X screen */
+    for (node = layout->system->physical_screens;
+         node;
+         node = node->next) {
+        num_queries += SCREEN_QUERY_COUNT;
+    }
+    if (num_queries == 0) {
+        return 0;
+    }
+
+    queries = calloc(num_queries, sizeof(CtrlAttributeQuery));
+    if (!queries) {
+        return 0;
+    }
+
+    screen_queries = queries;
+    for (node = layout->system->physical_screens;
+         node;
+         node = node->next) {
+        screen_set_queries(node->t, screen_queries);
+        screen_queries += SCREEN_QUERY_COUNT;
+    }
+
+    NvCtrlQueryAttributes(queries, num_queries);
+
+
+    /* Build the X screens from the replies */
+    screen_queries = queries;
     for (node = layout->system->physical_screens;
          node;
          node = node->next) {
         CtrlTarget *ctrl_target = node->t;
 
-        if (!layout_add_screen_from_server(layout, ctrl_target, err_str)) {
+        if (!layout_add_screen_from_server(layout, ctrl_target,
+                                           screen_queries, err_str)) {
             nv_warning_msg("Failed to add X screen %d to layout.",
                            NvCtrlGetTargetId(ctrl_target));
             g_free(*err_str);
             *err_str = NULL;
         }
+        screen_queries += SCREEN_QUERY_COUNT;
     }
 
+    NvCtrlFreeAttributeQueries(queries, num_queries);
+    free(queries);
+
     return layout->num_screens;
 
 } /* layout_add_screens_from_server() */
@@ -4009,6 +5601,122 @@ static const char *get_non_regular_file_type_description(mode_t mode)
 
 
 
+/** xconfig_preload_thread() ****************************************
+ *
+ * Parses the default X config file in the background, so that it is
+ * ready by the time the user saves the X configuration.
+ *
+ **/
+static gpointer xconfig_preload_thread(gpointer user_data)
+{
+    SaveXConfDlg *dlg = (SaveXConfDlg *)user_data;
+    XConfigPtr config = NULL;
+    const char *filename;
+    struct stat st;
+
+    if ((stat(dlg->preload_filename, &st) != 0) || !S_ISREG(st.st_mode)) {
+        return NULL;
+    }
+
+    filename = xconfigOpenConfigFile(dlg->preload_filename, NULL);
+    if (filename && !strcmp(filename, dlg->preload_filename)) {
+        if (xconfigReadConfigFile(&config) != XCONFIG_RETURN_SUCCESS) {
+            config = NULL;
+        }
+    }
+    xconfigCloseConfigFile();
+
+    dlg->preload_config = config;
+    dlg->preload_mtime = st.st_mtime;
+    dlg->preload_size = st.st_size;
+
+    return NULL;
+
+} /* xconfig_preload_thread() */
+
+
+
+/** xconfig_preload_start() *****************************************
+ *
+ * Starts parsing the X config file 'filename' in the background.  The
+ * X config parser keeps its state per thread, so this can run while
+ * the GUI thread parses other files.  Without thread support, the file
+ * is simply parsed when it is needed.
+ *
+ **/
+static void xconfig_preload_start(SaveXConfDlg *dlg, const gchar *filename)
+{
+    dlg->preload_thread = NULL;
+    dlg->preload_filename = NULL;
+    dlg->preload_config = NULL;
+
+    if (!filename || !filename[0]) {
+        return;
+    }
+
+    dlg->preload_filename = g_strdup(filename);
+
+#if GLIB_CHECK_VERSION(2, 32, 0)
+    dlg->preload_thread = g_thread_new("xconfig-preload",
+                                       xconfig_preload_thread, dlg);
+#else
+    if (g_thread_supported()) {
+        dlg->preload_thread = g_thread_create(xconfig_preload_thread, dlg,
+                                              TRUE, NULL);
+    }
+#endif
+
+    if (!dlg->preload_thread) {
+        g_free(dlg->preload_filename);
+        dlg->preload_filename = NULL;
+    }
+
+} /* xconfig_preload_start() */
+
+
+
+/** xconfig_preload_take() ******************************************
+ *
+ * Waits for the background parse (if any) to finish, and returns the
+ * X config it produced if it is of the file 'filename' and the file
+ * has not changed since ('st' is the file's current status).  The
+ * caller owns the returned X config.  Returns NULL otherwise; the
+ * background parse is only used once.
+ *
+ **/
+static XConfigPtr xconfig_preload_take(SaveXConfDlg *dlg,
+                                       const gchar *filename,
+                                       const struct stat *st)
+{
+    XConfigPtr config;
+
+    if (!dlg->preload_thread) {
+        return NULL;
+    }
+
+    g_thread_join(dlg->preload_thread);
+    dlg->preload_thread = NULL;
+
+    config = dlg->preload_config;
+    dlg->preload_config = NULL;
+
+    if (config &&
+        (strcmp(filename, dlg->preload_filename) ||
+         (dlg->preload_mtime != st->st_mtime) ||
+         (dlg->preload_size != st->st_size))) {
+        xconfigFreeConfig(&config);
+        config = NULL;
+    }
+
+    g_free(dlg->preload_filename);
+    dlg->preload_filename = NULL;
+
+    return config;
+
+} /* xconfig_preload_take() */
+
+
+
 /**  update_xconfig_save_buffer() ************************************
  *
  * Updates the "preview" buffer to hold the right contents based on
@@ -4018,6 +5726,9 @@ static const char *get_non_regular_file_type_description(mode_t mode)
  * Also updates the state of the "Merge" checkbox in the case where
  * the named file can/cannot be parsed as a valid X config file.
  *
+ * The preview is left alone when neither the merge setting nor the
+ * named file changed since it was last generated.
+ *
  */
 static void update_xconfig_save_buffer(SaveXConfDlg *dlg)
 {
@@ -4027,10 +5738,10 @@ static void update_xconfig_save_buffer(SaveXConfDlg *dlg)
     XConfigPtr xconfGen = NULL;
     XConfigError xconfErr;
 
-    char *tmp_filename = NULL;
-    int tmp_fd;
     struct stat st;
-    void *buf;
+    Bool file_exists;
+    char *buf;
+    size_t len;
     GtkTextIter buf_start, buf_end;
 
     gboolean merge;
@@ -4047,6 +5758,21 @@ static void update_xconfig_save_buffer(SaveXConfDlg *dlg)
 
     filename = gtk_entry_get_text(GTK_ENTRY(dlg->txt_xconfig_file));
 
+    file_exists = (filename && (stat(filename, &st) == 0));
+
+
+    /* Nothing to do if the preview was generated from the same inputs */
+    if (dlg->preview_valid &&
+        (dlg->preview_merge == merge) &&
+        (dlg->preview_file_exists == file_exists) &&
+        !g_strcmp0(dlg->preview_filename, filename) &&
+        (!file_exists ||
+         ((dlg->preview_mtime == st.st_mtime) &&
+          (dlg->preview_size == st.st_size)))) {
+        return;
+    }
+    dlg->preview_valid = FALSE;
+
 
     /* Assume we can save until we find out otherwise */
     gtk_dialog_set_response_sensitive(GTK_DIALOG(dlg->dlg_xconfig_save),
@@ -4055,10 +5781,11 @@ static void update_xconfig_save_buffer(SaveXConfDlg *dlg)
 
 
     /* Find out if the file is mergable */
-    if (filename && (stat(filename, &st) == 0)) {
+    if (file_exists) {
         const char *non_regular_file_type_description =
             get_non_regular_file_type_description(st.st_mode);
         const char *test_filename;
+        Bool parsed = FALSE;
 
         /* Make sure this is a regular file */
         if (non_regular_file_type_description) {
@@ -4073,17 +5800,28 @@ static void update_xconfig_save_buffer(SaveXConfDlg *dlg)
             goto fail;
         }
 
-        /* Must be able to open the file */
-        test_filename = xconfigOpenConfigFile(filename, NULL);
-        if (!test_filename || strcmp(test_filename, filename)) {
+        /* Use the copy of the file parsed in the background, if it is
+         * still current; otherwise, parse the file now.
+         */
+        xconfCur = xconfig_preload_take(dlg, filename, &st);
+        if (xconfCur) {
+            xconfErr = XCONFIG_RETURN_SUCCESS;
+            parsed = TRUE;
+        } else {
+            /* Must be able to open the file */
+            test_filename = xconfigOpenConfigFile(filename, NULL);
+            if (test_filename && !strcmp(test_filename, filename)) {
+
+                /* Must be able to parse the file as an X config file */
+                xconfErr = xconfigReadConfigFile(&xconfCur);
+                parsed = TRUE;
+            }
             xconfigCloseConfigFile();
+        }
 
-        } else {
+        if (parsed) {
             GenerateOptions gop;
 
-            /* Must be able to parse the file as an X config file */
-            xconfErr = xconfigReadConfigFile(&xconfCur);
-            xconfigCloseConfigFile();
             if ((xconfErr != XCONFIG_RETURN_SUCCESS) || !xconfCur) {
                 /* If we failed to parse the config file, we should not
                  * allow a merge.
@@ -4176,35 +5914,13 @@ static void update_xconfig_save_buffer(SaveXConfDlg *dlg)
     update_banner(xconfGen);
 
 
-    /* Setup the X config file preview buffer by writing to a temp file */
-    tmp_filename = g_strdup_printf("/tmp/.xconfig.tmp.XXXXXX");
-    tmp_fd = mkstemp(tmp_filename);
-    if (!tmp_fd) {
-        err_msg = g_strdup_printf("Failed to create temp X config file '%s' "
-                                  "for preview.",
-                                  tmp_filename);
-        goto fail;
-    }
-    xconfigWriteConfigFile(tmp_filename, xconfGen);
+    /* Render the X config file into the preview buffer */
+    buf = xconfigRenderConfig(xconfGen, &len);
     xconfigFreeConfig(&xconfGen);
 
-    if (lseek(tmp_fd, 0, SEEK_SET) == (off_t)-1) {
-        err_msg = g_strdup_printf("Failed lseek() on temp X config file '%s' "
-                                  "for preview.",
-                                  tmp_filename);
-        goto fail;
-    }
-    if (fstat(tmp_fd, &st) == -1) {
-        err_msg = g_strdup_printf("Failed fstat() on temp X config file '%s' "
-                                  "for preview.",
-                                  tmp_filename);
-        goto fail;
-    }
-    buf = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, tmp_fd, 0);
-    if (buf == MAP_FAILED) {
-        err_msg = g_strdup_printf("Failed mmap() on temp X config file '%s' "
-                                  "for preview.",
-                                  tmp_filename);
+    if (!buf) {
+        err_msg = g_strdup_printf("Failed to generate X config file "
+                                  "preview.");
         goto fail;
     }
 
@@ -4218,11 +5934,19 @@ static void update_xconfig_save_buffer(SaveXConfDlg *dlg)
 
     /* Set the new GTK buffer contents */
     gtk_text_buffer_set_text(GTK_TEXT_BUFFER(dlg->buf_xconfig_save),
-                             buf, st.st_size);
-    munmap(buf, st.st_size);
-    close(tmp_fd);
-    remove(tmp_filename);
-    g_free(tmp_filename);
+                             buf, len);
+    free(buf);
+
+    /* Remember what the preview was generated from */
+    g_free(dlg->preview_filename);
+    dlg->preview_filename = g_strdup(filename);
+    dlg->preview_merge = merged;
+    dlg->preview_file_exists = file_exists;
+    if (file_exists) {
+        dlg->preview_mtime = st.st_mtime;
+        dlg->preview_size = st.st_size;
+    }
+    dlg->preview_valid = TRUE;
 
     return;
 
@@ -4250,8 +5974,6 @@ static void update_xconfig_save_buffer(SaveXConfDlg *dlg)
         xconfigFreeConfig(&xconfCur);
     }
 
-    g_free(tmp_filename);
-
     return;
 
 } /* update_xconfig_save_buffer() */
@@ -4356,7 +6078,10 @@ void run_save_xconfig_dialog(SaveXConfDlg *dlg)
     gint result;
 
 
-    /* Generate the X config file save buffer */
+    /* Generate the X config file save buffer; the configuration may
+     * have changed since the dialog was last shown.
+     */
+    dlg->preview_valid = FALSE;
     update_xconfig_save_buffer(dlg);
 
 
@@ -4458,6 +6183,13 @@ SaveXConfDlg *create_save_xconfig_dialog(GtkWidget *parent,
     dlg->merge_toggleable = merge_toggleable;
     dlg->callback_data = callback_data;
 
+    dlg->preview_valid = FALSE;
+    dlg->preview_merge = FALSE;
+    dlg->preview_filename = NULL;
+    dlg->preview_file_exists = FALSE;
+    dlg->preview_mtime = 0;
+    dlg->preview_size = 0;
+
     /* Setup the default filename */
     tmp_filename = xconfigOpenConfigFile(NULL, NULL);
     if (tmp_filename) {
@@ -4472,6 +6204,9 @@ SaveXConfDlg *create_save_xconfig_dialog(GtkWidget *parent,
         return NULL;
     }
 
+    /* Parse the existing X config file while the page is built */
+    xconfig_preload_start(dlg, filename);
+
     /* Create the dialog */
     dlg->dlg_xconfig_save = gtk_dialog_new_with_buttons
         ("Save X Configuration",
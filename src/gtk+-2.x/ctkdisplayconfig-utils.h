@@ -20,6 +20,8 @@
 #ifndef __CTK_DISPLAYCONFIG_UTILS_H__
 #define __CTK_DISPLAYCONFIG_UTILS_H__
 
+#include <sys/types.h>
+
 #include <gtk/gtk.h>
 
 #include "XF86Config-parser/xf86Parser.h"
@@ -62,6 +64,7 @@ void get_underscan_settings_from_viewportout(const nvSize raster_size,
 
 Bool modelines_match(nvModeLinePtr modeline1, nvModeLinePtr modeline2);
 void modeline_free(nvModeLinePtr m);
+void modepool_free_modelines(nvModeLinePtr modelines, nvModePoolPtr pool);
 
 
 
@@ -79,8 +82,20 @@ Bool viewports_out_match(const GdkRectangle viewPortOut1,
 int display_find_closest_mode_matching_modeline(nvDisplayPtr display,
                                                 nvModeLinePtr modeline);
 Bool display_has_modeline(nvDisplayPtr display, nvModeLinePtr modeline);
+nvModeLinePtr display_find_modeline(nvDisplayPtr display,
+                                    nvModeLinePtr modeline);
+nvModeLinePtr display_find_modeline_by_name(nvDisplayPtr display,
+                                            const char *name);
+nvModeLinePtr *display_get_modelines_by_size(nvDisplayPtr display,
+                                             int width, int height,
+                                             int *count);
+nvModeLinePtr display_find_closest_modeline(nvDisplayPtr display,
+                                            nvModeLinePtr modeline);
 Bool display_add_modelines_from_server(nvDisplayPtr display, nvGpuPtr gpu,
                                        gchar **err_str);
+Bool display_load_modelines(nvDisplayPtr display);
+nvModeLinePtr display_take_modelines(nvDisplayPtr display,
+                                     nvModePoolPtr pool);
 void display_remove_modes(nvDisplayPtr display);
 Bool display_set_modes_rotation(nvDisplayPtr display, Rotation rotation);
 
@@ -98,15 +113,29 @@ void renumber_xscreens(nvLayoutPtr layout);
 void screen_unlink_display(nvDisplayPtr display);
 void screen_link_display(nvScreenPtr screen, nvDisplayPtr display);
 void screen_remove_display(nvDisplayPtr display);
+#define MODE_STR_SIZE_HINT 128 /* Typical length of a mode string */
+
 gchar * screen_get_metamode_str(nvScreenPtr screen, int metamode_idx,
                                 int force_target_id_name);
+gchar * screen_get_modes_metamode_str(nvScreenPtr screen, nvModePtr *modes,
+                                      int force_target_id_name);
 void link_screen_to_gpu(nvScreenPtr screen, nvGpuPtr gpu);
 Bool screen_has_gpu(nvScreenPtr screen, nvGpuPtr match_gpu);
 
 
+/* Grid functions */
+
+void grid_get_display_position(const nvGrid *grid, int row, int column,
+                               int *x, int *y);
+void grid_get_size(const nvGrid *grid, int *width, int *height);
+gchar *grid_get_metamode_str(const nvGrid *grid, const char *mode_name);
+
+
 /* GPU functions */
 
 void gpu_remove_and_free_display(nvDisplayPtr display);
+Bool gpu_update_displays_from_server(nvGpuPtr gpu, Bool *changed,
+                                     Bool *allow_apply, gchar **err_str);
 
 Bool gpu_add_screenless_modes_to_displays(nvGpuPtr gpu);
 
@@ -153,6 +182,25 @@ typedef struct _SaveXConfDlg {
     GtkWidget *btn_xconfig_file;
     GtkWidget *txt_xconfig_file;
 
+    /* Preview state: the preview is only regenerated when one of the
+     * inputs it was generated from (merge, file) changes.
+     */
+    Bool preview_valid;
+    Bool preview_merge;
+    gchar *preview_filename;
+    Bool preview_file_exists;
+    time_t preview_mtime;
+    off_t preview_size;
+
+    /* The default X config file, parsed in the background (see
+     * xconfig_preload_start()).
+     */
+    GThread *preload_thread;
+    gchar *preload_filename;
+    XConfigPtr preload_config;
+    time_t preload_mtime;
+    off_t preload_size;
+
 } SaveXConfDlg;
 
 
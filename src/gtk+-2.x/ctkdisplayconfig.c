@@ -99,6 +99,7 @@ static void screen_metamode_clicked(GtkWidget *widget, gpointer user_data);
 static void screen_metamode_activate(GtkWidget *widget, gpointer user_data);
 static void screen_metamode_add_clicked(GtkWidget *widget, gpointer user_data);
 static void screen_metamode_delete_clicked(GtkWidget *widget, gpointer user_data);
+static void screen_grid_clicked(GtkWidget *widget, gpointer user_data);
 
 static void xinerama_state_toggled(GtkWidget *widget, gpointer user_data);
 static void apply_clicked(GtkWidget *widget, gpointer user_data);
@@ -111,9 +112,15 @@ static void validation_details_clicked(GtkWidget *widget, gpointer user_data);
 static void display_config_attribute_changed(GtkWidget *object,
                                              CtrlEvent *event,
                                              gpointer user_data);
+static void display_config_probe_event(GtkWidget *object,
+                                       CtrlEvent *event,
+                                       gpointer user_data);
 static void reset_layout(CtkDisplayConfig *ctk_object);
 static gboolean force_layout_reset(gpointer user_data);
 static void user_changed_attributes(CtkDisplayConfig *ctk_object);
+static int validation_prompt(CtkDisplayConfig *ctk_object, gchar *err_strs,
+                             gboolean can_ignore_error);
+static void cancel_apply_validation(CtkDisplayConfig *ctk_object);
 
 static XConfigPtr xconfig_generate(XConfigPtr xconfCur,
                                    Bool merge,
@@ -153,6 +160,34 @@ typedef struct SwitchModeCallbackInfoRec {
 #define VALIDATE_APPLY 0
 #define VALIDATE_SAVE  1
 
+/* Number of metamodes validated for apply per GTK main loop iteration */
+#define APPLY_VALIDATION_BATCH 32
+
+/* Changes to make to an X screen's metamodes on apply */
+typedef struct nvApplyPlanRec {
+    enum {
+        APPLY_PLAN_FAILED = 0, /* X server's metamodes couldn't be queried */
+        APPLY_PLAN_SKIP,       /* Current X metamode couldn't be found */
+        APPLY_PLAN_STARTED,    /* Matching the CPL metamodes to X's */
+        APPLY_PLAN_READY
+    } status;
+
+    char *x_metamode_strs;   /* X server's metamodes */
+    char **x_entries;        /* Each metamode in x_metamode_strs */
+    const char **x_deletes;  /* Per X metamode, the string to delete it
+                              * with, or NULL to keep it */
+    int num_x_metamodes;
+    GHashTable *x_ids;       /* X metamode index (+1) by ID */
+
+    char *x_cur_full_str;    /* X server's current metamode */
+    const char *x_cur_str;   /* Same, without the tokens */
+    int x_cur_id;
+    int x_cur_idx;
+
+    nvMetaModePtr *adds;     /* CPL metamodes to add to X, in order */
+    int num_adds;
+} nvApplyPlan, *nvApplyPlanPtr;
+
 /* Underscan range of values */
 #define UNDERSCAN_MIN_PERCENT 0
 #define UNDERSCAN_MAX_PERCENT 35
@@ -308,6 +343,18 @@ static const char * __screen_metamode_delete_button_help =
 "MetaMode for the screen;  This option can be applied to your currently "
 "running X server.";
 
+static const char * __screen_grid_button_help =
+"The Arrange in Grid button allows you to place all the display devices "
+"of the selected screen in a grid (e.g. a video wall) in one step.  Pick "
+"the number of rows and columns, and how much neighboring display devices "
+"should overlap (use negative values to leave room for bezels).  All the "
+"display devices are set to the same resolution, and are placed in the "
+"grid from left to right and top to bottom.  This is done for every "
+"MetaMode of the X screen in which the selected display device (or the "
+"first display device of the screen) is on; the others are left as they "
+"are.  The resolution is either one picked from those of that display "
+"device, or by default the resolution it has in each MetaMode.";
+
 
 /* General button tooltips */
 
@@ -428,7 +475,7 @@ static void register_layout_events(CtkDisplayConfig *ctk_object)
 
         g_signal_connect(G_OBJECT(gpu->ctk_event),
                          CTK_EVENT_NAME(NV_CTRL_PROBE_DISPLAYS),
-                         G_CALLBACK(display_config_attribute_changed),
+                         G_CALLBACK(display_config_probe_event),
                          (gpointer) ctk_object);
 
         g_signal_connect(G_OBJECT(gpu->ctk_event),
@@ -494,6 +541,14 @@ static void unregister_layout_events(CtkDisplayConfig *ctk_object)
                                              NULL, // Closure
                                              G_CALLBACK(display_config_attribute_changed),
                                              (gpointer) ctk_object);
+
+        g_signal_handlers_disconnect_matched(G_OBJECT(gpu->ctk_event),
+                                             G_SIGNAL_MATCH_FUNC | G_SIGNAL_MATCH_DATA,
+                                             0, // Signal ID
+                                             0, // Signal Detail
+                                             NULL, // Closure
+                                             G_CALLBACK(display_config_probe_event),
+                                             (gpointer) ctk_object);
     }
 
     /* Unregister X screen events */
@@ -627,6 +682,9 @@ void xconfigPrint(MsgType t, const char *msg)
  *
  * "mode1_1, mode1_2, mode1_3 ... ; mode 2_1, mode 2_2, mode 2_3 ... ; ..."
  *
+ * The metamodes are joined in a single buffer, sized up front for the
+ * screen's metamodes.
+ *
  **/
 
 static int generate_xconf_metamode_str(CtkDisplayConfig *ctk_object,
@@ -635,12 +693,11 @@ static int generate_xconf_metamode_str(CtkDisplayConfig *ctk_object,
 {
     nvLayoutPtr layout = screen->layout;
     CtrlTarget *ctrl_target;
-    gchar *metamode_strs = NULL;
+    GString *metamode_strs;
     gchar *metamode_str;
-    gchar *tmp;
     int metamode_idx;
     nvMetaModePtr metamode;
-    int len = 0;
+    int len;
     int start_width;
     int start_height;
 
@@ -670,14 +727,19 @@ static int generate_xconf_metamode_str(CtkDisplayConfig *ctk_object,
     }
 
 
+    metamode_strs =
+        g_string_sized_new(screen->num_metamodes *
+                           (screen->num_displays + 1) * MODE_STR_SIZE_HINT);
+
     /* In basic view, always specify the currently selected
      * metamode first in the list so the X server starts
      * in this mode.
      */
     if (!ctk_object->advanced_mode) {
-        metamode_strs = screen_get_metamode_str(screen,
-                                                screen->cur_metamode_idx, 0);
-        len = strlen(metamode_strs);
+        metamode_str = screen_get_metamode_str(screen,
+                                               screen->cur_metamode_idx, 0);
+        g_string_append(metamode_strs, metamode_str);
+        g_free(metamode_str);
         start_width = screen->cur_metamode->edim.width;
         start_height = screen->cur_metamode->edim.height;
     } else {
@@ -689,8 +751,6 @@ static int generate_xconf_metamode_str(CtkDisplayConfig *ctk_object,
          (metamode_idx < screen->num_metamodes) && metamode;
          metamode_idx++, metamode = metamode->next) {
 
-        int metamode_len;
-
         /* Only write out metamodes that were specified by the user */
         if (!IS_METAMODE_SOURCE_USER(metamode->source)) {
             continue;
@@ -716,8 +776,8 @@ static int generate_xconf_metamode_str(CtkDisplayConfig *ctk_object,
 
         if (!metamode_str) continue;
 
-        metamode_len = strlen(metamode_str);
-        if (!longStringsOK && (len + metamode_len > 900)) {
+        len = metamode_strs->len + strlen(metamode_str);
+        if (!longStringsOK && (len > 900)) {
             GtkWidget *dlg;
             gchar *msg;
             GtkWidget *parent;
@@ -741,6 +801,7 @@ static int generate_xconf_metamode_str(CtkDisplayConfig *ctk_object,
             if (!parent) {
                 nv_warning_msg("%s", msg);
                 g_free(msg);
+                g_free(metamode_str);
                 break;
             }
             
@@ -763,28 +824,27 @@ static int generate_xconf_metamode_str(CtkDisplayConfig *ctk_object,
             g_free(msg);
             
             if (result == GTK_RESPONSE_YES) {
+                g_free(metamode_str);
                 break; /* Crop the list of metamodes */
             } else if (result == GTK_RESPONSE_NO) {
                 longStringsOK = 1; /* Write the full list of metamodes */
             } else {
+                g_free(metamode_str);
+                g_string_free(metamode_strs, TRUE);
                 return XCONFIG_GEN_ABORT; /* Don't save the X config file */
             }
         }
 
-        if (!metamode_strs) {
-            metamode_strs = metamode_str;
-            len += metamode_len;
-        } else {
-            tmp = g_strconcat(metamode_strs, "; ", metamode_str, NULL);
-            g_free(metamode_str);
-            g_free(metamode_strs);
-            metamode_strs = tmp;
-            len += metamode_len +2;
+        if (metamode_strs->len) {
+            g_string_append(metamode_strs, "; ");
         }
+        g_string_append(metamode_strs, metamode_str);
+        g_free(metamode_str);
     }
 
 
-    *pMetamode_strs = metamode_strs;
+    /* Callers expect NULL for a screen without any metamode to write */
+    *pMetamode_strs = g_string_free(metamode_strs, !metamode_strs->len);
 
     return XCONFIG_GEN_OK;
 
@@ -1079,6 +1139,95 @@ static GtkWidget * create_validation_apply_dialog(CtkDisplayConfig *ctk_object)
 
 
 
+/** create_screen_grid_spin_button() *********************************
+ *
+ * Adds a labeled spin button to the given row of the display grid
+ * dialog's table.
+ *
+ **/
+
+static GtkWidget *create_screen_grid_spin_button(GtkWidget *table, int row,
+                                                 const char *label_str,
+                                                 int min, int max)
+{
+    GtkWidget *label;
+    GtkWidget *spinbutton;
+
+    label = gtk_label_new(label_str);
+    gtk_misc_set_alignment(GTK_MISC(label), 0.0f, 0.5f);
+    gtk_table_attach(GTK_TABLE(table), label, 0, 1, row, row + 1,
+                     GTK_FILL, GTK_FILL, 0, 0);
+
+    spinbutton = gtk_spin_button_new_with_range(min, max, 1);
+    gtk_table_attach(GTK_TABLE(table), spinbutton, 1, 2, row, row + 1,
+                     GTK_EXPAND | GTK_FILL, GTK_FILL, 0, 0);
+
+    return spinbutton;
+
+} /* create_screen_grid_spin_button() */
+
+
+
+/** create_screen_grid_dialog() **************************************
+ *
+ * Creates the dialog used to arrange the displays of an X screen in
+ * a grid.
+ *
+ **/
+
+static GtkWidget *create_screen_grid_dialog(CtkDisplayConfig *ctk_object)
+{
+    GtkWidget *dialog;
+    GtkWidget *table;
+    GtkWidget *label;
+
+    dialog = gtk_dialog_new_with_buttons
+        ("Arrange Display Devices in Grid",
+         GTK_WINDOW(gtk_widget_get_parent(GTK_WIDGET(ctk_object))),
+         GTK_DIALOG_MODAL | GTK_DIALOG_DESTROY_WITH_PARENT,
+         GTK_STOCK_OK,
+         GTK_RESPONSE_ACCEPT,
+         GTK_STOCK_CANCEL,
+         GTK_RESPONSE_REJECT,
+         NULL);
+    gtk_window_set_resizable(GTK_WINDOW(dialog), FALSE);
+
+    table = gtk_table_new(5, 2, FALSE);
+    gtk_table_set_row_spacings(GTK_TABLE(table), 3);
+    gtk_table_set_col_spacings(GTK_TABLE(table), 15);
+    gtk_container_set_border_width(GTK_CONTAINER(table), 5);
+    gtk_box_pack_start(GTK_BOX(ctk_dialog_get_content_area(GTK_DIALOG(dialog))),
+                       table, TRUE, TRUE, 5);
+
+    /* The resolutions and ranges are updated to match the X screen each
+     * time the dialog is shown.
+     */
+    label = gtk_label_new("Resolution:");
+    gtk_misc_set_alignment(GTK_MISC(label), 0.0f, 0.5f);
+    gtk_table_attach(GTK_TABLE(table), label, 0, 1, 0, 1,
+                     GTK_FILL, GTK_FILL, 0, 0);
+
+    ctk_object->mnu_screen_grid_resolution = ctk_combo_box_text_new();
+    gtk_table_attach(GTK_TABLE(table), ctk_object->mnu_screen_grid_resolution,
+                     1, 2, 0, 1, GTK_EXPAND | GTK_FILL, GTK_FILL, 0, 0);
+
+    ctk_object->spn_screen_grid_rows =
+        create_screen_grid_spin_button(table, 1, "Rows:", 1, 1);
+    ctk_object->spn_screen_grid_columns =
+        create_screen_grid_spin_button(table, 2, "Columns:", 1, 1);
+    ctk_object->spn_screen_grid_h_overlap =
+        create_screen_grid_spin_button(table, 3, "Horizontal Overlap:", 0, 0);
+    ctk_object->spn_screen_grid_v_overlap =
+        create_screen_grid_spin_button(table, 4, "Vertical Overlap:", 0, 0);
+
+    gtk_widget_show_all(ctk_dialog_get_content_area(GTK_DIALOG(dialog)));
+
+    return dialog;
+
+} /* create_screen_grid_dialog() */
+
+
+
 /** user_changed_attributes() *************************************
  *
  * Turns off forced reset (of the layout config when the current
@@ -1088,6 +1237,9 @@ static GtkWidget * create_validation_apply_dialog(CtkDisplayConfig *ctk_object)
 
 static void user_changed_attributes(CtkDisplayConfig *ctk_object)
 {
+    /* The layout being validated for apply is no longer current */
+    cancel_apply_validation(ctk_object);
+
     if (ctk_object->forced_reset_allowed) {
         update_btn_apply(ctk_object, TRUE);
         ctk_object->forced_reset_allowed = FALSE;
@@ -1647,6 +1799,15 @@ GtkWidget* ctk_display_config_new(CtrlTarget *ctrl_target,
                      G_CALLBACK(screen_metamode_delete_clicked),
                      (gpointer) ctk_object);
 
+    /* X screen display grid */
+    ctk_object->btn_screen_grid =
+        gtk_button_new_with_label("Arrange in Grid...");
+    ctk_config_set_tooltip(ctk_config, ctk_object->btn_screen_grid,
+                           __screen_grid_button_help);
+    g_signal_connect(G_OBJECT(ctk_object->btn_screen_grid), "clicked",
+                     G_CALLBACK(screen_grid_clicked),
+                     (gpointer) ctk_object);
+
     
     /* Create the Validation dialog */
     ctk_object->dlg_validation_override = create_validation_dialog(ctk_object);
@@ -1659,6 +1820,10 @@ GtkWidget* ctk_display_config_new(CtrlTarget *ctrl_target,
                              FALSE);
 
 
+    /* Create the display grid dialog */
+    ctk_object->dlg_screen_grid = create_screen_grid_dialog(ctk_object);
+
+
     /* Reset confirmation dialog */
     ctk_object->dlg_reset_confirm = gtk_dialog_new_with_buttons
         ("Confirm Reset",
@@ -2053,6 +2218,17 @@ GtkWidget* ctk_display_config_new(CtrlTarget *ctrl_target,
                            TRUE, TRUE, 0);
         ctk_object->box_screen_metamode = hbox;
 
+        /* X screen display grid */
+        label = gtk_label_new("Display Grid:");
+        labels = g_slist_append(labels, label);
+
+        hbox = gtk_hbox_new(FALSE, 5);
+        gtk_box_pack_start(GTK_BOX(vbox), hbox, FALSE, FALSE, 0);
+        gtk_box_pack_start(GTK_BOX(hbox), label, FALSE, TRUE, 5);
+        gtk_box_pack_start(GTK_BOX(hbox), ctk_object->btn_screen_grid,
+                           FALSE, FALSE, 0);
+        ctk_object->box_screen_grid = hbox;
+
         /* Up the object ref count to make sure that the page and its widgets
          * do not get freed if/when the page is removed from the notebook.
          */
@@ -2305,6 +2481,9 @@ GtkTextBuffer *ctk_display_config_create_help(GtkTextTagTable *table,
     ctk_help_heading(b, &i, "Delete Metamode");
     ctk_help_para(b, &i, "%s This is only available when advanced view "
                   "is enabled.", __screen_metamode_delete_button_help);
+    ctk_help_heading(b, &i, "Arrange in Grid");
+    ctk_help_para(b, &i, "%s This is only available for X screens with "
+                  "more than one display device.", __screen_grid_button_help);
 
 
     ctk_help_para(b, &i, "");
@@ -2834,7 +3013,11 @@ static void setup_display_refresh_dropdown(CtkDisplayConfig *ctk_object)
     auto_modeline = NULL;
     for (modeline = modelines; modeline; modeline = modeline->next) {
 
-        nvModeLinePtr m;
+        nvModeLinePtr *same_size;
+        int num_same_size;
+        Bool counted;
+        int seen_ref;
+        int i;
         int count_ref; /* # modelines with similar refresh rates */ 
         int num_ref;   /* Modeline # in a group of similar refresh rates */
 
@@ -2852,30 +3035,41 @@ static void setup_display_refresh_dropdown(CtkDisplayConfig *ctk_object)
         name = g_strdup_printf("%0.*f Hz", (display->is_sdi ? 3 : 0),
                                modeline->refresh_rate);
 
-        /* Get a unique number for this modeline */
+        /* Get a unique number for this modeline; only modelines of the
+         * same resolution can have a similar refresh rate.
+         */
+        same_size = display_get_modelines_by_size(display,
+                                                  modeline->data.hdisplay,
+                                                  modeline->data.vdisplay,
+                                                  &num_same_size);
         count_ref = 0; /* # modelines with similar refresh rates */
-        num_ref = 0;   /* Modeline # in a group of similar refresh rates */
-        for (m = modelines; m; m = m->next) {
+        seen_ref = 0;  /* # of those up to this modeline in the list */
+        counted = FALSE;
+        for (i = 0; i < num_same_size; i++) {
+            nvModeLinePtr m = same_size[i];
             float m_rate = m->refresh_rate;
             gchar *tmp = g_strdup_printf("%.0f Hz", m_rate);
             
             if (!IS_NVIDIA_DEFAULT_MODE(m) &&
-                m->data.hdisplay == modeline->data.hdisplay &&
-                m->data.vdisplay == modeline->data.vdisplay &&
                 !g_ascii_strcasecmp(tmp, name) &&
                 m != auto_modeline) {
 
                 count_ref++;
-                /* Modelines with similar refresh rates get a
-                 * unique # (num_ref)
-                 */
+                if (m->seq <= modeline->seq) {
+                    seen_ref++;
+                }
                 if (m == modeline) {
-                    num_ref = count_ref; /* This modeline's # */
+                    counted = TRUE;
                 }
             }
             g_free(tmp);
         }
 
+        /* Modelines with similar refresh rates get a unique # (num_ref),
+         * following their order in the modeline list.
+         */
+        num_ref = counted ? seen_ref : 0;
+
         /* Is default refresh rate for resolution */
         if (!ctk_object->refresh_table_len && !display->is_sdi) {
             auto_modeline = modeline;
@@ -4212,6 +4406,10 @@ static void setup_display_page(CtkDisplayConfig *ctk_object)
     }
 
 
+    /* The display's resolutions need its full modepool */
+    display_load_modelines(display);
+
+
     /* Enable display widgets and setup widget information */
     gtk_widget_set_sensitive(ctk_object->display_page, True);
 
@@ -4699,6 +4897,29 @@ static void setup_screen_metamode(CtkDisplayConfig *ctk_object)
 
 
 
+/** setup_screen_grid() **********************************************
+ *
+ * Shows the display grid button for screens that drive more than one
+ * display device.
+ *
+ **/
+
+static void setup_screen_grid(CtkDisplayConfig *ctk_object)
+{
+    nvScreenPtr screen = ctk_display_layout_get_selected_screen
+        (CTK_DISPLAY_LAYOUT(ctk_object->obj_layout));
+
+    if (!screen || screen->no_scanout || screen->num_displays < 2) {
+        gtk_widget_hide(ctk_object->box_screen_grid);
+        return;
+    }
+
+    gtk_widget_show(ctk_object->box_screen_grid);
+
+} /* setup_screen_grid() */
+
+
+
 /** setup_screen_page() *********************************************
  *
  * Sets up the screen frame to reflect the currently selected screen.
@@ -4730,6 +4951,7 @@ static void setup_screen_page(CtkDisplayConfig *ctk_object)
     setup_screen_stereo_dropdown(ctk_object);
     setup_screen_position(ctk_object);
     setup_screen_metamode(ctk_object);
+    setup_screen_grid(ctk_object);
 
 } /* setup_screen_page() */
 
@@ -4829,6 +5051,7 @@ static gint validation_fix_crowded_metamodes(CtkDisplayConfig *ctk_object,
             } else if (first_mode) {
 
                 /* Select the first modeline in the modepool */
+                display_load_modelines(first_mode->display);
                 ctk_display_layout_set_mode_modeline
                     (CTK_DISPLAY_LAYOUT(ctk_object->obj_layout),
                      first_mode,
@@ -4924,27 +5147,36 @@ static gint validation_auto_fix(CtkDisplayConfig *ctk_object)
  * - All metamodes must have a coherent offset (The top left corner
  *   of the bounding box of all the metamodes must be the same.)
  *
+ * Only the 'count' metamodes starting at 'first' are checked, so that
+ * large screens can be validated a few metamodes at a time.  If given,
+ * 'modes' holds the mode of metamode 'first' on each of the screen's
+ * displays (in order), and is moved past the metamodes checked;
+ * otherwise these modes are found from the start of each display's
+ * list of modes.
+ *
  * If the screen is found to be in an invalid state, a string
  * describing the problem is returned.  This string should be freed
  * by the user when done with it.
  *
  **/
 
-static gchar * validate_screen(nvScreenPtr screen,
+static gchar * validate_screen(nvScreenPtr screen, nvModePtr *modes,
+                               int first, int count,
                                gboolean *can_ignore_error)
 {
     nvDisplayPtr display;
     nvModePtr mode;
-    int i, j;
+    int d, i;
     int max_displays = get_screen_max_displays(screen);
     int num_displays;
+    int *num_active;
+    gboolean *is_implicit;
     gchar *err_str = NULL;
     gchar *tmp;
     gchar *tmp2;
 
     gchar bullet[8]; // UTF8 Bullet string
     int len;
-    gboolean is_implicit;
 
 
 
@@ -4953,40 +5185,87 @@ static gchar * validate_screen(nvScreenPtr screen,
     bullet[len] = '\0';
 
 
-    for (i = 0; i < screen->num_metamodes; i++) {
+    if (first + count > screen->num_metamodes) {
+        count = screen->num_metamodes - first;
+    }
+    if (first < 0 || count <= 0) {
+        return NULL;
+    }
 
-        /* Count the number of display devices used in the metamode */
-        num_displays = 0;
-        is_implicit = TRUE;
-        for (display = screen->displays;
-             display;
-             display = display->next_in_screen) {
 
+    /* Count the number of display devices used in each metamode, walking
+     * each display's list of modes once.
+     */
+    num_active = calloc(count + 1, sizeof(int));
+    is_implicit = calloc(count + 1, sizeof(gboolean));
+    if (!num_active || !is_implicit) {
+        free(num_active);
+        free(is_implicit);
+
+        /* Still move past the metamodes given */
+        for (d = 0; modes && (d < screen->num_displays); d++) {
+            for (i = 0; modes[d] && (i < count); i++) {
+                modes[d] = modes[d]->next;
+            }
+        }
+
+        *can_ignore_error = FALSE;
+        return g_strdup_printf("%s Out of memory validating Screen %d.\n\n",
+                               bullet, screen->scrnum);
+    }
+
+    for (i = 0; i < count; i++) {
+        is_implicit[i] = TRUE;
+    }
+
+    for (display = screen->displays, d = 0;
+         display;
+         display = display->next_in_screen, d++) {
+
+        /* Find the first metamode's mode */
+        if (modes) {
+            mode = modes[d];
+        } else {
             mode = display->modes;
-            for (j = 0; j < i; j++) {
+            for (i = 0; mode && (i < first); i++) {
                 mode = mode->next;
             }
+        }
+
+        for (i = 0;
+             mode && (i < count);
+             mode = mode->next, i++) {
+
             if (mode->modeline) {
-                num_displays++;
+                num_active[i]++;
             } else if (mode->metamode) {
-                is_implicit = is_implicit &&
+                is_implicit[i] = is_implicit[i] &&
                     (mode->metamode->source == METAMODE_SOURCE_IMPLICIT);
             } else {
-                is_implicit = FALSE;
+                is_implicit[i] = FALSE;
             }
         }
 
+        if (modes) {
+            modes[d] = mode;
+        }
+    }
+
+
+    for (i = 0; i < count; i++) {
+
+        num_displays = num_active[i];
 
         /* There must be at least one display active in the metamode. */
         if (!num_displays) {
             tmp = g_strdup_printf("%s MetaMode %d of Screen %d  does not have "
                                   "an active display device.\n\n",
-                                  bullet, i+1, screen->scrnum);
+                                  bullet, first+i+1, screen->scrnum);
             tmp2 = g_strconcat((err_str ? err_str : ""), tmp, NULL);
             g_free(err_str);
             g_free(tmp);
             err_str = tmp2;
-            *can_ignore_error = *can_ignore_error && is_implicit;
+            *can_ignore_error = *can_ignore_error && is_implicit[i];
         }
 
 
@@ -4994,7 +5273,7 @@ static gchar * validate_screen(nvScreenPtr screen,
         if (max_displays >= 0 && num_displays > max_displays) {
             tmp = g_strdup_printf("%s MetaMode %d of Screen %d has more than "
                                   "%d active display devices.\n\n",
-                                  bullet, i+1, screen->scrnum,
+                                  bullet, first+i+1, screen->scrnum,
                                   max_displays);
             tmp2 = g_strconcat((err_str ? err_str : ""), tmp, NULL);
             g_free(err_str);
@@ -5004,6 +5283,9 @@ static gchar * validate_screen(nvScreenPtr screen,
         }
     }
 
+    free(num_active);
+    free(is_implicit);
+
     return err_str;
 
 } /* validate_screen() */
@@ -5027,14 +5309,14 @@ static int validate_layout(CtkDisplayConfig *ctk_object, int validation_type)
     gchar *err_strs = NULL;
     gchar *err_str;
     gchar *tmp;
-    gint result;
     int num_absolute = 0;
     gboolean can_ignore_error = TRUE;
 
 
     /* Validate each screen and count the number of screens using abs. pos. */
     for (screen = layout->screens; screen; screen = screen->next_in_layout) {
-        err_str = validate_screen(screen, &can_ignore_error);
+        err_str = validate_screen(screen, NULL, 0, screen->num_metamodes,
+                                  &can_ignore_error);
         if (err_str) {
             tmp = g_strconcat((err_strs ? err_strs : ""), err_str, NULL);
             g_free(err_strs);
@@ -5073,6 +5355,27 @@ static int validate_layout(CtkDisplayConfig *ctk_object, int validation_type)
         }
     }
 
+    return validation_prompt(ctk_object, err_strs, can_ignore_error);
+
+} /* validate_layout() */
+
+
+
+/** validation_prompt() **********************************************
+ *
+ * Given the errors found while validating the layout (or NULL), asks
+ * the user whether to cancel the operation, to ignore the errors or to
+ * have them fixed automatically.  Returns 1 if the operation should
+ * go on.  The error string is freed.
+ *
+ **/
+
+static int validation_prompt(CtkDisplayConfig *ctk_object, gchar *err_strs,
+                             gboolean can_ignore_error)
+{
+    gint result;
+
+
     /* Layout is valid */
     if (!err_strs) {
         return 1;
@@ -5130,7 +5433,7 @@ static int validate_layout(CtkDisplayConfig *ctk_object, int validation_type)
 
     return 0;
 
-} /* validate_layout() */
+} /* validation_prompt() */
 
 
 
@@ -5608,6 +5911,8 @@ static void do_disable_display(CtkDisplayConfig *ctk_object,
 
 static Bool display_build_modepool(nvDisplayPtr display, Bool *updated)
 {
+    display_load_modelines(display);
+
     if (!display->modelines) {
         char *tokens = NULL;
         gchar *err_str = NULL;
@@ -6975,6 +7280,151 @@ static void screen_metamode_delete_clicked(GtkWidget *widget,
 
 
 
+/** screen_grid_clicked() ********************************************
+ *
+ * Called when user clicks on the screen's "Arrange in Grid" button.
+ * Asks for the size of the grid and its resolution, and places all
+ * the displays of the screen in it, in every metamode, at the
+ * resolution picked, or by default at the resolution the selected
+ * display has in that metamode.
+ *
+ **/
+
+static void screen_grid_clicked(GtkWidget *widget, gpointer user_data)
+{
+    CtkDisplayConfig *ctk_object = CTK_DISPLAY_CONFIG(user_data);
+    CtkDisplayLayout *ctk_layout = CTK_DISPLAY_LAYOUT(ctk_object->obj_layout);
+    nvScreenPtr screen = ctk_display_layout_get_selected_screen(ctk_layout);
+    nvDisplayPtr display = ctk_display_layout_get_selected_display(ctk_layout);
+    GtkComboBox *resolution_menu;
+    nvModeLinePtr *resolutions;
+    nvModeLinePtr modeline;
+    nvModeLinePtr ml;
+    nvGrid grid;
+    gint result;
+    int num_resolutions = 0;
+    int max_width, max_height;
+    int i, idx;
+
+
+    if (!screen) return;
+
+    /* Use the resolution of the selected display, or of the first
+     * display of the screen that has one.
+     */
+    if (!display || !display->cur_mode || !display->cur_mode->modeline) {
+        for (display = screen->displays;
+             display;
+             display = display->next_in_screen) {
+            if (display->cur_mode && display->cur_mode->modeline) break;
+        }
+    }
+    if (!display) return;
+
+    modeline = display->cur_mode->modeline;
+    max_width = modeline->data.hdisplay;
+    max_height = modeline->data.vdisplay;
+
+    /* List the resolutions of the display, each one only once */
+    display_load_modelines(display);
+
+    resolutions = calloc(display->num_modelines + 1, sizeof(nvModeLinePtr));
+    if (!resolutions) return;
+
+    resolution_menu = GTK_COMBO_BOX(ctk_object->mnu_screen_grid_resolution);
+    gtk_list_store_clear(GTK_LIST_STORE(gtk_combo_box_get_model
+                                        (resolution_menu)));
+    ctk_combo_box_text_append_text(ctk_object->mnu_screen_grid_resolution,
+                                   "Same as each MetaMode");
+
+    for (ml = display->modelines; ml; ml = ml->next) {
+        gchar *name;
+
+        for (i = 0; i < num_resolutions; i++) {
+            if (resolutions[i]->data.hdisplay == ml->data.hdisplay &&
+                resolutions[i]->data.vdisplay == ml->data.vdisplay) {
+                break;
+            }
+        }
+        if ((i < num_resolutions) ||
+            (num_resolutions >= display->num_modelines)) {
+            continue;
+        }
+
+        resolutions[num_resolutions++] = ml;
+        max_width = NV_MAX(max_width, ml->data.hdisplay);
+        max_height = NV_MAX(max_height, ml->data.vdisplay);
+
+        name = g_strdup_printf("%dx%d", ml->data.hdisplay, ml->data.vdisplay);
+        ctk_combo_box_text_append_text(ctk_object->mnu_screen_grid_resolution,
+                                       name);
+        g_free(name);
+    }
+    gtk_combo_box_set_active(resolution_menu, 0);
+
+    /* Limit the grid to the screen's displays */
+    gtk_spin_button_set_range(GTK_SPIN_BUTTON(ctk_object->spn_screen_grid_rows),
+                              1, screen->num_displays);
+    gtk_spin_button_set_range
+        (GTK_SPIN_BUTTON(ctk_object->spn_screen_grid_columns),
+         1, screen->num_displays);
+    gtk_spin_button_set_range
+        (GTK_SPIN_BUTTON(ctk_object->spn_screen_grid_h_overlap),
+         -max_width, max_width);
+    gtk_spin_button_set_range
+        (GTK_SPIN_BUTTON(ctk_object->spn_screen_grid_v_overlap),
+         -max_height, max_height);
+
+    /* Show the display grid dialog */
+    gtk_window_set_transient_for
+        (GTK_WINDOW(ctk_object->dlg_screen_grid),
+         GTK_WINDOW(gtk_widget_get_toplevel(GTK_WIDGET(ctk_object))));
+    gtk_widget_show(ctk_object->dlg_screen_grid);
+    result = gtk_dialog_run(GTK_DIALOG(ctk_object->dlg_screen_grid));
+    gtk_widget_hide(ctk_object->dlg_screen_grid);
+
+    idx = gtk_combo_box_get_active(resolution_menu);
+    grid.modeline = NULL;
+    if ((idx > 0) && (idx <= num_resolutions)) {
+        grid.modeline = resolutions[idx - 1];
+        modeline = grid.modeline;
+    }
+    free(resolutions);
+
+    if (result != GTK_RESPONSE_ACCEPT) return;
+
+    grid.rows = gtk_spin_button_get_value_as_int
+        (GTK_SPIN_BUTTON(ctk_object->spn_screen_grid_rows));
+    grid.columns = gtk_spin_button_get_value_as_int
+        (GTK_SPIN_BUTTON(ctk_object->spn_screen_grid_columns));
+    grid.display_width = modeline->data.hdisplay;
+    grid.display_height = modeline->data.vdisplay;
+    grid.h_overlap = gtk_spin_button_get_value_as_int
+        (GTK_SPIN_BUTTON(ctk_object->spn_screen_grid_h_overlap));
+    grid.v_overlap = gtk_spin_button_get_value_as_int
+        (GTK_SPIN_BUTTON(ctk_object->spn_screen_grid_v_overlap));
+
+    if (!ctk_display_layout_set_screen_grid(ctk_layout, screen, &grid,
+                                            display)) {
+        gchar *err_msg =
+            g_strdup_printf("Unable to arrange the display devices in a "
+                            "grid: not all of them support the "
+                            "resolutions used by display device '%s'.",
+                            display->logName);
+        ctk_display_warning_msg(ctk_get_parent_window(GTK_WIDGET(ctk_object)),
+                                err_msg);
+        g_free(err_msg);
+        return;
+    }
+
+    /* Update the GUI */
+    setup_display_page(ctk_object);
+    setup_screen_page(ctk_object);
+
+} /* screen_grid_clicked() */
+
+
+
 /** xinerama_state_toggled() *****************************************
  *
  * Called when user toggles the state of the "Enable Xinerama"
@@ -7265,33 +7715,31 @@ static Bool switch_to_current_metamode(CtkDisplayConfig *ctk_object,
 
 
 
-/** link_metamode_string_by_id() *************************************
+/** free_apply_plan() ************************************************
  *
- * Looks in the list of strings (metamode_strs) for a metamode with
- * the given id (defined by string 'id_str').  If found, sets the metamode
- * id and x_id appropriately.
+ * Frees the changes planned for the screen's metamodes, if any.
  *
  **/
 
-static void link_metamode_string_by_id(char *metamode_strs, int match_id,
-                                       nvMetaModePtr metamode)
+static void free_apply_plan(nvScreenPtr screen)
 {
-    int x_idx = 0;
-    char *m;
+    nvApplyPlanPtr plan = screen->apply_plan;
 
-    for (m = metamode_strs; m && strlen(m); m += strlen(m) +1) {
-        char *str = strstr(m, "id=");
-        if (str) {
-            int id = atoi(str+3);
-            if (id && (id == match_id)) {
-                metamode->id = id;
-                metamode->x_idx = x_idx;
-                metamode->x_str_entry = m;
-                return;
-            }
-        }
-        x_idx++;
+    if (!plan) {
+        return;
+    }
+
+    if (plan->x_ids) {
+        g_hash_table_destroy(plan->x_ids);
     }
+    free(plan->x_metamode_strs);
+    free(plan->x_cur_full_str);
+    free(plan->x_entries);
+    free(plan->x_deletes);
+    free(plan->adds);
+    free(plan);
+
+    screen->apply_plan = NULL;
 }
 
 
@@ -7336,83 +7784,220 @@ static Bool add_cpl_metamode_to_X(nvScreenPtr screen, nvMetaModePtr metamode,
 
 
 
-/** stub_metamode_str() **********************************************
+/** start_apply_plan() ***********************************************
  *
- * Stubs out a metamode string.
+ * Starts planning the changes to make to the screen's metamodes:
+ * gets the X server's list of metamodes and its current metamode,
+ * and indexes the X metamodes by ID so that each CPL metamode can be
+ * matched to its X metamode with a single lookup.
  *
- **/
-
-static void stub_metamode_str(char *str)
-{
-    if (str) {
-        while (*str) {
-            *str = ' ';
-            str++;
-        }
-    }
-}
-
-
-/** setup_metamodes_for_apply() **************************************
+ * To begin with, all the X metamodes are set to be deleted; those
+ * matching a CPL metamode are kept by finish_apply_plan().
  *
- * Prepares the list of CPL metamodes to be applied to the X server.
+ * Returns FALSE if the screen's metamodes can't be planned for.
  *
  **/
 
-static void setup_metamodes_for_apply(nvScreenPtr screen,
-                                      char *metamode_strs)
+static Bool start_apply_plan(nvScreenPtr screen)
 {
-    nvMetaModePtr metamode;
+    nvApplyPlanPtr plan;
+    char *str;
+    const char *tmp;
+    int len;
+    int idx;
+    int id;
     ReturnStatus ret;
-    char *tmp;
-    int metamode_idx;
 
 
-    for (metamode = screen->metamodes, metamode_idx = 0;
-         metamode;
-         metamode = metamode->next, metamode_idx++) {
+    free_apply_plan(screen);
 
-        metamode->id = -1;
-        metamode->x_idx = -1;
+    plan = calloc(1, sizeof(nvApplyPlan));
+    if (!plan) {
+        return FALSE;
+    }
+    screen->apply_plan = plan;
+    plan->status = APPLY_PLAN_FAILED;
 
-        /* Get metamode string from CPL */
-        metamode->cpl_str = screen_get_metamode_str(screen, metamode_idx, 1);
-        if (!metamode->cpl_str) {
-            continue;
-        }
+    /* Get the list of the current metamodes */
 
-        /* Parse CPL string into X metamode string */
-        ret = NvCtrlStringOperation(screen->ctrl_target, 0,
-                                    NV_CTRL_STRING_OPERATION_PARSE_METAMODE,
-                                    metamode->cpl_str, &metamode->x_str);
-        if ((ret != NvCtrlSuccess) ||
-            !metamode->x_str) {
-            continue;
-        }
+    ret = NvCtrlGetBinaryAttribute(screen->ctrl_target,
+                                   0,
+                                   NV_CTRL_BINARY_DATA_METAMODES_VERSION_2,
+                                   (unsigned char **)&plan->x_metamode_strs,
+                                   &len);
+    if (ret != NvCtrlSuccess) return FALSE;
 
-        /* Identify metamode id and position in X */
-       tmp = strstr(metamode->x_str, "id=");
-        if (tmp) {
-            int id = atoi(tmp+3);
-            link_metamode_string_by_id(metamode_strs, id, metamode);
-        }
-    }
-}
+    /* Get the current metamode for the screen */
 
+    ret = NvCtrlGetStringAttribute(screen->ctrl_target,
+                                   NV_CTRL_STRING_CURRENT_METAMODE_VERSION_2,
+                                   &plan->x_cur_full_str);
+    if (ret != NvCtrlSuccess) return FALSE;
 
+    /* Get the current metamode index for the screen */
 
-/** cleanup_metamodes_for_apply() ************************************
- *
- * Releases memory used for applying metamodes to X.
- *
- **/
+    ret = NvCtrlGetAttribute(screen->ctrl_target,
+                             NV_CTRL_CURRENT_METAMODE_ID,
+                             &plan->x_cur_id);
+    if (ret != NvCtrlSuccess) return FALSE;
 
-static void cleanup_metamodes_for_apply(nvScreenPtr screen)
-{
-    nvMetaModePtr metamode;
+    /* Skip tokens */
+    tmp = strstr(plan->x_cur_full_str, "::");
+    if (tmp) {
+        plan->x_cur_str = parse_skip_whitespace(tmp +2);
+    } else {
+        plan->x_cur_str = plan->x_cur_full_str;
+    }
 
-    for (metamode = screen->metamodes;
-         metamode;
+    /* Count the number of metamodes in X */
+    for (str = plan->x_metamode_strs;
+         str && strlen(str);
+         str += strlen(str) +1) {
+        plan->num_x_metamodes++;
+    }
+
+    plan->x_entries = calloc(plan->num_x_metamodes +1, sizeof(char *));
+    plan->x_deletes = calloc(plan->num_x_metamodes +1, sizeof(char *));
+    plan->adds = calloc(screen->num_metamodes +1, sizeof(nvMetaModePtr));
+    plan->x_ids = g_hash_table_new(g_direct_hash, g_direct_equal);
+    if (!plan->x_entries || !plan->x_deletes || !plan->adds) {
+        return FALSE;
+    }
+
+    /* Index the X metamodes by ID, and find cur_metamode_str in them */
+    plan->x_cur_idx = -1;
+    for (str = plan->x_metamode_strs, idx = 0;
+         str && strlen(str);
+         str += strlen(str) +1, idx++) {
+
+        plan->x_entries[idx] = str;
+
+        tmp = strstr(str, "id=");
+        if (tmp) {
+            id = atoi(tmp+3);
+            if (id &&
+                !g_hash_table_lookup(plan->x_ids, GINT_TO_POINTER(id))) {
+                g_hash_table_insert(plan->x_ids, GINT_TO_POINTER(id),
+                                    GINT_TO_POINTER(idx +1));
+            }
+        }
+
+        /* Skip tokens */
+        tmp = strstr(str, "::");
+        if (!tmp) continue;
+        tmp = parse_skip_whitespace(tmp +2);
+        if (!tmp) continue;
+
+        plan->x_deletes[idx] = tmp;
+
+        if ((plan->x_cur_idx < 0) && !strcasecmp(tmp, plan->x_cur_str)) {
+            plan->x_cur_idx = idx;
+        }
+    }
+
+    if (plan->x_cur_idx < 0) {
+        nv_error_msg("Failed to identify current MetaMode in X list of "
+                     "MetaModes for screen %d", screen->scrnum);
+        plan->status = APPLY_PLAN_SKIP;
+        return FALSE;
+    }
+
+    plan->status = APPLY_PLAN_STARTED;
+    return TRUE;
+}
+
+
+
+/** plan_metamodes() *************************************************
+ *
+ * Matches up to 'count' of the screen's metamodes, starting with
+ * 'metamode' (at 'metamode_idx'), to the X server's metamodes: each
+ * metamode's string is generated, parsed by the X server, and looked
+ * up in the X metamodes by the ID the X server gives it.
+ *
+ * If given, 'modes' holds the metamode's mode on each of the screen's
+ * displays, and is moved on to the next metamode's.
+ *
+ * Returns the metamode to carry on with.
+ *
+ **/
+
+static nvMetaModePtr plan_metamodes(nvScreenPtr screen, nvModePtr *modes,
+                                    nvMetaModePtr metamode, int metamode_idx,
+                                    int count)
+{
+    nvApplyPlanPtr plan = screen->apply_plan;
+    gpointer x_idx;
+    ReturnStatus ret;
+    char *tmp;
+    int d;
+
+
+    for (;
+         metamode && (count > 0);
+         metamode = metamode->next, metamode_idx++, count--) {
+
+        cleanup_metamode(metamode);
+        metamode->id = -1;
+        metamode->x_idx = -1;
+
+        /* Get metamode string from CPL */
+        if (modes) {
+            metamode->cpl_str =
+                screen_get_modes_metamode_str(screen, modes, 1);
+            for (d = 0; d < screen->num_displays; d++) {
+                if (modes[d]) {
+                    modes[d] = modes[d]->next;
+                }
+            }
+        } else {
+            metamode->cpl_str =
+                screen_get_metamode_str(screen, metamode_idx, 1);
+        }
+        if (!metamode->cpl_str) {
+            continue;
+        }
+
+        /* Parse CPL string into X metamode string */
+        ret = NvCtrlStringOperation(screen->ctrl_target, 0,
+                                    NV_CTRL_STRING_OPERATION_PARSE_METAMODE,
+                                    metamode->cpl_str, &metamode->x_str);
+        if ((ret != NvCtrlSuccess) ||
+            !metamode->x_str) {
+            continue;
+        }
+
+        /* Identify metamode id and position in X */
+        tmp = strstr(metamode->x_str, "id=");
+        if (!tmp) {
+            continue;
+        }
+        x_idx = g_hash_table_lookup(plan->x_ids,
+                                    GINT_TO_POINTER(atoi(tmp+3)));
+        if (x_idx) {
+            metamode->id = atoi(tmp+3);
+            metamode->x_idx = GPOINTER_TO_INT(x_idx) -1;
+            metamode->x_str_entry = plan->x_entries[metamode->x_idx];
+        }
+    }
+
+    return metamode;
+}
+
+
+
+/** cleanup_metamodes_for_apply() ************************************
+ *
+ * Releases memory used for applying metamodes to X.
+ *
+ **/
+
+static void cleanup_metamodes_for_apply(nvScreenPtr screen)
+{
+    nvMetaModePtr metamode;
+
+    for (metamode = screen->metamodes;
+         metamode;
          metamode = metamode->next) {
 
         cleanup_metamode(metamode);
@@ -7430,17 +8015,19 @@ static void cleanup_metamodes_for_apply(nvScreenPtr screen)
 static void remove_duplicate_cpl_metamodes(CtkDisplayConfig *ctk_object,
                                            nvScreenPtr screen)
 {
+    GHashTable *x_strs;
     nvMetaModePtr m1;
-    nvMetaModePtr m2;
     int m1_idx;
     int m1_old_idx;
     int m2_idx;
 
+    /* Index (+1) of the first CPL metamode with each parsed string */
+    x_strs = g_hash_table_new(g_str_hash, g_str_equal);
+
     m1 = screen->metamodes;
     m1_idx = 0;
     m1_old_idx = 0;
     while (m1) {
-        Bool found = FALSE;
 
         if (!m1->x_str) {
             m1 = m1->next;
@@ -7449,95 +8036,78 @@ static void remove_duplicate_cpl_metamodes(CtkDisplayConfig *ctk_object,
             continue;
         }
 
-        for (m2 = screen->metamodes, m2_idx = 0;
-             m2 != m1;
-             m2 = m2->next, m2_idx++) {
-
-            if (!m2->x_str) {
-                continue;
-            }
-
-            if (strcmp(m1->x_str, m2->x_str)) {
-                continue;
-            }
-
-            /* m1 and m2 are the same, delete m1 (since it comes after) */
-            if (m1 == screen->cur_metamode) {
-                ctk_display_layout_set_screen_metamode
-                    (CTK_DISPLAY_LAYOUT(ctk_object->obj_layout),
-                     screen, m2_idx);
-            }
-
+        m2_idx = GPOINTER_TO_INT(g_hash_table_lookup(x_strs, m1->x_str)) -1;
+        if (m2_idx < 0) {
+            g_hash_table_insert(x_strs, m1->x_str,
+                                GINT_TO_POINTER(m1_idx +1));
             m1 = m1->next;
+            m1_idx++;
+            m1_old_idx++;
+            continue;
+        }
 
-            ctk_display_layout_delete_screen_metamode
+        /* m1 and m2 are the same, delete m1 (since it comes after) */
+        if (m1 == screen->cur_metamode) {
+            ctk_display_layout_set_screen_metamode
                 (CTK_DISPLAY_LAYOUT(ctk_object->obj_layout),
-                 screen, m1_idx, FALSE);
+                 screen, m2_idx);
+        }
 
-            nv_info_msg(TAB, "Removed MetaMode %d on Screen %d (is "
-                        "duplicate of MetaMode %d)\n", m1_old_idx+1,
-                        screen->scrnum,
-                        m2_idx+1);
+        m1 = m1->next;
 
-            found = TRUE;
-            break;
-        }
+        ctk_display_layout_delete_screen_metamode
+            (CTK_DISPLAY_LAYOUT(ctk_object->obj_layout),
+             screen, m1_idx, FALSE);
+
+        nv_info_msg(TAB, "Removed MetaMode %d on Screen %d (is "
+                    "duplicate of MetaMode %d)\n", m1_old_idx+1,
+                    screen->scrnum,
+                    m2_idx+1);
 
-        if (!found) {
-            m1 = m1->next;
-            m1_idx++;
-        }
         m1_old_idx++;
     }
+
+    g_hash_table_destroy(x_strs);
 }
 
 
 
-/** preprocess_metamodes() *******************************************
+/** finish_apply_plan() **********************************************
  *
- * Does preprocess work to the metamode strings:
+ * Once all the screen's metamodes are matched to the X server's,
+ * removes the duplicate CPL metamodes and plans the rest of the
+ * changes:
  *
- * - Generates the metamode strings for the screen's metamodes
- *   that will be used for creating the metamode list on the X
- *   Server.
+ * - X metamodes that match a CPL metamode are kept (all others are
+ *   deleted.)
  *
- * - Stubs out each string in the metamode_strs list that should
- *   not be deleted (it has a matching metamode in "screen".)
- *
- * - Adds new metamodes to the X server screen that are specified
- *   in "screen" but not found in metamode_strs.
+ * - CPL metamodes not found in X are added.
  *
  **/
 
-static void preprocess_metamodes(CtkDisplayConfig *ctk_object,
-                                 nvScreenPtr screen,
-                                 char *x_metamode_strs,
-                                 char *cur_x_metamode_str,
-                                 int num_x_metamodes,
-                                 int cur_x_metamode_idx)
+static void finish_apply_plan(CtkDisplayConfig *ctk_object,
+                              nvScreenPtr screen)
 {
+    nvApplyPlanPtr plan = screen->apply_plan;
     nvMetaModePtr metamode;
     Bool cur_x_metamode_matched = FALSE;
 
 
-    /* Generate metamode strings and match CPL metamodes to X */
-    setup_metamodes_for_apply(screen, x_metamode_strs);
+    g_hash_table_destroy(plan->x_ids);
+    plan->x_ids = NULL;
 
     /* Remove duplicate metamodes in CPL based on parsed string */
     remove_duplicate_cpl_metamodes(ctk_object, screen);
 
-    /* Add metamodes from the CPL that aren't in X */
     for (metamode = screen->metamodes;
          metamode;
          metamode = metamode->next) {
 
-        /* CPL metamode was found in X, stub out the string entry in the X
-         * metamodes list so we don't delete it later.
-         */
+        /* CPL metamode was found in X, so we should not delete it */
         if (metamode->x_str_entry) {
-            stub_metamode_str(metamode->x_str_entry);
+            plan->x_deletes[metamode->x_idx] = NULL;
             /* Track if the current X metamode matched a CPL metamode */
-            if (metamode->x_str_entry == cur_x_metamode_str) {
+            if (metamode->x_idx == plan->x_cur_idx) {
                 cur_x_metamode_matched = TRUE;
             }
             continue;
@@ -7546,18 +8116,16 @@ static void preprocess_metamodes(CtkDisplayConfig *ctk_object,
         /* CPL metamode was not found in X, so we should add it. */
 
         /* Don't add the current metamode (yet).  If the current X metamode
-         * string does not get stubbed out (i.e. it does not match to another
-         * CPL metamode), then it can be modify via
-         * NV_CTRL_STRING_CURRENT_METAMODE instead of adding a new metamode,
-         * switching to it and deleting the old one.
+         * is not kept (i.e. it does not match to another CPL metamode),
+         * then it can be modify via NV_CTRL_STRING_CURRENT_METAMODE instead
+         * of adding a new metamode, switching to it and deleting the old
+         * one.
          */
         if (metamode == screen->cur_metamode) {
             continue;
         }
 
-        if (add_cpl_metamode_to_X(screen, metamode, num_x_metamodes)) {
-            num_x_metamodes++;
-        }
+        plan->adds[plan->num_adds++] = metamode;
     }
 
     /* If the currently selected CPL metamode did not match any X metamode, and
@@ -7566,20 +8134,18 @@ static void preprocess_metamodes(CtkDisplayConfig *ctk_object,
      */
     if (screen->cur_metamode->id < 0) {
         if (cur_x_metamode_matched) {
-            if (add_cpl_metamode_to_X(screen, screen->cur_metamode,
-                                      num_x_metamodes)) {
-                num_x_metamodes++;
-            }
+            plan->adds[plan->num_adds++] = screen->cur_metamode;
         } else {
-            /* Current metamode will be overridden, so stub it here so that it
-             * does not get deleted later.
+            /* Current metamode will be overridden, so keep it here so that
+             * it does not get deleted later.
              */
-            stub_metamode_str(cur_x_metamode_str);
-            screen->cur_metamode->x_idx = cur_x_metamode_idx;
+            plan->x_deletes[plan->x_cur_idx] = NULL;
+            screen->cur_metamode->x_idx = plan->x_cur_idx;
         }
     }
 
-} /* preprocess_metamodes() */
+    plan->status = APPLY_PLAN_READY;
+}
 
 
 
@@ -7687,39 +8253,29 @@ static void order_metamodes(nvScreenPtr screen)
  *
  * Does post processing work on the metamode list:
  *
- * - Deletes any metamode left in the metamode_strs
+ * - Deletes the X metamodes planned to be deleted
  *
  **/
 
-static void postprocess_metamodes(nvScreenPtr screen, char *metamode_strs)
+static void postprocess_metamodes(nvScreenPtr screen)
 {
-    char *metamode_str, *tmp;
-    const char *str;
+    nvApplyPlanPtr plan = screen->apply_plan;
     ReturnStatus ret;
     int idx;
 
 
-    /* Delete metamodes that were not cleared out from the metamode_strs */
-    for (metamode_str = metamode_strs, idx = 0;
-         metamode_str && strlen(metamode_str);
-         metamode_str += strlen(metamode_str) +1, idx++) {
+    for (idx = 0; idx < plan->num_x_metamodes; idx++) {
 
-        /* Skip tokens */
-        str = strstr(metamode_str, "::");
-        if (!str) continue;
-
-        str = parse_skip_whitespace(str +2);
-        tmp = strdup(str);
-        if (!tmp) continue;
+        if (!plan->x_deletes[idx]) continue;
 
         /* Delete the metamode */
         ret = NvCtrlSetStringAttribute(screen->ctrl_target,
                                        NV_CTRL_STRING_DELETE_METAMODE,
-                                       tmp);
+                                       plan->x_deletes[idx]);
         if (ret == NvCtrlSuccess) {
             nvMetaModePtr metamode;
 
-            nv_info_msg(TAB, "Removed MetaMode > %s", str);
+            nv_info_msg(TAB, "Removed MetaMode > %s", plan->x_deletes[idx]);
 
             /* MetaModes after the one that was deleted will have
              * moved up an index, so update the book keeping here.
@@ -7732,8 +8288,6 @@ static void postprocess_metamodes(nvScreenPtr screen, char *metamode_strs)
                 }
             }
         }
-
-        free(tmp);
     }
 
     /* Reorder the list of metamodes */
@@ -7747,25 +8301,19 @@ static void postprocess_metamodes(nvScreenPtr screen, char *metamode_strs)
 
 /** update_screen_metamodes() ****************************************
  *
- * Updates the screen's metamode list.
+ * Updates the screen's metamode list, making the changes planned
+ * while the layout was being applied (see finish_apply_plan()).
  *
  **/
 
 static int update_screen_metamodes(CtkDisplayConfig *ctk_object,
                                    nvScreenPtr screen)
 {
-    char *metamode_strs = NULL;
-    char *cur_full_metamode_str = NULL;
-    char *cur_metamode_ptr = NULL; /* Pointer into metamode_strs */
-    int cur_metamode_id; /* ID of current MetaMode on X screen */
-    int cur_metamode_idx;
+    nvApplyPlanPtr plan = screen->apply_plan;
     int num_metamodes_in_X;
-    char *str;
-    const char *cur_metamode_str;
-    int len;
+    int i;
 
     int clear_apply = 0; /* Set if we should clear the apply button */
-    ReturnStatus ret;
 
 
     /* Make sure the screen has a valid target to make the updates */
@@ -7776,10 +8324,14 @@ static int update_screen_metamodes(CtkDisplayConfig *ctk_object,
     nv_info_msg("", "Updating Screen %d's MetaModes:",
                 NvCtrlGetTargetId(screen->ctrl_target));
 
+    /* The X server's metamodes could not be matched */
+    if (!plan || (plan->status != APPLY_PLAN_READY)) {
+        return plan && (plan->status == APPLY_PLAN_SKIP);
+    }
+
     /* To update the metamode list of the screen:
      *
      * (preprocess)
-     *  - Get the current list of metamodes for this screen
      *  - Add all the new metamodes at the end of the list
      *
      * (mode switch)
@@ -7790,77 +8342,14 @@ static int update_screen_metamodes(CtkDisplayConfig *ctk_object,
      *  - Move metamodes to the correct location
      */
 
-    /* Get the list of the current metamodes */
-
-    ret = NvCtrlGetBinaryAttribute(screen->ctrl_target,
-                                   0,
-                                   NV_CTRL_BINARY_DATA_METAMODES_VERSION_2,
-                                   (unsigned char **)&metamode_strs,
-                                   &len);
-    if (ret != NvCtrlSuccess) goto done;
-
-    /* Get the current metamode for the screen */
-
-    ret = NvCtrlGetStringAttribute(screen->ctrl_target,
-                                   NV_CTRL_STRING_CURRENT_METAMODE_VERSION_2,
-                                   &cur_full_metamode_str);
-    if (ret != NvCtrlSuccess) goto done;
-
-    /* Get the current metamode index for the screen */
-
-    ret = NvCtrlGetAttribute(screen->ctrl_target,
-                             NV_CTRL_CURRENT_METAMODE_ID,
-                             &cur_metamode_id);
-    if (ret != NvCtrlSuccess) goto done;
-
-    /* Skip tokens */
-    cur_metamode_str = strstr(cur_full_metamode_str, "::");
-    if (cur_metamode_str) {
-        cur_metamode_str = parse_skip_whitespace(cur_metamode_str +2);
-    } else {
-        cur_metamode_str = cur_full_metamode_str;
-    }
-
-    /* Count the number of metamodes in X */
-    num_metamodes_in_X = 0;
-    for (str = metamode_strs;
-         str && strlen(str);
-         str += strlen(str) +1) {
-        num_metamodes_in_X++;
-    }
-
-    /* Find cur_metamode_str inside metamode_strs */
-    cur_metamode_ptr = NULL;
-    cur_metamode_idx = 0;
-    for (str = metamode_strs;
-         str && strlen(str);
-         str += strlen(str) +1) {
-        const char *tmp;
-
-        tmp = strstr(str, "::");
-        if (!tmp) continue;
-        tmp = parse_skip_whitespace(tmp +2);
-        if (!tmp) continue;
-
-        if (!strcasecmp(tmp, cur_metamode_str)) {
-            cur_metamode_ptr = str;
-            break;
+    num_metamodes_in_X = plan->num_x_metamodes;
+    for (i = 0; i < plan->num_adds; i++) {
+        if (add_cpl_metamode_to_X(screen, plan->adds[i],
+                                  num_metamodes_in_X)) {
+            num_metamodes_in_X++;
         }
-        cur_metamode_idx++;
-    }
-
-    if (!cur_metamode_ptr) {
-        nv_error_msg("Failed to identify current MetaMode in X list of "
-                     "MetaModes for screen %d", screen->scrnum);
-        return 1;
     }
 
-    /* Add new metamodes and relate MetaModes from CPL to X */
-
-    preprocess_metamodes(ctk_object, screen, metamode_strs, cur_metamode_ptr,
-                         num_metamodes_in_X,
-                         cur_metamode_idx);
-
     /* Update the current metamode.
      *
      * At this point, the metamode we want to set as the current metamode should
@@ -7882,10 +8371,10 @@ static int update_screen_metamodes(CtkDisplayConfig *ctk_object,
      *   we should add the current CPL MetaMode to X and switch to it.
      */
 
-    if (screen->cur_metamode->id != cur_metamode_id) {
+    if (screen->cur_metamode->id != plan->x_cur_id) {
 
         if (switch_to_current_metamode(ctk_object, screen,
-                                       cur_metamode_str)) {
+                                       plan->x_cur_str)) {
 
             ctk_config_statusbar_message(ctk_object->ctk_config,
                                          "Switched to MetaMode %dx%d.",
@@ -7902,12 +8391,7 @@ static int update_screen_metamodes(CtkDisplayConfig *ctk_object,
 
     /* Post process the metamodes list */
 
-    postprocess_metamodes(screen, metamode_strs);
-
- done:
-
-    free(metamode_strs);
-    free(cur_full_metamode_str);
+    postprocess_metamodes(screen);
 
     return clear_apply;
 
@@ -7915,30 +8399,127 @@ static int update_screen_metamodes(CtkDisplayConfig *ctk_object,
 
 
 
-/** apply_clicked() **************************************************
+/** clear_apply_validation() *****************************************
  *
- * Called when user clicks on the "Apply" button.
+ * Releases the state kept while validating the layout for apply (and
+ * planning the changes to make), and restores the Apply button.
  *
  **/
 
-static void apply_clicked(GtkWidget *widget, gpointer user_data)
+static void clear_apply_validation(CtkDisplayConfig *ctk_object)
 {
-    CtkDisplayConfig *ctk_object = CTK_DISPLAY_CONFIG(user_data);
     nvScreenPtr screen;
-    ReturnStatus ret;
-    gboolean clear_apply = TRUE;
 
+    if (ctk_object->apply_validation_source) {
+        g_source_remove(ctk_object->apply_validation_source);
+        ctk_object->apply_validation_source = 0;
+    }
 
-    /* Make sure we can apply */
-    if (!validate_apply(ctk_object)) {
+    g_free(ctk_object->apply_validation_errors);
+    ctk_object->apply_validation_errors = NULL;
+    ctk_object->apply_planning = FALSE;
+    ctk_object->apply_validation_screen = NULL;
+    ctk_object->apply_validation_metamode = NULL;
+    ctk_object->apply_validation_metamode_idx = 0;
+    free(ctk_object->apply_validation_modes);
+    ctk_object->apply_validation_modes = NULL;
+
+    /* Drop the plans and metamode strings made so far */
+    for (screen = ctk_object->layout->screens;
+         screen;
+         screen = screen->next_in_layout) {
+        free_apply_plan(screen);
+        cleanup_metamodes_for_apply(screen);
+    }
+
+    gtk_button_set_label(GTK_BUTTON(ctk_object->btn_apply), "Apply");
+
+} /* clear_apply_validation() */
+
+
+
+/** cancel_apply_validation() ****************************************
+ *
+ * Stops validating the layout for apply, if that is under way.  This
+ * happens when the user asks for it, and whenever the layout changes
+ * since what is being validated is then out of date.
+ *
+ **/
+
+static void cancel_apply_validation(CtkDisplayConfig *ctk_object)
+{
+    if (!ctk_object->apply_validation_source) {
         return;
     }
 
-    /* Make sure the layout is ready to be applied */
-    if (!validate_layout(ctk_object, VALIDATE_APPLY)) {
+    clear_apply_validation(ctk_object);
+
+    ctk_config_statusbar_message(ctk_object->ctk_config,
+                                 "Apply cancelled.");
+
+} /* cancel_apply_validation() */
+
+
+
+/** start_apply_validation_screen() **********************************
+ *
+ * Moves the validation for apply (or the planning) on to the given X
+ * screen, starting from its first metamode.  The mode of that
+ * metamode on each of the screen's displays is kept track of, so that
+ * the displays' lists of modes are only walked once.
+ *
+ **/
+
+static void start_apply_validation_screen(CtkDisplayConfig *ctk_object,
+                                          nvScreenPtr screen)
+{
+    nvDisplayPtr display;
+    int d;
+
+    ctk_object->apply_validation_screen = screen;
+    ctk_object->apply_validation_metamode = screen ? screen->metamodes : NULL;
+    ctk_object->apply_validation_metamode_idx = 0;
+
+    free(ctk_object->apply_validation_modes);
+    ctk_object->apply_validation_modes = NULL;
+
+    if (!screen) {
+        return;
+    }
+
+    /* Without these, each metamode's modes are found from the start of
+     * the lists of modes instead.
+     */
+    ctk_object->apply_validation_modes =
+        calloc(screen->num_displays +1, sizeof(nvModePtr));
+    if (!ctk_object->apply_validation_modes) {
         return;
     }
 
+    for (display = screen->displays, d = 0;
+         display && (d < screen->num_displays);
+         display = display->next_in_screen, d++) {
+        ctk_object->apply_validation_modes[d] = display->modes;
+    }
+
+} /* start_apply_validation_screen() */
+
+
+
+/** apply_layout() ***************************************************
+ *
+ * Applies the (validated) layout to the X server, making the changes
+ * to the X screens' metamodes planned by apply_planning_step().
+ *
+ **/
+
+static void apply_layout(CtkDisplayConfig *ctk_object)
+{
+    nvScreenPtr screen;
+    ReturnStatus ret;
+    gboolean clear_apply = TRUE;
+
+
     /* Temporarily unregister events */
     unregister_layout_events(ctk_object);
 
@@ -7973,11 +8554,21 @@ static void apply_clicked(GtkWidget *widget, gpointer user_data)
 
     }
 
+    /* Release the plans, and the metamode strings of screens that were
+     * not updated.
+     */
+    for (screen = ctk_object->layout->screens;
+         screen;
+         screen = screen->next_in_layout) {
+        free_apply_plan(screen);
+        cleanup_metamodes_for_apply(screen);
+    }
+
     /* Clear the apply button if all went well, and we were able to apply
      * everything.
      */
     if (ctk_object->apply_possible && clear_apply) {
-        gtk_widget_set_sensitive(widget, False);
+        gtk_widget_set_sensitive(ctk_object->btn_apply, False);
         ctk_object->forced_reset_allowed = TRUE;
     }
 
@@ -7995,6 +8586,220 @@ static void apply_clicked(GtkWidget *widget, gpointer user_data)
 
     update_gui(ctk_object);
 
+} /* apply_layout() */
+
+
+
+/** apply_planning_step() ********************************************
+ *
+ * Plans the changes to make to the X screens' metamodes from the GTK
+ * main loop, a batch of metamodes at a time: the metamode strings are
+ * generated and matched to the X server's metamodes, and once all of
+ * a screen's metamodes are matched, the metamodes to add to and delete
+ * from the X server are worked out (see finish_apply_plan()).
+ *
+ * Once all X screens are planned, the layout is applied.
+ *
+ **/
+
+static gboolean apply_planning_step(CtkDisplayConfig *ctk_object)
+{
+    nvScreenPtr screen = ctk_object->apply_validation_screen;
+    nvMetaModePtr metamode;
+
+
+    if (screen) {
+
+        /* Start with the X server's metamodes.  Screens whose metamodes
+         * are not updated (or can't be planned for) are skipped.
+         */
+        if (!screen->apply_plan &&
+            (!screen->ctrl_target || screen->no_scanout ||
+             !start_apply_plan(screen))) {
+            start_apply_validation_screen(ctk_object,
+                                          screen->next_in_layout);
+            return TRUE;
+        }
+
+        ctk_config_statusbar_message(ctk_object->ctk_config,
+                                     "Preparing X screen %d of %d "
+                                     "(MetaMode %d of %d)...",
+                                     screen->scrnum + 1,
+                                     ctk_object->layout->num_screens,
+                                     NV_MIN(ctk_object->apply_validation_metamode_idx +
+                                            APPLY_VALIDATION_BATCH,
+                                            screen->num_metamodes),
+                                     screen->num_metamodes);
+
+        metamode = plan_metamodes(screen, ctk_object->apply_validation_modes,
+                                  ctk_object->apply_validation_metamode,
+                                  ctk_object->apply_validation_metamode_idx,
+                                  APPLY_VALIDATION_BATCH);
+
+        /* Resume with the next batch, or the next X screen */
+        if (metamode) {
+            ctk_object->apply_validation_metamode = metamode;
+            ctk_object->apply_validation_metamode_idx +=
+                APPLY_VALIDATION_BATCH;
+        } else {
+            finish_apply_plan(ctk_object, screen);
+            start_apply_validation_screen(ctk_object,
+                                          screen->next_in_layout);
+        }
+        return TRUE;
+    }
+
+    /* All X screens are planned */
+    ctk_object->apply_validation_source = 0;
+    ctk_object->apply_planning = FALSE;
+
+    gtk_button_set_label(GTK_BUTTON(ctk_object->btn_apply), "Apply");
+    ctk_config_statusbar_message(ctk_object->ctk_config,
+                                 "Applying layout...");
+
+    apply_layout(ctk_object);
+
+    return FALSE;
+
+} /* apply_planning_step() */
+
+
+
+/** apply_validation_step() ******************************************
+ *
+ * Validates the layout for apply from the GTK main loop, a batch of
+ * metamodes at a time, so that the GUI stays responsive (and the
+ * Cancel button usable) even for a single X screen with many
+ * metamodes.
+ *
+ * Once all X screens are done, the user is asked about any errors,
+ * and the changes to make to the X server are planned (see
+ * apply_planning_step()) the same way.
+ *
+ **/
+
+static gboolean apply_validation_step(gpointer user_data)
+{
+    CtkDisplayConfig *ctk_object = CTK_DISPLAY_CONFIG(user_data);
+    nvScreenPtr screen = ctk_object->apply_validation_screen;
+    gchar *err_str;
+    gchar *tmp;
+    gchar *err_strs;
+    gboolean can_ignore_error;
+    int first;
+    int result;
+
+
+    if (ctk_object->apply_planning) {
+        return apply_planning_step(ctk_object);
+    }
+
+    if (screen) {
+        first = ctk_object->apply_validation_metamode_idx;
+
+        ctk_config_statusbar_message(ctk_object->ctk_config,
+                                     "Validating X screen %d of %d "
+                                     "(MetaMode %d of %d)...",
+                                     screen->scrnum + 1,
+                                     ctk_object->layout->num_screens,
+                                     NV_MIN(first + APPLY_VALIDATION_BATCH,
+                                            screen->num_metamodes),
+                                     screen->num_metamodes);
+
+        err_str = validate_screen(screen, ctk_object->apply_validation_modes,
+                                  first, APPLY_VALIDATION_BATCH,
+                                  &ctk_object->apply_validation_can_ignore);
+        if (err_str) {
+            tmp = g_strconcat((ctk_object->apply_validation_errors ?
+                               ctk_object->apply_validation_errors : ""),
+                              err_str, NULL);
+            g_free(ctk_object->apply_validation_errors);
+            g_free(err_str);
+            ctk_object->apply_validation_errors = tmp;
+        }
+
+        /* Resume with the next batch, or the next X screen */
+        if (first + APPLY_VALIDATION_BATCH < screen->num_metamodes) {
+            ctk_object->apply_validation_metamode_idx =
+                first + APPLY_VALIDATION_BATCH;
+        } else {
+            start_apply_validation_screen(ctk_object,
+                                          screen->next_in_layout);
+        }
+        return TRUE;
+    }
+
+    /* All X screens are validated */
+    ctk_object->apply_validation_source = 0;
+
+    err_strs = ctk_object->apply_validation_errors;
+    can_ignore_error = ctk_object->apply_validation_can_ignore;
+    ctk_object->apply_validation_errors = NULL;
+
+    gtk_button_set_label(GTK_BUTTON(ctk_object->btn_apply), "Apply");
+
+    result = validation_prompt(ctk_object, err_strs, can_ignore_error);
+    if (!result) {
+        clear_apply_validation(ctk_object);
+        ctk_config_statusbar_message(ctk_object->ctk_config,
+                                     "Apply cancelled.");
+        return FALSE;
+    }
+
+    /* Plan the changes from the layout as validated (or fixed) */
+    ctk_object->apply_planning = TRUE;
+    start_apply_validation_screen(ctk_object, ctk_object->layout->screens);
+
+    gtk_button_set_label(GTK_BUTTON(ctk_object->btn_apply), "Cancel");
+    ctk_config_statusbar_message(ctk_object->ctk_config,
+                                 "Preparing to apply layout...");
+
+    ctk_object->apply_validation_source =
+        g_idle_add(apply_validation_step, (gpointer)ctk_object);
+
+    return FALSE;
+
+} /* apply_validation_step() */
+
+
+
+/** apply_clicked() **************************************************
+ *
+ * Called when user clicks on the "Apply" button.  The layout is first
+ * validated, and the changes to make planned, in the background (see
+ * apply_validation_step()); clicking the button again meanwhile
+ * cancels the apply.
+ *
+ **/
+
+static void apply_clicked(GtkWidget *widget, gpointer user_data)
+{
+    CtkDisplayConfig *ctk_object = CTK_DISPLAY_CONFIG(user_data);
+
+
+    /* Cancel the apply in progress */
+    if (ctk_object->apply_validation_source) {
+        cancel_apply_validation(ctk_object);
+        return;
+    }
+
+    /* Make sure we can apply */
+    if (!validate_apply(ctk_object)) {
+        return;
+    }
+
+    /* Make sure the layout is ready to be applied */
+    clear_apply_validation(ctk_object);
+    start_apply_validation_screen(ctk_object, ctk_object->layout->screens);
+    ctk_object->apply_validation_can_ignore = TRUE;
+
+    gtk_button_set_label(GTK_BUTTON(ctk_object->btn_apply), "Cancel");
+    ctk_config_statusbar_message(ctk_object->ctk_config,
+                                 "Validating layout...");
+
+    ctk_object->apply_validation_source =
+        g_idle_add(apply_validation_step, (gpointer)ctk_object);
+
 } /* apply_clicked() */
 
 
@@ -9051,9 +9856,14 @@ static void reset_layout(CtkDisplayConfig *ctk_object)
     allow_apply = layout_change_is_applyable(ctk_object->layout, layout);
 
     /* Free existing layout */
+    cancel_apply_validation(ctk_object);
     unregister_layout_events(ctk_object);
     layout_free(ctk_object->layout);
 
+    /* Pending probe updates refer to the GPUs of the old layout */
+    g_slist_free(ctk_object->probed_gpus);
+    ctk_object->probed_gpus = NULL;
+
 
     /* Setup the new layout */
     ctk_object->layout = layout;
@@ -9247,6 +10057,129 @@ static void display_config_attribute_changed(GtkWidget *object,
 
 
 
+/** update_probed_gpus() *********************************************
+ *
+ * Updates the display devices of the GPUs that emitted a probe event,
+ * without reloading the rest of the layout.  Falls back to a full
+ * layout reset when a GPU cannot be updated in place.
+ *
+ **/
+
+static gboolean update_probed_gpus(gpointer user_data)
+{
+    CtkDisplayConfig *ctk_object = (CtkDisplayConfig *) user_data;
+    CtkDisplayLayout *ctk_layout = (CtkDisplayLayout *)(ctk_object->obj_layout);
+    nvDisplayPtr selected_display;
+    nvScreenPtr selected_screen;
+    int selected_display_id = -1;
+    Bool changed = FALSE;
+    Bool allow_apply = FALSE;
+    GSList *probed_gpus;
+    GSList *item;
+
+    probed_gpus = ctk_object->probed_gpus;
+    ctk_object->probed_gpus = NULL;
+
+    /* A full reset was queued in the meantime */
+    if (ctk_object->ignore_reset_events) {
+        g_slist_free(probed_gpus);
+        return FALSE;
+    }
+
+    selected_display = ctk_display_layout_get_selected_display(ctk_layout);
+    selected_screen = ctk_display_layout_get_selected_screen(ctk_layout);
+    if (selected_display) {
+        selected_display_id = NvCtrlGetTargetId(selected_display->ctrl_target);
+    }
+
+    for (item = probed_gpus; item; item = item->next) {
+        nvGpuPtr gpu = (nvGpuPtr) item->data;
+        gchar *err_str = NULL;
+        Bool gpu_changed;
+        Bool gpu_allow_apply;
+
+        if (!gpu_update_displays_from_server(gpu, &gpu_changed,
+                                             &gpu_allow_apply, &err_str)) {
+            g_free(err_str);
+            g_slist_free(probed_gpus);
+
+            ctk_object->ignore_reset_events = TRUE;
+            return force_layout_reset(ctk_object);
+        }
+
+        changed |= gpu_changed;
+        allow_apply |= gpu_allow_apply;
+    }
+    g_slist_free(probed_gpus);
+
+    if (!changed) {
+        return FALSE;
+    }
+
+    /* Refresh the layout widget, keeping the selection when possible */
+    ctk_display_layout_set_layout(ctk_layout, ctk_object->layout);
+
+    if (selected_display_id >= 0) {
+        selected_display = layout_get_display(ctk_object->layout,
+                                              selected_display_id);
+        if (selected_display) {
+            ctk_display_layout_select_display(ctk_layout, selected_display);
+        }
+    } else if (selected_screen) {
+        ctk_display_layout_select_screen(ctk_layout, selected_screen);
+    }
+
+    update_gui(ctk_object);
+
+    if (allow_apply) {
+        update_btn_apply(ctk_object, TRUE);
+    }
+
+    return FALSE;
+
+} /* update_probed_gpus() */
+
+
+
+/** display_config_probe_event() *************************************
+ *
+ * Callback for the probe events of the layout's GPUs.
+ *
+ * A probe only changes which display devices are connected to the GPU
+ * that emitted it, so rather than reloading the whole layout, the GPU
+ * is queued for update_probed_gpus() to add and remove the affected
+ * displays once all pending events are consumed.
+ *
+ **/
+
+static void display_config_probe_event(GtkWidget *object,
+                                       CtrlEvent *event,
+                                       gpointer user_data)
+{
+    CtkDisplayConfig *ctk_object = (CtkDisplayConfig *) user_data;
+    nvGpuPtr gpu;
+
+    if (ctk_object->ignore_reset_events) return;
+
+    for (gpu = ctk_object->layout->gpus; gpu; gpu = gpu->next_in_layout) {
+        if (G_OBJECT(gpu->ctk_event) == G_OBJECT(object)) {
+            break;
+        }
+    }
+    if (!gpu) return;
+
+    if (g_slist_find(ctk_object->probed_gpus, gpu)) return;
+
+    /* Queue update_probed_gpus() with the first GPU of the block */
+    if (!ctk_object->probed_gpus) {
+        g_idle_add(update_probed_gpus, (gpointer)ctk_object);
+    }
+    ctk_object->probed_gpus = g_slist_append(ctk_object->probed_gpus, gpu);
+
+} /* display_config_probe_event() */
+
+
+
 /** ctk_display_config_unselected() **********************************
  *
  * Called when display config page is unselected.
@@ -185,6 +185,9 @@ typedef struct _CtkDisplayConfig
     GtkWidget *btn_screen_metamode_add;
     GtkWidget *btn_screen_metamode_delete;
 
+    GtkWidget *box_screen_grid;
+    GtkWidget *btn_screen_grid;
+
     int *screen_depth_table;
     int screen_depth_table_len;
 
@@ -202,6 +205,13 @@ typedef struct _CtkDisplayConfig
 
     GtkWidget *dlg_validation_apply;
 
+    GtkWidget *dlg_screen_grid;
+    GtkWidget *mnu_screen_grid_resolution;
+    GtkWidget *spn_screen_grid_rows;
+    GtkWidget *spn_screen_grid_columns;
+    GtkWidget *spn_screen_grid_h_overlap;
+    GtkWidget *spn_screen_grid_v_overlap;
+
     GtkWidget *dlg_reset_confirm;
     GtkWidget *btn_reset_cancel;
 
@@ -217,10 +227,21 @@ typedef struct _CtkDisplayConfig
     GtkWidget *btn_apply;
     gboolean apply_possible; /* True if all modifications are applicable */
 
+    guint apply_validation_source; /* Validating the layout for apply */
+    gboolean apply_planning; /* Validated, planning the changes to make */
+    nvScreenPtr apply_validation_screen; /* Next X screen to go through */
+    nvMetaModePtr apply_validation_metamode; /* Next metamode of that screen */
+    int apply_validation_metamode_idx; /* Index of that metamode */
+    nvModePtr *apply_validation_modes; /* Mode of that metamode on each of
+                                        * the screen's displays */
+    gchar *apply_validation_errors; /* Errors found so far */
+    gboolean apply_validation_can_ignore; /* Errors found can be ignored */
+
     gboolean reset_required; /* Reset required to apply */
     gboolean forced_reset_allowed; /* OK to reset layout w/o user input */
     gboolean notify_user_of_reset; /* User was notified of reset requirement */
     gboolean ignore_reset_events; /* Ignore reset-causing events */
+    GSList *probed_gpus; /* GPUs to update after a probe event */
 
     GdkPoint cur_screen_pos; /* Keep track of the selected X screen's position */
 
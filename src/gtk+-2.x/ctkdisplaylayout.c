@@ -49,6 +49,8 @@
 #define LAYOUT_IMG_BG_COLOR         "#AAAAAA"
 #define LAYOUT_IMG_SELECT_COLOR     "#FF8888"
 
+#define LAYOUT_DAMAGE_MARGIN        4 /* Room for borders around moved items */
+
 #ifdef CTK_GTK3
 #define LENGTH_DASH_ARRAY 2
 static const double dashes[] = {4.0, 4.0};
@@ -178,39 +180,51 @@ static void calc_metamode(nvScreenPtr screen, nvMetaModePtr metamode);
 
 static Bool sync_layout(CtkDisplayLayout *ctk_object);
 
+static void clear_layout(CtkDisplayLayout *ctk_object);
+
 
 
 
 /*** F U N C T I O N S *******************************************************/
 
 
-/** queue_layout_redraw() ********************************************
+/** queue_full_redraw() **********************************************
  *
- * Queues an expose event to happen on ourselves so we know to
- * redraw later.
+ * Queues an expose event for the whole drawing area, redrawing the
+ * cached image of the static elements as well.
  *
  **/
 
-static void queue_layout_redraw(CtkDisplayLayout *ctk_object)
+static void queue_full_redraw(CtkDisplayLayout *ctk_object)
 {
-    GtkWidget *drawing_area = ctk_object->drawing_area;
-    GdkWindow *window = ctk_widget_get_window(drawing_area);
-    GtkAllocation allocation;
-    GdkRectangle rect;
+    GdkWindow *window = ctk_widget_get_window(ctk_object->drawing_area);
+
+    ctk_object->static_valid = FALSE;
 
     if (!window) {
         return;
     }
 
-    ctk_widget_get_allocation(drawing_area, &allocation);
+    /* Queue an expose event for the whole drawing area */
+    gdk_window_invalidate_rect(window, NULL, TRUE);
+
+} /* queue_full_redraw() */
+
+
 
-    /* Queue an expose event */
-    rect.x = allocation.x;
-    rect.y = allocation.x;
-    rect.width = allocation.width;
-    rect.height = allocation.height;
+/** queue_layout_redraw() ********************************************
+ *
+ * Queues an expose event to happen on ourselves so we know to
+ * redraw later.  Since anything in the layout may have changed, the
+ * layout index is rebuilt before the next lookup as well.
+ *
+ **/
+
+static void queue_layout_redraw(CtkDisplayLayout *ctk_object)
+{
+    ctk_object->layout_index.valid = FALSE;
 
-    gdk_window_invalidate_rect(window, &rect, TRUE);
+    queue_full_redraw(ctk_object);
 
 } /* queue_layout_redraw() */
 
@@ -239,6 +253,7 @@ static void zorder_layout(CtkDisplayLayout *ctk_object)
         ctk_object->Zorder = NULL;
     }
     ctk_object->Zcount = 0;
+    ctk_object->layout_index.valid = FALSE;
 
 
     /* Count the number of Z-orderable elements in the layout */
@@ -361,6 +376,32 @@ static GdkRectangle *get_screen_rect(nvScreenPtr screen, Bool edim)
 
 
 
+/** get_znode_rects() ************************************************
+ *
+ * Returns the two layout rectangles that a Z-order node is drawn in.
+ *
+ **/
+
+static void get_znode_rects(const ZNode *node, GdkRectangle rects[2])
+{
+    if (node->type == ZNODE_TYPE_DISPLAY) {
+        nvModePtr mode = node->u.display->cur_mode;
+
+        if (mode) {
+            rects[0] = mode->pan;
+            get_viewportin_rect(mode, &rects[1]);
+        } else {
+            memset(rects, 0, 2 * sizeof(GdkRectangle));
+        }
+    } else {
+        rects[0] = *get_screen_rect(node->u.screen, 1);
+        rects[1] = node->u.screen->dim;
+    }
+
+} /* get_znode_rects() */
+
+
+
 /** get_modify_info() ************************************************
  *
  * Gather information prior to moving/panning.
@@ -523,6 +564,403 @@ static int point_in_screen(nvScreenPtr screen, int x, int y)
 
 
 
+/** get_index_cells() ************************************************
+ *
+ * Returns the range of layout index cells that the given area touches.
+ *
+ **/
+
+static void get_index_cells(const LayoutIndex *index, const GdkRectangle *dim,
+                            int *col0, int *col1, int *row0, int *row1)
+{
+    *col0 = NV_MAX(0, (dim->x - index->dim.x) / index->cell_width);
+    *col1 = NV_MIN(index->cols - 1,
+                   (dim->x + dim->width - index->dim.x) / index->cell_width);
+    *row0 = NV_MAX(0, (dim->y - index->dim.y) / index->cell_height);
+    *row1 = NV_MIN(index->rows - 1,
+                   (dim->y + dim->height - index->dim.y) / index->cell_height);
+
+} /* get_index_cells() */
+
+
+
+/** get_znode_dim() **************************************************
+ *
+ * Returns the bounding box of the rectangles a Z-order node is drawn
+ * in.  Nodes without a size get an empty box.
+ *
+ **/
+
+static void get_znode_dim(const ZNode *node, GdkRectangle *dim)
+{
+    GdkRectangle rects[2];
+    int j;
+
+    memset(dim, 0, sizeof(*dim));
+
+    get_znode_rects(node, rects);
+    for (j = 0; j < 2; j++) {
+        if (rects[j].width <= 0 || rects[j].height <= 0) continue;
+        if (dim->width <= 0) {
+            *dim = rects[j];
+        } else {
+            gdk_rectangle_union(dim, rects + j, dim);
+        }
+    }
+
+} /* get_znode_dim() */
+
+
+
+/** build_layout_index() *********************************************
+ *
+ * (Re)builds the grid used to look up Z-order nodes by position.
+ * The grid has about as many cells as there are nodes, and each cell
+ * lists (in Z-order) the nodes whose bounding box touches it.
+ *
+ * Returns FALSE if memory could not be allocated.
+ *
+ **/
+
+static Bool build_layout_index(CtkDisplayLayout *ctk_object)
+{
+    LayoutIndex *index = &(ctk_object->layout_index);
+    GdkRectangle *dim;
+    int *fill;
+    int num_cells;
+    int count = 0;
+    int i, col, row;
+    int col0, col1, row0, row1;
+
+
+    free(index->cell_start);
+    free(index->nodes);
+    free(index->node_dim);
+    free(index->found);
+    free(index->mark);
+    free(index->moved);
+    free(index->is_moved);
+    memset(index, 0, sizeof(*index));
+
+    index->node_dim = calloc(ctk_object->Zcount + 1, sizeof(GdkRectangle));
+    index->found = calloc(ctk_object->Zcount + 1, sizeof(int));
+    index->mark = calloc(ctk_object->Zcount + 1, sizeof(int));
+    index->moved = calloc(ctk_object->Zcount + 1, sizeof(int));
+    index->is_moved = calloc(ctk_object->Zcount + 1, sizeof(Bool));
+    if (!index->node_dim || !index->found || !index->mark ||
+        !index->moved || !index->is_moved) {
+        return FALSE;
+    }
+
+    /* Gather the bounding box of each node, and of the whole grid */
+    for (i = 0; i < ctk_object->Zcount; i++) {
+        dim = index->node_dim + i;
+
+        get_znode_dim(ctk_object->Zorder + i, dim);
+
+        /* Nodes without a size can't be found */
+        if (dim->width <= 0) continue;
+
+        if (!count) {
+            index->dim = *dim;
+        } else {
+            gdk_rectangle_union(&(index->dim), dim, &(index->dim));
+        }
+        count++;
+    }
+
+    /* Size the grid to have about one node per cell */
+    index->cols = 1;
+    while (index->cols * index->cols < count) {
+        index->cols++;
+    }
+    index->rows = index->cols;
+    index->cell_width =
+        NV_MAX(1, (index->dim.width + index->cols - 1) / index->cols);
+    index->cell_height =
+        NV_MAX(1, (index->dim.height + index->rows - 1) / index->rows);
+
+    num_cells = index->cols * index->rows;
+    index->cell_start = calloc(num_cells + 1, sizeof(int));
+    fill = calloc(num_cells, sizeof(int));
+    if (!index->cell_start || !fill) {
+        free(fill);
+        return FALSE;
+    }
+
+    /* Count the nodes in each cell, then lay the cells out back to back */
+    for (i = 0; i < ctk_object->Zcount; i++) {
+        dim = index->node_dim + i;
+        if (dim->width <= 0) continue;
+
+        get_index_cells(index, dim, &col0, &col1, &row0, &row1);
+        for (row = row0; row <= row1; row++) {
+            for (col = col0; col <= col1; col++) {
+                index->cell_start[row * index->cols + col + 1]++;
+            }
+        }
+    }
+
+    for (i = 0; i < num_cells; i++) {
+        index->cell_start[i + 1] += index->cell_start[i];
+        fill[i] = index->cell_start[i];
+    }
+
+    index->nodes = calloc(index->cell_start[num_cells] + 1, sizeof(int));
+    if (!index->nodes) {
+        free(fill);
+        return FALSE;
+    }
+
+    for (i = 0; i < ctk_object->Zcount; i++) {
+        dim = index->node_dim + i;
+        if (dim->width <= 0) continue;
+
+        get_index_cells(index, dim, &col0, &col1, &row0, &row1);
+        for (row = row0; row <= row1; row++) {
+            for (col = col0; col <= col1; col++) {
+                index->nodes[fill[row * index->cols + col]++] = i;
+            }
+        }
+    }
+
+    free(fill);
+
+    index->valid = TRUE;
+    return TRUE;
+
+} /* build_layout_index() */
+
+
+
+/** update_layout_index() ********************************************
+ *
+ * Brings the layout index up to date after Z-order nodes have moved
+ * (or changed size), without rebuilding the grid: the bounding box of
+ * each node that moved is updated in place, and the node is added to
+ * the list of moved nodes, which lookups check on top of the grid
+ * cells.  The grid cells a moved node was listed in are left as they
+ * are, since lookups check each node's bounding box anyway.
+ *
+ * Once too many nodes have moved for that to pay off, the index is
+ * marked for a rebuild instead.
+ *
+ **/
+
+static void update_layout_index(CtkDisplayLayout *ctk_object)
+{
+    LayoutIndex *index = &(ctk_object->layout_index);
+    GdkRectangle dim;
+    int i;
+
+
+    if (!index->valid) {
+        return;
+    }
+
+    for (i = 0; i < ctk_object->Zcount; i++) {
+        get_znode_dim(ctk_object->Zorder + i, &dim);
+        if (!memcmp(&dim, index->node_dim + i, sizeof(dim))) {
+            continue;
+        }
+
+        index->node_dim[i] = dim;
+        if (!index->is_moved[i]) {
+            index->is_moved[i] = TRUE;
+            index->moved[index->num_moved++] = i;
+        }
+    }
+
+    /* With this many nodes to check on every lookup, the grid no longer
+     * helps much: rebuild it.
+     */
+    if (index->num_moved > ctk_object->Zcount / 2) {
+        index->valid = FALSE;
+    }
+
+} /* update_layout_index() */
+
+
+
+/** find_znodes() ****************************************************
+ *
+ * Looks up the Z-order nodes whose bounding box touches any of the
+ * given layout areas.  Returns their Z-order indices, from top to
+ * bottom, and sets 'count' to how many there are.  The returned
+ * array belongs to the layout index and is only valid until the next
+ * lookup.
+ *
+ * If the index cannot be built, NULL is returned and 'count' is set
+ * to the Z-order count: the caller should then look at every node.
+ *
+ **/
+
+static int compare_znode_indices(const void *a, const void *b)
+{
+    return *(const int *)a - *(const int *)b;
+}
+
+static int *find_znodes(CtkDisplayLayout *ctk_object,
+                        const GdkRectangle *areas, int num_areas,
+                        int *count)
+{
+    LayoutIndex *index = &(ctk_object->layout_index);
+    const GdkRectangle *area;
+    const GdkRectangle *dim;
+    int a, i, n, col, row, cell;
+    int col0, col1, row0, row1;
+    int num_cells = 0;
+    int num_found;
+
+
+    if (!index->valid && !build_layout_index(ctk_object)) {
+        *count = ctk_object->Zcount;
+        return NULL;
+    }
+
+    /* Start a new round of duplicate checks */
+    if (++index->mark_serial <= 0) {
+        memset(index->mark, 0, ctk_object->Zcount * sizeof(int));
+        index->mark_serial = 1;
+    }
+
+    *count = 0;
+
+    for (a = 0; a < num_areas; a++) {
+        area = areas + a;
+
+        /* Skip areas that are outside the grid */
+        if (area->x > index->dim.x + index->dim.width ||
+            area->y > index->dim.y + index->dim.height ||
+            area->x + area->width < index->dim.x ||
+            area->y + area->height < index->dim.y) {
+            continue;
+        }
+
+        get_index_cells(index, area, &col0, &col1, &row0, &row1);
+        for (row = row0; row <= row1; row++) {
+            for (col = col0; col <= col1; col++) {
+                cell = row * index->cols + col;
+                num_cells++;
+
+                for (n = index->cell_start[cell];
+                     n < index->cell_start[cell + 1];
+                     n++) {
+                    i = index->nodes[n];
+                    dim = index->node_dim + i;
+
+                    if (index->mark[i] == index->mark_serial) continue;
+
+                    if (dim->x > area->x + area->width ||
+                        dim->y > area->y + area->height ||
+                        dim->x + dim->width < area->x ||
+                        dim->y + dim->height < area->y) {
+                        continue;
+                    }
+
+                    index->mark[i] = index->mark_serial;
+                    index->found[(*count)++] = i;
+                }
+            }
+        }
+    }
+
+    /* Nodes that moved since the grid was built may not be listed in the
+     * cells they are in now (see update_layout_index()).
+     */
+    num_found = *count;
+    for (n = 0; n < index->num_moved; n++) {
+        i = index->moved[n];
+        dim = index->node_dim + i;
+
+        if (index->mark[i] == index->mark_serial) continue;
+
+        for (a = 0; a < num_areas; a++) {
+            area = areas + a;
+
+            if (dim->x > area->x + area->width ||
+                dim->y > area->y + area->height ||
+                dim->x + dim->width < area->x ||
+                dim->y + dim->height < area->y) {
+                continue;
+            }
+
+            index->mark[i] = index->mark_serial;
+            index->found[(*count)++] = i;
+            break;
+        }
+    }
+
+    /* Each cell lists its nodes in Z-order, so only results gathered
+     * from several cells (or from the moved nodes) need sorting.
+     */
+    if (num_cells > 1 || *count > num_found) {
+        qsort(index->found, *count, sizeof(int), compare_znode_indices);
+    }
+
+    return index->found;
+
+} /* find_znodes() */
+
+
+
+/** find_znodes_at() *************************************************
+ *
+ * Looks up the Z-order nodes whose bounding box contains the given
+ * point (see find_znodes()).
+ *
+ **/
+
+static int *find_znodes_at(CtkDisplayLayout *ctk_object, int x, int y,
+                           int *count)
+{
+    GdkRectangle area;
+
+    area.x = x;
+    area.y = y;
+    area.width = 0;
+    area.height = 0;
+
+    return find_znodes(ctk_object, &area, 1, count);
+
+} /* find_znodes_at() */
+
+
+
+/** find_snap_znodes() ***********************************************
+ *
+ * Looks up the Z-order nodes that the modify info's source dimensions
+ * (src_dim) could snap to (see find_znodes()).  Snapping only happens
+ * within the snap strength, so a node can only be snapped to
+ * vertically if it overlaps the band of rows around the source, and
+ * horizontally if it overlaps the band of columns around it.
+ *
+ **/
+
+static int *find_snap_znodes(CtkDisplayLayout *ctk_object, int *count)
+{
+    GdkRectangle *src = &(ctk_object->modify_info.src_dim);
+    int strength = ctk_object->snap_strength + 1;
+    GdkRectangle bands[2];
+
+    /* Rows the source spans */
+    bands[0].x = -2 * MAX_LAYOUT_WIDTH;
+    bands[0].width = 4 * MAX_LAYOUT_WIDTH;
+    bands[0].y = src->y - strength;
+    bands[0].height = src->height + 2 * strength;
+
+    /* Columns the source spans */
+    bands[1].x = src->x - strength;
+    bands[1].width = src->width + 2 * strength;
+    bands[1].y = -2 * MAX_LAYOUT_HEIGHT;
+    bands[1].height = 4 * MAX_LAYOUT_HEIGHT;
+
+    return find_znodes(ctk_object, bands, 2, count);
+
+} /* find_snap_znodes() */
+
+
+
 /** get_point_relative_position() ************************************
  *
  * Returns where the point (x, y) is, relative to the given rectangle
@@ -1377,17 +1815,21 @@ static void snap_move(CtkDisplayLayout *ctk_object)
     ModifyInfo *info = &(ctk_object->modify_info);
     int *bv;
     int *bh;
-    int i;
+    int i, j;
     int dist;
     nvLayoutPtr layout = ctk_object->layout;
     nvScreenPtr screen;
     nvDisplayPtr other;
     GdkRectangle *screen_rect;
+    int *nodes;
+    int count;
 
 
     /* Snap to other display's modes */
     if (info->display) {
-        for (i = 0; i < ctk_object->Zcount; i++) {
+        nodes = find_snap_znodes(ctk_object, &count);
+        for (j = 0; j < count; j++) {
+            i = nodes ? nodes[j] : j;
 
             if (ctk_object->Zorder[i].type != ZNODE_TYPE_DISPLAY) continue;
 
@@ -1565,12 +2007,14 @@ static void snap_pan(CtkDisplayLayout *ctk_object)
     ModifyInfo *info = &(ctk_object->modify_info);
     int *bv;
     int *bh;
-    int i;
+    int i, j;
     int dist;
     nvLayoutPtr layout = ctk_object->layout;
     nvScreenPtr screen;
     nvDisplayPtr other;
     GdkRectangle *screen_rect;
+    int *nodes;
+    int count;
 
 
     if (info->display) {
@@ -1610,7 +2054,9 @@ static void snap_pan(CtkDisplayLayout *ctk_object)
 
 
     /* Snap to other display's modes */
-    for (i = 0; i < ctk_object->Zcount; i++) {
+    nodes = find_snap_znodes(ctk_object, &count);
+    for (j = 0; j < count; j++) {
+        i = nodes ? nodes[j] : j;
 
         if (ctk_object->Zorder[i].type != ZNODE_TYPE_DISPLAY) continue;
 
@@ -2186,6 +2632,8 @@ static void select_screen(CtkDisplayLayout *ctk_object, nvScreenPtr screen)
 
     free(tmpzo);
 
+    ctk_object->layout_index.valid = FALSE;
+
  done:
     ctk_object->selected_screen = screen;
 
@@ -2226,6 +2674,8 @@ static void select_display(CtkDisplayLayout *ctk_object, nvDisplayPtr display)
                 /* Place the display at the top */
                 ctk_object->Zorder[0].type = ZNODE_TYPE_DISPLAY;
                 ctk_object->Zorder[0].u.display = display;
+
+                ctk_object->layout_index.valid = FALSE;
             }
             break;
         }
@@ -2432,10 +2882,12 @@ static char *get_tooltip_under_mouse(CtkDisplayLayout *ctk_object,
 {
     static nvDisplayPtr last_display = NULL;
     static nvScreenPtr  last_screen = NULL;
-    int i;
+    int i, j;
     nvDisplayPtr display = NULL;
     nvScreenPtr screen = NULL;
     char *tip = NULL;
+    int *nodes;
+    int count;
 
 
     /* Scale and offset x & y so they reside in clickable area */
@@ -2444,7 +2896,9 @@ static char *get_tooltip_under_mouse(CtkDisplayLayout *ctk_object,
 
 
     /* Go through the Z-order looking for what we are under */
-    for (i = 0; i < ctk_object->Zcount; i++) {
+    nodes = find_znodes_at(ctk_object, x, y, &count);
+    for (j = 0; j < count; j++) {
+        i = nodes ? nodes[j] : j;
 
         if (ctk_object->Zorder[i].type == ZNODE_TYPE_DISPLAY) {
             display = ctk_object->Zorder[i].u.display;
@@ -2497,7 +2951,9 @@ static char *get_tooltip_under_mouse(CtkDisplayLayout *ctk_object,
 static int click_layout(CtkDisplayLayout *ctk_object,
                         GdkDevice *device, int x, int y)
 {
-    int i;
+    int i, j;
+    int *nodes;
+    int count;
     nvDisplayPtr cur_selected_display = ctk_object->selected_display;
     nvScreenPtr cur_selected_screen = ctk_object->selected_screen;
     nvDisplayPtr display;
@@ -2522,7 +2978,9 @@ static int click_layout(CtkDisplayLayout *ctk_object,
 #endif
 
     /* Look through the Z-order for the next element */
-    for (i = 0; i < ctk_object->Zcount; i++) {
+    nodes = find_znodes_at(ctk_object, x, y, &count);
+    for (j = 0; j < count; j++) {
+        i = nodes ? nodes[j] : j;
         if (ctk_object->Zorder[i].type == ZNODE_TYPE_DISPLAY) {
             display = ctk_object->Zorder[i].u.display;
             if (point_in_display(display, x, y)) {
@@ -3121,9 +3579,247 @@ static void draw_screen(CtkDisplayLayout *ctk_object,
 
 
 
+/** get_selection_zcount() *******************************************
+ *
+ * Returns the number of nodes at the top of the Z-order that make up
+ * the selection: the selected display, or the selected screen along
+ * with its displays.  These are the nodes that get moved around.
+ *
+ **/
+
+static int get_selection_zcount(CtkDisplayLayout *ctk_object)
+{
+    nvScreenPtr screen = ctk_object->selected_screen;
+    int count;
+
+    if (ctk_object->selected_display) {
+        if ((ctk_object->Zcount > 0) &&
+            (ctk_object->Zorder[0].type == ZNODE_TYPE_DISPLAY) &&
+            (ctk_object->Zorder[0].u.display ==
+             ctk_object->selected_display)) {
+            return 1;
+        }
+        return 0;
+    }
+
+    if (screen) {
+        count = screen->num_displays + 1;
+        if ((count <= ctk_object->Zcount) &&
+            (ctk_object->Zorder[count - 1].type == ZNODE_TYPE_SCREEN) &&
+            (ctk_object->Zorder[count - 1].u.screen == screen)) {
+            return count;
+        }
+    }
+
+    return 0;
+
+} /* get_selection_zcount() */
+
+
+
+/** get_selection_area() *********************************************
+ *
+ * Returns the area of the drawing area covered by the top 'count'
+ * nodes of the Z-order and the selection hilite.
+ *
+ **/
+
+static void get_selection_area(CtkDisplayLayout *ctk_object, int count,
+                               GdkRectangle *area)
+{
+    GdkRectangle rects[2];
+    GdkRectangle r;
+    Bool empty = TRUE;
+    int i, j;
+
+    memset(area, 0, sizeof(GdkRectangle));
+
+    for (i = 0; i < count; i++) {
+        get_znode_rects(ctk_object->Zorder + i, rects);
+
+        for (j = 0; j < 2; j++) {
+            r.x = ctk_object->img_dim.x + ctk_object->scale * rects[j].x
+                - LAYOUT_DAMAGE_MARGIN;
+            r.y = ctk_object->img_dim.y + ctk_object->scale * rects[j].y
+                - LAYOUT_DAMAGE_MARGIN;
+            r.width = ctk_object->scale * rects[j].width
+                + 2 * LAYOUT_DAMAGE_MARGIN;
+            r.height = ctk_object->scale * rects[j].height
+                + 2 * LAYOUT_DAMAGE_MARGIN;
+
+            if (empty) {
+                *area = r;
+                empty = FALSE;
+            } else {
+                gdk_rectangle_union(area, &r, area);
+            }
+        }
+    }
+
+} /* get_selection_area() */
+
+
+
+/** static_layer_is_current() ****************************************
+ *
+ * Returns whether the cached image of the static elements still
+ * matches the layout: the same nodes are left out of it, and all the
+ * nodes drawn in it are where they were when it was drawn.
+ *
+ **/
+
+static Bool static_layer_is_current(CtkDisplayLayout *ctk_object)
+{
+    GdkRectangle rects[2];
+    int skip = get_selection_zcount(ctk_object);
+    int i;
+
+    if (!ctk_object->static_valid ||
+        (ctk_object->static_skip != skip) ||
+        (ctk_object->static_scale != ctk_object->scale) ||
+        (ctk_object->num_static_rects != 2 * (ctk_object->Zcount - skip))) {
+        return FALSE;
+    }
+
+    for (i = skip; i < ctk_object->Zcount; i++) {
+        get_znode_rects(ctk_object->Zorder + i, rects);
+        if (memcmp(rects, ctk_object->static_rects + 2 * (i - skip),
+                   sizeof(rects))) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+
+} /* static_layer_is_current() */
+
+
+
+/** draw_znode() *****************************************************
+ *
+ * Draws a display or screen node of the Z-order.
+ *
+ **/
+
+static void draw_znode(CtkDisplayLayout *ctk_object, const ZNode *node)
+{
+    if (node->type == ZNODE_TYPE_DISPLAY) {
+        draw_display(ctk_object, node->u.display);
+    } else if (node->type == ZNODE_TYPE_SCREEN) {
+        draw_screen(ctk_object, node->u.screen);
+    }
+
+} /* draw_znode() */
+
+
+
+/** draw_static_layer() **********************************************
+ *
+ * Draws the background and every node of the Z-order below the
+ * selection into the cached image, and records where those nodes
+ * were.  While the selection is dragged around, only the cached image
+ * needs to be copied and the selection drawn over it.
+ *
+ **/
+
+static void draw_static_layer(CtkDisplayLayout *ctk_object)
+{
+    GtkWidget *drawing_area = ctk_object->drawing_area;
+    GdkWindow *window = ctk_widget_get_window(drawing_area);
+    GtkAllocation allocation;
+    GdkRectangle *rects;
+    int skip = get_selection_zcount(ctk_object);
+    int num_rects = 2 * (ctk_object->Zcount - skip);
+    int i;
+#ifdef CTK_GTK3
+    cairo_t *saved_context = ctk_object->c_context;
+#else
+    GdkPixmap *saved_pixmap = ctk_object->pixmap;
+#endif
+
+    ctk_widget_get_allocation(drawing_area, &allocation);
+
+#ifdef CTK_GTK3
+    if (!ctk_object->static_surface) {
+        ctk_object->static_surface =
+            gdk_window_create_similar_surface(window, CAIRO_CONTENT_COLOR,
+                                              allocation.width,
+                                              allocation.height);
+    }
+    ctk_object->c_context = cairo_create(ctk_object->static_surface);
+#else
+    if (!ctk_object->static_pixmap) {
+        ctk_object->static_pixmap =
+            gdk_pixmap_new(window, allocation.width, allocation.height, -1);
+    }
+    ctk_object->pixmap = ctk_object->static_pixmap;
+#endif
+
+    clear_layout(ctk_object);
+
+    for (i = ctk_object->Zcount - 1; i >= skip; i--) {
+        draw_znode(ctk_object, ctk_object->Zorder + i);
+    }
+
+#ifdef CTK_GTK3
+    cairo_destroy(ctk_object->c_context);
+    ctk_object->c_context = saved_context;
+#else
+    ctk_object->pixmap = saved_pixmap;
+#endif
+
+    /* Remember what the image shows */
+    rects = realloc(ctk_object->static_rects,
+                    (num_rects ? num_rects : 1) * sizeof(GdkRectangle));
+    if (!rects) {
+        ctk_object->static_valid = FALSE;
+        return;
+    }
+    ctk_object->static_rects = rects;
+    ctk_object->num_static_rects = num_rects;
+
+    for (i = skip; i < ctk_object->Zcount; i++) {
+        get_znode_rects(ctk_object->Zorder + i, rects + 2 * (i - skip));
+    }
+
+    ctk_object->static_skip = skip;
+    ctk_object->static_scale = ctk_object->scale;
+    ctk_object->static_valid = TRUE;
+
+} /* draw_static_layer() */
+
+
+
+/** queue_selection_redraw() *****************************************
+ *
+ * Queues an expose event for the area the selection covered before it
+ * was moved ('old_area') and the area it covers now.
+ *
+ **/
+
+static void queue_selection_redraw(CtkDisplayLayout *ctk_object,
+                                   const GdkRectangle *old_area)
+{
+    GdkWindow *window = ctk_widget_get_window(ctk_object->drawing_area);
+    GdkRectangle area;
+
+    if (!window) {
+        return;
+    }
+
+    get_selection_area(ctk_object, ctk_object->static_skip, &area);
+    gdk_rectangle_union(&area, old_area, &area);
+
+    gdk_window_invalidate_rect(window, &area, TRUE);
+
+} /* queue_selection_redraw() */
+
+
+
 /** draw_layout() ****************************************************
  *
- * Draws a layout.
+ * Draws a layout: the cached image of the static elements, redrawn
+ * first if it is out of date, then the selection on top.
  *
  **/
 
@@ -3144,13 +3840,29 @@ static void draw_layout(CtkDisplayLayout *ctk_object)
     gdk_color_parse("#888888", &bg_color);
     gdk_color_parse("#777777", &bd_color);
 
-    /* Draw the Z-order back to front */
-    for (i = ctk_object->Zcount - 1; i >= 0; i--) {
-        if (ctk_object->Zorder[i].type == ZNODE_TYPE_DISPLAY) {
-            draw_display(ctk_object, ctk_object->Zorder[i].u.display);
-        } else if (ctk_object->Zorder[i].type == ZNODE_TYPE_SCREEN) {
-            draw_screen(ctk_object, ctk_object->Zorder[i].u.screen);
-        }
+    /* Draw the static elements from the cached image */
+    if (!static_layer_is_current(ctk_object)) {
+        draw_static_layer(ctk_object);
+    }
+
+    if (ctk_object->static_valid) {
+#ifdef CTK_GTK3
+        cairo_set_source_surface(fg_gc, ctk_object->static_surface, 0, 0);
+        cairo_paint(fg_gc);
+#else
+        gdk_draw_drawable(ctk_object->pixmap, fg_gc,
+                          ctk_object->static_pixmap,
+                          0, 0, 0, 0, -1, -1);
+#endif
+        i = ctk_object->static_skip - 1;
+    } else {
+        clear_layout(ctk_object);
+        i = ctk_object->Zcount - 1;
+    }
+
+    /* Draw the rest of the Z-order back to front */
+    for (; i >= 0; i--) {
+        draw_znode(ctk_object, ctk_object->Zorder + i);
     }
 
     /* Hilite the selected item */
@@ -3391,6 +4103,9 @@ static Bool sync_layout(CtkDisplayLayout *ctk_object)
         modified = TRUE;
     }
 
+    /* Things may have moved, look them up where they are now */
+    update_layout_index(ctk_object);
+
     if (sync_scaling(ctk_object)) {
         modified = TRUE;
     }
@@ -4005,6 +4720,207 @@ void ctk_display_layout_set_display_position(CtkDisplayLayout *ctk_object,
 
 
 
+/** ctk_display_layout_set_screen_grid() *****************************
+ *
+ * Arranges the display devices of the screen in the given grid, in
+ * every metamode of the screen.  In each metamode, the display devices
+ * are all set to the modeline the reference display device uses in
+ * that metamode, or to the grid's modeline if it has one (or to their
+ * closest match), and the size of the grid's cells is that of the
+ * modeline.  Metamodes in which the reference display device is off
+ * are left as they are.
+ *
+ * Display devices are placed in the order they appear in the layout
+ * (left to right, then top to bottom), starting at the top left
+ * corner of the screen.  Display devices beyond the size of the grid
+ * are left as they are.
+ *
+ * The whole grid is placed before the layout is recalculated, so this
+ * is much faster than moving each display device in turn.
+ *
+ * Returns FALSE (without modifying the layout) if some display device
+ * in the grid does not support one of the modelines' resolutions.
+ *
+ **/
+
+static int compare_display_positions(const void *a, const void *b)
+{
+    const nvMode *mode1 = (*(const nvDisplayPtr *)a)->cur_mode;
+    const nvMode *mode2 = (*(const nvDisplayPtr *)b)->cur_mode;
+
+    if (mode1->pan.y != mode2->pan.y) {
+        return mode1->pan.y - mode2->pan.y;
+    }
+    return mode1->pan.x - mode2->pan.x;
+}
+
+Bool ctk_display_layout_set_screen_grid(CtkDisplayLayout *ctk_object,
+                                        nvScreenPtr screen,
+                                        const nvGrid *grid,
+                                        nvDisplayPtr ref_display)
+{
+    nvDisplayPtr display;
+    nvDisplayPtr other;
+    nvDisplayPtr *displays;
+    nvModePtr *modes;
+    nvModeLinePtr *ref_modelines;
+    nvModeLinePtr *modelines;
+    nvModeLinePtr modeline;
+    nvModePtr mode;
+    nvGrid metamode_grid;
+    GdkRectangle *screen_rect;
+    int num_displays = 0;
+    int num_metamodes;
+    int i, j, m, x, y;
+    Bool ret = FALSE;
+
+
+    if (!screen || !grid || !ref_display ||
+        grid->rows < 1 || grid->columns < 1) {
+        return FALSE;
+    }
+
+    num_metamodes = screen->num_metamodes;
+
+    displays = calloc(screen->num_displays + 1, sizeof(nvDisplayPtr));
+    modes = calloc(screen->num_displays + 1, sizeof(nvModePtr));
+    ref_modelines = calloc(num_metamodes + 1, sizeof(nvModeLinePtr));
+    modelines = calloc(num_metamodes * screen->num_displays + 1,
+                       sizeof(nvModeLinePtr));
+    if (!displays || !modes || !ref_modelines || !modelines) {
+        goto done;
+    }
+
+    /* Gather the display devices to place, in reading order */
+    for (display = screen->displays;
+         display;
+         display = display->next_in_screen) {
+        if (display->cur_mode) {
+            displays[num_displays++] = display;
+        }
+    }
+    qsort(displays, num_displays, sizeof(nvDisplayPtr),
+          compare_display_positions);
+
+    num_displays = NV_MIN(num_displays, grid->rows * grid->columns);
+
+    /* Find the modeline of each display device in each metamode, making
+     * sure every display device can drive it before modifying anything.
+     */
+    for (i = 0; i < num_displays; i++) {
+        display_load_modelines(displays[i]);
+    }
+
+    for (mode = ref_display->modes, m = 0;
+         mode && (m < num_metamodes);
+         mode = mode->next, m++) {
+
+        if (!mode->modeline) continue;
+
+        ref_modelines[m] = grid->modeline ? grid->modeline : mode->modeline;
+
+        for (i = 0; i < num_displays; i++) {
+            modeline = display_find_closest_modeline(displays[i],
+                                                     ref_modelines[m]);
+            if (!modeline) {
+                goto done;
+            }
+            modelines[m * num_displays + i] = modeline;
+        }
+    }
+
+    /* Make sure nothing is positioned relative to the display devices
+     * of the grid (to avoid relationship loops).
+     */
+    for (other = screen->displays; other; other = other->next_in_screen) {
+        for (mode = other->modes; mode; mode = mode->next) {
+            for (j = 0; j < num_displays; j++) {
+                if (mode->relative_to == displays[j]) {
+                    mode->position_type = CONF_ADJ_ABSOLUTE;
+                    mode->relative_to = NULL;
+                    break;
+                }
+            }
+        }
+    }
+
+    /* Place the grid in each metamode */
+    screen_rect = get_screen_rect(screen, 0);
+    x = screen_rect->x;
+    y = screen_rect->y;
+
+    for (i = 0; i < num_displays; i++) {
+        modes[i] = displays[i]->modes;
+    }
+
+    for (m = 0; m < num_metamodes; m++) {
+
+        if (ref_modelines[m]) {
+            metamode_grid = *grid;
+            metamode_grid.display_width = ref_modelines[m]->data.hdisplay;
+            metamode_grid.display_height = ref_modelines[m]->data.vdisplay;
+            metamode_grid.h_overlap =
+                NV_MIN(grid->h_overlap, metamode_grid.display_width - 1);
+            metamode_grid.v_overlap =
+                NV_MIN(grid->v_overlap, metamode_grid.display_height - 1);
+        }
+
+        for (i = 0; i < num_displays; i++) {
+            mode = modes[i];
+            if (!mode) continue;
+            modes[i] = mode->next;
+
+            modeline = modelines[m * num_displays + i];
+            if (!modeline) continue;
+
+            /* In advanced mode, changing the resolution a display uses
+             * for a particular metamode should make this metamode
+             * non-implicit.
+             */
+            if (ctk_object->advanced_mode &&
+                (mode->modeline != modeline) &&
+                mode->metamode) {
+                mode->metamode->source = METAMODE_SOURCE_NVCONTROL;
+            }
+
+            mode_set_modeline(mode, modeline, NULL, NULL);
+
+            mode->position_type = CONF_ADJ_ABSOLUTE;
+            mode->relative_to = NULL;
+            grid_get_display_position(&metamode_grid,
+                                      i / grid->columns, i % grid->columns,
+                                      &(mode->pan.x), &(mode->pan.y));
+            mode->pan.x += x;
+            mode->pan.y += y;
+        }
+    }
+
+    ret = TRUE;
+
+ done:
+    free(displays);
+    free(modes);
+    free(ref_modelines);
+    free(modelines);
+
+    if (!ret) {
+        return FALSE;
+    }
+
+    /* Recalculate the layout once everything is in place */
+    ctk_display_layout_update(ctk_object);
+
+    if (ctk_object->modified_callback) {
+        ctk_object->modified_callback(ctk_object->layout,
+                                      ctk_object->modified_callback_data);
+    }
+
+    return TRUE;
+
+} /* ctk_display_layout_set_screen_grid() */
+
+
+
 /** ctk_display_layout_set_display_panning() *************************
  *
  * Sets the panning domain of the display.
@@ -4417,7 +5333,6 @@ draw_event_callback(GtkWidget *widget, cairo_t *cr, gpointer data)
     CtkDisplayLayout *ctk_object = CTK_DISPLAY_LAYOUT(data);
 
     ctk_object->c_context = cr;
-    clear_layout(ctk_object);
     draw_layout(ctk_object);
     ctk_object->c_context = NULL;
 
@@ -4449,8 +5364,6 @@ expose_event_callback(GtkWidget *widget, GdkEventExpose *event, gpointer data)
 
     gdk_gc_get_values(fg_gc, &old_gc_values);
 
-    clear_layout(ctk_object);
-
     draw_layout(ctk_object);
 
     gdk_gc_set_values(fg_gc, &old_gc_values, GDK_GC_FOREGROUND);
@@ -4497,6 +5410,20 @@ configure_event_callback(GtkWidget *widget, GdkEventConfigure *event,
 
     sync_scaling(ctk_object);
 
+    /* The cached image of the static elements has the old size */
+#ifdef CTK_GTK3
+    if (ctk_object->static_surface) {
+        cairo_surface_destroy(ctk_object->static_surface);
+        ctk_object->static_surface = NULL;
+    }
+#else
+    if (ctk_object->static_pixmap) {
+        g_object_unref(ctk_object->static_pixmap);
+        ctk_object->static_pixmap = NULL;
+    }
+#endif
+    ctk_object->static_valid = FALSE;
+
 #ifndef CTK_GTK3
     ctk_object->pixmap = gdk_pixmap_new(widget->window, width, height, -1);
 #endif
@@ -4564,6 +5491,10 @@ motion_event_callback(GtkWidget *widget, GdkEventMotion *event, gpointer data)
             (x - ctk_object->last_mouse_x) / ctk_object->scale;
         int delta_y =
             (y - ctk_object->last_mouse_y) / ctk_object->scale;
+        GdkRectangle old_area;
+
+        get_selection_area(ctk_object, get_selection_zcount(ctk_object),
+                           &old_area);
 
         if (!modify_panning) {
             modified = move_selected(ctk_object, delta_x, delta_y, 1);
@@ -4579,8 +5510,17 @@ motion_event_callback(GtkWidget *widget, GdkEventMotion *event, gpointer data)
                                               ctk_object->modified_callback_data);
             }
 
-            /* Queue and process expose event so we redraw ASAP */
-            queue_layout_redraw(ctk_object);
+            /* Queue and process expose event so we redraw ASAP.  Unless
+             * other elements moved along with the selection, only the
+             * area the selection moved over needs to be redrawn.  Either
+             * way, sync_layout() has already brought the layout index up
+             * to date, so it is kept for the rest of the drag.
+             */
+            if (static_layer_is_current(ctk_object)) {
+                queue_selection_redraw(ctk_object, &old_area);
+            } else {
+                queue_full_redraw(ctk_object);
+            }
             gdk_window_process_updates(ctk_widget_get_window(drawing_area), TRUE);
         }
 
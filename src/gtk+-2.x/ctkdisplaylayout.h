@@ -159,10 +159,44 @@ typedef struct nvModeLineRec {
     unsigned int source;
     char *xconfig_name;
 
+    /* Modepool bookkeeping (see modepool_add_modeline()) */
+    struct nvModePoolRec *pool;     /* Pool the modeline lives in */
+    struct nvModeLineRec *hash_next;
+    struct nvModeLineRec *name_next;
+    unsigned int hash;              /* Hash of the timings */
+    unsigned int name_hash;         /* Hash of the identifier */
+    int seq;                        /* Position in the modeline list */
+
 } nvModeLine, *nvModeLinePtr;
 
 
 
+/* Modepool (Arena holding a display's modelines and their strings, with
+ * indices for looking modelines up by timings, by name and by size)
+ */
+typedef struct nvModePoolChunkRec {
+    struct nvModePoolChunkRec *next;
+    size_t used;
+    size_t size;
+} nvModePoolChunk, *nvModePoolChunkPtr;
+
+typedef struct nvModePoolRec {
+    nvModePoolChunkPtr chunks;
+
+    nvModeLinePtr *timing_buckets;  /* Chained through hash_next */
+    nvModeLinePtr *name_buckets;    /* Chained through name_next */
+    unsigned int num_buckets;
+    int num_modelines;              /* # modelines in the indices */
+    int next_seq;
+
+    nvModeLinePtr *sorted;          /* By (width, height, refresh, seq) */
+    int num_sorted;
+    Bool sorted_valid;
+
+} nvModePool, *nvModePoolPtr;
+
+
+
 typedef struct nvSelectedModeRec {
     struct nvSelectedModeRec *next;
 
@@ -243,6 +277,9 @@ typedef struct nvDisplayRec {
 
     nvModeLinePtr       modelines;      /* Modelines validated by X */
     int                 num_modelines;
+    nvModePool          modepool;       /* Storage/indices for modelines */
+    Bool                modelines_pending; /* Only the current modeline has
+                                            * been queried so far */
 
     nvSelectedModePtr   selected_modes; /* List of modes to show in the dropdown menu */
     int                 num_selected_modes;
@@ -339,6 +376,9 @@ typedef struct nvScreenRec {
     Bool no_scanout;        /* This screen has no display devices */
     Bool stereo_supported;  /* Can stereo be configured on this screen */
 
+    /* Changes to make to the running X server's metamodes on apply */
+    struct nvApplyPlanRec *apply_plan;
+
 } nvScreen, *nvScreenPtr;
 
 
@@ -413,6 +453,25 @@ typedef struct nvLayoutRec {
 
 
 
+/* Grid of identical display devices (e.g. a video wall) */
+typedef struct nvGridRec {
+    int rows;
+    int columns;
+
+    int display_width;  /* Size of each display in the grid */
+    int display_height;
+
+    nvModeLinePtr modeline; /* Modeline of the reference display to use in
+                             * every metamode, or NULL to use the one it
+                             * has in each metamode */
+
+    int h_overlap;      /* Overlap between neighboring displays.  Negative */
+    int v_overlap;      /* values leave a gap (e.g. to account for bezels) */
+
+} nvGrid, *nvGridPtr;
+
+
+
 typedef void (* ctk_display_layout_selected_callback) (nvLayoutPtr, void *);
 typedef void (* ctk_display_layout_modified_callback) (nvLayoutPtr, void *);
 
@@ -467,6 +526,30 @@ typedef struct _ZNode
 } ZNode;
 
 
+/* Uniform grid of the Z-order nodes' bounding boxes, used to find the
+ * nodes near a point or area without going through the whole Z-order.
+ */
+typedef struct _LayoutIndex
+{
+    Bool          valid;        /* Matches the Z-order and layout */
+    GdkRectangle  dim;          /* Area covered by the grid */
+    int           cell_width;
+    int           cell_height;
+    int           cols;
+    int           rows;
+    int          *cell_start;   /* Where each cell's nodes start in 'nodes' */
+    int          *nodes;        /* Z-order indices of the nodes in each cell */
+    GdkRectangle *node_dim;     /* Bounding box of each Z-order node */
+    int          *found;        /* Results of the last lookup */
+    int          *mark;         /* Per Z-order node, to skip duplicates */
+    int           mark_serial;
+    int          *moved;        /* Nodes that moved since the grid was built */
+    int           num_moved;
+    Bool         *is_moved;     /* Per Z-order node, listed in 'moved' */
+
+} LayoutIndex;
+
+
 typedef struct _CtkDisplayLayout
 {
     GtkVBox parent;
@@ -489,6 +572,18 @@ typedef struct _CtkDisplayLayout
     GdkPixmap *pixmap;
 #endif
 
+    /* Cached image of the elements not being moved (see draw_layout()) */
+#ifdef CTK_GTK3
+    cairo_surface_t *static_surface;
+#else
+    GdkPixmap *static_pixmap;
+#endif
+    Bool          static_valid;     /* Cached image is up to date */
+    int           static_skip;      /* Top Z-order nodes left out of it */
+    float         static_scale;     /* Scale it was drawn at */
+    GdkRectangle *static_rects;     /* Geometry of the nodes drawn in it */
+    int           num_static_rects;
+
     /* Image information */
     GdkRectangle img_dim;
     float scale;
@@ -506,6 +601,7 @@ typedef struct _CtkDisplayLayout
     /* List of visible elements in the layout */
     ZNode *Zorder; /* Z ordering of visible elements in layout */
     int    Zcount; /* Count of visible elements in the z order */
+    LayoutIndex layout_index; /* Where Z-order elements are in the layout */
 
     nvDisplayPtr  selected_display; /* Currently selected display */
     nvScreenPtr   selected_screen;  /* Selected screen */
@@ -581,6 +677,10 @@ void ctk_display_layout_set_display_position (CtkDisplayLayout *ctk_object,
                                               int position_type,
                                               nvDisplayPtr relative_to,
                                               int x, int y);
+Bool ctk_display_layout_set_screen_grid (CtkDisplayLayout *ctk_object,
+                                         nvScreenPtr screen,
+                                         const nvGrid *grid,
+                                         nvDisplayPtr ref_display);
 void ctk_display_layout_set_display_panning (CtkDisplayLayout *ctk_object,
                                              nvDisplayPtr display,
                                              int width, int height);
@@ -50,11 +50,12 @@ static void save_xconfig_button_clicked(GtkWidget *widget, gpointer user_data);
 static void add_slimm_options(XConfigPtr xconf, gchar *metamode_str);
 static void remove_slimm_options(XConfigPtr xconf);
 static nvDisplayPtr find_active_display(nvLayoutPtr layout);
+static void ctk_slimm_class_init(CtkSLIMMClass *ctk_slimm_class);
+static void ctk_slimm_finalize(GObject *object);
+
+static GObjectClass *parent_class = NULL;
 static nvDisplayPtr intersect_modelines(nvLayoutPtr layout);
 static void remove_duplicate_modelines(nvDisplayPtr display);
-static Bool other_displays_have_modeline(nvLayoutPtr layout, 
-                                         nvDisplayPtr display,
-                                         nvModeLinePtr modeline);
 
 
 typedef struct GridConfigRec {
@@ -131,7 +132,7 @@ GType ctk_slimm_get_type()
             sizeof (CtkSLIMMClass),
             NULL, /* base_init */
             NULL, /* base_finalize */
-            NULL, /* class_init */
+            (GClassInitFunc) ctk_slimm_class_init,
             NULL, /* class_finalize */
             NULL, /* class_data */
             sizeof (CtkSLIMM),
@@ -148,6 +149,26 @@ GType ctk_slimm_get_type()
     return ctk_slimm_type;
 }
 
+static void ctk_slimm_class_init(CtkSLIMMClass *ctk_slimm_class)
+{
+    GObjectClass *gobject_class = G_OBJECT_CLASS(ctk_slimm_class);
+
+    parent_class = (GObjectClass *)g_type_class_peek_parent(ctk_slimm_class);
+    gobject_class->finalize = ctk_slimm_finalize;
+}
+
+static void ctk_slimm_finalize(GObject *object)
+{
+    CtkSLIMM *ctk_slimm = CTK_SLIMM(object);
+
+    /* The modelines taken from the layout are ours to free */
+    modepool_free_modelines(ctk_slimm->modelines, &ctk_slimm->modepool);
+    ctk_slimm->modelines = NULL;
+    ctk_slimm->cur_modeline = NULL;
+
+    parent_class->finalize(object);
+}
+
 static void remove_slimm_options(XConfigPtr xconf)
 {
     /* Remove SLI Mosaic Option */
@@ -178,6 +199,41 @@ static GridConfig *get_ith_valid_grid_config(int idx)
 
 
 
+/* get_current_grid()
+ * Fills 'grid' with the display grid currently configured: the
+ * selected grid configuration, edge overlaps and resolution.
+ */
+
+static Bool get_current_grid(CtkSLIMM *ctk_object, nvGrid *grid)
+{
+    CtkDropDownMenu *menu = CTK_DROP_DOWN_MENU(ctk_object->mnu_display_config);
+    GridConfig *grid_config;
+
+    if (!ctk_object->cur_modeline) {
+        return FALSE;
+    }
+
+    /* Get grid configuration values from index */
+    grid_config =
+        get_ith_valid_grid_config(ctk_drop_down_menu_get_current_value(menu));
+    if (grid_config) {
+        grid->columns = grid_config->columns;
+        grid->rows = grid_config->rows;
+    } else {
+        grid->columns = grid->rows = 0;
+    }
+
+    grid->display_width = ctk_object->cur_modeline->data.hdisplay;
+    grid->display_height = ctk_object->cur_modeline->data.vdisplay;
+
+    grid->h_overlap = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(ctk_object->spbtn_hedge_overlap));
+    grid->v_overlap = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(ctk_object->spbtn_vedge_overlap));
+
+    return TRUE;
+} /* get_current_grid() */
+
+
+
 static void add_slimm_options(XConfigPtr xconf, gchar *metamode_str)
 {
     XConfigAdjacencyPtr adj;
@@ -223,17 +279,10 @@ static XConfigPtr xconfig_generate(XConfigPtr xconfCur,
                                    void *callback_data)
 {
     CtkSLIMM *ctk_object = (CtkSLIMM *)callback_data;
-    CtkDropDownMenu *menu = CTK_DROP_DOWN_MENU(ctk_object->mnu_display_config);
 
-    gint idx;
-
-    gint xctr,yctr;
-
-    gint x_displays,y_displays;
-    gint h_overlap, v_overlap;
+    nvGrid grid;
 
     gchar *metamode_str = NULL;
-    gchar *tmpstr;
 
     gint checkbox_state = 
         gtk_toggle_button_get_active(GTK_TOGGLE_BUTTON(ctk_object->cbtn_slimm_enable));
@@ -247,41 +296,15 @@ static XConfigPtr xconfig_generate(XConfigPtr xconfCur,
 
 
     if (checkbox_state) {
-        GridConfig *grid_config;
         /* SLI MM needs to be enabled */
-        idx = ctk_drop_down_menu_get_current_value(menu);
-
-        /* Get grid configuration values from index */
-
-        grid_config = get_ith_valid_grid_config(idx);
-        if (grid_config) {
-            x_displays = grid_config->columns;
-            y_displays = grid_config->rows;
-        } else {
-            x_displays = y_displays = 0;
-        }
-
-        h_overlap = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(ctk_object->spbtn_hedge_overlap));
-        v_overlap = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(ctk_object->spbtn_vedge_overlap));
-
-        for (yctr = 0; yctr < y_displays;yctr++) {
-            for (xctr = 0; xctr < x_displays;xctr++) {
-                tmpstr = g_strdup_printf("%s +%d+%d",
-                                         ctk_object->cur_modeline->data.identifier,
-                                         ctk_object->cur_modeline->data.hdisplay * xctr - 
-                                         h_overlap * xctr,
-                                         ctk_object->cur_modeline->data.vdisplay * yctr - 
-                                         v_overlap * yctr);
-                if (metamode_str) {
-                    metamode_str = g_strconcat(metamode_str, ", ", tmpstr, NULL);
-                    g_free(tmpstr);
-                } else {
-                    metamode_str = tmpstr;
-                }
-            }
+        if (get_current_grid(ctk_object, &grid)) {
+            metamode_str =
+                grid_get_metamode_str(&grid,
+                                      ctk_object->cur_modeline->data.identifier);
         }
 
         add_slimm_options(xconfCur, metamode_str);
+        g_free(metamode_str);
     } else {
         /* SLI MM needs to be disabled */
 
@@ -324,38 +347,14 @@ static void set_overlap_controls_status(CtkSLIMM *ctk_object)
 static Bool compute_screen_size(CtkSLIMM *ctk_object, gint *width,
                                 gint *height)
 {
-    gint config_idx;
-    GridConfig *grid_config;
-    gint x_displays,y_displays;
-    gint h_overlap, v_overlap;
-
-    CtkDropDownMenu *menu;
-
+    nvGrid grid;
 
-    if (!ctk_object->cur_modeline) {
+    if (!get_current_grid(ctk_object, &grid)) {
         return FALSE;
     }
 
-    menu = CTK_DROP_DOWN_MENU(ctk_object->mnu_display_config);
-    config_idx = ctk_drop_down_menu_get_current_value(menu);
-
-    /* Get grid configuration values from index */
-    grid_config = get_ith_valid_grid_config(config_idx);
-    if (grid_config) {
-        x_displays = grid_config->columns;
-        y_displays = grid_config->rows;
-    } else {
-        x_displays = y_displays = 0;
-    }
-
-    h_overlap = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(ctk_object->spbtn_hedge_overlap));
-    v_overlap = gtk_spin_button_get_value_as_int(GTK_SPIN_BUTTON(ctk_object->spbtn_vedge_overlap));
-
     /* Total X Screen Size Calculation */
-    *width = x_displays * ctk_object->cur_modeline->data.hdisplay - 
-        (x_displays - 1) * h_overlap;
-    *height = y_displays * ctk_object->cur_modeline->data.vdisplay - 
-        (y_displays - 1) * v_overlap;
+    grid_get_size(&grid, width, height);
 
     return TRUE;
 }
@@ -1135,7 +1134,7 @@ static Bool parse_slimm_layout(CtkSLIMM *ctk_slimm,
 
 static void remove_duplicate_modelines(nvDisplayPtr display)
 {
-    nvModeLinePtr m, nextm;
+    nvModeLinePtr m, prev, first;
     m = display->modelines;
     if (!m) {
         return;
@@ -1150,70 +1149,100 @@ static void remove_duplicate_modelines(nvDisplayPtr display)
         modeline_free(m);
         display->num_modelines--;
     }
-    
-    /* Remove duplicate modelines in active display - assuming sorted order*/
+
+    /* Remove duplicate modelines in active display, keeping the first of
+     * each.  The modepool looks up the first match of a modeline directly,
+     * so the modelines need not be sorted.
+     */
+    prev = NULL;
     for (m = display->modelines; m;) {
-        nextm = m->next;
-        if (!nextm) break; 
-            
-        if (modelines_match(m, nextm)) {
-            /* nextm is a duplicate - remove it. */
-            m->next = nextm->next;
-            if (nextm == display->cur_mode->modeline) {
-                display->cur_mode->modeline = m;
+        first = display_find_modeline(display, m);
+
+        if (first && first != m) {
+            /* m is a duplicate - remove it. */
+            if (prev) {
+                prev->next = m->next;
+            } else {
+                display->modelines = m->next;
+            }
+            if (m == display->cur_mode->modeline) {
+                display->cur_mode->modeline = first;
             }
-            modeline_free(nextm);
+            modeline_free(m);
             display->num_modelines--;
         }
         else {
-            m = nextm;
+            prev = m;
         }
+        m = prev ? prev->next : display->modelines;
     }
 
 }
 
 
-static Bool other_displays_have_modeline(nvLayoutPtr layout, 
-                                         nvDisplayPtr display,
-                                         nvModeLinePtr modeline)
+static nvDisplayPtr find_active_display(nvLayoutPtr layout)
 {
     nvGpuPtr gpu;
-    nvDisplayPtr d;
+    nvDisplayPtr display;
 
     for (gpu = layout->gpus; gpu; gpu = gpu->next_in_layout) {
-        for (d = gpu->displays; d; d = d->next_on_gpu) {
-            if (display == d) continue;
-            if (d->modelines == NULL) continue;
-            if (!display_has_modeline(d, modeline)) {
-                return FALSE;
-            }
+        for (display = gpu->displays;
+             display;
+             display = display->next_on_gpu) {
+            if (display->modelines) return display;
         }
     }
-
-    return TRUE;
+    return NULL;
 }
 
 
-static nvDisplayPtr find_active_display(nvLayoutPtr layout)
+/*
+ * Returns whether every display of the layout (other than the given
+ * one) that has modelines also has the given modeline.  The displays
+ * to check are taken from 'others' when it could be allocated, and
+ * found by walking the layout otherwise.
+ */
+static Bool modeline_is_common(nvLayoutPtr layout, nvDisplayPtr display,
+                               nvDisplayPtr *others, int num_others,
+                               nvModeLinePtr modeline)
 {
     nvGpuPtr gpu;
-    nvDisplayPtr display;
+    nvDisplayPtr d;
+    int i;
+
+    if (others) {
+        for (i = 0; i < num_others; i++) {
+            if (!display_has_modeline(others[i], modeline)) return FALSE;
+        }
+        return TRUE;
+    }
 
     for (gpu = layout->gpus; gpu; gpu = gpu->next_in_layout) {
-        for (display = gpu->displays;
-             display;
-             display = display->next_on_gpu) {
-            if (display->modelines) return display;
+        for (d = gpu->displays; d; d = d->next_on_gpu) {
+            if (display == d) continue;
+            if (d->modelines == NULL) continue;
+            if (!display_has_modeline(d, modeline)) return FALSE;
         }
     }
-    return NULL;
+    return TRUE;
 }
 
 
 static nvDisplayPtr intersect_modelines(nvLayoutPtr layout)
 {
-    nvDisplayPtr display;
+    nvDisplayPtr display, d;
+    nvDisplayPtr *others;
     nvModeLinePtr m, prev;
+    nvGpuPtr gpu;
+    int num_others = 0;
+
+    /* Intersecting needs the full modepool of every display */
+    for (gpu = layout->gpus; gpu; gpu = gpu->next_in_layout) {
+        for (d = gpu->displays; d; d = d->next_on_gpu) {
+            display_load_modelines(d);
+            num_others++;
+        }
+    }
 
     /** 
      * 
@@ -1225,10 +1254,25 @@ static nvDisplayPtr intersect_modelines(nvLayoutPtr layout)
     display = find_active_display(layout);
     if (display == NULL) return NULL;
 
+    /* Gather the other displays once, so checking a modeline only costs
+     * a modepool lookup per display.  Without memory for that, each
+     * check walks the layout instead.
+     */
+    others = calloc(num_others + 1, sizeof(nvDisplayPtr));
+
+    num_others = 0;
+    for (gpu = layout->gpus; others && gpu; gpu = gpu->next_in_layout) {
+        for (d = gpu->displays; d; d = d->next_on_gpu) {
+            if (display == d) continue;
+            if (d->modelines == NULL) continue;
+            others[num_others++] = d;
+        }
+    }
+
     prev = NULL;
     m = display->modelines;
     while (m) {
-        if (!other_displays_have_modeline(layout, display, m)) {
+        if (!modeline_is_common(layout, display, others, num_others, m)) {
             if (prev) {
                 /* Remove past beginning */
                 prev->next = m->next;
@@ -1254,6 +1298,8 @@ static nvDisplayPtr intersect_modelines(nvLayoutPtr layout)
         }
     }
 
+    free(others);
+
     remove_duplicate_modelines(display);
 
     return display;
@@ -1490,20 +1536,20 @@ GtkWidget* ctk_slimm_new(CtrlTarget *ctrl_target,
 
 
     /* Extract modelines and cur_modeline and free layout structure */
-    ctk_object->modelines = display->modelines;
+    ctk_object->num_modelines = display->num_modelines;
     if (display->cur_mode->modeline) {
         ctk_object->cur_modeline = display->cur_mode->modeline; 
     } else {
-        ctk_object->cur_modeline = ctk_object->modelines;
+        ctk_object->cur_modeline = display->modelines;
     }
-    ctk_object->num_modelines = display->num_modelines;
 
-    /* XXX Since we've hijacked the layout's modelines,
-     *     we can stub out the layout's pointer and free it.
+    /* XXX Since we've hijacked the layout's modelines, along with the
+     *     modepool they live in, we can stub out the layout's pointers
+     *     and free it.
      */
-    display->modelines = NULL;
+    ctk_object->modelines =
+        display_take_modelines(display, &ctk_object->modepool);
     display->cur_mode->modeline = NULL;
-    display->num_modelines = 0;
     layout_free(layout);
     layout = NULL;
 
@@ -76,6 +76,7 @@ struct _CtkSLIMM
     nvModeLinePtr modelines;
     nvModeLinePtr cur_modeline;
     gint num_modelines;
+    nvModePool modepool; /* Storage for the modelines */
 
     int max_screen_width;
     int max_screen_height;
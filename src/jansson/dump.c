@@ -22,11 +22,29 @@
 #define MAX_INTEGER_STR_LENGTH  100
 #define MAX_REAL_STR_LENGTH     100
 
+#define DUMP_BUFFER_SIZE        4096
+
 struct object_key {
     size_t serial;
     const char *key;
+    json_t *value;
 };
 
+/* Output is collected in a fixed-size buffer and handed to the callback
+   in large pieces, instead of one call per token. The key array used to
+   order object members is shared by all objects of a dump: each object
+   uses the part of it above the keys of its enclosing objects. */
+typedef struct {
+    size_t flags;
+    json_dump_callback_t dump;
+    void *data;
+    struct object_key *keys;
+    size_t keys_size;
+    size_t keys_used;
+    size_t length;
+    char buffer[DUMP_BUFFER_SIZE];
+} dumper_t;
+
 static int dump_to_strbuffer(const char *buffer, size_t size, void *data)
 {
     return strbuffer_append_bytes((strbuffer_t *)data, buffer, size);
@@ -40,37 +58,87 @@ static int dump_to_file(const char *buffer, size_t size, void *data)
     return 0;
 }
 
-/* 32 spaces (the maximum indentation size) */
-static const char whitespace[] = "                                ";
+static int dump_flush(dumper_t *dumper)
+{
+    size_t length = dumper->length;
+
+    dumper->length = 0;
+    if(length == 0)
+        return 0;
 
-static int dump_indent(size_t flags, int depth, int space, json_dump_callback_t dump, void *data)
+    return dumper->dump(dumper->buffer, length, dumper->data);
+}
+
+static int dump_bytes(dumper_t *dumper, const char *bytes, size_t size)
 {
+    if(size > DUMP_BUFFER_SIZE - dumper->length)
+    {
+        if(dump_flush(dumper))
+            return -1;
+
+        /* too large to be worth copying */
+        if(size >= DUMP_BUFFER_SIZE)
+            return dumper->dump(bytes, size, dumper->data);
+    }
+
+    memcpy(dumper->buffer + dumper->length, bytes, size);
+    dumper->length += size;
+    return 0;
+}
+
+static int dump_byte(dumper_t *dumper, char byte)
+{
+    if(dumper->length == DUMP_BUFFER_SIZE && dump_flush(dumper))
+        return -1;
+
+    dumper->buffer[dumper->length++] = byte;
+    return 0;
+}
+
+static int dump_indent(dumper_t *dumper, int depth, int space)
+{
+    size_t flags = dumper->flags;
+
     if(JSON_INDENT(flags) > 0)
     {
-        int i, ws_count = JSON_INDENT(flags);
+        size_t count = (size_t)JSON_INDENT(flags) * depth;
 
-        if(dump("\n", 1, data))
+        if(dump_byte(dumper, '\n'))
             return -1;
 
-        for(i = 0; i < depth; i++)
+        /* write the spaces straight into the buffer */
+        while(count > 0)
         {
-            if(dump(whitespace, ws_count, data))
-                return -1;
+            size_t n = DUMP_BUFFER_SIZE - dumper->length;
+
+            if(n == 0)
+            {
+                if(dump_flush(dumper))
+                    return -1;
+                n = DUMP_BUFFER_SIZE;
+            }
+            if(n > count)
+                n = count;
+
+            memset(dumper->buffer + dumper->length, ' ', n);
+            dumper->length += n;
+            count -= n;
         }
     }
     else if(space && !(flags & JSON_COMPACT))
     {
-        return dump(" ", 1, data);
+        return dump_byte(dumper, ' ');
     }
     return 0;
 }
 
-static int dump_string(const char *str, size_t len, json_dump_callback_t dump, void *data, size_t flags)
+static int dump_string(dumper_t *dumper, const char *str, size_t len)
 {
     const char *pos, *end, *lim;
     int32_t codepoint;
+    size_t flags = dumper->flags;
 
-    if(dump("\"", 1, data))
+    if(dump_byte(dumper, '"'))
         return -1;
 
     end = pos = str;
@@ -83,6 +151,14 @@ static int dump_string(const char *str, size_t len, json_dump_callback_t dump, v
 
         while(end < lim)
         {
+            /* plain ASCII needs no decoding */
+            unsigned char c = (unsigned char)*pos;
+            if(c >= 0x20 && c < 0x80 && c != '\\' && c != '"' && c != '/')
+            {
+                end = ++pos;
+                continue;
+            }
+
             end = utf8_iterate(pos, lim - pos, &codepoint);
             if(!end)
                 return -1;
@@ -103,7 +179,7 @@ static int dump_string(const char *str, size_t len, json_dump_callback_t dump, v
         }
 
         if(pos != str) {
-            if(dump(str, pos - str, data))
+            if(dump_bytes(dumper, str, pos - str))
                 return -1;
         }
 
@@ -149,13 +225,13 @@ static int dump_string(const char *str, size_t len, json_dump_callback_t dump, v
             }
         }
 
-        if(dump(text, length, data))
+        if(dump_bytes(dumper, text, length))
             return -1;
 
         str = pos = end;
     }
 
-    return dump("\"", 1, data);
+    return dump_byte(dumper, '"');
 }
 
 static int object_key_compare_keys(const void *key1, const void *key2)
@@ -172,21 +248,49 @@ static int object_key_compare_serials(const void *key1, const void *key2)
     return a < b ? -1 : a == b ? 0 : 1;
 }
 
-static int do_dump(const json_t *json, size_t flags, int depth,
-                   json_dump_callback_t dump, void *data)
+/* Reserve room for size more keys in the shared key array */
+static int dump_reserve_keys(dumper_t *dumper, size_t size)
+{
+    struct object_key *keys;
+    size_t new_size;
+
+    if(size <= dumper->keys_size - dumper->keys_used)
+        return 0;
+
+    new_size = dumper->keys_size ? dumper->keys_size * 2 : 16;
+    while(new_size < dumper->keys_used + size)
+        new_size *= 2;
+
+    keys = jsonp_malloc(new_size * sizeof(struct object_key));
+    if(!keys)
+        return -1;
+
+    if(dumper->keys_used)
+        memcpy(keys, dumper->keys,
+               dumper->keys_used * sizeof(struct object_key));
+    jsonp_free(dumper->keys);
+
+    dumper->keys = keys;
+    dumper->keys_size = new_size;
+    return 0;
+}
+
+static int do_dump(dumper_t *dumper, const json_t *json, int depth)
 {
+    size_t flags = dumper->flags;
+
     if(!json)
         return -1;
 
     switch(json_typeof(json)) {
         case JSON_NULL:
-            return dump("null", 4, data);
+            return dump_bytes(dumper, "null", 4);
 
         case JSON_TRUE:
-            return dump("true", 4, data);
+            return dump_bytes(dumper, "true", 4);
 
         case JSON_FALSE:
-            return dump("false", 5, data);
+            return dump_bytes(dumper, "false", 5);
 
         case JSON_INTEGER:
         {
@@ -199,7 +303,7 @@ static int do_dump(const json_t *json, size_t flags, int depth,
             if(size < 0 || size >= MAX_INTEGER_STR_LENGTH)
                 return -1;
 
-            return dump(buffer, size, data);
+            return dump_bytes(dumper, buffer, size);
         }
 
         case JSON_REAL:
@@ -212,11 +316,11 @@ static int do_dump(const json_t *json, size_t flags, int depth,
             if(size < 0)
                 return -1;
 
-            return dump(buffer, size, data);
+            return dump_bytes(dumper, buffer, size);
         }
 
         case JSON_STRING:
-            return dump_string(json_string_value(json), json_string_length(json), dump, data, flags);
+            return dump_string(dumper, json_string_value(json), json_string_length(json));
 
         case JSON_ARRAY:
         {
@@ -232,35 +336,34 @@ static int do_dump(const json_t *json, size_t flags, int depth,
 
             n = json_array_size(json);
 
-            if(dump("[", 1, data))
+            if(dump_byte(dumper, '['))
                 goto array_error;
             if(n == 0) {
                 array->visited = 0;
-                return dump("]", 1, data);
+                return dump_byte(dumper, ']');
             }
-            if(dump_indent(flags, depth + 1, 0, dump, data))
+            if(dump_indent(dumper, depth + 1, 0))
                 goto array_error;
 
             for(i = 0; i < n; ++i) {
-                if(do_dump(json_array_get(json, i), flags, depth + 1,
-                           dump, data))
+                if(do_dump(dumper, json_array_get(json, i), depth + 1))
                     goto array_error;
 
                 if(i < n - 1)
                 {
-                    if(dump(",", 1, data) ||
-                       dump_indent(flags, depth + 1, 1, dump, data))
+                    if(dump_byte(dumper, ',') ||
+                       dump_indent(dumper, depth + 1, 1))
                         goto array_error;
                 }
                 else
                 {
-                    if(dump_indent(flags, depth, 0, dump, data))
+                    if(dump_indent(dumper, depth, 0))
                         goto array_error;
                 }
             }
 
             array->visited = 0;
-            return dump("]", 1, data);
+            return dump_byte(dumper, ']');
 
         array_error:
             array->visited = 0;
@@ -291,80 +394,78 @@ static int do_dump(const json_t *json, size_t flags, int depth,
 
             iter = json_object_iter((json_t *)json);
 
-            if(dump("{", 1, data))
+            if(dump_byte(dumper, '{'))
                 goto object_error;
             if(!iter) {
                 object->visited = 0;
-                return dump("}", 1, data);
+                return dump_byte(dumper, '}');
             }
-            if(dump_indent(flags, depth + 1, 0, dump, data))
+            if(dump_indent(dumper, depth + 1, 0))
                 goto object_error;
 
             if(flags & JSON_SORT_KEYS || flags & JSON_PRESERVE_ORDER)
             {
                 struct object_key *keys;
-                size_t size, i;
-                int (*cmp_func)(const void *, const void *);
+                size_t size, i, first;
 
                 size = json_object_size(json);
-                keys = jsonp_malloc(size * sizeof(struct object_key));
-                if(!keys)
+                if(dump_reserve_keys(dumper, size))
                     goto object_error;
 
+                first = dumper->keys_used;
+                keys = dumper->keys + first;
+
                 i = 0;
                 while(iter)
                 {
                     keys[i].serial = hashtable_iter_serial(iter);
                     keys[i].key = json_object_iter_key(iter);
+                    keys[i].value = json_object_iter_value(iter);
                     iter = json_object_iter_next((json_t *)json, iter);
                     i++;
                 }
                 assert(i == size);
 
-                if(flags & JSON_SORT_KEYS)
-                    cmp_func = object_key_compare_keys;
-                else
-                    cmp_func = object_key_compare_serials;
+                qsort(keys, size, sizeof(struct object_key),
+                      (flags & JSON_SORT_KEYS) ? object_key_compare_keys
+                                               : object_key_compare_serials);
 
-                qsort(keys, size, sizeof(struct object_key), cmp_func);
+                /* nested objects use the keys after ours, and may move
+                   the array */
+                dumper->keys_used = first + size;
 
                 for(i = 0; i < size; i++)
                 {
-                    const char *key;
-                    json_t *value;
+                    const struct object_key *key = &dumper->keys[first + i];
 
-                    key = keys[i].key;
-                    value = json_object_get(json, key);
-                    assert(value);
-
-                    dump_string(key, strlen(key), dump, data, flags);
-                    if(dump(separator, separator_length, data) ||
-                       do_dump(value, flags, depth + 1, dump, data))
+                    if(dump_string(dumper, key->key, strlen(key->key)) ||
+                       dump_bytes(dumper, separator, separator_length) ||
+                       do_dump(dumper, key->value, depth + 1))
                     {
-                        jsonp_free(keys);
+                        dumper->keys_used = first;
                         goto object_error;
                     }
 
                     if(i < size - 1)
                     {
-                        if(dump(",", 1, data) ||
-                           dump_indent(flags, depth + 1, 1, dump, data))
+                        if(dump_byte(dumper, ',') ||
+                           dump_indent(dumper, depth + 1, 1))
                         {
-                            jsonp_free(keys);
+                            dumper->keys_used = first;
                             goto object_error;
                         }
                     }
                     else
                     {
-                        if(dump_indent(flags, depth, 0, dump, data))
+                        if(dump_indent(dumper, depth, 0))
                         {
-                            jsonp_free(keys);
+                            dumper->keys_used = first;
                             goto object_error;
                         }
                     }
                 }
 
-                jsonp_free(keys);
+                dumper->keys_used = first;
             }
             else
             {
@@ -375,21 +476,20 @@ static int do_dump(const json_t *json, size_t flags, int depth,
                     void *next = json_object_iter_next((json_t *)json, iter);
                     const char *key = json_object_iter_key(iter);
 
-                    dump_string(key, strlen(key), dump, data, flags);
-                    if(dump(separator, separator_length, data) ||
-                       do_dump(json_object_iter_value(iter), flags, depth + 1,
-                               dump, data))
+                    if(dump_string(dumper, key, strlen(key)) ||
+                       dump_bytes(dumper, separator, separator_length) ||
+                       do_dump(dumper, json_object_iter_value(iter), depth + 1))
                         goto object_error;
 
                     if(next)
                     {
-                        if(dump(",", 1, data) ||
-                           dump_indent(flags, depth + 1, 1, dump, data))
+                        if(dump_byte(dumper, ',') ||
+                           dump_indent(dumper, depth + 1, 1))
                             goto object_error;
                     }
                     else
                     {
-                        if(dump_indent(flags, depth, 0, dump, data))
+                        if(dump_indent(dumper, depth, 0))
                             goto object_error;
                     }
 
@@ -398,7 +498,7 @@ static int do_dump(const json_t *json, size_t flags, int depth,
             }
 
             object->visited = 0;
-            return dump("}", 1, data);
+            return dump_byte(dumper, '}');
 
         object_error:
             object->visited = 0;
@@ -422,7 +522,7 @@ char *json_dumps(const json_t *json, size_t flags)
     if(json_dump_callback(json, dump_to_strbuffer, (void *)&strbuff, flags))
         result = NULL;
     else
-        result = jsonp_strdup(strbuffer_value(&strbuff));
+        result = strbuffer_steal_value(&strbuff);
 
     strbuffer_close(&strbuff);
     return result;
@@ -449,10 +549,26 @@ int json_dump_file(const json_t *json, const char *path, size_t flags)
 
 int json_dump_callback(const json_t *json, json_dump_callback_t callback, void *data, size_t flags)
 {
+    dumper_t dumper;
+    int result;
+
     if(!(flags & JSON_ENCODE_ANY)) {
         if(!json_is_array(json) && !json_is_object(json))
            return -1;
     }
 
-    return do_dump(json, flags, 0, callback, data);
+    dumper.flags = flags;
+    dumper.dump = callback;
+    dumper.data = data;
+    dumper.keys = NULL;
+    dumper.keys_size = 0;
+    dumper.keys_used = 0;
+    dumper.length = 0;
+
+    result = do_dump(&dumper, json, 0);
+    if(dump_flush(&dumper))
+        result = -1;
+
+    jsonp_free(dumper.keys);
+    return result;
 }
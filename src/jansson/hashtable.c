@@ -20,254 +20,410 @@
 #include "jansson_private.h"  /* for container_of() */
 #include "hashtable.h"
 
-typedef struct hashtable_list list_t;
 typedef struct hashtable_pair pair_t;
-typedef struct hashtable_bucket bucket_t;
+typedef struct hashtable_slot slot_t;
 
 extern volatile uint32_t hashtable_seed;
 
 /* Implementation of the hash function */
 #include "lookup3.h"
 
-#define list_to_pair(list_)  container_of(list_, pair_t, list)
-#define hash_str(key)        ((size_t)hashlittle((key), strlen(key), hashtable_seed))
+#define HASHTABLE_INITIAL_ORDER 5
+#define HASHTABLE_NO_PAIR       ((size_t)-1)
 
-static JSON_INLINE void list_init(list_t *list)
-{
-    list->next = list;
-    list->prev = list;
-}
+#define hash_str(key, len)   ((size_t)hashlittle((key), (len), hashtable_seed))
 
-static JSON_INLINE void list_insert(list_t *list, list_t *node)
-{
-    node->next = list;
-    node->prev = list->prev;
-    list->prev->next = node;
-    list->prev = node;
-}
+/* the index is grown when it would become more than 3/4 full */
+#define hashtable_index_full(hashtable_) \
+    (((hashtable_)->size + 1) * 4 > hashsize((hashtable_)->order) * 3)
 
-static JSON_INLINE void list_remove(list_t *list)
+static pair_t *pair_at(hashtable_t *hashtable, size_t index)
 {
-    list->prev->next = list->next;
-    list->next->prev = list->prev;
+    size_t chunk = 1;
+
+    if(index < HASHTABLE_FIRST_CHUNK_SIZE)
+        return &hashtable->pairs[index];
+
+    while(index >= (HASHTABLE_FIRST_CHUNK_SIZE << chunk))
+        chunk++;
+
+    return &hashtable->chunks[chunk - 1]
+        [index - (HASHTABLE_FIRST_CHUNK_SIZE << (chunk - 1))];
 }
 
-static JSON_INLINE int bucket_is_empty(hashtable_t *hashtable, bucket_t *bucket)
+/* returns the pair after the one at index - 1, which was prev; chunks
+   start at powers of two, and pairs are contiguous within a chunk */
+static JSON_INLINE pair_t *pair_after(hashtable_t *hashtable, pair_t *prev,
+                                      size_t index)
 {
-    return bucket->first == &hashtable->list && bucket->first == bucket->last;
+    if(!prev || (index & (index - 1)) == 0)
+        return pair_at(hashtable, index);
+
+    return prev + 1;
 }
 
-static void insert_to_bucket(hashtable_t *hashtable, bucket_t *bucket,
-                             list_t *list)
+/* returns the index slot holding the pair with the given key, or the
+   empty slot where it would be inserted */
+static slot_t *hashtable_find_slot(hashtable_t *hashtable,
+                                   const char *key, size_t hash)
 {
-    if(bucket_is_empty(hashtable, bucket))
-    {
-        list_insert(&hashtable->list, list);
-        bucket->first = bucket->last = list;
-    }
-    else
+    size_t mask = hashmask(hashtable->order);
+    slot_t *slot = &hashtable->slots[hash & mask];
+
+    while(slot->pair)
     {
-        list_insert(bucket->first, list);
-        bucket->first = list;
+        if(slot->hash == hash &&
+           (slot->pair->key == key || strcmp(slot->pair->key, key) == 0))
+            break;
+
+        if(++slot == &hashtable->slots[mask + 1])
+            slot = hashtable->slots;
     }
+
+    return slot;
 }
 
-static pair_t *hashtable_find_pair(hashtable_t *hashtable, bucket_t *bucket,
-                                   const char *key, size_t hash)
+/* searches a small table, which has no index; small tables are
+   compared directly instead of hashing the key */
+static pair_t *hashtable_scan(hashtable_t *hashtable, const char *key)
 {
-    list_t *list;
-    pair_t *pair;
-
-    if(bucket_is_empty(hashtable, bucket))
-        return NULL;
+    pair_t *pair = NULL;
+    size_t i;
 
-    list = bucket->first;
-    while(1)
+    for(i = 0; i < hashtable->num_pairs; i++)
     {
-        pair = list_to_pair(list);
-        if(pair->hash == hash && strcmp(pair->key, key) == 0)
-            return pair;
+        pair = pair_after(hashtable, pair, i);
 
-        if(list == bucket->last)
-            break;
-
-        list = list->next;
+        if(pair->value &&
+           (pair->key == key ||
+            (pair->key[0] == key[0] && strcmp(pair->key, key) == 0)))
+            return pair;
     }
 
     return NULL;
 }
 
-/* returns 0 on success, -1 if key was not found */
-static int hashtable_do_del(hashtable_t *hashtable,
-                            const char *key, size_t hash)
+static pair_t *hashtable_find_pair(hashtable_t *hashtable, const char *key)
 {
-    pair_t *pair;
-    bucket_t *bucket;
-    size_t index;
+    if(!hashtable->size)
+        return NULL;
 
-    index = hash & hashmask(hashtable->order);
-    bucket = &hashtable->buckets[index];
+    if(!hashtable->slots)
+        return hashtable_scan(hashtable, key);
 
-    pair = hashtable_find_pair(hashtable, bucket, key, hash);
-    if(!pair)
+    return hashtable_find_slot(hashtable, key, hash_str(key, strlen(key)))->pair;
+}
+
+static int hashtable_do_rehash(hashtable_t *hashtable)
+{
+    slot_t *slots;
+    size_t i, mask, new_order;
+
+    new_order = hashtable->slots ? hashtable->order + 1
+                                 : HASHTABLE_INITIAL_ORDER;
+
+    slots = jsonp_malloc(hashsize(new_order) * sizeof(slot_t));
+    if(!slots)
         return -1;
 
-    if(&pair->list == bucket->first && &pair->list == bucket->last)
-        bucket->first = bucket->last = &hashtable->list;
+    memset(slots, 0, hashsize(new_order) * sizeof(slot_t));
+    mask = hashmask(new_order);
 
-    else if(&pair->list == bucket->first)
-        bucket->first = pair->list.next;
+    for(i = 0; i < hashtable->num_pairs; i++)
+    {
+        pair_t *pair = pair_at(hashtable, i);
+        size_t index;
 
-    else if(&pair->list == bucket->last)
-        bucket->last = pair->list.prev;
+        if(!pair->value)
+            continue;
 
-    list_remove(&pair->list);
-    json_decref(pair->value);
+        /* the keys of small tables are not hashed until they grow */
+        if(!hashtable->slots)
+            pair->hash = hash_str(pair->key, strlen(pair->key));
 
-    jsonp_free(pair);
-    hashtable->size--;
+        index = pair->hash & mask;
+        while(slots[index].pair)
+            index = (index + 1) & mask;
+        slots[index].hash = pair->hash;
+        slots[index].pair = pair;
+    }
+
+    jsonp_free(hashtable->slots);
+    hashtable->slots = slots;
+    hashtable->order = new_order;
 
     return 0;
 }
 
-static void hashtable_do_clear(hashtable_t *hashtable)
+/* takes a pair from the free list, or from the end of the storage */
+static pair_t *hashtable_alloc_pair(hashtable_t *hashtable)
 {
-    list_t *list, *next;
     pair_t *pair;
+    size_t n = hashtable->num_chunks;
 
-    for(list = hashtable->list.next; list != &hashtable->list; list = next)
+    if(hashtable->first_free != HASHTABLE_NO_PAIR)
     {
-        next = list->next;
-        pair = list_to_pair(list);
-        json_decref(pair->value);
-        jsonp_free(pair);
+        pair = pair_at(hashtable, hashtable->first_free);
+        hashtable->first_free = pair->serial;
+        return pair;
+    }
+
+    if(!hashtable->pairs)
+    {
+        hashtable->pairs = jsonp_malloc(HASHTABLE_FIRST_CHUNK_SIZE * sizeof(pair_t));
+        if(!hashtable->pairs)
+            return NULL;
+    }
+    else if(hashtable->num_pairs == (HASHTABLE_FIRST_CHUNK_SIZE << n))
+    {
+        pair_t **chunks;
+        pair_t *chunk;
+
+        chunks = jsonp_malloc((n + 1) * sizeof(pair_t *));
+        if(!chunks)
+            return NULL;
+
+        chunk = jsonp_malloc((HASHTABLE_FIRST_CHUNK_SIZE << n) * sizeof(pair_t));
+        if(!chunk)
+        {
+            jsonp_free(chunks);
+            return NULL;
+        }
+
+        if(n)
+            memcpy(chunks, hashtable->chunks, n * sizeof(pair_t *));
+        chunks[n] = chunk;
+
+        jsonp_free(hashtable->chunks);
+        hashtable->chunks = chunks;
+        hashtable->num_chunks++;
     }
+
+    pair = pair_at(hashtable, hashtable->num_pairs);
+    pair->index = hashtable->num_pairs++;
+
+    return pair;
 }
 
-static int hashtable_do_rehash(hashtable_t *hashtable)
+static void hashtable_free_key(pair_t *pair)
 {
-    list_t *list, *next;
-    pair_t *pair;
-    size_t i, index, new_size;
-
-    jsonp_free(hashtable->buckets);
+    if(pair->key != pair->inline_key)
+        jsonp_free((char *)pair->key - sizeof(pair_t *));
+}
 
-    hashtable->order++;
-    new_size = hashsize(hashtable->order);
+static void hashtable_free_pair(hashtable_t *hashtable, pair_t *pair)
+{
+    hashtable_free_key(pair);
 
-    hashtable->buckets = jsonp_malloc(new_size * sizeof(bucket_t));
-    if(!hashtable->buckets)
-        return -1;
+    pair->value = NULL;
+    pair->serial = hashtable->first_free;
+    hashtable->first_free = pair->index;
+}
 
-    for(i = 0; i < hashsize(hashtable->order); i++)
+/* sets the key of a newly allocated pair, returns -1 on failure */
+static int hashtable_set_pair_key(pair_t *pair, const char *key, size_t len)
+{
+    if(len < HASHTABLE_INLINE_KEY_SIZE)
     {
-        hashtable->buckets[i].first = hashtable->buckets[i].last =
-            &hashtable->list;
+        pair->key_owner = pair;
+        pair->key = pair->inline_key;
     }
+    else
+    {
+        pair_t **block;
+
+        if(len >= (size_t)-1 - sizeof(pair_t *)) {
+            /* Avoid an overflow if the key is very long */
+            return -1;
+        }
 
-    list = hashtable->list.next;
-    list_init(&hashtable->list);
+        block = jsonp_malloc(sizeof(pair_t *) + len + 1);
+        if(!block)
+            return -1;
 
-    for(; list != &hashtable->list; list = next) {
-        next = list->next;
-        pair = list_to_pair(list);
-        index = pair->hash % new_size;
-        insert_to_bucket(hashtable, &hashtable->buckets[index], &pair->list);
+        block[0] = pair;
+        pair->key = (char *)(block + 1);
     }
 
+    memcpy(pair->key, key, len + 1);
     return 0;
 }
 
+/* removes a pair from the index */
+static void hashtable_unindex_pair(hashtable_t *hashtable, slot_t *slot)
+{
+    size_t mask = hashmask(hashtable->order);
+    size_t hole = slot - hashtable->slots;
+    size_t index = hole;
 
-int hashtable_init(hashtable_t *hashtable)
+    /* Shift back any later pairs in the same probe sequence so that
+       lookups never need to skip over deleted slots */
+    while(1)
+    {
+        size_t home;
+
+        index = (index + 1) & mask;
+        if(!hashtable->slots[index].pair)
+            break;
+
+        /* the pair can fill the hole if its home slot is not cyclically
+           within (hole, index] */
+        home = hashtable->slots[index].hash & mask;
+        if(((index - home) & mask) >= ((index - hole) & mask))
+        {
+            hashtable->slots[hole] = hashtable->slots[index];
+            hole = index;
+        }
+    }
+
+    hashtable->slots[hole].pair = NULL;
+}
+
+/* returns 0 on success, -1 if key was not found */
+static int hashtable_do_del(hashtable_t *hashtable, const char *key)
 {
-    size_t i;
+    pair_t *pair;
 
-    hashtable->size = 0;
-    hashtable->order = 3;
-    hashtable->buckets = jsonp_malloc(hashsize(hashtable->order) * sizeof(bucket_t));
-    if(!hashtable->buckets)
+    if(!hashtable->size)
         return -1;
 
-    list_init(&hashtable->list);
+    if(hashtable->slots)
+    {
+        slot_t *slot;
 
-    for(i = 0; i < hashsize(hashtable->order); i++)
+        slot = hashtable_find_slot(hashtable, key, hash_str(key, strlen(key)));
+        pair = slot->pair;
+        if(!pair)
+            return -1;
+
+        hashtable_unindex_pair(hashtable, slot);
+    }
+    else
     {
-        hashtable->buckets[i].first = hashtable->buckets[i].last =
-            &hashtable->list;
+        pair = hashtable_scan(hashtable, key);
+        if(!pair)
+            return -1;
     }
 
+    json_decref(pair->value);
+    hashtable_free_pair(hashtable, pair);
+    hashtable->size--;
+
+    return 0;
+}
+
+static void hashtable_do_clear(hashtable_t *hashtable)
+{
+    size_t i;
+
+    for(i = 0; i < hashtable->num_pairs; i++)
+    {
+        pair_t *pair = pair_at(hashtable, i);
+        if(!pair->value)
+            continue;
+
+        json_decref(pair->value);
+        hashtable_free_key(pair);
+    }
+}
+
+
+int hashtable_init(hashtable_t *hashtable)
+{
+    /* storage is allocated when the first key is added */
+    hashtable->size = 0;
+    hashtable->slots = NULL;
+    hashtable->order = 0;
+    hashtable->pairs = NULL;
+    hashtable->chunks = NULL;
+    hashtable->num_chunks = 0;
+    hashtable->num_pairs = 0;
+    hashtable->first_free = HASHTABLE_NO_PAIR;
+
     return 0;
 }
 
 void hashtable_close(hashtable_t *hashtable)
 {
+    size_t i;
+
     hashtable_do_clear(hashtable);
-    jsonp_free(hashtable->buckets);
+
+    for(i = 0; i < hashtable->num_chunks; i++)
+        jsonp_free(hashtable->chunks[i]);
+
+    jsonp_free(hashtable->chunks);
+    jsonp_free(hashtable->pairs);
+    jsonp_free(hashtable->slots);
 }
 
 int hashtable_set(hashtable_t *hashtable,
                   const char *key, size_t serial,
                   json_t *value)
 {
+    slot_t *slot = NULL;
     pair_t *pair;
-    bucket_t *bucket;
-    size_t hash, index;
+    size_t hash = 0, len;
 
-    /* rehash if the load ratio exceeds 1 */
-    if(hashtable->size >= hashsize(hashtable->order))
-        if(hashtable_do_rehash(hashtable))
-            return -1;
+    len = strlen(key);
 
-    hash = hash_str(key);
-    index = hash & hashmask(hashtable->order);
-    bucket = &hashtable->buckets[index];
-    pair = hashtable_find_pair(hashtable, bucket, key, hash);
+    if(hashtable->slots)
+    {
+        hash = hash_str(key, len);
+        pair = hashtable_find_slot(hashtable, key, hash)->pair;
+    }
+    else
+        pair = hashtable_scan(hashtable, key);
 
     if(pair)
     {
         json_decref(pair->value);
         pair->value = value;
+        return 0;
     }
-    else
+
+    /* build or grow the index if the table is getting too large */
+    if(hashtable->slots ? hashtable_index_full(hashtable)
+                        : hashtable->size >= HASHTABLE_SMALL_SIZE)
     {
-        /* offsetof(...) returns the size of pair_t without the last,
-           flexible member. This way, the correct amount is
-           allocated. */
+        if(!hashtable->slots)
+            hash = hash_str(key, len);
 
-        size_t len = strlen(key);
-        if(len >= (size_t)-1 - offsetof(pair_t, key)) {
-            /* Avoid an overflow if the key is very long */
+        if(hashtable_do_rehash(hashtable))
             return -1;
-        }
+    }
 
-        pair = jsonp_malloc(offsetof(pair_t, key) + len + 1);
-        if(!pair)
-            return -1;
+    if(hashtable->slots)
+        slot = hashtable_find_slot(hashtable, key, hash);
 
-        pair->hash = hash;
-        pair->serial = serial;
-        strcpy(pair->key, key);
-        pair->value = value;
-        list_init(&pair->list);
+    pair = hashtable_alloc_pair(hashtable);
+    if(!pair)
+        return -1;
+
+    if(hashtable_set_pair_key(pair, key, len))
+    {
+        pair->key = pair->inline_key;
+        hashtable_free_pair(hashtable, pair);
+        return -1;
+    }
 
-        insert_to_bucket(hashtable, bucket, &pair->list);
+    pair->hash = hash;
+    pair->serial = serial;
+    pair->value = value;
 
-        hashtable->size++;
+    if(slot)
+    {
+        slot->hash = hash;
+        slot->pair = pair;
     }
+    hashtable->size++;
+
     return 0;
 }
 
 void *hashtable_get(hashtable_t *hashtable, const char *key)
 {
-    pair_t *pair;
-    size_t hash;
-    bucket_t *bucket;
-
-    hash = hash_str(key);
-    bucket = &hashtable->buckets[hash & hashmask(hashtable->order)];
-
-    pair = hashtable_find_pair(hashtable, bucket, key, hash);
+    pair_t *pair = hashtable_find_pair(hashtable, key);
     if(!pair)
         return NULL;
 
@@ -276,76 +432,75 @@ void *hashtable_get(hashtable_t *hashtable, const char *key)
 
 int hashtable_del(hashtable_t *hashtable, const char *key)
 {
-    size_t hash = hash_str(key);
-    return hashtable_do_del(hashtable, key, hash);
+    return hashtable_do_del(hashtable, key);
 }
 
 void hashtable_clear(hashtable_t *hashtable)
 {
-    size_t i;
-
     hashtable_do_clear(hashtable);
 
-    for(i = 0; i < hashsize(hashtable->order); i++)
+    if(hashtable->slots)
+        memset(hashtable->slots, 0,
+               hashsize(hashtable->order) * sizeof(slot_t));
+
+    hashtable->num_pairs = 0;
+    hashtable->first_free = HASHTABLE_NO_PAIR;
+    hashtable->size = 0;
+}
+
+/* returns the first pair in use at or after index, or NULL */
+static pair_t *hashtable_next_pair(hashtable_t *hashtable, size_t index)
+{
+    pair_t *pair = NULL;
+
+    for(; index < hashtable->num_pairs; index++)
     {
-        hashtable->buckets[i].first = hashtable->buckets[i].last =
-            &hashtable->list;
+        pair = pair_after(hashtable, pair, index);
+
+        if(pair->value)
+            return pair;
     }
 
-    list_init(&hashtable->list);
-    hashtable->size = 0;
+    return NULL;
 }
 
 void *hashtable_iter(hashtable_t *hashtable)
 {
-    return hashtable_iter_next(hashtable, &hashtable->list);
+    return hashtable_next_pair(hashtable, 0);
 }
 
 void *hashtable_iter_at(hashtable_t *hashtable, const char *key)
 {
-    pair_t *pair;
-    size_t hash;
-    bucket_t *bucket;
-
-    hash = hash_str(key);
-    bucket = &hashtable->buckets[hash & hashmask(hashtable->order)];
-
-    pair = hashtable_find_pair(hashtable, bucket, key, hash);
-    if(!pair)
-        return NULL;
-
-    return &pair->list;
+    return hashtable_find_pair(hashtable, key);
 }
 
 void *hashtable_iter_next(hashtable_t *hashtable, void *iter)
 {
-    list_t *list = (list_t *)iter;
-    if(list->next == &hashtable->list)
-        return NULL;
-    return list->next;
+    pair_t *pair = (pair_t *)iter;
+    return hashtable_next_pair(hashtable, pair->index + 1);
 }
 
 void *hashtable_iter_key(void *iter)
 {
-    pair_t *pair = list_to_pair((list_t *)iter);
+    pair_t *pair = (pair_t *)iter;
     return pair->key;
 }
 
 size_t hashtable_iter_serial(void *iter)
 {
-    pair_t *pair = list_to_pair((list_t *)iter);
+    pair_t *pair = (pair_t *)iter;
     return pair->serial;
 }
 
 void *hashtable_iter_value(void *iter)
 {
-    pair_t *pair = list_to_pair((list_t *)iter);
+    pair_t *pair = (pair_t *)iter;
     return pair->value;
 }
 
 void hashtable_iter_set(void *iter, json_t *value)
 {
-    pair_t *pair = list_to_pair((list_t *)iter);
+    pair_t *pair = (pair_t *)iter;
 
     json_decref(pair->value);
     pair->value = value;
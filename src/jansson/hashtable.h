@@ -8,37 +8,65 @@
 #ifndef HASHTABLE_H
 #define HASHTABLE_H
 
-struct hashtable_list {
-    struct hashtable_list *prev;
-    struct hashtable_list *next;
-};
+/* Keys shorter than this are stored inside the pair itself */
+#define HASHTABLE_INLINE_KEY_SIZE 24
+
+/* Tables with up to this many keys are searched linearly */
+#define HASHTABLE_SMALL_SIZE 16
+
+/* Number of pairs in the first chunk of pair storage */
+#define HASHTABLE_FIRST_CHUNK_SIZE 4
 
 /* "pair" may be a bit confusing a name, but think of it as a
    key-value pair. In this case, it just encodes some extra data,
    too */
 struct hashtable_pair {
-    size_t hash;
-    struct hashtable_list list;
-    json_t *value;
-    size_t serial;
-    char key[1];
+    size_t hash;        /* only valid once the table has an index */
+    size_t serial;      /* for a free pair, the index of the next free pair */
+    json_t *value;      /* NULL if the pair is free */
+    size_t index;       /* position of the pair in the pair storage */
+    char *key;          /* inline_key, or a separate allocation */
+
+    /* Every key is immediately preceded by a pointer to the pair that
+       owns it, so that hashtable_key_to_iter() can find the pair from
+       the key alone. For long keys, the pointer is stored at the start
+       of the separate allocation. */
+    struct hashtable_pair *key_owner;
+    char inline_key[HASHTABLE_INLINE_KEY_SIZE];
 };
 
-struct hashtable_bucket {
-    struct hashtable_list *first;
-    struct hashtable_list *last;
+/* An entry in the index of a large table. The hash of the key is kept
+   alongside the pair so that probing only touches pairs whose hash
+   matches. */
+struct hashtable_slot {
+    size_t hash;
+    struct hashtable_pair *pair;    /* NULL if the slot is empty */
 };
 
+/* Pairs are never moved once allocated, so that iterators and keys
+   stay valid while other keys are added or deleted. The first
+   HASHTABLE_FIRST_CHUNK_SIZE pairs live in one allocation, and each
+   further chunk doubles the total, so chunk i (i >= 1) holds pairs
+   [HASHTABLE_FIRST_CHUNK_SIZE << (i - 1), HASHTABLE_FIRST_CHUNK_SIZE << i).
+
+   Small tables are searched by comparing keys directly, without
+   hashing them. Larger tables cache the hash of each key, and have an
+   open-addressed index of slots pointing to their pairs, using linear
+   probing. */
 typedef struct hashtable {
-    size_t size;
-    struct hashtable_bucket *buckets;
-    size_t order;  /* hashtable has pow(2, order) buckets */
-    struct hashtable_list list;
+    size_t size;            /* number of pairs in use */
+    struct hashtable_slot *slots;   /* NULL for small tables */
+    size_t order;           /* the index has pow(2, order) slots */
+    struct hashtable_pair *pairs;   /* the first chunk of pairs */
+    struct hashtable_pair **chunks; /* the remaining chunks */
+    size_t num_chunks;
+    size_t num_pairs;       /* pairs handed out from the chunks */
+    size_t first_free;      /* index of the first free pair, or (size_t)-1 */
 } hashtable_t;
 
 
 #define hashtable_key_to_iter(key_) \
-    (&(container_of(key_, struct hashtable_pair, key)->list))
+    ((void *)((struct hashtable_pair *const *)(const void *)(key_))[-1])
 
 
 /**
@@ -117,7 +145,9 @@ void hashtable_clear(hashtable_t *hashtable);
  *
  * Returns an opaque iterator to the first element in the hashtable.
  * The iterator should be passed to hashtable_iter_* functions.
- * The hashtable items are not iterated over in any particular order.
+ * The hashtable items are iterated over in insertion order, except
+ * that keys added after a deletion may take the place of the deleted
+ * key.
  *
  * There's no need to free the iterator in any way. The iterator is
  * valid as long as the item that is referenced by the iterator is not
@@ -256,6 +256,35 @@ json_t *json_loadf(FILE *input, size_t flags, json_error_t *error);
 json_t *json_load_file(const char *path, size_t flags, json_error_t *error);
 json_t *json_load_callback(json_load_callback_t callback, void *data, size_t flags, json_error_t *error);
 
+/* event-based decoding */
+
+typedef enum {
+    JSON_EVENT_OBJECT_START,
+    JSON_EVENT_OBJECT_END,
+    JSON_EVENT_ARRAY_START,
+    JSON_EVENT_ARRAY_END,
+    JSON_EVENT_KEY,
+    JSON_EVENT_STRING,
+    JSON_EVENT_INTEGER,
+    JSON_EVENT_REAL,
+    JSON_EVENT_TRUE,
+    JSON_EVENT_FALSE,
+    JSON_EVENT_NULL
+} json_event_type;
+
+typedef struct {
+    json_event_type type;
+    const char *string;     /* JSON_EVENT_KEY and JSON_EVENT_STRING */
+    size_t length;
+    json_int_t integer;     /* JSON_EVENT_INTEGER */
+    double real;            /* JSON_EVENT_REAL */
+} json_event_t;
+
+/* return non-zero to stop parsing */
+typedef int (*json_event_callback_t)(const json_event_t *event, void *data);
+
+int json_parse_events(const char *input, size_t flags, json_event_callback_t callback, void *data, json_error_t *error);
+
 
 /* encoding */
 
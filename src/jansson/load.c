@@ -906,6 +906,226 @@ static json_t *parse_json(lex_t *lex, size_t flags, json_error_t *error)
     return result;
 }
 
+
+/*** event parser ***/
+
+/* The event parser checks the same grammar as the parser above, but
+   reports each token to a callback instead of building values. Strings
+   passed to the callback are only valid until it returns. */
+
+typedef struct {
+    json_event_callback_t callback;
+    void *data;
+} event_sink_t;
+
+static int emit_event(event_sink_t *sink, lex_t *lex, json_event_t *event,
+                      json_error_t *error)
+{
+    if(sink->callback(event, sink->data)) {
+        error_set(error, lex, "parsing stopped by callback");
+        return -1;
+    }
+    return 0;
+}
+
+static int emit_simple_event(event_sink_t *sink, lex_t *lex,
+                             json_event_type type, json_error_t *error)
+{
+    json_event_t event;
+
+    memset(&event, 0, sizeof(event));
+    event.type = type;
+    return emit_event(sink, lex, &event, error);
+}
+
+static int parse_event_value(lex_t *lex, size_t flags, event_sink_t *sink,
+                             json_error_t *error);
+
+static int parse_event_object(lex_t *lex, size_t flags, event_sink_t *sink,
+                              json_error_t *error)
+{
+    if(emit_simple_event(sink, lex, JSON_EVENT_OBJECT_START, error))
+        return -1;
+
+    lex_scan(lex, error);
+    if(lex->token == '}')
+        return emit_simple_event(sink, lex, JSON_EVENT_OBJECT_END, error);
+
+    while(1) {
+        json_event_t event;
+
+        if(lex->token != TOKEN_STRING) {
+            error_set(error, lex, "string or '}' expected");
+            return -1;
+        }
+
+        if(memchr(lex->value.string.val, '\0', lex->value.string.len)) {
+            error_set(error, lex, "NUL byte in object key not supported");
+            return -1;
+        }
+
+        memset(&event, 0, sizeof(event));
+        event.type = JSON_EVENT_KEY;
+        event.string = lex->value.string.val;
+        event.length = lex->value.string.len;
+        if(emit_event(sink, lex, &event, error))
+            return -1;
+
+        lex_scan(lex, error);
+        if(lex->token != ':') {
+            error_set(error, lex, "':' expected");
+            return -1;
+        }
+
+        lex_scan(lex, error);
+        if(parse_event_value(lex, flags, sink, error))
+            return -1;
+
+        lex_scan(lex, error);
+        if(lex->token != ',')
+            break;
+
+        lex_scan(lex, error);
+    }
+
+    if(lex->token != '}') {
+        error_set(error, lex, "'}' expected");
+        return -1;
+    }
+
+    return emit_simple_event(sink, lex, JSON_EVENT_OBJECT_END, error);
+}
+
+static int parse_event_array(lex_t *lex, size_t flags, event_sink_t *sink,
+                             json_error_t *error)
+{
+    if(emit_simple_event(sink, lex, JSON_EVENT_ARRAY_START, error))
+        return -1;
+
+    lex_scan(lex, error);
+    if(lex->token == ']')
+        return emit_simple_event(sink, lex, JSON_EVENT_ARRAY_END, error);
+
+    while(lex->token) {
+        if(parse_event_value(lex, flags, sink, error))
+            return -1;
+
+        lex_scan(lex, error);
+        if(lex->token != ',')
+            break;
+
+        lex_scan(lex, error);
+    }
+
+    if(lex->token != ']') {
+        error_set(error, lex, "']' expected");
+        return -1;
+    }
+
+    return emit_simple_event(sink, lex, JSON_EVENT_ARRAY_END, error);
+}
+
+static int parse_event_value(lex_t *lex, size_t flags, event_sink_t *sink,
+                             json_error_t *error)
+{
+    json_event_t event;
+
+    memset(&event, 0, sizeof(event));
+
+    switch(lex->token) {
+        case TOKEN_STRING: {
+            if(!(flags & JSON_ALLOW_NUL)) {
+                if(memchr(lex->value.string.val, '\0', lex->value.string.len)) {
+                    error_set(error, lex, "\\u0000 is not allowed without JSON_ALLOW_NUL");
+                    return -1;
+                }
+            }
+
+            event.type = JSON_EVENT_STRING;
+            event.string = lex->value.string.val;
+            event.length = lex->value.string.len;
+            break;
+        }
+
+        case TOKEN_INTEGER: {
+            if (flags & JSON_DECODE_INT_AS_REAL) {
+                if(jsonp_strtod(&lex->saved_text, &event.real)) {
+                    error_set(error, lex, "real number overflow");
+                    return -1;
+                }
+                event.type = JSON_EVENT_REAL;
+            } else {
+                event.type = JSON_EVENT_INTEGER;
+                event.integer = lex->value.integer;
+            }
+            break;
+        }
+
+        case TOKEN_REAL:
+            event.type = JSON_EVENT_REAL;
+            event.real = lex->value.real;
+            break;
+
+        case TOKEN_TRUE:
+            event.type = JSON_EVENT_TRUE;
+            break;
+
+        case TOKEN_FALSE:
+            event.type = JSON_EVENT_FALSE;
+            break;
+
+        case TOKEN_NULL:
+            event.type = JSON_EVENT_NULL;
+            break;
+
+        case '{':
+            return parse_event_object(lex, flags, sink, error);
+
+        case '[':
+            return parse_event_array(lex, flags, sink, error);
+
+        case TOKEN_INVALID:
+            error_set(error, lex, "invalid token");
+            return -1;
+
+        default:
+            error_set(error, lex, "unexpected token");
+            return -1;
+    }
+
+    return emit_event(sink, lex, &event, error);
+}
+
+static int parse_json_events(lex_t *lex, size_t flags, event_sink_t *sink,
+                             json_error_t *error)
+{
+    lex_scan(lex, error);
+    if(!(flags & JSON_DECODE_ANY)) {
+        if(lex->token != '[' && lex->token != '{') {
+            error_set(error, lex, "'[' or '{' expected");
+            return -1;
+        }
+    }
+
+    if(parse_event_value(lex, flags, sink, error))
+        return -1;
+
+    if(!(flags & JSON_DISABLE_EOF_CHECK)) {
+        lex_scan(lex, error);
+        if(lex->token != TOKEN_EOF) {
+            error_set(error, lex, "end of file expected");
+            return -1;
+        }
+    }
+
+    if(error) {
+        /* Save the position even though there was no error */
+        error->position = lex->stream.position;
+    }
+
+    return 0;
+}
+
 typedef struct
 {
     const char *data;
@@ -951,6 +1171,37 @@ json_t *json_loads(const char *string, size_t flags, json_error_t *error)
     return result;
 }
 
+int json_parse_events(const char *string, size_t flags,
+                      json_event_callback_t callback, void *data,
+                      json_error_t *error)
+{
+    lex_t lex;
+    int result;
+    string_data_t stream_data;
+    event_sink_t sink;
+
+    jsonp_error_init(error, "<string>");
+
+    if (string == NULL || callback == NULL) {
+        error_set(error, NULL, "wrong arguments");
+        return -1;
+    }
+
+    stream_data.data = string;
+    stream_data.pos = 0;
+
+    sink.callback = callback;
+    sink.data = data;
+
+    if(lex_init(&lex, string_get, (void *)&stream_data))
+        return -1;
+
+    result = parse_json_events(&lex, flags, &sink, error);
+
+    lex_close(&lex);
+    return result;
+}
+
 typedef struct
 {
     const char *data;
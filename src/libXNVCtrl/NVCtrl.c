@@ -1053,6 +1053,191 @@ Bool XNVCTRLQueryBinaryData (
                                         attribute, ptr, len);
 }
 
+/*
+ * State shared between XNVCTRLQueryTargetBatch() and the asynchronous
+ * reply handler that collects the replies to its requests.
+ */
+
+typedef struct {
+    unsigned long start_seq;
+    unsigned long stop_seq;
+    XNVCTRLBatchQuery *queries;
+} XNVCTRLBatchState;
+
+static Bool XNVCTRLBatchHandler(Display *dpy, xReply *rep, char *buf,
+                                int len, XPointer data)
+{
+    XNVCTRLBatchState *state = (XNVCTRLBatchState *) data;
+    XNVCTRLBatchQuery *query;
+    unsigned long seq = dpy->last_request_read;
+
+    if (seq < state->start_seq || seq > state->stop_seq) {
+        return False;
+    }
+
+    /* Let errors go to the error handler; the query is left as not
+     * existing.
+     */
+    if (rep->generic.type == X_Error) {
+        return False;
+    }
+
+    query = &state->queries[seq - state->start_seq];
+
+    switch (query->type) {
+    case XNVCTRL_BATCH_QUERY_INTEGER:
+        {
+            xnvCtrlQueryAttributeReply replbuf, *repl;
+
+            repl = (xnvCtrlQueryAttributeReply *)
+                _XGetAsyncReply(dpy, (char *) &replbuf, rep, buf, len,
+                                (SIZEOF(xnvCtrlQueryAttributeReply) -
+                                 SIZEOF(xReply)) >> 2, True);
+            query->exists = repl->flags;
+            if (query->exists) query->value = repl->value;
+        }
+        break;
+
+    case XNVCTRL_BATCH_QUERY_INTEGER64:
+        {
+            xnvCtrlQueryAttribute64Reply replbuf, *repl;
+
+            repl = (xnvCtrlQueryAttribute64Reply *)
+                _XGetAsyncReply(dpy, (char *) &replbuf, rep, buf, len,
+                                (SIZEOF(xnvCtrlQueryAttribute64Reply) -
+                                 SIZEOF(xReply)) >> 2, True);
+            query->exists = repl->flags;
+            if (query->exists) query->value = repl->value_64;
+        }
+        break;
+
+    case XNVCTRL_BATCH_QUERY_STRING:
+    case XNVCTRL_BATCH_QUERY_BINARY:
+        {
+            /* The string and binary data replies share the same layout */
+            xnvCtrlQueryBinaryDataReply replbuf, *repl;
+            int numbytes;
+
+            repl = (xnvCtrlQueryBinaryDataReply *)
+                _XGetAsyncReply(dpy, (char *) &replbuf, rep, buf, len,
+                                (SIZEOF(xnvCtrlQueryBinaryDataReply) -
+                                 SIZEOF(xReply)) >> 2, False);
+            numbytes = repl->n;
+            query->exists = repl->flags;
+            query->data = NULL;
+            if (query->exists) {
+                query->data = (unsigned char *) Xmalloc(numbytes);
+                if (!query->data) query->exists = False;
+            }
+            _XGetAsyncData(dpy, (char *) query->data, buf, len,
+                           SIZEOF(xnvCtrlQueryBinaryDataReply),
+                           query->data ? numbytes : 0,
+                           repl->length << 2);
+            if (query->exists) query->len = numbytes;
+        }
+        break;
+    }
+
+    return True;
+}
+
+Bool XNVCTRLQueryTargetBatch (
+    Display *dpy,
+    XNVCTRLBatchQuery *queries,
+    int count
+){
+    XExtDisplayInfo *info = find_display (dpy);
+    XNVCTRLBatchState state;
+    _XAsyncHandler async;
+    xGetInputFocusReply rep;
+    xReq *sync_req;
+    Bool swap_target;
+    int i;
+
+    if(!XextHasExtension(info))
+        return False;
+
+    XNVCTRLCheckExtension (dpy, info, False);
+
+    /*
+     * Resolve the NV-CONTROL version before queuing any requests: the
+     * first lookup makes a request (and takes the display lock) of its
+     * own, which must not land among the batched requests.
+     */
+    swap_target = (version_flags(dpy, info) & NVCTRL_EXT_NEED_TARGET_SWAP) != 0;
+
+    for (i = 0; i < count; i++) {
+        queries[i].exists = False;
+        queries[i].value = 0;
+        queries[i].data = NULL;
+        queries[i].len = 0;
+    }
+
+    if (count <= 0) {
+        return True;
+    }
+
+    LockDisplay (dpy);
+
+    state.start_seq = dpy->request + 1;
+    state.queries = queries;
+
+    for (i = 0; i < count; i++) {
+        XNVCTRLBatchQuery *query = &queries[i];
+        /* All the query requests share the same layout */
+        xnvCtrlQueryAttributeReq *req;
+        int target_type = query->target_type;
+        int target_id = query->target_id;
+
+        /* As XNVCTRLCheckTargetData() does */
+        if (swap_target) {
+            target_type = query->target_id;
+            target_id = query->target_type;
+        }
+
+        GetReq (nvCtrlQueryAttribute, req);
+        req->reqType = info->codes->major_opcode;
+        switch (query->type) {
+        case XNVCTRL_BATCH_QUERY_INTEGER64:
+            req->nvReqType = X_nvCtrlQueryAttribute64;
+            break;
+        case XNVCTRL_BATCH_QUERY_STRING:
+            req->nvReqType = X_nvCtrlQueryStringAttribute;
+            break;
+        case XNVCTRL_BATCH_QUERY_BINARY:
+            req->nvReqType = X_nvCtrlQueryBinaryData;
+            break;
+        case XNVCTRL_BATCH_QUERY_INTEGER:
+        default:
+            query->type = XNVCTRL_BATCH_QUERY_INTEGER;
+            req->nvReqType = X_nvCtrlQueryAttribute;
+            break;
+        }
+        req->target_type = target_type;
+        req->target_id = target_id;
+        req->display_mask = query->display_mask;
+        req->attribute = query->attribute;
+    }
+
+    state.stop_seq = dpy->request;
+
+    async.next = dpy->async_handlers;
+    async.handler = XNVCTRLBatchHandler;
+    async.data = (XPointer) &state;
+    dpy->async_handlers = &async;
+
+    /* Round trip; the replies to the queries are handled on the way */
+    GetEmptyReq (GetInputFocus, sync_req);
+    (void) sync_req;
+    (void) _XReply (dpy, (xReply *) &rep, 0, xTrue);
+
+    DeqAsyncHandler (dpy, &async);
+
+    UnlockDisplay (dpy);
+    SyncHandle ();
+    return True;
+}
+
 Bool XNVCTRLStringOperation (
     Display *dpy,
     int target_type,
@@ -615,6 +615,52 @@ Bool XNVCTRLQueryTargetBinaryData (
 );
 
 
+/*
+ * XNVCTRLQueryTargetBatch -
+ *
+ *  Performs several integer, string and binary data queries with a
+ *  single round trip to the X server: all the requests are sent
+ *  before any reply is waited for.  For each query, the caller fills
+ *  in the type (one of the XNVCTRL_BATCH_QUERY_* values), target,
+ *  display_mask and attribute; on return, 'exists' is set as the
+ *  corresponding XNVCTRLQueryTarget*() function would have returned,
+ *  and the result is stored in 'value', or in 'data' and 'len'.  It
+ *  is the caller's responsibility to free 'data' with XFree() when
+ *  done.
+ *
+ *  Integer queries of type XNVCTRL_BATCH_QUERY_INTEGER64 require
+ *  NV-CONTROL 1.21 or later.
+ *
+ *  Returns False if the extension is not available, True otherwise.
+ *
+ *  Possible errors are those of the individual queries.
+ */
+
+#define XNVCTRL_BATCH_QUERY_INTEGER    0
+#define XNVCTRL_BATCH_QUERY_INTEGER64  1
+#define XNVCTRL_BATCH_QUERY_STRING     2
+#define XNVCTRL_BATCH_QUERY_BINARY     3
+
+typedef struct {
+    int type;
+    int target_type;
+    int target_id;
+    unsigned int display_mask;
+    unsigned int attribute;
+
+    Bool exists;
+    int64_t value;
+    unsigned char *data;
+    int len;
+} XNVCTRLBatchQuery;
+
+Bool XNVCTRLQueryTargetBatch (
+    Display *dpy,
+    XNVCTRLBatchQuery *queries,
+    int count
+);
+
+
 /*
  * XNVCTRLStringOperation -
  *
@@ -1195,6 +1195,171 @@ ReturnStatus NvCtrlGetBinaryAttribute(const CtrlTarget *ctrl_target,
 } /* NvCtrlGetBinaryAttribute() */
 
 
+/*
+ * Resolves the query if it can be answered without an NV-CONTROL
+ * request: through NVML, from cached extension information, or because
+ * it is invalid.  Returns FALSE if the query needs to be sent to the
+ * X server through NV-CONTROL.
+ */
+
+static Bool resolveQueryLocally(CtrlAttributeQuery *query)
+{
+    const CtrlTarget *ctrl_target = query->ctrl_target;
+    const NvCtrlAttributePrivateHandle *h = getPrivateHandleConst(ctrl_target);
+    ReturnStatus ret = NvCtrlNotSupported;
+    Bool nvml_first;
+
+    if (h == NULL) {
+        query->status = NvCtrlBadHandle;
+        return TRUE;
+    }
+
+    switch (h->target_type) {
+        case GPU_TARGET:
+        case THERMAL_SENSOR_TARGET:
+        case COOLER_TARGET:
+            nvml_first = TRUE;
+            break;
+        case DISPLAY_TARGET:
+        case X_SCREEN_TARGET:
+        case FRAMELOCK_TARGET:
+        case VCS_TARGET:
+        case GVI_TARGET:
+        case NVIDIA_3D_VISION_PRO_TRANSCEIVER_TARGET:
+            nvml_first = FALSE;
+            break;
+        default:
+            query->status = NvCtrlBadHandle;
+            return TRUE;
+    }
+
+    switch (query->attr_type) {
+        case CTRL_ATTRIBUTE_TYPE_INTEGER:
+            if ((query->attr < 0) || (query->attr > NV_CTRL_LAST_ATTRIBUTE)) {
+                query->status =
+                    NvCtrlGetDisplayAttribute64(ctrl_target,
+                                                query->display_mask,
+                                                query->attr, &query->val);
+                return TRUE;
+            }
+            if (nvml_first) {
+                ret = NvCtrlNvmlGetAttribute(ctrl_target, query->attr,
+                                             &query->val);
+            }
+            break;
+
+        case CTRL_ATTRIBUTE_TYPE_STRING:
+            if ((query->attr < 0) ||
+                (query->attr > NV_CTRL_STRING_LAST_ATTRIBUTE)) {
+                query->status =
+                    NvCtrlGetStringDisplayAttribute(ctrl_target,
+                                                    query->display_mask,
+                                                    query->attr,
+                                                    &query->str);
+                return TRUE;
+            }
+            if (nvml_first) {
+                ret = NvCtrlNvmlGetStringAttribute(ctrl_target, query->attr,
+                                                   &query->str);
+            }
+            break;
+
+        case CTRL_ATTRIBUTE_TYPE_BINARY_DATA:
+            if (nvml_first) {
+                ret = NvCtrlNvmlGetBinaryAttribute(ctrl_target, query->attr,
+                                                   &query->data,
+                                                   &query->len);
+            }
+            break;
+
+        default:
+            query->status = NvCtrlBadArgument;
+            return TRUE;
+    }
+
+    if ((ret != NvCtrlMissingExtension) && (ret != NvCtrlNotSupported)) {
+        query->status = ret;
+        return TRUE;
+    }
+
+    if (!h->nv) {
+        query->status = NvCtrlMissingExtension;
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+
+void NvCtrlQueryAttributes(CtrlAttributeQuery *queries, int count)
+{
+    CtrlAttributeQuery **pending, **group;
+    int num_pending = 0;
+    int i;
+
+    if (count <= 0) {
+        return;
+    }
+
+    pending = nvalloc(count * sizeof(*pending));
+    group = nvalloc(count * sizeof(*group));
+
+    for (i = 0; i < count; i++) {
+        CtrlAttributeQuery *query = &queries[i];
+
+        query->status = NvCtrlError;
+        query->val = 0;
+        query->str = NULL;
+        query->data = NULL;
+        query->len = 0;
+
+        if (!resolveQueryLocally(query)) {
+            pending[num_pending++] = query;
+        }
+    }
+
+    /* Send one batch per display connection */
+    while (num_pending > 0) {
+        const NvCtrlAttributePrivateHandle *h =
+            getPrivateHandleConst(pending[0]->ctrl_target);
+        int num_group = 0;
+        int num_left = 0;
+
+        for (i = 0; i < num_pending; i++) {
+            const NvCtrlAttributePrivateHandle *other =
+                getPrivateHandleConst(pending[i]->ctrl_target);
+
+            if (other->dpy == h->dpy) {
+                group[num_group++] = pending[i];
+            } else {
+                pending[num_left++] = pending[i];
+            }
+        }
+
+        NvCtrlNvControlQueryAttributes(group, num_group);
+        num_pending = num_left;
+    }
+
+    nvfree(group);
+    nvfree(pending);
+
+} /* NvCtrlQueryAttributes() */
+
+
+void NvCtrlFreeAttributeQueries(CtrlAttributeQuery *queries, int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        free(queries[i].str);
+        free(queries[i].data);
+        queries[i].str = NULL;
+        queries[i].data = NULL;
+    }
+
+} /* NvCtrlFreeAttributeQueries() */
+
+
 ReturnStatus NvCtrlStringOperation(CtrlTarget *ctrl_target,
                                    unsigned int display_mask, int attr,
                                    const char *ptrIn, char **ptrOut)
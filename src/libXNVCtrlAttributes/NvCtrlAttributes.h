@@ -710,6 +710,34 @@ ReturnStatus NvCtrlGetBinaryAttribute(const CtrlTarget *ctrl_target,
                                       unsigned int display_mask, int attr,
                                       unsigned char **data, int *len);
 
+/*
+ * NvCtrlQueryAttributes() - performs a list of integer, string and
+ * binary data queries, possibly on different targets.  The NV-CONTROL
+ * requests of all the queries are sent to the X server before any
+ * reply is waited for, so that the whole list costs a single round
+ * trip.  Each query's status, and its result in 'val', 'str' or
+ * 'data'/'len', are set as the corresponding NvCtrlGet*Attribute()
+ * function would have set them.  Results left in 'str' and 'data'
+ * belong to the caller; NvCtrlFreeAttributeQueries() frees them.
+ */
+
+typedef struct {
+    const CtrlTarget *ctrl_target;
+    CtrlAttributeType attr_type; /* INTEGER, STRING or BINARY_DATA */
+    unsigned int display_mask;
+    int attr;
+
+    ReturnStatus status;
+    int64_t val;
+    char *str;
+    unsigned char *data;
+    int len;
+} CtrlAttributeQuery;
+
+void NvCtrlQueryAttributes(CtrlAttributeQuery *queries, int count);
+
+void NvCtrlFreeAttributeQueries(CtrlAttributeQuery *queries, int count);
+
 /*
  * NvCtrlStringOperation() - Performs the string operation associated
  * with the specified attribute, where valid values are the
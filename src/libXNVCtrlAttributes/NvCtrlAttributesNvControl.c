@@ -620,6 +620,135 @@ NvCtrlNvControlGetBinaryAttribute(const NvCtrlAttributePrivateHandle *h,
 }
 
 
+/*
+ * Sends the NV-CONTROL requests of all the given queries in one batch,
+ * and stores the replies in the queries.  All the queries must be on
+ * targets sharing the same display connection, and be of a type and
+ * attribute handled by NV-CONTROL.
+ */
+
+void NvCtrlNvControlQueryAttributes(CtrlAttributeQuery **queries, int count)
+{
+    XNVCTRLBatchQuery *batch;
+    CtrlAttributeQuery **batched;
+    Display *dpy = NULL;
+    Bool ret;
+    int num_batched = 0;
+    int i;
+
+    if (count <= 0) {
+        return;
+    }
+
+    batch = nvalloc(count * sizeof(*batch));
+    batched = nvalloc(count * sizeof(*batched));
+
+    for (i = 0; i < count; i++) {
+        CtrlAttributeQuery *query = queries[i];
+        const NvCtrlAttributePrivateHandle *h =
+            getPrivateHandleConst(query->ctrl_target);
+        const CtrlTargetTypeInfo *targetTypeInfo;
+        XNVCTRLBatchQuery *b;
+
+        targetTypeInfo = NvCtrlGetTargetTypeInfo(h->target_type);
+        if (targetTypeInfo == NULL) {
+            query->status = NvCtrlBadHandle;
+            continue;
+        }
+
+        b = &batch[num_batched];
+
+        switch (query->attr_type) {
+        case CTRL_ATTRIBUTE_TYPE_INTEGER:
+            if (NV_VERSION2(h->nv->major_version, h->nv->minor_version) >
+                NV_VERSION2(1, 20)) {
+                b->type = XNVCTRL_BATCH_QUERY_INTEGER64;
+            } else {
+                b->type = XNVCTRL_BATCH_QUERY_INTEGER;
+            }
+            break;
+        case CTRL_ATTRIBUTE_TYPE_STRING:
+            b->type = XNVCTRL_BATCH_QUERY_STRING;
+            break;
+        case CTRL_ATTRIBUTE_TYPE_BINARY_DATA:
+            /* the X_nvCtrlQueryBinaryData opcode was added in 1.7 */
+            if (NV_VERSION2(h->nv->major_version, h->nv->minor_version) <
+                NV_VERSION2(1, 7)) {
+                query->status = NvCtrlNoAttribute;
+                continue;
+            }
+            b->type = XNVCTRL_BATCH_QUERY_BINARY;
+            break;
+        default:
+            query->status = NvCtrlBadArgument;
+            continue;
+        }
+
+        b->target_type = targetTypeInfo->nvctrl;
+        b->target_id = h->target_id;
+        b->display_mask = query->display_mask;
+        b->attribute = query->attr;
+
+        dpy = h->dpy;
+        batched[num_batched++] = query;
+    }
+
+    ret = (num_batched > 0) &&
+          XNVCTRLQueryTargetBatch(dpy, batch, num_batched);
+
+    for (i = 0; i < num_batched; i++) {
+        CtrlAttributeQuery *query = batched[i];
+        XNVCTRLBatchQuery *b = &batch[i];
+        Bool exists = ret && b->exists;
+
+        switch (query->attr_type) {
+        case CTRL_ATTRIBUTE_TYPE_INTEGER:
+            if (exists) {
+                query->val = b->value;
+                query->status = NvCtrlSuccess;
+            } else {
+                query->status = NvCtrlAttributeNotAvailable;
+            }
+            break;
+
+        case CTRL_ATTRIBUTE_TYPE_STRING:
+            if (exists) {
+                query->str = b->data ?
+                    nvstrndup((const char *) b->data, b->len) : NULL;
+                query->status = NvCtrlSuccess;
+            } else {
+                query->status = NvCtrlAttributeNotAvailable;
+            }
+            break;
+
+        case CTRL_ATTRIBUTE_TYPE_BINARY_DATA:
+            if (exists) {
+                if (b->data) {
+                    query->data = nvalloc(b->len);
+                    memcpy(query->data, b->data, b->len);
+                }
+                query->len = b->len;
+                query->status = NvCtrlSuccess;
+            } else {
+                query->status = NvCtrlError;
+            }
+            break;
+
+        default:
+            break;
+        }
+
+        if (b->data) {
+            XFree(b->data);
+        }
+    }
+
+    nvfree(batched);
+    nvfree(batch);
+
+} /* NvCtrlNvControlQueryAttributes() */
+
+
 ReturnStatus
 NvCtrlNvControlStringOperation(NvCtrlAttributePrivateHandle *h,
                                unsigned int display_mask, int attr,
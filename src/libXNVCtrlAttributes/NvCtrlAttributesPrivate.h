@@ -376,6 +376,8 @@ NvCtrlNvControlGetBinaryAttribute(const NvCtrlAttributePrivateHandle *h,
                                   unsigned int display_mask, int attr,
                                   unsigned char **data, int *len);
 
+void NvCtrlNvControlQueryAttributes(CtrlAttributeQuery **queries, int count);
+
 ReturnStatus
 NvCtrlNvControlStringOperation (NvCtrlAttributePrivateHandle *h,
                                 unsigned int display_mask, int attr,
@@ -22,11 +22,14 @@
 #include "command-line.h"
 #include "config-file.h"
 #include "query-assign.h"
+#include "app-profiles.h"
 #include "msg.h"
 #include "version.h"
 
 #include <dlfcn.h>
 #include <sys/stat.h>
+#include <dirent.h>
+#include <errno.h>
 #include <getopt.h>
 #include <string.h>
 #include <stdlib.h>
@@ -213,6 +216,154 @@ static void *load_ui_library(GtkLibraryData *libdata, Options *op)
 }
 
 
+/*
+ * resolve_app_profile() - print the application profile settings that the
+ * configuration on disk would apply to the process described by process_str,
+ * which is the process name optionally followed by a comma-separated list of
+ * loaded libraries.
+ */
+
+static int resolve_app_profile(const char *process_str)
+{
+    AppProfileConfig *config;
+    AppProfileMatcher *matcher;
+    char **search_path;
+    size_t search_path_size;
+    char *global_config_file;
+    char *procname, *s;
+    const char **dsos = NULL;
+    size_t i, num_dsos = 0;
+    json_t *resolved, *setting;
+    char *value;
+
+    procname = nvstrdup(process_str);
+    for (s = strchr(procname, ','); s; s = strchr(s, ',')) {
+        *s++ = '\0';
+        if (*s != '\0' && *s != ',') {
+            dsos = nvrealloc(dsos, (num_dsos + 1) * sizeof(char *));
+            dsos[num_dsos++] = s;
+        }
+    }
+
+    search_path = nv_app_profile_config_get_default_search_path(&search_path_size);
+    global_config_file = nv_app_profile_config_get_default_global_config_file();
+    config = nv_app_profile_config_load(global_config_file,
+                                        search_path,
+                                        search_path_size);
+    nv_app_profile_config_free_search_path(search_path, search_path_size);
+    free(global_config_file);
+
+    matcher = nv_app_profile_matcher_new(config);
+    resolved = nv_app_profile_matcher_resolve(matcher, procname,
+                                              dsos, num_dsos);
+
+    if (!nv_app_profile_config_get_enabled(config)) {
+        nv_warning_msg("Application profiles are disabled; the following "
+                       "settings will not be applied by the driver.");
+    }
+
+    if (json_array_size(resolved) == 0) {
+        nv_msg(NULL, "No application profile settings apply to '%s'.",
+               procname);
+    } else {
+        nv_msg(NULL, "Application profile settings for '%s':", procname);
+        nv_msg(NULL, "");
+    }
+
+    for (i = 0; i < json_array_size(resolved); i++) {
+        setting = json_array_get(resolved, i);
+        value = json_dumps(json_object_get(setting, "value"), JSON_ENCODE_ANY);
+        nv_msg("  ", "%s = %s (profile '%s', rule %" JSON_INTEGER_FORMAT ")",
+               json_string_value(json_object_get(setting, "key")),
+               value ? value : "?",
+               json_string_value(json_object_get(setting, "profile")),
+               json_integer_value(json_object_get(setting, "rule")));
+        free(value);
+    }
+
+    json_decref(resolved);
+    nv_app_profile_matcher_free(matcher);
+    nv_app_profile_config_free(config);
+    nvfree(dsos);
+    nvfree(procname);
+
+    return 0;
+}
+
+
+/*
+ * validate_app_profile_file() - check one application profile file, and
+ * report the result.
+ */
+
+static int validate_app_profile_file(const char *filename)
+{
+    AppProfileFileSummary summary;
+    char *error_str;
+
+    if (!nv_app_profile_file_validate(filename, &summary, &error_str)) {
+        nv_error_msg("%s", error_str);
+        free(error_str);
+        return FALSE;
+    }
+
+    nv_msg(NULL, "%s: %lu profile%s, %lu rule%s, %lu setting%s.", filename,
+           (unsigned long)summary.num_profiles,
+           summary.num_profiles == 1 ? "" : "s",
+           (unsigned long)summary.num_rules,
+           summary.num_rules == 1 ? "" : "s",
+           (unsigned long)summary.num_settings,
+           summary.num_settings == 1 ? "" : "s");
+
+    return TRUE;
+}
+
+
+/*
+ * validate_app_profile() - check the application profile file at path, or
+ * each regular file in the directory at path. Returns 0 if every file is
+ * valid.
+ */
+
+static int validate_app_profile(const char *path)
+{
+    struct stat stat_buf;
+    struct dirent **namelist;
+    int i, n, ret = 0;
+
+    if (stat(path, &stat_buf) < 0) {
+        nv_error_msg("Unable to access '%s': %s", path, strerror(errno));
+        return 1;
+    }
+
+    if (!S_ISDIR(stat_buf.st_mode)) {
+        return validate_app_profile_file(path) ? 0 : 1;
+    }
+
+    n = scandir(path, &namelist, NULL, alphasort);
+    if (n < 0) {
+        nv_error_msg("Failed to open directory '%s'", path);
+        return 1;
+    }
+
+    for (i = 0; i < n; i++) {
+        char *full_path = nvstrcat(path, "/", namelist[i]->d_name, NULL);
+
+        // Like the configuration loader, ignore all but regular files
+        if (stat(full_path, &stat_buf) == 0 && S_ISREG(stat_buf.st_mode) &&
+            !validate_app_profile_file(full_path)) {
+            ret = 1;
+        }
+
+        free(full_path);
+        free(namelist[i]);
+    }
+
+    free(namelist);
+
+    return ret;
+}
+
 
 /*
  * main() - nvidia-settings application start
@@ -242,6 +393,24 @@ int main(int argc, char **argv)
 
     op = parse_command_line(argc, argv, &systems);
 
+    /*
+     * Resolving and validating application profiles only reads the
+     * configuration files, and does not need the user interface or a
+     * connection to the X server.
+     */
+
+    if (op->resolve_app_profile) {
+        ret = resolve_app_profile(op->resolve_app_profile);
+        free(op);
+        return ret;
+    }
+
+    if (op->validate_app_profile) {
+        ret = validate_app_profile(op->validate_app_profile);
+        free(op);
+        return ret;
+    }
+
     /*
      * Using the default library names, along with a possible path or name
      * specified by the user, attempt to dlopen the appropriate user interface
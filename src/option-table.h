@@ -206,6 +206,27 @@ static const NVGetoptOption __options[] = {
       "appropriately named library. If this is the exact location, the "
       "'use-gtk2' option is ignored.\n" },
 
+    { "resolve-app-profile", RESOLVE_APP_PROFILE_OPTION,
+      NVGETOPT_STRING_ARGUMENT | NVGETOPT_HELP_ALWAYS, "PROCESS",
+      "Print the application profile settings which the current application "
+      "profile configuration would apply to the process &PROCESS&, and exit.  "
+      "&PROCESS& is the name of the process, optionally followed by a "
+      "comma-separated list of the shared libraries loaded by the process; "
+      "for example:\n"
+      "\n"
+      TAB "--resolve-app-profile=glxgears,libGL.so.1\n"
+      "\n"
+      "Leading directory components are ignored.  For each setting, the "
+      "profile and rule which supply it are also printed.\n" },
+
+    { "validate-app-profile", VALIDATE_APP_PROFILE_OPTION,
+      NVGETOPT_STRING_ARGUMENT | NVGETOPT_HELP_ALWAYS, "PATH",
+      "Check that &PATH& is a valid application profile configuration file, "
+      "and exit.  If &PATH& is a directory, each file in the directory is "
+      "checked.  The number of profiles, rules and settings in each valid "
+      "file is printed, along with the first problem found in each invalid "
+      "file.  The exit status is non-zero if any file is invalid.\n" },
+
     { NULL, 0, 0, NULL, NULL},
 };
 
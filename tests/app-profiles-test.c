@@ -0,0 +1,193 @@
+/*
+ * nvidia-settings: A tool for configuring the NVIDIA X driver on Unix
+ * and Linux systems.
+ *
+ * Copyright (C) 2013 NVIDIA Corporation.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses>.
+ */
+
+/*
+ * app-profiles-test.c - checks that nv_app_profile_file_validate() agrees
+ * with nv_app_profile_config_load() about application profile files.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "app-profiles.h"
+
+typedef struct {
+    const char *name;
+    const char *text;
+    int valid;
+    size_t num_profiles;
+    size_t num_rules;
+    size_t num_settings;
+} AppProfileTest;
+
+static const AppProfileTest tests[] = {
+    {
+        // Only the last occurrence of a member counts, as with json_loads()
+        "duplicate keys, last valid",
+        "{\n"
+        "    \"profiles\": 7,\n"
+        "    \"profiles\": [\n"
+        "        { \"name\": 3, \"name\": \"p1\", \"settings\": [ \"a\", 1 ] },\n"
+        "        { \"name\": \"p2\", \"settings\": [ \"x\" ],\n"
+        "          \"settings\": [ { \"key\": \"b\", \"value\": 2 } ] }\n"
+        "    ],\n"
+        "    \"rules\": [\n"
+        "        { \"pattern\": 5,\n"
+        "          \"pattern\": { \"feature\": \"procname\", \"matches\": \"foo\" },\n"
+        "          \"profile\": \"p1\" }\n"
+        "    ]\n"
+        "}\n",
+        1, 2, 1, 2,
+    },
+    {
+        "duplicate keys, last invalid",
+        "{\n"
+        "    \"profiles\": [ { \"name\": \"p1\", \"settings\": [ \"a\", 1 ] } ],\n"
+        "    \"profiles\": 7\n"
+        "}\n",
+        0, 0, 0, 0,
+    },
+};
+
+static size_t count_loaded_profiles(AppProfileConfig *config)
+{
+    AppProfileConfigProfileIter *iter;
+    size_t count = 0;
+
+    for (iter = nv_app_profile_config_profile_iter(config);
+         iter;
+         iter = nv_app_profile_config_profile_iter_next(iter)) {
+        count++;
+    }
+
+    return count;
+}
+
+static size_t count_loaded_rules(AppProfileConfig *config)
+{
+    AppProfileConfigRuleIter *iter;
+    size_t count = 0;
+
+    for (iter = nv_app_profile_config_rule_iter(config);
+         iter;
+         iter = nv_app_profile_config_rule_iter_next(iter)) {
+        count++;
+    }
+
+    return count;
+}
+
+static int run_test(const AppProfileTest *test, const char *filename)
+{
+    AppProfileFileSummary summary;
+    AppProfileConfig *config;
+    char *search_path[1];
+    char *error = NULL;
+    size_t num_profiles, num_rules;
+    int valid;
+    int failed = 0;
+    FILE *fp;
+
+    fp = fopen(filename, "w");
+    if (!fp || (fputs(test->text, fp) < 0) || (fclose(fp) != 0)) {
+        printf("FAIL: %s: could not write %s\n", test->name, filename);
+        return 1;
+    }
+
+    valid = nv_app_profile_file_validate(filename, &summary, &error);
+
+    search_path[0] = (char *)filename;
+    config = nv_app_profile_config_load(NULL, search_path, 1);
+    num_profiles = count_loaded_profiles(config);
+    num_rules = count_loaded_rules(config);
+    nv_app_profile_config_free(config);
+
+    if (valid != test->valid) {
+        printf("FAIL: %s: validator says %s (%s)\n", test->name,
+               valid ? "valid" : "invalid", error ? error : "no error");
+        failed = 1;
+    }
+
+    // A file the validator accepts must load the same way
+    if (valid &&
+        ((summary.num_profiles != num_profiles) ||
+         (summary.num_rules != num_rules))) {
+        printf("FAIL: %s: validator counted %zu profiles and %zu rules, "
+               "loader found %zu and %zu\n", test->name,
+               summary.num_profiles, summary.num_rules,
+               num_profiles, num_rules);
+        failed = 1;
+    }
+
+    if (valid &&
+        ((summary.num_profiles != test->num_profiles) ||
+         (summary.num_rules != test->num_rules) ||
+         (summary.num_settings != test->num_settings))) {
+        printf("FAIL: %s: validator counted %zu profiles, %zu rules and "
+               "%zu settings\n", test->name, summary.num_profiles,
+               summary.num_rules, summary.num_settings);
+        failed = 1;
+    }
+
+    // The loader drops a file that is not valid
+    if (!valid && (num_profiles || num_rules)) {
+        printf("FAIL: %s: loader accepted a file the validator rejected\n",
+               test->name);
+        failed = 1;
+    }
+
+    if (!failed) {
+        printf("PASS: %s\n", test->name);
+    }
+
+    free(error);
+    unlink(filename);
+    return failed;
+}
+
+int main(void)
+{
+    char dirname[] = "/tmp/app-profiles-test.XXXXXX";
+    char *filename;
+    size_t i;
+    int failed = 0;
+
+    if (!mkdtemp(dirname)) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    filename = malloc(strlen(dirname) + sizeof("/rc"));
+    if (!filename) {
+        rmdir(dirname);
+        return 1;
+    }
+    sprintf(filename, "%s/rc", dirname);
+
+    for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        failed |= run_test(&tests[i], filename);
+    }
+
+    free(filename);
+    rmdir(dirname);
+
+    return failed;
+}